@@ -1089,6 +1089,297 @@ client_result_t client_get(client_instance_t *client, const char *key, char *val
     return result;  
 }
 
+/*
+BATCH COMMANDS
+
+MGET and MSET carry many keys in one round trip. Their request may need
+several send() calls and their reply several recv() calls: the reply is
+read until it holds the expected number of lines, one per key for MGET.
+After any failure part of the reply may still be on its way, and the next
+command would take it for its own, so the connection is closed.
+*/
+static client_result_t client_send_batch(client_instance_t *client,
+                                         const char *command,
+                                         size_t command_len,
+                                         char *response_buffer,
+                                         size_t response_size,
+                                         size_t lines,
+                                         size_t *response_len)
+{
+    pthread_mutex_lock(&client->lock);
+
+    if (client->status != CLIENT_STATUS_CONNECTED)
+    {
+        pthread_mutex_unlock(&client->lock);
+        return CLIENT_ERROR_CONNECTION;
+    }
+
+    client_result_t result = CLIENT_SUCCESS;
+    size_t sent = 0;
+    while (sent < command_len)
+    {
+        ssize_t bytes_sent = send(client->sockfd, command + sent, command_len - sent, MSG_NOSIGNAL);
+        if (bytes_sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_sent < 0)
+        {
+            snprintf(client->last_error, sizeof(client->last_error),
+                     "Send failed: %s", strerror(errno));
+            result = CLIENT_ERROR_CONNECTION;
+            goto cleanup;
+        }
+        sent += (size_t)bytes_sent;
+        client->stats.bytes_sent += bytes_sent;
+    }
+
+    size_t received = 0;
+    size_t lines_received = 0;
+    while (lines_received < lines)
+    {
+        if (received == response_size - 1)
+        {
+            snprintf(client->last_error, sizeof(client->last_error),
+                     "Response too large: more than %zu bytes", response_size - 1);
+            result = CLIENT_ERROR_PROTOCOL;
+            goto cleanup;
+        }
+
+        ssize_t bytes_received = recv(client->sockfd, response_buffer + received, response_size - 1 - received, 0);
+        if (bytes_received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_received <= 0)
+        {
+            snprintf(client->last_error, sizeof(client->last_error),
+                     "Receive failed: %s", bytes_received < 0 ? strerror(errno) : "connection closed");
+            result = CLIENT_ERROR_CONNECTION;
+            goto cleanup;
+        }
+
+        for (ssize_t i = 0; i < bytes_received; i++)
+        {
+            lines_received += response_buffer[received + i] == '\n';
+        }
+        received += (size_t)bytes_received;
+        client->stats.bytes_received += bytes_received;
+    }
+
+    response_buffer[received] = '\0';
+    *response_len = received;
+    client->last_activity = time(NULL);
+
+cleanup:
+    if (result != CLIENT_SUCCESS)
+    {
+        close(client->sockfd);
+        client->sockfd = -1;
+        if (client->connect_time > 0)
+        {
+            client->stats.connection_time_seconds += difftime(time(NULL), client->connect_time);
+            client->connect_time = 0;
+        }
+        client->status = CLIENT_STATUS_DISCONNECTED;
+    }
+    pthread_mutex_unlock(&client->lock);
+    return result;
+}
+
+// MSET splits its arguments on spaces and the protocol on line ends
+static bool client_batch_word_valid(const char *word, size_t max_length)
+{
+    size_t length = strlen(word);
+    return length > 0 && length <= max_length && strpbrk(word, " \r\n") == NULL;
+}
+
+static void client_record_operation(client_instance_t *client, client_result_t result)
+{
+    pthread_mutex_lock(&client->lock);
+    client->stats.operations_total++;
+    if (result != CLIENT_SUCCESS)
+    {
+        client->stats.operations_failed++;
+    }
+    pthread_mutex_unlock(&client->lock);
+}
+
+client_result_t client_mset(client_instance_t *client, const char *const *keys, const char *const *values,
+                            size_t count)
+{
+    if (client == NULL || keys == NULL || values == NULL)
+    {
+        return CLIENT_ERROR_CONNECTION;
+    }
+
+    if (count == 0)
+    {
+        return CLIENT_ERROR_INVALID_PARAM;
+    }
+
+    size_t cmd_len = strlen("MSET") + strlen("\r\n");
+    for (size_t i = 0; i < count; i++)
+    {
+        if (keys[i] == NULL || values[i] == NULL ||
+            !client_batch_word_valid(keys[i], get_client_max_key_length()) ||
+            !client_batch_word_valid(values[i], get_client_max_value_length()))
+        {
+            snprintf(client->last_error, sizeof(client->last_error),
+                     "MSET pair %zu: keys and values must be non-empty words within the length limits", i);
+            return CLIENT_ERROR_INVALID_PARAM;
+        }
+        cmd_len += strlen(keys[i]) + strlen(values[i]) + 2;
+    }
+
+    if (cmd_len > get_max_batch_command_length())
+    {
+        snprintf(client->last_error, sizeof(client->last_error),
+                 "Command too long: %zu bytes (max: %zu)", cmd_len, get_max_batch_command_length());
+        return CLIENT_ERROR_PROTOCOL;
+    }
+
+    client_result_t conn_result = client_connect(client);
+    if (conn_result != CLIENT_SUCCESS)
+    {
+        return conn_result;
+    }
+
+    char *command = malloc(cmd_len + 1);
+    if (command == NULL)
+    {
+        return CLIENT_ERROR_MEMORY;
+    }
+
+    char *cursor = command;
+    cursor += sprintf(cursor, "MSET");
+    for (size_t i = 0; i < count; i++)
+    {
+        cursor += sprintf(cursor, " %s %s", keys[i], values[i]);
+    }
+    sprintf(cursor, "\r\n");
+
+    char response[get_client_buffer_size()];
+    size_t response_len;
+    client_result_t result = client_send_batch(client, command, cmd_len, response, sizeof(response), 1,
+                                               &response_len);
+    free(command);
+
+    if (result == CLIENT_SUCCESS && strncmp(response, "OK", 2) != 0)
+    {
+        snprintf(client->last_error, sizeof(client->last_error), "%.*s",
+                 (int)strcspn(response, "\r\n"), response);
+        result = CLIENT_ERROR_SERVER;
+    }
+
+    client_record_operation(client, result);
+    return result;
+}
+
+/*
+Values are copied the way client_get() does, truncated to `buffer_size`.
+A missing key gets an empty string and, when `found` is given, false.
+*/
+client_result_t client_mget(client_instance_t *client, const char *const *keys, size_t count,
+                            char *const *value_buffers, size_t buffer_size, bool *found)
+{
+    if (client == NULL || keys == NULL || value_buffers == NULL || buffer_size == 0)
+    {
+        return CLIENT_ERROR_CONNECTION;
+    }
+
+    if (count == 0)
+    {
+        return CLIENT_ERROR_INVALID_PARAM;
+    }
+
+    size_t cmd_len = strlen("MGET") + strlen("\r\n");
+    for (size_t i = 0; i < count; i++)
+    {
+        if (keys[i] == NULL || !client_batch_word_valid(keys[i], get_client_max_key_length()))
+        {
+            snprintf(client->last_error, sizeof(client->last_error),
+                     "MGET key %zu: keys must be non-empty words within the length limit", i);
+            return CLIENT_ERROR_INVALID_PARAM;
+        }
+        cmd_len += strlen(keys[i]) + 1;
+    }
+
+    if (cmd_len > get_max_batch_command_length())
+    {
+        snprintf(client->last_error, sizeof(client->last_error),
+                 "Command too long: %zu bytes (max: %zu)", cmd_len, get_max_batch_command_length());
+        return CLIENT_ERROR_PROTOCOL;
+    }
+
+    client_result_t conn_result = client_connect(client);
+    if (conn_result != CLIENT_SUCCESS)
+    {
+        return conn_result;
+    }
+
+    char *command = malloc(cmd_len + 1);
+    char *response = malloc(get_max_response_size());
+    if (command == NULL || response == NULL)
+    {
+        free(command);
+        free(response);
+        return CLIENT_ERROR_MEMORY;
+    }
+
+    char *cursor = command;
+    cursor += sprintf(cursor, "MGET");
+    for (size_t i = 0; i < count; i++)
+    {
+        cursor += sprintf(cursor, " %s", keys[i]);
+    }
+    sprintf(cursor, "\r\n");
+
+    size_t response_len = 0;
+    client_result_t result = client_send_batch(client, command, cmd_len, response, get_max_response_size(), count,
+                                               &response_len);
+    free(command);
+
+    // one reply line per key, in request order; lines are found by length, so a value may hold '\r' or NUL
+    const char *line = response;
+    const char *response_end = response + response_len;
+    for (size_t i = 0; result == CLIENT_SUCCESS && i < count; i++)
+    {
+        const char *newline = memchr(line, '\n', (size_t)(response_end - line));
+        if (newline == NULL)
+        {
+            break;
+        }
+
+        size_t line_len = (size_t)(newline - line);
+        line_len -= line_len > 0 && line[line_len - 1] == '\r';
+        bool value = line_len >= 6 && memcmp(line, "VALUE ", 6) == 0;
+        value_buffers[i][0] = '\0';
+
+        if (value)
+        {
+            size_t value_len = line_len - 6 < buffer_size - 1 ? line_len - 6 : buffer_size - 1;
+            memcpy(value_buffers[i], line + 6, value_len);
+            value_buffers[i][value_len] = '\0';
+        }
+        else if (line_len < 9 || memcmp(line, "NOT_FOUND", 9) != 0)
+        {
+            snprintf(client->last_error, sizeof(client->last_error), "%.*s", (int)line_len, line);
+            result = CLIENT_ERROR_SERVER;
+        }
+
+        if (found != NULL)
+        {
+            found[i] = value;
+        }
+        line = newline + 1;
+    }
+    free(response);
+
+    client_record_operation(client, result);
+    return result;
+}
+
 client_result_t client_exists(client_instance_t *client, const char *key)
 {
     if (client == NULL || key == NULL)
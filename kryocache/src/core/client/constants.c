@@ -46,6 +46,7 @@ static const uint32_t TEST_CLIENT_TIMEOUT = 1000;
 // ==================== Response Size Constants ====================
 
 static const size_t MAX_RESPONSE_SIZE = 1048576; // 1MB
+static const size_t MAX_BATCH_COMMAND_LENGTH = 1048576; // 1MB, the server's request line limit
 
 // ==================== Client Configuration Default Implementation ====================
 
@@ -103,4 +104,5 @@ uint32_t get_test_client_timeout(void) { return TEST_CLIENT_TIMEOUT; }
 
 // ==================== Response Size Getters ====================
 
-size_t get_max_response_size(void) { return MAX_RESPONSE_SIZE; }
\ No newline at end of file
+size_t get_max_response_size(void) { return MAX_RESPONSE_SIZE; }
+size_t get_max_batch_command_length(void) { return MAX_BATCH_COMMAND_LENGTH; }
@@ -129,6 +129,31 @@ extern "C"
                                const char *key,
                                char *value_buffer,
                                size_t buffer_size);
+    /**
+     * @brief Set several keys in one round trip
+     *
+     * Keys and values must not contain spaces or line breaks.
+     */
+    client_result_t client_mset(client_instance_t *client,
+                                const char *const *keys,
+                                const char *const *values,
+                                size_t count);
+    /**
+     * @brief Get several keys in one round trip
+     *
+     * Reply lines end at '\n', so a value holding one would be split; the
+     * text protocol cannot store such a value in the first place. On any
+     * failure but an error reply the client is disconnected, as part of
+     * the reply may still be unread.
+     * @param value_buffers `count` buffers of `buffer_size` bytes each
+     * @param found optional, receives whether each key exists
+     */
+    client_result_t client_mget(client_instance_t *client,
+                                const char *const *keys,
+                                size_t count,
+                                char *const *value_buffers,
+                                size_t buffer_size,
+                                bool *found);
     client_result_t client_delete(client_instance_t *client, const char *key);
     client_result_t client_exists(client_instance_t *client, const char *key);
     client_result_t client_flush(client_instance_t *client);
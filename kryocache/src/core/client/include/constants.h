@@ -47,6 +47,10 @@ extern "C"
     uint32_t get_test_client_port(void);    ///< Test server port
     uint32_t get_test_client_timeout(void); ///< Test timeout
 
+    // ==================== Response Size Constants ====================
+    size_t get_max_response_size(void);        ///< Largest reply a batch command reads
+    size_t get_max_batch_command_length(void); ///< Largest MGET or MSET request
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -58,8 +58,37 @@ int main()
             printf("❌ SET failed: %s\n\n", client_get_last_error(client));
         }
 
-        // 5. Показываем статистику
-        printf("5. Client statistics:\n");
+        // 5. Тестируем MSET/MGET
+        printf("5. Testing MSET/MGET commands...\n");
+        const char *keys[] = {"batch_key_1", "batch_key_2", "batch_key_3"};
+        const char *values[] = {"one", "two", "three"};
+        result = client_mset(client, keys, values, 3);
+        if (result == CLIENT_SUCCESS)
+        {
+            printf("✅ MSET command successful\n");
+
+            char value_storage[4][256];
+            char *value_buffers[] = {value_storage[0], value_storage[1], value_storage[2], value_storage[3]};
+            const char *get_keys[] = {"batch_key_1", "batch_key_2", "batch_key_3", "missing_key"};
+            bool found[4];
+            result = client_mget(client, get_keys, 4, value_buffers, sizeof(value_storage[0]), found);
+            if (result == CLIENT_SUCCESS)
+            {
+                printf("✅ MGET command successful: %s %s %s (missing key found: %s)\n\n",
+                       value_storage[0], value_storage[1], value_storage[2], found[3] ? "yes" : "no");
+            }
+            else
+            {
+                printf("❌ MGET failed: %s\n\n", client_get_last_error(client));
+            }
+        }
+        else
+        {
+            printf("❌ MSET failed: %s\n\n", client_get_last_error(client));
+        }
+
+        // 6. Показываем статистику
+        printf("6. Client statistics:\n");
         client_stats_t stats;
         if (client_get_stats(client, &stats))
         {
@@ -70,7 +99,7 @@ int main()
             printf("   🔄 Reconnects: %u\n", stats.reconnect_count);
         }
 
-        // 6. Отключаемся
+        // 7. Отключаемся
         client_disconnect(client);
         printf("\n✅ Disconnected from server\n");
     }
@@ -80,7 +109,7 @@ int main()
         printf("💡 Make sure the server is running on [::1]:6898\n");
     }
 
-    // 7. Очистка
+    // 8. Очистка
     client_destroy(client);
     printf("\n🎉 Test completed successfully!\n");
 
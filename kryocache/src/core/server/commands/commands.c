@@ -1,228 +1,1380 @@
 #include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/commands/include/commands.h"
 #include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/commands/include/constants.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/slab.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/aof.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/snapshot.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <linux/errqueue.h>
 
-unsigned int hash(const char *key);
-bool storage_set(const char *key, const char *value);
-const char *storage_get(const char *key);
+// ==================== Connection Buffers ====================
 
-void handle_client_connection(int client_fd)
+static size_t io_buffer_pending(const io_buffer_t *buffer)
 {
-    // temp
-    char buffer[1024];
-    /*
-    ssize_t
-        Used for a count of bytes or an error indication.  It is a
-        signed integer type capable of storing values at least in
-        the range [-1, SSIZE_MAX].
-    */
-    ssize_t bytes_read;
-    
-    // -1 for /0
-    bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-    
-    if (bytes_read > 0) {
-        buffer[bytes_read] = '\0';
-        printf("Received command: %s", buffer);
-        
-        char *command = buffer;
-        if (bytes_read > 0) {
-            if (command[bytes_read - 1] == '\n') {
-                command[bytes_read - 1] = '\0';
-                bytes_read--;  
-            }
-    
-            if (bytes_read > 0 && command[bytes_read - 1] == '\r') {
-                command[bytes_read - 1] = '\0';
-            }
-        }
-
-        /*
-        #include <sys/socket.h>
-
-        The system calls send(), sendto(), and sendmsg() are used to
-        transmit a message to another socket.
-
-        The send() call may be used only when the socket is in a connected
-        state (so that the intended recipient is known).  The only
-        difference between send() and write(2) is the presence of flags.
-        With a zero flags argument, send() is equivalent to write(2).
-        Also, the following call
-
-        send(sockfd, buf, size, flags);
-
-        is equivalent to
-
-        sendto(sockfd, buf, size, flags, NULL, 0);
-
-        The argument sockfd is the file descriptor of the sending socket.
-
-
-        ssize_t send(size_t size;
-                      int sockfd, const void buf[size], size_t size, int flags);
-        ssize_t sendto(size_t size;
-                      int sockfd, const void buf[size], size_t size, int flags,
-                      const struct sockaddr *dest_addr, socklen_t addrlen);
-        ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags);
-
-        */
-        if (strncmp(command, "PING", 5) == 0) {
-            const char *response = "PONG\r\n";
-            send(client_fd, response, strlen(response), 0);
-            printf("Sent PONG response\n");
-        }
-        else if (strncmp(command, "FLUSH", 5) == 0) {
-            for (int i = 0; i < 1000; i++) {
-                storage_node_db_t *node = g_storage.buckets[i];
-                while (node) {
-                    storage_node_db_t *next = node->next;
-                    free(node);
-                    node = next;
-                }
-                g_storage.buckets[i] = NULL;
-            }
-            g_storage.size = 0;
-            const char *response = "OK\r\n";
-            send(client_fd, response, strlen(response), 0);
-            printf("Sent FLUSH OK response\n");
-        }
-        /*
-        strncmp — compare part of two strings
-
-        #include <string.h>
-
-        The core difference boils down to one of safety: strncmp allows you to limit the comparison, 
-        preventing potential buffer overruns and undefined behavior, while strcmp does not.
-
-        int strcmp(const char *s1, const char *s2);
-        int strncmp(const char *s1, const char *s2, size_t n);
-        */
-        else if (strncmp(command, "SET ", 4) == 0) {
-            char *key = command + 4;
-            char *value = strchr(key, ' ');
-            if (value) {
-                *value = '\0';
-                value++;
-                if (storage_set(key, value)) {
-                    const char *response = "OK\r\n";
-                    send(client_fd, response, strlen(response), 0);
-                    printf("Sent SET OK response for key: %s\n", key);
-                } else {
-                    const char *response = "ERROR Memory full\r\n";
-                    send(client_fd, response, strlen(response), 0);
-                    printf("Sent ERROR for SET\n");
+    return buffer->len - buffer->pos;
+}
+
+/*
+Make room for at least `extra` more bytes after len.
+Consumed bytes at the front are reclaimed first, the buffer only grows
+(by doubling) when compaction is not enough.
+*/
+static bool io_buffer_reserve(io_buffer_t *buffer, size_t extra)
+{
+    if (buffer->pos > 0)
+    {
+        size_t pending = io_buffer_pending(buffer);
+        memmove(buffer->data, buffer->data + buffer->pos, pending);
+        buffer->pos = 0;
+        buffer->len = pending;
+    }
+
+    if (buffer->cap - buffer->len >= extra)
+    {
+        return true;
+    }
+
+    size_t new_cap = buffer->cap ? buffer->cap : get_connection_initial_buffer_size();
+    while (new_cap - buffer->len < extra)
+    {
+        new_cap *= 2;
+    }
+
+    char *data = realloc(buffer->data, new_cap);
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    buffer->data = data;
+    buffer->cap = new_cap;
+    return true;
+}
+
+static bool io_buffer_append(io_buffer_t *buffer, const void *bytes, size_t length)
+{
+    if (!io_buffer_reserve(buffer, length))
+    {
+        return false;
+    }
+
+    memcpy(buffer->data + buffer->len, bytes, length);
+    buffer->len += length;
+    return true;
+}
+
+static void io_buffer_release(io_buffer_t *buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->pos = buffer->len = buffer->cap = 0;
+}
+
+// ==================== Output Queue ====================
+
+static bool output_queue_push(output_queue_t *queue, storage_value_t *value, size_t offset, size_t length)
+{
+    if (queue->count == queue->cap)
+    {
+        if (queue->head > 0)
+        {
+            memmove(queue->segments, queue->segments + queue->head,
+                    (queue->count - queue->head) * sizeof(output_segment_t));
+            queue->count -= queue->head;
+            queue->head = 0;
+        }
+
+        if (queue->count == queue->cap)
+        {
+            size_t new_cap = queue->cap ? queue->cap * 2 : get_connection_initial_segment_count();
+            output_segment_t *segments = realloc(queue->segments, new_cap * sizeof(output_segment_t));
+            if (segments == NULL)
+            {
+                return false;
+            }
+            queue->segments = segments;
+            queue->cap = new_cap;
+        }
+    }
+
+    queue->segments[queue->count++] = (output_segment_t){
+        .value = value,
+        .offset = offset,
+        .length = length,
+    };
+    queue->pending += length;
+    return true;
+}
+
+/*
+Inline bytes before the first pending inline segment are already sent.
+They are reclaimed only when the buffer would otherwise have to grow,
+rebasing the offsets of the pending inline segments.
+*/
+static void output_queue_compact(output_queue_t *queue)
+{
+    size_t sent = queue->bytes.len;
+    for (size_t i = queue->head; i < queue->count; i++)
+    {
+        if (queue->segments[i].value == NULL)
+        {
+            sent = queue->segments[i].offset;
+            break;
+        }
+    }
+
+    if (sent == 0)
+    {
+        return;
+    }
+
+    memmove(queue->bytes.data, queue->bytes.data + sent, queue->bytes.len - sent);
+    queue->bytes.len -= sent;
+    for (size_t i = queue->head; i < queue->count; i++)
+    {
+        if (queue->segments[i].value == NULL)
+        {
+            queue->segments[i].offset -= sent;
+        }
+    }
+}
+
+static bool output_queue_append(output_queue_t *queue, const void *bytes, size_t length)
+{
+    io_buffer_t *buffer = &queue->bytes;
+
+    if (buffer->cap - buffer->len < length)
+    {
+        output_queue_compact(queue);
+        if (!io_buffer_reserve(buffer, length))
+        {
+            return false;
+        }
+    }
+
+    // extend the tail segment when it is inline and ends where this write starts
+    if (queue->count > queue->head)
+    {
+        output_segment_t *tail = &queue->segments[queue->count - 1];
+        if (tail->value == NULL && tail->offset + tail->length == buffer->len)
+        {
+            memcpy(buffer->data + buffer->len, bytes, length);
+            buffer->len += length;
+            tail->length += length;
+            queue->pending += length;
+            return true;
+        }
+    }
+
+    if (!output_queue_push(queue, NULL, buffer->len, length))
+    {
+        return false;
+    }
+    memcpy(buffer->data + buffer->len, bytes, length);
+    buffer->len += length;
+    return true;
+}
+
+/*
+Queue a stored value by reference. The queue takes over the caller's
+reference and drops it once the last byte of the value has been sent.
+*/
+static bool output_queue_append_value(output_queue_t *queue, storage_value_t *value)
+{
+    if (value->length < get_connection_inline_value_limit())
+    {
+        // below one cache line or so the extra iovec costs more than the copy
+        bool queued = output_queue_append(queue, value->data, value->length);
+        storage_value_release(value);
+        return queued;
+    }
+
+    if (!output_queue_push(queue, value, 0, value->length))
+    {
+        storage_value_release(value);
+        return false;
+    }
+    return true;
+}
+
+size_t output_queue_fill_iovec(const output_queue_t *queue, struct iovec *iov, size_t max_iov)
+{
+    size_t filled = 0;
+
+    for (size_t i = queue->head; i < queue->count && filled < max_iov; i++)
+    {
+        const output_segment_t *segment = &queue->segments[i];
+        const char *base = segment->value ? segment->value->data : queue->bytes.data;
+        iov[filled].iov_base = (void *)(base + segment->offset);
+        iov[filled].iov_len = segment->length;
+        filled++;
+    }
+
+    return filled;
+}
+
+void output_queue_consume(output_queue_t *queue, size_t bytes)
+{
+    queue->pending -= bytes;
+
+    while (bytes > 0 && queue->head < queue->count)
+    {
+        output_segment_t *segment = &queue->segments[queue->head];
+        if (bytes < segment->length)
+        {
+            segment->offset += bytes;
+            segment->length -= bytes;
+            return;
+        }
+
+        bytes -= segment->length;
+        storage_value_release(segment->value);
+        queue->head++;
+    }
+
+    if (queue->head == queue->count)
+    {
+        queue->head = queue->count = 0;
+        queue->bytes.pos = queue->bytes.len = 0;
+    }
+}
+
+/*
+Drop the bytes queued after the first `pending` ones, newest first. Only
+replies not handed to the socket yet may be dropped.
+*/
+static void output_queue_truncate(output_queue_t *queue, size_t pending)
+{
+    while (queue->pending > pending && queue->count > queue->head)
+    {
+        output_segment_t *tail = &queue->segments[queue->count - 1];
+        size_t excess = queue->pending - pending;
+        if (excess < tail->length)
+        {
+            // replies appended to the same inline segment share it
+            tail->length -= excess;
+            queue->bytes.len = tail->value == NULL ? tail->offset + tail->length : queue->bytes.len;
+            queue->pending = pending;
+            return;
+        }
+
+        queue->pending -= tail->length;
+        queue->bytes.len = tail->value == NULL ? tail->offset : queue->bytes.len;
+        storage_value_release(tail->value);
+        queue->count--;
+    }
+
+    if (queue->head == queue->count)
+    {
+        queue->head = queue->count = 0;
+        queue->bytes.pos = queue->bytes.len = 0;
+    }
+}
+
+void output_queue_release(output_queue_t *queue)
+{
+    for (size_t i = queue->head; i < queue->count; i++)
+    {
+        storage_value_release(queue->segments[i].value);
+    }
+
+    free(queue->segments);
+    queue->segments = NULL;
+    queue->head = queue->count = queue->cap = 0;
+    queue->pending = 0;
+    io_buffer_release(&queue->bytes);
+}
+
+static void connection_reply(connection_state_t *conn, const char *response)
+{
+    if (!output_queue_append(&conn->output, response, strlen(response)))
+    {
+        // a reply that cannot be queued desynchronizes the pipeline
+        conn->closing = true;
+    }
+}
+
+bool connection_has_pending_output(const connection_state_t *conn)
+{
+    return conn->output.pending > 0;
+}
+
+static void connection_release_zerocopy(connection_state_t *conn)
+{
+    for (size_t i = 0; i < conn->zerocopy_count; i++)
+    {
+        storage_value_release(conn->zerocopy_pending[i].value);
+    }
+
+    free(conn->zerocopy_pending);
+    conn->zerocopy_pending = NULL;
+    conn->zerocopy_count = conn->zerocopy_cap = 0;
+    conn->zerocopy_next_sequence = 0;
+}
+
+void connection_state_release(connection_state_t *conn)
+{
+    io_buffer_release(&conn->input);
+    output_queue_release(&conn->output);
+    connection_release_zerocopy(conn);
+    conn->peer_closed = false;
+    conn->closing = false;
+    conn->zerocopy = false;
+}
+
+// ==================== Command Execution ====================
+
+// unsigned decimal number: digits only, false when empty or over 64 bits
+static bool commands_parse_unsigned(const char *digits, const char *end, uint64_t *number)
+{
+    uint64_t parsed = 0;
+    if (digits == end)
+    {
+        return false;
+    }
+
+    for (const char *p = digits; p < end; p++)
+    {
+        if (*p < '0' || *p > '9' || parsed > (UINT64_MAX - 9) / 10)
+        {
+            return false;
+        }
+        parsed = parsed * 10 + (uint64_t)(*p - '0');
+    }
+
+    *number = parsed;
+    return true;
+}
+
+/*
+Seconds argument of EX and EXPIRE: decimal digits only, returned in ms.
+*/
+static bool commands_parse_seconds(const char *digits, const char *end, uint64_t *ttl_ms)
+{
+    uint64_t seconds;
+    if (!commands_parse_unsigned(digits, end, &seconds) || seconds > UINT64_MAX / 1000)
+    {
+        return false;
+    }
+
+    *ttl_ms = seconds * 1000;
+    return true;
+}
+
+/*
+SET key value EX seconds. Values may contain spaces, so the option is only
+recognised at the very end of the line. Returns whether it is present and
+cuts it off the value; an unusable number leaves *ttl_ms at 0.
+*/
+static bool commands_split_expiry(const char *value, const char **end, uint64_t *ttl_ms)
+{
+    const char *digits = *end;
+    while (digits > value && digits[-1] >= '0' && digits[-1] <= '9')
+    {
+        digits--;
+    }
+
+    if (digits == *end || digits - value < 5 || memcmp(digits - 4, " EX ", 4) != 0)
+    {
+        return false;
+    }
+
+    if (!commands_parse_seconds(digits, *end, ttl_ms))
+    {
+        *ttl_ms = 0;
+    }
+    *end = digits - 4;
+    return true;
+}
+
+/*
+Glob-style MATCH patterns: `*` matches any run of bytes, `?` any one byte,
+`[abc]`, `[a-z]` and `[^...]` a set of bytes, and a backslash makes the
+next byte literal. A `[` without its `]` is literal too.
+*/
+static const char *commands_glob_set(const char *p, const char *end, unsigned char c, bool *matched)
+{
+    bool negate = p < end && *p == '^';
+    bool found = false;
+    p += negate;
+
+    for (; p < end && *p != ']'; p++)
+    {
+        if (*p == '\\' && p + 1 < end)
+        {
+            p++;
+        }
+        unsigned char low = (unsigned char)*p;
+
+        if (p + 2 < end && p[1] == '-' && p[2] != ']')
+        {
+            p += 2;
+            if (*p == '\\' && p + 1 < end)
+            {
+                p++;
+            }
+            unsigned char high = (unsigned char)*p;
+            found = found || (low <= c && c <= high) || (high <= c && c <= low);
+        }
+        else
+        {
+            found = found || c == low;
+        }
+    }
+
+    if (p == end)
+    {
+        return NULL;
+    }
+    *matched = found != negate;
+    return p + 1;
+}
+
+// a mismatch after `*` retries with the star swallowing one more byte
+static bool commands_glob_match(const char *p, const char *p_end, const char *s, const char *s_end)
+{
+    const char *star = NULL;
+    const char *star_s = NULL;
+
+    while (s < s_end)
+    {
+        if (p < p_end && *p == '*')
+        {
+            star = ++p;
+            star_s = s;
+            continue;
+        }
+
+        if (p < p_end)
+        {
+            bool matched = false;
+            const char *next = NULL;
+            if (*p == '?')
+            {
+                matched = true;
+                next = p + 1;
+            }
+            else if (*p == '[')
+            {
+                next = commands_glob_set(p + 1, p_end, (unsigned char)*s, &matched);
+            }
+
+            if (next == NULL)
+            {
+                if (*p == '\\' && p + 1 < p_end)
+                {
+                    p++;
                 }
-            } else {
-                const char *response = "ERROR Invalid SET format\r\n";
-                send(client_fd, response, strlen(response), 0);
-                printf("Sent ERROR for invalid SET\n");
-            }
-        }
-        else if (strncmp(command, "GET ", 4) == 0) {
-            char *key = command + 4;
-            const char *value = storage_get(key);
-            if (value) {
-                char response[512];
-                snprintf(response, sizeof(response), "VALUE %s\r\n", value);
-                send(client_fd, response, strlen(response), 0);
-                printf("Sent GET response for key: %s -> %s\n", key, value);
-            } else {
-                const char *response = "NOT_FOUND\r\n";
-                send(client_fd, response, strlen(response), 0);
-                printf("Sent NOT_FOUND for key: %s\n", key);
-            }
-        }
-        else if (strncmp(command, "DELETE ", 7) == 0) {
-            char *key = command + 7;
-            const char *response = "OK\r\n";
-            send(client_fd, response, strlen(response), 0);
-            printf("Sent DELETE OK response\n");
-        }
-        else if (strncmp(command, "EXISTS ", 7) == 0) {
-            char *key = command + 7;
-            const char *value = storage_get(key);
-            if (value) {
-                const char *response = "1\r\n"; // 1 = exists
-                send(client_fd, response, strlen(response), 0);
-                printf("Sent EXISTS 1 for key: %s\n", key);
-            } else {
-                const char *response = "0\r\n"; // 0 = not exists
-                send(client_fd, response, strlen(response), 0);
-                printf("Sent EXISTS 0 for key: %s\n", key);
-            }
-        }
-        else if (strncmp(command, "STATS", 6) == 0) {
-            char response[128];
-            snprintf(response, sizeof(response), "KEYS: %zu\r\n", g_storage.size);
-            send(client_fd, response, strlen(response), 0);
-            printf("Sent STATS response: %s", response);
-        }
-        else {
-            const char *response = "ERROR Unknown command\r\n";
-            send(client_fd, response, strlen(response), 0);
-            printf("Sent ERROR response for unknown command\n");
-        }
-    } else {
-        printf("Client disconnected or error reading command\n");
-    }
-    
-    close(client_fd);
+                matched = *p == *s;
+                next = p + 1;
+            }
+
+            if (matched)
+            {
+                p = next;
+                s++;
+                continue;
+            }
+        }
+
+        if (star == NULL)
+        {
+            return false;
+        }
+        p = star;
+        s = ++star_s;
+    }
+
+    while (p < p_end && *p == '*')
+    {
+        p++;
+    }
+    return p == p_end;
 }
 
-bool storage_set(const char *key, const char *value) {
-    unsigned int index = hash(key); 
-    /*
-    In computer science, "buckets" are containers for holding related data.
-    */
-    storage_node_db_t *node = g_storage.buckets[index]; // until 64
+typedef struct commands_scan
+{
+    connection_state_t *conn;
+    const char *pattern; /**< MATCH pattern, NULL for every key */
+    const char *pattern_end;
+} commands_scan_t;
+
+static void commands_scan_key(const char *key, size_t key_length, void *arg)
+{
+    commands_scan_t *scan = arg;
+    if (scan->pattern != NULL && !commands_glob_match(scan->pattern, scan->pattern_end, key, key + key_length))
+    {
+        return;
+    }
+
+    connection_reply(scan->conn, "KEY ");
+    if (!output_queue_append(&scan->conn->output, key, key_length))
+    {
+        scan->conn->closing = true;
+    }
+    connection_reply(scan->conn, "\r\n");
+}
+
+/*
+SCAN cursor [MATCH pattern] [COUNT n]. Replies with a KEY line per key and
+ends with the CURSOR line to pass to the next call, 0 once the walk is
+done. COUNT bounds the work, MATCH only filters what that work found.
+*/
+static void commands_scan(connection_state_t *conn, char *args, char *end)
+{
+    char *token_end = memchr(args, ' ', (size_t)(end - args));
+    token_end = token_end ? token_end : end;
+
+    uint64_t cursor;
+    if (!commands_parse_unsigned(args, token_end, &cursor))
+    {
+        connection_reply(conn, "ERROR Invalid cursor\r\n");
+        return;
+    }
+
+    commands_scan_t scan = {.conn = conn};
+    uint64_t count = get_scan_default_count();
+    for (char *option = token_end; option < end;)
+    {
+        option++;
+        char *option_end = memchr(option, ' ', (size_t)(end - option));
+        if (option_end == NULL)
+        {
+            connection_reply(conn, "ERROR Invalid SCAN format\r\n");
+            return;
+        }
+
+        char *value = option_end + 1;
+        char *value_end = memchr(value, ' ', (size_t)(end - value));
+        value_end = value_end ? value_end : end;
+
+        if (option_end - option == 5 && memcmp(option, "MATCH", 5) == 0 && value < value_end)
+        {
+            scan.pattern = value;
+            scan.pattern_end = value_end;
+        }
+        else if (option_end - option == 5 && memcmp(option, "COUNT", 5) == 0 &&
+                 commands_parse_unsigned(value, value_end, &count) && count > 0)
+        {
+            count = count < get_scan_max_count() ? count : get_scan_max_count();
+        }
+        else
+        {
+            connection_reply(conn, "ERROR Invalid SCAN format\r\n");
+            return;
+        }
+        option = value_end;
+    }
+
+    cursor = storage_scan(conn->context->storage, cursor, (size_t)count, commands_scan_key, &scan);
+
+    char response[48];
+    snprintf(response, sizeof(response), "CURSOR %llu\r\n", (unsigned long long)cursor);
+    connection_reply(conn, response);
+}
+
+/*
+MGET key [key ...]: one GET reply per key, in order. Keys go to the storage
+a batch at a time so that the lookups of a batch overlap their misses.
+*/
+static void commands_mget(connection_state_t *conn, char *args, char *end)
+{
+    size_t batch_size = get_multi_key_batch_size();
+    const char *keys[batch_size];
+    size_t key_lengths[batch_size];
+    storage_value_t *values[batch_size];
+    size_t total = 0;
+
+    for (char *key = args; key < end;)
+    {
+        size_t count = 0;
+        while (key < end && count < batch_size)
+        {
+            char *key_end = memchr(key, ' ', (size_t)(end - key));
+            key_end = key_end ? key_end : end;
+            if (key_end > key)
+            {
+                keys[count] = key;
+                key_lengths[count] = (size_t)(key_end - key);
+                count++;
+            }
+            key = key_end + 1;
+        }
+
+        storage_get_many(conn->context->storage, keys, key_lengths, count, values);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (values[i] == NULL)
+            {
+                connection_reply(conn, "NOT_FOUND\r\n");
+                continue;
+            }
+
+            connection_reply(conn, "VALUE ");
+            if (!output_queue_append_value(&conn->output, values[i]))
+            {
+                conn->closing = true;
+            }
+            connection_reply(conn, "\r\n");
+        }
+        total += count;
+    }
+
+    if (total == 0)
+    {
+        connection_reply(conn, "ERROR Invalid MGET format\r\n");
+    }
+}
+
+/*
+A new key TinyLFU turns away is not an error: the memory goes to keys
+asked for more often, and the client may simply not cache this one.
+*/
+static const char *commands_set_reply(storage_set_status_t status)
+{
+    switch (status)
+    {
+    case STORAGE_SET_OK:
+        return "OK\r\n";
+    case STORAGE_SET_NOT_ADMITTED:
+        return "NOT_STORED\r\n";
+    default:
+        return "ERROR Memory full\r\n";
+    }
+}
+
+/*
+MSET key value [key value ...]. Unlike SET, values end at the next space.
+The whole line is checked before the first key is stored, but the writes
+are independent: a concurrent reader may see some of them before others.
+*/
+static void commands_mset(connection_state_t *conn, char *args, char *end)
+{
+    size_t words = 0;
+    bool empty_word = false;
+    for (char *word = args; word < end && !empty_word; words++)
+    {
+        char *word_end = memchr(word, ' ', (size_t)(end - word));
+        word_end = word_end ? word_end : end;
+        empty_word = word_end == word;
+        word = word_end + 1;
+    }
+
+    if (words == 0 || words % 2 != 0 || empty_word)
+    {
+        connection_reply(conn, "ERROR Invalid MSET format\r\n");
+        return;
+    }
+
+    // the reply is that of the worst outcome: running out of memory, then a key not admitted
+    storage_set_status_t status = STORAGE_SET_OK;
+    for (char *key = args; key < end;)
+    {
+        char *key_end = memchr(key, ' ', (size_t)(end - key));
+        char *value = key_end + 1;
+        char *value_end = memchr(value, ' ', (size_t)(end - value));
+        value_end = value_end ? value_end : end;
+
+        storage_value_t *stored_value = storage_value_create(value, (size_t)(value_end - value));
+        storage_set_status_t stored = stored_value == NULL
+                                          ? STORAGE_SET_NO_MEMORY
+                                          : storage_set_expiring(conn->context->storage, key,
+                                                                 (size_t)(key_end - key), stored_value, 0);
+        status = stored > status ? stored : status;
+        key = value_end + 1;
+    }
 
-    // temp
-    extern storage_db_t g_storage;
+    connection_reply(conn, commands_set_reply(status));
+}
 
-    while (node) {
-        if (strcmp(node->key, key) == 0) {
-            strncpy(node->value, value, sizeof(node->value) - 1);
-            node->value[sizeof(node->value) - 1] = '\0';
+/*
+Delta of INCRBY/DECRBY: an optional '-' and decimal digits that fit in a
+signed 64-bit number.
+*/
+static bool commands_parse_signed(const char *digits, const char *end, int64_t *number)
+{
+    bool negative = digits < end && *digits == '-';
+    uint64_t magnitude;
+    if (!commands_parse_unsigned(digits + negative, end, &magnitude) ||
+        magnitude > (uint64_t)INT64_MAX + negative)
+    {
+        return false;
+    }
+
+    *number = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return true;
+}
+
+/*
+INCR/DECR key and INCRBY/DECRBY key delta; `name` is the command for error
+messages. As with EXPIRE, the delta is the last word and the key everything
+before it. Replies with the new value.
+*/
+static void commands_incr(connection_state_t *conn, const char *name, char *key, char *end, bool by, bool negate)
+{
+    char response[64];
+    char *key_end = end;
+    int64_t delta = 1;
+
+    if (by)
+    {
+        char *digits = end;
+        while (digits > key && digits[-1] != ' ')
+        {
+            digits--;
+        }
+
+        key_end = digits - 1;
+        if (digits - key < 2 || !commands_parse_signed(digits, end, &delta) || (negate && delta == INT64_MIN))
+        {
+            snprintf(response, sizeof(response), "ERROR Invalid %s format\r\n", name);
+            connection_reply(conn, response);
+            return;
+        }
+    }
+
+    int64_t result;
+    switch (storage_incr(conn->context->storage, key, (size_t)(key_end - key), negate ? -delta : delta, &result))
+    {
+    case STORAGE_INCR_OK:
+        snprintf(response, sizeof(response), "%lld\r\n", (long long)result);
+        connection_reply(conn, response);
+        break;
+    case STORAGE_INCR_NOT_INTEGER:
+        connection_reply(conn, "ERROR Value is not an integer\r\n");
+        break;
+    case STORAGE_INCR_OVERFLOW:
+        connection_reply(conn, "ERROR Increment would overflow\r\n");
+        break;
+    default:
+        connection_reply(conn, "ERROR Memory full\r\n");
+        break;
+    }
+}
+
+static bool commands_mutating(const char *command)
+{
+    static const char *const prefixes[] = {
+        "FLUSH", "SET ", "MSET ", "DELETE ", "EXPIRE ", "PERSIST ", "INCR ", "DECR ", "INCRBY ", "DECRBY ",
+    };
+
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++)
+    {
+        if (strncmp(command, prefixes[i], strlen(prefixes[i])) == 0)
+        {
             return true;
         }
-        node = node->next;
     }
+    return false;
+}
 
-    storage_node_db_t *new_node = calloc(sizeof(storage_node_db_t));
-    if (!new_node) return false;
+/*
+Execute one command line (already stripped of its line terminator and
+NUL-terminated) and queue the response into conn->output. Keys and values
+are taken by length, not by strlen(), so they may contain NUL bytes.
+*/
+static void commands_execute(connection_state_t *conn, char *command, size_t length)
+{
+    char *end = command + length;
     /*
-    The strdup() function returns a pointer to a new string which is a
-       duplicate of the string s.  Memory for the new string is obtained
-       with malloc(3), and can be freed with free(3).
+    #include <sys/socket.h>
+
+    The system calls send(), sendto(), and sendmsg() are used to
+    transmit a message to another socket.
+
+    Responses are no longer sent one by one: they are appended to the
+    connection output buffer and flushed together once every pipelined
+    command of the current read has been executed.
     */
-    strncpy(new_node->key, key, sizeof(new_node->key) - 1);
-    new_node->key[sizeof(new_node->key) - 1] = '\0';
-    
-    strncpy(new_node->value, value, sizeof(new_node->value) - 1);
-    new_node->value[sizeof(new_node->value) - 1] = '\0';
-    
-    new_node->next = g_storage.buckets[index];
-    g_storage.buckets[index] = new_node;
-    g_storage.size++;
+    storage_t *storage = conn->context->storage;
+
+    // a change the log cannot take would be acknowledged and then lost on restart
+    if (conn->context->aof != NULL && commands_mutating(command) && !aof_healthy(conn->context->aof)) {
+        connection_reply(conn, "ERROR Persistence failed\r\n");
+        return;
+    }
+
+    if (strncmp(command, "PING", 5) == 0) {
+        connection_reply(conn, "PONG\r\n");
+    }
+    else if (strncmp(command, "FLUSH", 5) == 0) {
+        // replies still queued on other connections keep their own value reference
+        storage_flush(storage);
+        connection_reply(conn, "OK\r\n");
+    }
+    /*
+    strncmp — compare part of two strings
+
+    #include <string.h>
+
+    The core difference boils down to one of safety: strncmp allows you to limit the comparison, 
+    preventing potential buffer overruns and undefined behavior, while strcmp does not.
+
+    int strcmp(const char *s1, const char *s2);
+    int strncmp(const char *s1, const char *s2, size_t n);
+    */
+    else if (strncmp(command, "SET ", 4) == 0) {
+        char *key = command + 4;
+        char *value = memchr(key, ' ', (size_t)(end - key));
+        if (value) {
+            size_t key_length = (size_t)(value - key);
+            value++;
+            const char *value_end = end;
+            uint64_t ttl_ms = 0;
+            if (commands_split_expiry(value, &value_end, &ttl_ms) && ttl_ms == 0) {
+                connection_reply(conn, "ERROR Invalid expire time\r\n");
+                return;
+            }
+
+            storage_value_t *stored = storage_value_create(value, (size_t)(value_end - value));
+            storage_set_status_t status = stored ? storage_set_expiring(storage, key, key_length, stored, ttl_ms)
+                                                 : STORAGE_SET_NO_MEMORY;
+            connection_reply(conn, commands_set_reply(status));
+        } else {
+            connection_reply(conn, "ERROR Invalid SET format\r\n");
+        }
+    }
+    else if (strncmp(command, "GET ", 4) == 0) {
+        char *key = command + 4;
+        storage_value_t *value = storage_get(storage, key, (size_t)(end - key));
+        if (value) {
+            /*
+            The value is not copied into the reply: the output queue keeps a
+            reference and sendmsg() gathers it straight from storage.
+            */
+            connection_reply(conn, "VALUE ");
+            if (!output_queue_append_value(&conn->output, value)) {
+                conn->closing = true;
+            }
+            connection_reply(conn, "\r\n");
+        } else {
+            connection_reply(conn, "NOT_FOUND\r\n");
+        }
+    }
+    else if (strncmp(command, "DELETE ", 7) == 0) {
+        char *key = command + 7;
+        if (storage_delete(storage, key, (size_t)(end - key))) {
+            connection_reply(conn, "OK\r\n");
+        } else {
+            connection_reply(conn, "NOT_FOUND\r\n");
+        }
+    }
+    else if (strncmp(command, "EXISTS ", 7) == 0) {
+        char *key = command + 7;
+        if (storage_exists(storage, key, (size_t)(end - key))) {
+            connection_reply(conn, "1\r\n"); // 1 = exists
+        } else {
+            connection_reply(conn, "0\r\n"); // 0 = not exists
+        }
+    }
+    else if (strncmp(command, "EXPIRE ", 7) == 0) {
+        char *key = command + 7;
+        char *seconds = end;
+        while (seconds > key && seconds[-1] != ' ') {
+            seconds--;
+        }
+
+        uint64_t ttl_ms;
+        if (seconds - key < 2 || !commands_parse_seconds(seconds, end, &ttl_ms)) {
+            connection_reply(conn, "ERROR Invalid EXPIRE format\r\n");
+        } else if (storage_expire(storage, key, (size_t)(seconds - 1 - key), ttl_ms)) {
+            connection_reply(conn, "1\r\n"); // 1 = TTL set
+        } else {
+            connection_reply(conn, "0\r\n"); // 0 = no such key
+        }
+    }
+    else if (strncmp(command, "PERSIST ", 8) == 0) {
+        char *key = command + 8;
+        if (storage_persist(storage, key, (size_t)(end - key))) {
+            connection_reply(conn, "1\r\n"); // 1 = TTL removed
+        } else {
+            connection_reply(conn, "0\r\n"); // 0 = no such key or no TTL
+        }
+    }
+    else if (strncmp(command, "TTL ", 4) == 0) {
+        char *key = command + 4;
+        int64_t ttl = storage_ttl(storage, key, (size_t)(end - key));
+        char response[32];
+        // -1 = no TTL, -2 = no such key, otherwise seconds rounded to the nearest
+        snprintf(response, sizeof(response), "%lld\r\n", (long long)(ttl < 0 ? ttl : (ttl + 500) / 1000));
+        connection_reply(conn, response);
+    }
+    else if (strncmp(command, "INCR ", 5) == 0) {
+        commands_incr(conn, "INCR", command + 5, end, false, false);
+    }
+    else if (strncmp(command, "DECR ", 5) == 0) {
+        commands_incr(conn, "DECR", command + 5, end, false, true);
+    }
+    else if (strncmp(command, "INCRBY ", 7) == 0) {
+        commands_incr(conn, "INCRBY", command + 7, end, true, false);
+    }
+    else if (strncmp(command, "DECRBY ", 7) == 0) {
+        commands_incr(conn, "DECRBY", command + 7, end, true, true);
+    }
+    else if (strncmp(command, "MGET ", 5) == 0) {
+        commands_mget(conn, command + 5, end);
+    }
+    else if (strncmp(command, "MSET ", 5) == 0) {
+        commands_mset(conn, command + 5, end);
+    }
+    else if (strncmp(command, "SCAN ", 5) == 0) {
+        commands_scan(conn, command + 5, end);
+    }
+    else if (strncmp(command, "STATS", 6) == 0) {
+        char response[128];
+        snprintf(response, sizeof(response), "KEYS: %zu\r\n", storage_size(storage));
+        connection_reply(conn, response);
+    }
+    else if (strncmp(command, "SLABS", 6) == 0) {
+        // one line per size class that owns pages, then END
+        slab_class_stats_t stats[SLAB_MAX_CLASSES];
+        size_t classes = slab_stats(stats, SLAB_MAX_CLASSES);
+        char response[128];
+
+        for (size_t i = 0; i < classes; i++) {
+            if (stats[i].pages == 0) {
+                continue;
+            }
+            snprintf(response, sizeof(response), "SLAB %zu pages=%zu used=%zu free=%zu\r\n",
+                     stats[i].chunk_size, stats[i].pages, stats[i].chunks_used, stats[i].chunks_free);
+            connection_reply(conn, response);
+        }
+        connection_reply(conn, "END\r\n");
+    }
+    else if (strncmp(command, "SAVE", 5) == 0) {
+        // only this event loop waits for the child, the others keep serving
+        if (conn->context->snapshot == NULL) {
+            connection_reply(conn, "ERROR Persistence disabled\r\n");
+        } else {
+            connection_reply(conn, snapshot_save(conn->context->snapshot) ? "OK\r\n" : "ERROR Snapshot failed\r\n");
+        }
+    }
+    else if (strncmp(command, "BGSAVE", 7) == 0) {
+        if (conn->context->snapshot == NULL) {
+            connection_reply(conn, "ERROR Persistence disabled\r\n");
+        } else if (snapshot_start(conn->context->snapshot)) {
+            connection_reply(conn, "OK\r\n");
+        } else {
+            connection_reply(conn, "ERROR Snapshot already running or fork failed\r\n");
+        }
+    }
+    else if (strncmp(command, "SNAPSHOTS", 10) == 0) {
+        snapshot_stats_t stats = {0};
+        if (conn->context->snapshot != NULL) {
+            snapshot_get_stats(conn->context->snapshot, &stats);
+        }
+
+        char response[384];
+        snprintf(response, sizeof(response),
+                 "SNAPSHOTS saves=%" PRIu64 " deltas=%" PRIu64 " failures=%" PRIu64 " in_progress=%d fork_us=%" PRIu64
+                 " max_fork_us=%" PRIu64 " cow_bytes=%" PRIu64 " duration_ms=%" PRIu64 " bytes=%" PRIu64
+                 " last_save=%" PRIu64 "\r\n",
+                 stats.saves, stats.deltas, stats.failures, stats.in_progress ? 1 : 0, stats.last_fork_us,
+                 stats.max_fork_us, stats.last_cow_bytes, stats.last_duration_ms, stats.last_bytes,
+                 stats.last_save_time);
+        connection_reply(conn, response);
+    }
+    else {
+        connection_reply(conn, "ERROR Unknown command\r\n");
+    }
+}
+
+/*
+Pipelining: execute every complete line currently buffered. A trailing
+partial line stays in the input buffer until the rest of it arrives.
+Lines end with "\r\n"; a bare "\n" is accepted as well.
+
+When the log fails while the batch is being made durable, every reply
+from the first change on is replaced by an error: the changes stay in
+memory, but the client must not count on them surviving a restart.
+*/
+static void commands_process_input(connection_state_t *conn)
+{
+    io_buffer_t *input = &conn->input;
+    size_t replied = 0;
+    size_t unconfirmed = 0;
+
+    while (!conn->closing && io_buffer_pending(input) > 0)
+    {
+        char *line = input->data + input->pos;
+        char *newline = memchr(line, '\n', io_buffer_pending(input));
+        if (newline == NULL)
+        {
+            if (io_buffer_pending(input) > get_connection_max_request_length())
+            {
+                connection_reply(conn, "ERROR Request too long\r\n");
+                conn->closing = true;
+            }
+            break;
+        }
+
+        size_t line_length = (size_t)(newline - line);
+        input->pos += line_length + 1;
+
+        if (line_length > 0 && line[line_length - 1] == '\r')
+        {
+            line_length--;
+        }
+        line[line_length] = '\0';
+
+        bool mutating = conn->context != NULL && conn->context->aof != NULL && commands_mutating(line);
+        if (mutating && unconfirmed == 0)
+        {
+            replied = conn->output.pending;
+        }
+        unconfirmed += unconfirmed > 0 || mutating ? 1 : 0;
+        commands_execute(conn, line, line_length);
+
+        if (conn->context != NULL)
+        {
+            // single writer: a relaxed load/store pair avoids a locked RMW per command
+            uint64_t processed = atomic_load_explicit(&conn->context->commands_processed, memory_order_relaxed);
+            atomic_store_explicit(&conn->context->commands_processed, processed + 1, memory_order_relaxed);
+        }
+    }
+
+    // replies of the whole batch are held back by a single wait under AOF_FSYNC_ALWAYS
+    if (conn->context != NULL && conn->context->aof != NULL && !aof_wait(conn->context->aof) && unconfirmed > 0)
+    {
+        output_queue_truncate(&conn->output, replied);
+        for (; unconfirmed > 0; unconfirmed--)
+        {
+            connection_reply(conn, "ERROR Persistence failed\r\n");
+        }
+    }
+
+    if (io_buffer_pending(input) == 0)
+    {
+        input->pos = input->len = 0;
+    }
+}
+
+bool connection_feed_input(connection_state_t *conn, const char *data, size_t length)
+{
+    if (!io_buffer_append(&conn->input, data, length))
+    {
+        return false;
+    }
+
+    commands_process_input(conn);
+    return true;
+}
+
+bool connection_output_over_watermark(const connection_state_t *conn)
+{
+    return conn->output.pending >= get_connection_output_high_watermark();
+}
 
+// ==================== Socket I/O ====================
+
+static bool connection_track_zerocopy(connection_state_t *conn, storage_value_t *value)
+{
+    if (conn->zerocopy_count == conn->zerocopy_cap)
+    {
+        size_t new_cap = conn->zerocopy_cap ? conn->zerocopy_cap * 2 : get_connection_initial_segment_count();
+        zerocopy_pending_t *pending = realloc(conn->zerocopy_pending, new_cap * sizeof(zerocopy_pending_t));
+        if (pending == NULL)
+        {
+            return false;
+        }
+        conn->zerocopy_pending = pending;
+        conn->zerocopy_cap = new_cap;
+    }
+
+    storage_value_acquire(value);
+    conn->zerocopy_pending[conn->zerocopy_count++] = (zerocopy_pending_t){
+        .sequence = conn->zerocopy_next_sequence,
+        .value = value,
+    };
     return true;
 }
 
-const char *storage_get(const char *key) {
-    unsigned int index = hash(key);  
-    storage_node_db_t *node = g_storage.buckets[index];
-    
-    while (node) {
-        if (strncmp(node->key, key) == 0) {
-            return node->value;
+/*
+Drain MSG_ZEROCOPY completion notifications from the socket error queue.
+Each one covers an inclusive range [ee_info, ee_data] of send sequence
+numbers whose pages the kernel no longer references.
+*/
+static void zerocopy_reap(int client_fd, zerocopy_pending_t *pending, size_t *count)
+{
+    while (*count > 0)
+    {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+        struct msghdr msg = {
+            .msg_control = control,
+            .msg_controllen = sizeof(control),
+        };
+
+        if (recvmsg(client_fd, &msg, MSG_ERRQUEUE) < 0)
+        {
+            return; // EAGAIN: nothing completed yet
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            const struct sock_extended_err *err = (const struct sock_extended_err *)CMSG_DATA(cmsg);
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+
+            uint32_t first = err->ee_info;
+            uint32_t span = err->ee_data - first; // sequence numbers wrap at 2^32
+            size_t kept = 0;
+            for (size_t i = 0; i < *count; i++)
+            {
+                if (pending[i].sequence - first <= span)
+                {
+                    storage_value_release(pending[i].value);
+                }
+                else
+                {
+                    pending[kept++] = pending[i];
+                }
+            }
+            *count = kept;
+        }
+    }
+}
+
+static void connection_reap_zerocopy(int client_fd, connection_state_t *conn)
+{
+    zerocopy_reap(client_fd, conn->zerocopy_pending, &conn->zerocopy_count);
+}
+
+/*
+Reset the connection: with a zero linger timeout close() drops whatever
+the kernel has not sent yet instead of transmitting it.
+*/
+static void connection_abort(int client_fd)
+{
+    struct linger linger = {.l_onoff = 1, .l_linger = 0};
+    setsockopt(client_fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    close(client_fd);
+}
+
+bool connection_close(int client_fd, connection_state_t *conn)
+{
+    connection_reap_zerocopy(client_fd, conn);
+    if (conn->zerocopy_count == 0)
+    {
+        close(client_fd);
+        return false;
+    }
+
+    command_context_t *context = conn->context;
+    if (context == NULL)
+    {
+        connection_abort(client_fd);
+        return false;
+    }
+
+    if (context->orphan_count == context->orphan_cap)
+    {
+        size_t new_cap = context->orphan_cap ? context->orphan_cap * 2 : get_connection_initial_segment_count();
+        zerocopy_orphan_t *orphans = realloc(context->orphans, new_cap * sizeof(zerocopy_orphan_t));
+        if (orphans == NULL)
+        {
+            connection_abort(client_fd);
+            return false;
+        }
+        context->orphans = orphans;
+        context->orphan_cap = new_cap;
+    }
+
+    // the peer sees the close now, the descriptor goes once the sends complete
+    shutdown(client_fd, SHUT_RDWR);
+    context->orphans[context->orphan_count++] = (zerocopy_orphan_t){
+        .fd = client_fd,
+        .pending = conn->zerocopy_pending,
+        .count = conn->zerocopy_count,
+    };
+    conn->zerocopy_pending = NULL;
+    conn->zerocopy_count = conn->zerocopy_cap = 0;
+    conn->zerocopy_next_sequence = 0;
+    return true;
+}
+
+void connection_reap_orphans(command_context_t *context)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < context->orphan_count; i++)
+    {
+        zerocopy_orphan_t *orphan = &context->orphans[i];
+        zerocopy_reap(orphan->fd, orphan->pending, &orphan->count);
+        if (orphan->count == 0)
+        {
+            free(orphan->pending);
+            close(orphan->fd);
+        }
+        else
+        {
+            context->orphans[kept++] = *orphan;
+        }
+    }
+    context->orphan_count = kept;
+}
+
+void command_context_release(command_context_t *context)
+{
+    for (size_t i = 0; i < context->orphan_count; i++)
+    {
+        zerocopy_orphan_t *orphan = &context->orphans[i];
+        connection_abort(orphan->fd);
+        for (size_t j = 0; j < orphan->count; j++)
+        {
+            storage_value_release(orphan->pending[j].value);
+        }
+        free(orphan->pending);
+    }
+
+    free(context->orphans);
+    context->orphans = NULL;
+    context->orphan_count = context->orphan_cap = 0;
+}
+
+/*
+Send queued output until it is drained or the socket buffer is full.
+Segments are gathered with sendmsg() so referenced values go out without
+being copied into the output buffer. A value of at least
+zerocopy_threshold bytes at the head of the queue is sent on its own with
+MSG_ZEROCOPY and stays pinned until the kernel reports completion.
+MSG_NOSIGNAL turns a write to a reset peer into EPIPE instead of SIGPIPE.
+*/
+static bool connection_flush_output(int client_fd, connection_state_t *conn)
+{
+    output_queue_t *output = &conn->output;
+    size_t threshold = conn->context ? conn->context->zerocopy_threshold : 0;
+    struct iovec iov[get_connection_max_iovecs()];
+
+    while (output->pending > 0)
+    {
+        const output_segment_t *head = &output->segments[output->head];
+        bool zerocopy = conn->zerocopy && threshold > 0 &&
+                        head->value != NULL && head->length >= threshold;
+
+        struct msghdr msg = {.msg_iov = iov};
+        msg.msg_iovlen = output_queue_fill_iovec(output, iov, zerocopy ? 1 : get_connection_max_iovecs());
+        if (!zerocopy)
+        {
+            // stop in front of the next zerocopy candidate so it is sent on its own
+            for (size_t i = 1; threshold > 0 && conn->zerocopy && i < msg.msg_iovlen; i++)
+            {
+                const output_segment_t *segment = &output->segments[output->head + i];
+                if (segment->value != NULL && segment->length >= threshold)
+                {
+                    msg.msg_iovlen = i;
+                    break;
+                }
+            }
         }
-        node = node->next;
+
+        ssize_t sent = sendmsg(client_fd, &msg, MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0));
+        if (sent > 0)
+        {
+            if (zerocopy)
+            {
+                // the kernel numbers every successful MSG_ZEROCOPY call, even a partial one
+                if (!connection_track_zerocopy(conn, head->value))
+                {
+                    return false;
+                }
+                conn->zerocopy_next_sequence++;
+            }
+            output_queue_consume(output, (size_t)sent);
+            continue;
+        }
+
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (sent < 0 && errno == ENOBUFS && zerocopy)
+        {
+            // optmem_max exhausted by pinned pages: fall back to copying sends
+            conn->zerocopy = false;
+            continue;
+        }
+
+        // EAGAIN: the rest goes out on the next EPOLLOUT edge
+        return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
     }
 
-    return NULL;   
-}
\ No newline at end of file
+    return true;
+}
+
+bool handle_client_connection(int client_fd, connection_state_t *conn)
+{
+    connection_reap_zerocopy(client_fd, conn);
+
+    if (!connection_flush_output(client_fd, conn))
+    {
+        return false;
+    }
+
+    /*
+    ssize_t
+        Used for a count of bytes or an error indication.  It is a
+        signed integer type capable of storing values at least in
+        the range [-1, SSIZE_MAX].
+
+    Reading stops once the client has queued more output than the high
+    watermark without reading it; the remaining input is picked up when
+    the next EPOLLOUT edge drains the output buffer. Should the flush
+    below send it all without EAGAIN, no edge is coming, so reading goes
+    on until recv() or sendmsg() would block.
+    */
+    bool input_drained = false;
+    do
+    {
+        while (!conn->peer_closed && !conn->closing &&
+               !connection_output_over_watermark(conn))
+        {
+            if (!io_buffer_reserve(&conn->input, get_connection_read_chunk_size()))
+            {
+                return false;
+            }
+
+            ssize_t bytes_read = recv(client_fd, conn->input.data + conn->input.len,
+                                      conn->input.cap - conn->input.len, 0);
+            if (bytes_read > 0)
+            {
+                conn->input.len += (size_t)bytes_read;
+                commands_process_input(conn);
+                continue;
+            }
+
+            if (bytes_read == 0)
+            {
+                conn->peer_closed = true;
+            }
+            else if (errno == EINTR)
+            {
+                continue;
+            }
+            else if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return false;
+            }
+            else
+            {
+                input_drained = true;
+            }
+            break;
+        }
+
+        if (!connection_flush_output(client_fd, conn))
+        {
+            return false;
+        }
+    } while (!input_drained && !conn->peer_closed && !conn->closing &&
+             !connection_output_over_watermark(conn));
+
+    return !((conn->peer_closed || conn->closing) && !connection_has_pending_output(conn));
+}
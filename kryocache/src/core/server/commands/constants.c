@@ -0,0 +1,50 @@
+/**
+ * @file constants.c
+ * @brief Command layer constants implementation
+ */
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/commands/include/constants.h"
+
+// ==================== Connection Buffer Constants ====================
+
+static const size_t CONNECTION_INITIAL_BUFFER_SIZE = 4096;
+static const size_t CONNECTION_READ_CHUNK_SIZE = 16384;
+static const size_t CONNECTION_MAX_REQUEST_LENGTH = 1048576 + 1024; // 1MB value + command and key
+static const size_t CONNECTION_OUTPUT_HIGH_WATERMARK = 4194304;     // 4MB
+
+// ==================== Output Queue Constants ====================
+
+static const size_t CONNECTION_INITIAL_SEGMENT_COUNT = 16;
+static const size_t CONNECTION_MAX_IOVECS = 64;          // well below IOV_MAX
+static const size_t CONNECTION_INLINE_VALUE_LIMIT = 128; // shorter values are copied into the reply
+
+// ==================== Multi-Key Constants ====================
+
+static const size_t MULTI_KEY_BATCH_SIZE = 64; // keys per storage_get_many() call, on the stack
+
+// ==================== Scan Constants ====================
+
+static const size_t SCAN_DEFAULT_COUNT = 10;
+static const size_t SCAN_MAX_COUNT = 100000; // keeps a single reply bounded
+
+// ==================== Connection Buffer Constants Getters ====================
+
+size_t get_connection_initial_buffer_size(void) { return CONNECTION_INITIAL_BUFFER_SIZE; }
+size_t get_connection_read_chunk_size(void) { return CONNECTION_READ_CHUNK_SIZE; }
+size_t get_connection_max_request_length(void) { return CONNECTION_MAX_REQUEST_LENGTH; }
+size_t get_connection_output_high_watermark(void) { return CONNECTION_OUTPUT_HIGH_WATERMARK; }
+
+// ==================== Output Queue Constants Getters ====================
+
+size_t get_connection_initial_segment_count(void) { return CONNECTION_INITIAL_SEGMENT_COUNT; }
+size_t get_connection_max_iovecs(void) { return CONNECTION_MAX_IOVECS; }
+size_t get_connection_inline_value_limit(void) { return CONNECTION_INLINE_VALUE_LIMIT; }
+
+// ==================== Multi-Key Constants Getters ====================
+
+size_t get_multi_key_batch_size(void) { return MULTI_KEY_BATCH_SIZE; }
+
+// ==================== Scan Constants Getters ====================
+
+size_t get_scan_default_count(void) { return SCAN_DEFAULT_COUNT; }
+size_t get_scan_max_count(void) { return SCAN_MAX_COUNT; }
@@ -3,31 +3,151 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/storage.h"
 
-typedef struct storage_node_db
+struct aof;
+struct snapshot;
+
+/*
+Growable byte buffer used for both directions of a connection.
+Bytes in [pos, len) are pending: not yet parsed (input) or not yet sent (output).
+*/
+typedef struct io_buffer
+{
+    char *data;
+    size_t pos;
+    size_t len;
+    size_t cap;
+} io_buffer_t;
+
+/*
+One piece of queued output: either bytes copied into the queue buffer
+(value == NULL) or a referenced stored value sent straight from storage.
+*/
+typedef struct output_segment
+{
+    storage_value_t *value; /**< Referenced value, NULL for inline bytes */
+    size_t offset;          /**< First unsent byte in the queue buffer or in value->data */
+    size_t length;          /**< Bytes left to send */
+} output_segment_t;
+
+/*
+Ordered reply stream of a connection, sent with scatter-gather I/O.
+Segments [head, count) are pending.
+*/
+typedef struct output_queue
+{
+    io_buffer_t bytes;          /**< Backing store of inline segments */
+    output_segment_t *segments;
+    size_t head;
+    size_t count;
+    size_t cap;
+    size_t pending;             /**< Bytes not sent yet over all segments */
+} output_queue_t;
+
+/*
+Value pinned by an in-flight MSG_ZEROCOPY send until the kernel reports the
+completion of `sequence` on the socket error queue.
+*/
+typedef struct zerocopy_pending
 {
-    char key[64];
-    char value[256];
-    struct storage_node_db *next;
-} storage_node_db_t;
-
-typedef struct {
-    storage_node_db_t *buckets[1000];
-    size_t size;
-} storage_db_t;
-
-// warning
-static storage_db_t g_storage = {0};
-
-// temp (improve!)
-static unsigned int hash(const char *key) {
-    unsigned int hash = 0;
-    while (*key) {
-        hash = (hash * 31) + *key++;
-    }
-
-    return hash & 1000;
-}
-
-void handle_client_connection(int client_fd);
-bool storage_set(const char *key, const char *value);
\ No newline at end of file
+    uint32_t sequence;
+    storage_value_t *value;
+} zerocopy_pending_t;
+
+/*
+Socket closed while MSG_ZEROCOPY sends were in flight. The kernel may still
+transmit from the pinned values, so the descriptor stays open until their
+completions arrive on its error queue.
+*/
+typedef struct zerocopy_orphan
+{
+    int fd;
+    zerocopy_pending_t *pending;
+    size_t count;
+} zerocopy_orphan_t;
+
+/*
+State shared by all connections of one event loop thread. Counters have a
+single writer (that thread) and are read concurrently by server_get_stats().
+*/
+typedef struct command_context
+{
+    _Atomic(uint64_t) commands_processed;
+    storage_t *storage;        /**< Keyspace shared by every event loop */
+    size_t zerocopy_threshold; /**< Values at least this long use MSG_ZEROCOPY, 0 = never */
+    struct aof *aof;           /**< Log whose fsync replies may wait for, NULL = no persistence */
+    struct snapshot *snapshot; /**< Target of SAVE and BGSAVE, NULL = no persistence */
+    zerocopy_orphan_t *orphans; /**< Owned by the event loop thread */
+    size_t orphan_count;
+    size_t orphan_cap;
+} command_context_t;
+
+/*
+Per-connection protocol state. It lives as long as the TCP connection,
+so any number of commands can be pipelined over one socket.
+*/
+typedef struct connection_state
+{
+    io_buffer_t input;
+    output_queue_t output;
+    bool peer_closed; /**< recv() returned 0, close once output is drained */
+    bool closing;     /**< protocol error, close once output is drained */
+    bool zerocopy;    /**< SO_ZEROCOPY is enabled on the socket */
+    command_context_t *context; /**< Owning event loop, set when the connection is accepted */
+    zerocopy_pending_t *zerocopy_pending;
+    size_t zerocopy_count;
+    size_t zerocopy_cap;
+    uint32_t zerocopy_next_sequence; /**< Kernel numbers MSG_ZEROCOPY sends per socket from 0 */
+} connection_state_t;
+
+/**
+ * @brief Serve a readable and/or writable client socket
+ *
+ * Reads everything the kernel has buffered (the socket is edge-triggered and
+ * non-blocking), executes every complete command line and sends as much of
+ * the queued responses as the socket accepts.
+ *
+ * @return false when the connection must be closed by the caller
+ */
+bool handle_client_connection(int client_fd, connection_state_t *conn);
+/**
+ * @brief Append bytes received by an asynchronous backend and execute every complete command
+ *
+ * @return false when the bytes could not be buffered
+ */
+bool connection_feed_input(connection_state_t *conn, const char *data, size_t length);
+bool connection_has_pending_output(const connection_state_t *conn);
+bool connection_output_over_watermark(const connection_state_t *conn);
+void connection_state_release(connection_state_t *conn);
+/**
+ * @brief Close a client socket without releasing values the kernel may still send
+ *
+ * With MSG_ZEROCOPY sends in flight the socket is shut down and handed to
+ * the connection's context instead of being closed; without a context, or
+ * out of memory, it is reset so that nothing more is sent.
+ * @return true when the socket was kept open: its completions must then be
+ *         passed to connection_reap_orphans()
+ */
+bool connection_close(int client_fd, connection_state_t *conn);
+/**
+ * @brief Release the values of completed orphaned sends, closing sockets with none left
+ */
+void connection_reap_orphans(command_context_t *context);
+/**
+ * @brief Reset the sockets still orphaned and release their values
+ */
+void command_context_release(command_context_t *context);
+
+/**
+ * @brief Describe up to max_iov pending output segments as an iovec array
+ * @return number of iovec entries filled
+ */
+size_t output_queue_fill_iovec(const output_queue_t *queue, struct iovec *iov, size_t max_iov);
+/**
+ * @brief Drop `bytes` sent bytes from the front, releasing fully sent value references
+ */
+void output_queue_consume(output_queue_t *queue, size_t bytes);
+void output_queue_release(output_queue_t *queue);
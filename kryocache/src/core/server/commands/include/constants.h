@@ -0,0 +1,38 @@
+/**
+ * @file constants.h
+ * @brief Command layer constants definition header
+ *
+ * Limits and sizes used by the connection buffers and the command parser.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // ==================== Connection Buffer Constants ====================
+    size_t get_connection_initial_buffer_size(void); ///< First allocation of a connection buffer
+    size_t get_connection_read_chunk_size(void);     ///< Minimum free space reserved before each recv()
+    size_t get_connection_max_request_length(void);  ///< Longest single command line accepted
+    size_t get_connection_output_high_watermark(void); ///< Pending output size that pauses reading
+
+    // ==================== Output Queue Constants ====================
+    size_t get_connection_initial_segment_count(void); ///< First allocation of the segment and zerocopy arrays
+    size_t get_connection_max_iovecs(void);            ///< Segments gathered by a single sendmsg()
+    size_t get_connection_inline_value_limit(void);    ///< Values shorter than this are copied, not referenced
+
+    // ==================== Multi-Key Constants ====================
+    size_t get_multi_key_batch_size(void); ///< Keys of an MGET looked up together
+
+    // ==================== Scan Constants ====================
+    size_t get_scan_default_count(void); ///< Keys a SCAN call looks for without COUNT
+    size_t get_scan_max_count(void);     ///< Largest COUNT honoured by SCAN
+
+#ifdef __cplusplus
+}
+#endif
@@ -84,6 +84,23 @@ static const int SOCKET_BIND_ADDRESS = INADDR_ANY;
 static const int SOCKET_BACKLOG = 10;
 static const int SOCKET_SHUTDOWN_MODE = SHUT_RDWR;
 
+// ==================== Event Loop Constants ====================
+
+static const int EPOLL_MAX_EVENTS = 256;
+static const int EPOLL_WAIT_INFINITE = -1;
+static const uint64_t WAKE_SIGNAL_VALUE = 1;
+static const uint32_t DEFAULT_REACTOR_THREADS = 0; // one per online CPU
+static const uint32_t MAX_REACTOR_THREADS = 256;
+static const server_io_backend_t DEFAULT_IO_BACKEND = SERVER_IO_BACKEND_EPOLL;
+static const size_t DEFAULT_ZEROCOPY_THRESHOLD = 16384; // page pinning only pays off for large sends
+
+// ==================== io_uring Constants ====================
+
+static const uint32_t URING_QUEUE_DEPTH = 1024;
+static const uint32_t URING_BUFFER_COUNT = 256;
+static const uint32_t URING_BUFFER_SIZE = 16384; // 4MB of receive buffers per reactor
+static const uint16_t URING_BUFFER_GROUP = 0;
+
 // ==================== Test Constants ====================
 
 static const int TEST_CUSTOM_PORT = 9999;
@@ -94,6 +111,7 @@ static const char *TEST_BIND_ADDRESS = "127.0.0.1";
 static const char *TEST_DATA_DIRECTORY = "/tmp/test_cache";
 static const bool TEST_PERSISTENCE_ENABLED = true;
 static const int TEST_PERSISTENCE_INTERVAL = 60;
+static const uint32_t TEST_POLL_INTERVAL_US = 1000;
 
 static const int INVALID_PORT_NUMBER = 70000;
 static const uint32_t INVALID_CLIENT_COUNT = 0;
@@ -115,7 +133,8 @@ static const int MINIMUM_BUILD_INFO_LENGTH = 1;
 static const int INIT_TEST_COUNT = 3;
 static const int CONFIG_TEST_COUNT = 2;
 static const int INFO_TEST_COUNT = 2;
-static const int ADVANCED_TEST_COUNT = 2;
+static const int ADVANCED_TEST_COUNT = 7;
+static const int COMMAND_TEST_COUNT = 4;
 
 static const int POLLING_INTERVAL_SECONDS = 1;
 static const int MILLISECONDS_PER_SECOND = 1000;
@@ -128,6 +147,14 @@ static const char *SOCKET_OPTION_ERROR_MESSAGE = "Socket option setting failed";
 static const char *SOCKET_BIND_ERROR_MESSAGE = "Socket bind failed";
 static const char *SOCKET_LISTEN_ERROR_MESSAGE = "Socket listen failed";
 static const char *THREAD_CREATION_ERROR_MESSAGE = "Thread creation failed";
+static const char *EVENT_LOOP_ERROR_MESSAGE = "Event loop setup failed";
+static const char *INVALID_REACTOR_COUNT_ERROR_MESSAGE = "Invalid reactor thread count (max %u)";
+static const char *INVALID_IO_BACKEND_ERROR_MESSAGE = "Unknown I/O backend";
+static const char *INVALID_EVICTION_POLICY_ERROR_MESSAGE = "Unknown eviction policy";
+static const char *INVALID_AOF_FSYNC_ERROR_MESSAGE = "Unknown AOF fsync policy";
+static const char *PERSISTENCE_ERROR_MESSAGE = "Cannot open or load the append-only log or snapshot";
+static const char *PERSISTENCE_WRITE_ERROR_MESSAGE = "Cannot write the append-only log, writes are refused until it recovers";
+static const char *PERSISTENCE_RECOVERED_MESSAGE = "The append-only log is writable again";
 static const char *NULL_CONFIG_ERROR_MESSAGE = "Configuration is NULL";
 static const char *INVALID_PORT_ERROR_MESSAGE = "Invalid port number: %d";
 static const char *INVALID_CLIENT_COUNT_ERROR_MESSAGE = "Invalid client count";
@@ -138,11 +165,13 @@ static const char *SERVER_BUILD_INFO_STRING = "In-Memory Cache Server 1.0.0";
 static const char *EMPTY_STRING = "";
 
 static const size_t DEFAULT_MAX_MEMORY = 0; // Unlimited
+static const storage_eviction_policy_t DEFAULT_EVICTION_POLICY = STORAGE_EVICTION_LRU;
 static const server_mode_t DEFAULT_SERVER_MODE = SERVER_MODE_STANDALONE;
 static const char *DEFAULT_BIND_ADDRESS = NULL; // All interfaces
 static const char *DEFAULT_DATA_DIRECTORY = "./data";
 static const bool DEFAULT_PERSISTENCE_ENABLED = false;
 static const int DEFAULT_PERSISTENCE_INTERVAL = 300; // 5 minutes
+static const aof_fsync_policy_t DEFAULT_AOF_FSYNC_POLICY = AOF_FSYNC_EVERYSEC;
 
 // ==================== Server Default Values Getters ====================
 
@@ -224,6 +253,23 @@ int get_socket_bind_address(void) { return SOCKET_BIND_ADDRESS; }
 int get_socket_backlog(void) { return SOCKET_BACKLOG; }
 int get_socket_shutdown_mode(void) { return SOCKET_SHUTDOWN_MODE; }
 
+// ==================== Event Loop Constants Getters ====================
+
+int get_epoll_max_events(void) { return EPOLL_MAX_EVENTS; }
+int get_epoll_wait_infinite(void) { return EPOLL_WAIT_INFINITE; }
+uint64_t get_wake_signal_value(void) { return WAKE_SIGNAL_VALUE; }
+uint32_t get_default_reactor_threads(void) { return DEFAULT_REACTOR_THREADS; }
+uint32_t get_max_reactor_threads(void) { return MAX_REACTOR_THREADS; }
+server_io_backend_t get_default_io_backend(void) { return DEFAULT_IO_BACKEND; }
+size_t get_default_zerocopy_threshold(void) { return DEFAULT_ZEROCOPY_THRESHOLD; }
+
+// ==================== io_uring Constants Getters ====================
+
+uint32_t get_uring_queue_depth(void) { return URING_QUEUE_DEPTH; }
+uint32_t get_uring_buffer_count(void) { return URING_BUFFER_COUNT; }
+uint32_t get_uring_buffer_size(void) { return URING_BUFFER_SIZE; }
+uint16_t get_uring_buffer_group(void) { return URING_BUFFER_GROUP; }
+
 // ==================== Test Constants Getters ====================
 
 int get_test_custom_port(void) { return TEST_CUSTOM_PORT; }
@@ -234,6 +280,7 @@ const char *get_test_bind_address(void) { return TEST_BIND_ADDRESS; }
 const char *get_test_data_directory(void) { return TEST_DATA_DIRECTORY; }
 bool get_test_persistence_enabled(void) { return TEST_PERSISTENCE_ENABLED; }
 int get_test_persistence_interval(void) { return TEST_PERSISTENCE_INTERVAL; }
+uint32_t get_test_poll_interval_us(void) { return TEST_POLL_INTERVAL_US; }
 
 int get_invalid_port_number(void) { return INVALID_PORT_NUMBER; }
 uint32_t get_invalid_client_count(void) { return INVALID_CLIENT_COUNT; }
@@ -256,6 +303,7 @@ int get_init_test_count(void) { return INIT_TEST_COUNT; }
 int get_config_test_count(void) { return CONFIG_TEST_COUNT; }
 int get_info_test_count(void) { return INFO_TEST_COUNT; }
 int get_advanced_test_count(void) { return ADVANCED_TEST_COUNT; }
+int get_command_test_count(void) { return COMMAND_TEST_COUNT; }
 
 int get_polling_interval_seconds(void) { return POLLING_INTERVAL_SECONDS; }
 int get_milliseconds_per_second(void) { return MILLISECONDS_PER_SECOND; }
@@ -268,6 +316,14 @@ const char *get_socket_option_error_message(void) { return SOCKET_OPTION_ERROR_M
 const char *get_socket_bind_error_message(void) { return SOCKET_BIND_ERROR_MESSAGE; }
 const char *get_socket_listen_error_message(void) { return SOCKET_LISTEN_ERROR_MESSAGE; }
 const char *get_thread_creation_error_message(void) { return THREAD_CREATION_ERROR_MESSAGE; }
+const char *get_event_loop_error_message(void) { return EVENT_LOOP_ERROR_MESSAGE; }
+const char *get_invalid_reactor_count_error_message(void) { return INVALID_REACTOR_COUNT_ERROR_MESSAGE; }
+const char *get_invalid_io_backend_error_message(void) { return INVALID_IO_BACKEND_ERROR_MESSAGE; }
+const char *get_invalid_eviction_policy_error_message(void) { return INVALID_EVICTION_POLICY_ERROR_MESSAGE; }
+const char *get_invalid_aof_fsync_error_message(void) { return INVALID_AOF_FSYNC_ERROR_MESSAGE; }
+const char *get_persistence_error_message(void) { return PERSISTENCE_ERROR_MESSAGE; }
+const char *get_persistence_write_error_message(void) { return PERSISTENCE_WRITE_ERROR_MESSAGE; }
+const char *get_persistence_recovered_message(void) { return PERSISTENCE_RECOVERED_MESSAGE; }
 const char *get_null_config_error_message(void) { return NULL_CONFIG_ERROR_MESSAGE; }
 const char *get_invalid_port_error_message(void) { return INVALID_PORT_ERROR_MESSAGE; }
 const char *get_invalid_client_count_error_message(void) { return INVALID_CLIENT_COUNT_ERROR_MESSAGE; }
@@ -280,11 +336,13 @@ const char *get_empty_string(void) { return EMPTY_STRING; }
 // ==================== Configuration Default Getters ====================
 
 size_t get_default_max_memory(void) { return DEFAULT_MAX_MEMORY; }
+storage_eviction_policy_t get_default_eviction_policy(void) { return DEFAULT_EVICTION_POLICY; }
 server_mode_t get_default_server_mode(void) { return DEFAULT_SERVER_MODE; }
 const char *get_default_bind_address(void) { return DEFAULT_BIND_ADDRESS; }
 const char *get_default_data_directory(void) { return DEFAULT_DATA_DIRECTORY; }
 bool get_default_persistence_enabled(void) { return DEFAULT_PERSISTENCE_ENABLED; }
 int get_default_persistence_interval(void) { return DEFAULT_PERSISTENCE_INTERVAL; }
+aof_fsync_policy_t get_default_aof_fsync_policy(void) { return DEFAULT_AOF_FSYNC_POLICY; }
 
 // ==================== Utility Functions ====================
 
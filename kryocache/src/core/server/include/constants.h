@@ -91,6 +91,21 @@ extern "C"
     int get_socket_backlog(void);          ///< Socket listen backlog
     int get_socket_shutdown_mode(void);    ///< Socket shutdown mode
 
+    // ==================== Event Loop Constants ====================
+    int get_epoll_max_events(void);    ///< Events drained per epoll_wait() call
+    int get_epoll_wait_infinite(void); ///< epoll_wait() timeout that blocks until an event arrives
+    uint64_t get_wake_signal_value(void); ///< Value written to the wake eventfd
+    uint32_t get_default_reactor_threads(void); ///< Default reactor count (0 = one per online CPU)
+    uint32_t get_max_reactor_threads(void);     ///< Upper bound on reactor threads
+    server_io_backend_t get_default_io_backend(void); ///< Default network I/O backend
+    size_t get_default_zerocopy_threshold(void);      ///< Default minimum GET value size for MSG_ZEROCOPY
+
+    // ==================== io_uring Constants ====================
+    uint32_t get_uring_queue_depth(void);  ///< Submission queue entries per reactor ring
+    uint32_t get_uring_buffer_count(void); ///< Provided receive buffers per reactor (power of two)
+    uint32_t get_uring_buffer_size(void);  ///< Size of one provided receive buffer
+    uint16_t get_uring_buffer_group(void); ///< Buffer group id of the provided buffer ring
+
     // ==================== Test Constants ====================
     int get_test_custom_port(void);            ///< Test custom port
     uint32_t get_test_max_clients(void);       ///< Test max clients
@@ -100,6 +115,7 @@ extern "C"
     const char *get_test_data_directory(void); ///< Test data directory
     bool get_test_persistence_enabled(void);   ///< Test persistence enabled
     int get_test_persistence_interval(void);   ///< Test persistence interval
+    uint32_t get_test_poll_interval_us(void);  ///< Test wait between checks of a background task
 
     int get_invalid_port_number(void);       ///< Invalid port number for testing
     uint32_t get_invalid_client_count(void); ///< Invalid client count for testing
@@ -122,6 +138,7 @@ extern "C"
     int get_config_test_count(void);   ///< Configuration test count
     int get_info_test_count(void);     ///< Information test count
     int get_advanced_test_count(void); ///< Advanced features test count
+    int get_command_test_count(void);  ///< Command parsing test count
 
     int get_polling_interval_seconds(void); ///< Polling interval in seconds
     int get_milliseconds_per_second(void);  ///< Milliseconds per second
@@ -133,6 +150,14 @@ extern "C"
     const char *get_socket_bind_error_message(void);          ///< Socket bind error message
     const char *get_socket_listen_error_message(void);        ///< Socket listen error message
     const char *get_thread_creation_error_message(void);      ///< Thread creation error message
+    const char *get_event_loop_error_message(void);           ///< epoll/eventfd setup error message
+    const char *get_invalid_reactor_count_error_message(void); ///< Invalid reactor count error message
+    const char *get_invalid_io_backend_error_message(void);    ///< Unknown I/O backend error message
+    const char *get_invalid_eviction_policy_error_message(void); ///< Unknown eviction policy error message
+    const char *get_invalid_aof_fsync_error_message(void);       ///< Unknown AOF fsync policy error message
+    const char *get_persistence_error_message(void);             ///< Append-only log or snapshot open/load error message
+    const char *get_persistence_write_error_message(void);       ///< Append-only log write/fsync error message
+    const char *get_persistence_recovered_message(void);         ///< Append-only log recovered message
     const char *get_null_config_error_message(void);          ///< Null config error message
     const char *get_invalid_port_error_message(void);         ///< Invalid port error message
     const char *get_invalid_client_count_error_message(void); ///< Invalid client count error message
@@ -144,11 +169,13 @@ extern "C"
 
     // ==================== Configuration Defaults ====================
     size_t get_default_max_memory(void);          ///< Default max memory
+    storage_eviction_policy_t get_default_eviction_policy(void); ///< Default eviction policy at max memory
     server_mode_t get_default_server_mode(void);  ///< Default server mode
     const char *get_default_bind_address(void);   ///< Default bind address
     const char *get_default_data_directory(void); ///< Default data directory
     bool get_default_persistence_enabled(void);   ///< Default persistence enabled
     int get_default_persistence_interval(void);   ///< Default persistence interval
+    aof_fsync_policy_t get_default_aof_fsync_policy(void); ///< Default fsync policy of the append-only log
 
     // ==================== Utility Functions ====================
     double get_server_uptime_seconds(const server_instance_t *server); ///< Calculate server uptime
@@ -18,7 +18,13 @@ extern "C"
 #include <stdint.h>
 #include <time.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/commands/include/commands.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/storage.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/aof.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/snapshot.h"
 
     typedef struct {
         int err;
@@ -75,6 +81,15 @@ extern "C"
         SERVER_STATUS_ERROR          /**< Server encountered an error */
     } server_status_t;
 
+    /**
+     * @brief Network I/O backend used by the reactors
+     */
+    typedef enum
+    {
+        SERVER_IO_BACKEND_EPOLL,   /**< Non-blocking sockets driven by epoll (always available) */
+        SERVER_IO_BACKEND_IO_URING /**< io_uring multishot accept/recv, falls back to epoll if unsupported */
+    } server_io_backend_t;
+
     /**
      * @brief Server configuration structure
      */
@@ -83,11 +98,16 @@ extern "C"
         uint32_t port;              /**< TCP port to listen on */
         uint32_t max_clients;       /**< Maximum client connections */
         size_t max_memory;          /**< Maximum memory usage in bytes */
+        storage_eviction_policy_t eviction_policy; /**< Which keys go first once max_memory is reached */
         server_mode_t mode;         /**< Server operation mode */
         const char *bind_address;   /**< IP address to bind to */
         const char *data_directory; /**< Directory for persistence files */
-        bool persistence_enabled;   /**< Enable data persistence to disk */
+        bool persistence_enabled;   /**< Log every change to an append-only file in data_directory and allow snapshots */
         int persistence_interval;   /**< Persistence interval in seconds */
+        uint32_t reactor_threads;   /**< Event loop threads, 0 = one per online CPU */
+        server_io_backend_t io_backend; /**< Requested I/O backend */
+        size_t zerocopy_threshold;  /**< GET values at least this long are sent with MSG_ZEROCOPY, 0 = off */
+        aof_fsync_policy_t aof_fsync_policy; /**< When the append-only log is flushed to disk */
     } server_config_t;
 
     /**
@@ -101,47 +121,89 @@ extern "C"
         size_t memory_used;          /**< Current memory usage in bytes */
         uint32_t connected_clients;  /**< Currently connected clients */
         double uptime_seconds;       /**< Server uptime in seconds */
+        uint64_t snapshots_saved;    /**< Snapshots written since start */
+        uint64_t snapshot_deltas;    /**< Checkpoints that only wrote the keys changed since the previous one */
+        bool snapshot_in_progress;   /**< A forked child is writing a snapshot */
+        uint64_t snapshot_fork_us;   /**< Writes were held back this long by the last fork() */
+        uint64_t snapshot_max_fork_us; /**< Longest of those since start */
+        uint64_t snapshot_cow_bytes; /**< Memory the last snapshot child had to copy from the parent */
     } server_stats_t;
 
     // =================== Foundation =====================
 
-    typedef struct storage_node
-    {
-        char key[256];           // вместо MAX_SIZE_KEY
-        char value[1024 * 1024]; // вместо MAX_SIZE_VALUE
-        time_t expires_at;
-        struct storage_node *next;
-    } storage_node_t;
-
-    typedef struct
+    /**
+     * @brief io_uring bookkeeping of a client (unused by the epoll backend)
+     */
+    typedef struct client_uring_state
     {
-        storage_node_t **buckets;
-        size_t capacity;
-        size_t size;
-        pthread_mutex_t lock;
-    } storage_t;
+        output_queue_t sending; /**< Output owned by the kernel until its SENDMSG completes */
+        struct iovec *iov;      /**< Gather list of the SENDMSG in flight */
+        struct msghdr msg;      /**< Must stay valid until the SENDMSG completes */
+        uint32_t ops_in_flight; /**< Submitted requests that still reference this client */
+        bool recv_armed;        /**< A multishot RECV is active */
+        bool recv_paused;       /**< RECV cancelled because output passed the high watermark */
+        bool closing;           /**< Socket shut down, slot is released when ops_in_flight drops to 0 */
+    } client_uring_state_t;
 
     typedef struct client_context
     {
         int fd;
-        sockaddr_in_t addr;
-        pthread_t thread_id;
+        struct sockaddr_in6 addr; /**< Peer address as returned by accept4() */
+        pthread_t thread_id;      /**< Event loop thread serving this client */
         bool connected;
+        connection_state_t conn;  /**< Buffered input/output kept for the connection lifetime */
+        client_uring_state_t uring;
     } client_context_t;
 
+    /**
+     * @brief Event loop thread state
+     *
+     * Every reactor owns its own SO_REUSEPORT listener and epoll instance, so
+     * the kernel spreads new connections across reactors and a client is served
+     * by the same thread for its whole lifetime. Counters are written only by
+     * the owning thread and summed up by server_get_stats().
+     */
+    typedef struct server_reactor
+    {
+        _Alignas(64) struct server_instance *server; /**< Cache-line aligned: no false sharing between reactors */
+        uint32_t id;
+        int listen_fd;                 /**< SO_REUSEPORT listening socket */
+        int epoll_fd;                  /**< Multiplexes listen_fd, wake_fd and the reactor's clients */
+        int wake_fd;                   /**< eventfd used to interrupt epoll_wait() on stop */
+        pthread_t thread;
+        bool running;                  /**< thread was created and must be joined */
+        server_io_backend_t io_backend; /**< Backend in use after probing kernel support */
+        struct server_uring *uring;    /**< Ring state when io_backend is SERVER_IO_BACKEND_IO_URING */
+        _Atomic(uint64_t) connections_total; /**< Connections accepted by this reactor */
+        command_context_t commands;    /**< Per-reactor command counters */
+    } server_reactor_t;
+
     typedef struct server_instance
     {
         server_config_t config;
         size_t actual_max_clients;
         server_status_t status;
         storage_t *storage;
-        int server_fd;
-        pthread_t acceptor_thread;
+        server_reactor_t *reactors;
+        uint32_t reactor_count;
         client_context_t *clients;
+        uint32_t *free_slots;       /**< Stack of unused indexes into clients */
+        uint32_t free_slot_count;
         uint32_t client_count;
         pthread_mutex_t clients_lock;
         char last_error[256];
         time_t start_time;
+        pthread_t expire_thread;    /**< Runs storage_expire_cycle() every wheel tick */
+        bool expire_running;        /**< expire_thread was created and must be joined */
+        pthread_t defrag_thread;    /**< Runs storage_defrag_cycle() while slab pages are sparse */
+        bool defrag_running;        /**< defrag_thread was created and must be joined */
+        pthread_t lazy_free_thread; /**< Frees flushed tables and big values off the shard locks */
+        bool lazy_free_running;     /**< lazy_free_thread was created and must be joined */
+        aof_t *aof;                 /**< Append-only log, NULL unless persistence_enabled */
+        uint64_t aof_segment;       /**< Log segment server_load_data() found last, the log appends to it */
+        snapshot_t *snapshot;       /**< Snapshots of the keyspace, NULL unless persistence_enabled */
+        pthread_t aof_thread;       /**< Writes and fsyncs the log */
+        bool aof_running;           /**< aof_thread was created and must be joined */
     } server_instance_t;
 
     /**
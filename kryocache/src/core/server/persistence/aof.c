@@ -0,0 +1,671 @@
+/**
+ * @file aof.c
+ * @brief Append-only log writer and loader
+ */
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/aof.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/constants.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define AOF_RECORD_HEADER 17 // op, key length, value length, deadline
+
+/*
+Where the calling thread's last record ends, and in which log, so that
+aof_wait() only waits for records of its own.
+*/
+static _Thread_local const aof_t *aof_last_log;
+static _Thread_local uint64_t aof_last_offset;
+
+static uint64_t aof_monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static uint64_t aof_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// bytes written before a failure, `length` when all of them were
+static size_t aof_write_all(int fd, const char *data, size_t length)
+{
+    size_t done = 0;
+    while (done < length)
+    {
+        ssize_t written = write(fd, data + done, length - done);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written < 0)
+        {
+            break;
+        }
+        done += (size_t)written;
+    }
+    return done;
+}
+
+// a new file gets the signature, an existing one must start with it
+static bool aof_check_signature(int fd, off_t size)
+{
+    size_t length = get_aof_signature_length();
+    if (size == 0)
+    {
+        return aof_write_all(fd, get_aof_signature(), length) == length && fdatasync(fd) == 0;
+    }
+
+    char signature[16];
+    return (size_t)size >= length && length <= sizeof(signature) &&
+           pread(fd, signature, length, 0) == (ssize_t)length && memcmp(signature, get_aof_signature(), length) == 0;
+}
+
+// segment 0 is `path` itself, segment n is `path`.n
+static bool aof_segment_path(const char *path, uint64_t segment, char *segment_path, size_t size)
+{
+    int length = segment == 0 ? snprintf(segment_path, size, "%s", path)
+                              : snprintf(segment_path, size, "%s.%" PRIu64, path, segment);
+    return length > 0 && (size_t)length < size;
+}
+
+static bool aof_sync_directory(const char *path)
+{
+    char directory[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    int length = slash == NULL ? snprintf(directory, sizeof(directory), ".")
+                               : snprintf(directory, sizeof(directory), "%.*s", (int)(slash - path + 1), path);
+    if (length <= 0 || (size_t)length >= sizeof(directory))
+    {
+        return false;
+    }
+
+    int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+
+// ==================== Writer ====================
+
+aof_t *aof_open(const char *path, uint64_t segment, aof_fsync_policy_t fsync_policy)
+{
+    char segment_path[PATH_MAX];
+    int fd = aof_segment_path(path, segment, segment_path, sizeof(segment_path))
+                 ? open(segment_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644)
+                 : -1;
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || !aof_check_signature(fd, status.st_size))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    aof_t *aof = calloc(1, sizeof(aof_t));
+    if (aof == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    aof->capacity = aof->spare_capacity = get_aof_initial_buffer();
+    aof->buffer = malloc(aof->capacity);
+    aof->spare = malloc(aof->spare_capacity);
+    aof->path = strdup(path);
+    if (aof->buffer == NULL || aof->spare == NULL || aof->path == NULL || pthread_mutex_init(&aof->lock, NULL) != 0)
+    {
+        free(aof->path);
+        free(aof->buffer);
+        free(aof->spare);
+        free(aof);
+        close(fd);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&aof->io_lock, NULL) != 0)
+    {
+        pthread_mutex_destroy(&aof->lock);
+        free(aof->path);
+        free(aof->buffer);
+        free(aof->spare);
+        free(aof);
+        close(fd);
+        return NULL;
+    }
+
+    if (pthread_cond_init(&aof->pending, NULL) != 0)
+    {
+        pthread_mutex_destroy(&aof->io_lock);
+        pthread_mutex_destroy(&aof->lock);
+        free(aof->path);
+        free(aof->buffer);
+        free(aof->spare);
+        free(aof);
+        close(fd);
+        return NULL;
+    }
+
+    uint64_t size = status.st_size > 0 ? (uint64_t)status.st_size : get_aof_signature_length();
+    aof->fd = fd;
+    aof->next_fd = aof->cut_fd = -1;
+    aof->segment = segment;
+    aof->fsync_policy = fsync_policy;
+    aof->appended = aof->synced = aof->written = size;
+    aof->last_sync_ms = aof_monotonic_ms();
+    return aof;
+}
+
+// caller holds aof->lock
+static bool aof_reserve(aof_t *aof, size_t extra)
+{
+    if (aof->capacity - aof->length >= extra)
+    {
+        return true;
+    }
+
+    size_t capacity = aof->capacity * 2;
+    while (capacity - aof->length < extra)
+    {
+        capacity *= 2;
+    }
+
+    char *buffer = realloc(aof->buffer, capacity);
+    if (buffer == NULL)
+    {
+        return false;
+    }
+    aof->buffer = buffer;
+    aof->capacity = capacity;
+    return true;
+}
+
+/*
+Caller holds aof->lock. Records a drain could not write go back in front
+of those appended meanwhile, so the next drain writes them first and the
+log keeps its order.
+*/
+static void aof_requeue(aof_t *aof, const char *records, size_t length)
+{
+    if (!aof_reserve(aof, length))
+    {
+        aof->lost = true;
+        return;
+    }
+
+    memmove(aof->buffer + length, aof->buffer, aof->length);
+    memcpy(aof->buffer, records, length);
+    aof->length += length;
+}
+
+/*
+Take the buffered records, write them with one call and fsync if the
+policy asks for it. The buffer is swapped for the spare one, so appenders
+only wait for the swap and never for the disk. Nothing is done once the
+log is synced up to `target`: a thread that waited for io_lock may find
+its records were flushed by the previous holder. Records buffered before
+a cut go to the previous segment, which is synced and closed before
+anything goes to the next one: a segment is whole once a later one has
+records; the cut stays pending until then, so no other one can start.
+
+A failed write or fsync keeps what was not written or synced for the
+next drain, which syncs regardless of the policy, and the log counts as
+failed until one succeeds. Records that could not be buffered at all
+leave a gap nothing can fill, so that failure is final.
+*/
+static bool aof_drain(aof_t *aof, bool force_sync, uint64_t target)
+{
+    pthread_mutex_lock(&aof->io_lock);
+    if (aof->synced >= target)
+    {
+        pthread_mutex_unlock(&aof->io_lock);
+        return true;
+    }
+
+    pthread_mutex_lock(&aof->lock);
+    char *records = aof->buffer;
+    size_t length = aof->length;
+    size_t capacity = aof->capacity;
+    aof->buffer = aof->spare;
+    aof->capacity = aof->spare_capacity;
+    aof->length = 0;
+    bool retry = aof->failed;
+    int cut_fd = aof->cut_fd;
+    size_t cut = aof->cut;
+    pthread_mutex_unlock(&aof->lock);
+
+    bool healthy = true;
+    size_t done = 0;
+    if (cut_fd >= 0)
+    {
+        done = aof_write_all(aof->fd, records, cut);
+        aof->written += done;
+        healthy = done == cut && fdatasync(aof->fd) == 0;
+        if (healthy)
+        {
+            close(aof->fd);
+            aof->fd = cut_fd;
+            aof->synced = aof->written;
+        }
+    }
+
+    if (healthy && done < length)
+    {
+        size_t written = aof_write_all(aof->fd, records + done, length - done);
+        aof->written += written;
+        done += written;
+        healthy = done == length;
+    }
+
+    uint64_t now_ms = aof_monotonic_ms();
+    bool due = force_sync || aof->fsync_policy == AOF_FSYNC_ALWAYS ||
+               (aof->fsync_policy == AOF_FSYNC_EVERYSEC &&
+                (retry || now_ms - aof->last_sync_ms >= get_aof_fsync_interval_ms()));
+    if (healthy && due && aof->written > aof->synced)
+    {
+        healthy = fdatasync(aof->fd) == 0;
+        aof->synced = healthy ? aof->written : aof->synced;
+        aof->last_sync_ms = now_ms;
+    }
+
+    pthread_mutex_lock(&aof->lock);
+    if (done < length)
+    {
+        aof_requeue(aof, records + done, length - done);
+    }
+    if (cut_fd >= 0)
+    {
+        aof->cut_fd = aof->fd == cut_fd ? -1 : cut_fd;
+        aof->cut = done < cut ? cut - done : 0;
+    }
+    aof->failed = !healthy;
+    healthy = healthy && !aof->lost;
+    pthread_mutex_unlock(&aof->lock);
+
+    aof->spare = records;
+    aof->spare_capacity = capacity;
+    pthread_mutex_unlock(&aof->io_lock);
+    return healthy;
+}
+
+void aof_close(aof_t *aof)
+{
+    if (aof == NULL)
+    {
+        return;
+    }
+
+    aof_drain(aof, true, UINT64_MAX);
+    close(aof->fd);
+    if (aof->next_fd >= 0)
+    {
+        close(aof->next_fd);
+    }
+    pthread_cond_destroy(&aof->pending);
+    pthread_mutex_destroy(&aof->io_lock);
+    pthread_mutex_destroy(&aof->lock);
+    free(aof->path);
+    free(aof->buffer);
+    free(aof->spare);
+    free(aof);
+}
+
+/*
+Runs under the shard lock of the key, so it only copies the record. A
+record that cannot be buffered would leave a gap in the log: the log is
+marked lost instead of silently skipping it. A log that is failing only
+to write keeps buffering; the records are written once it recovers.
+*/
+void aof_journal(const storage_journal_record_t *record, void *arg)
+{
+    aof_t *aof = arg;
+    uint8_t op = (uint8_t)record->op;
+    uint32_t key_length = (uint32_t)record->key_length;
+    uint32_t value_length = (uint32_t)record->value_length;
+    size_t size = AOF_RECORD_HEADER + key_length + value_length;
+
+    pthread_mutex_lock(&aof->lock);
+    if (aof->lost || !aof_reserve(aof, size))
+    {
+        aof->lost = true;
+        aof_last_log = aof;
+        pthread_mutex_unlock(&aof->lock);
+        return;
+    }
+
+    char *p = aof->buffer + aof->length;
+    p[0] = (char)op;
+    memcpy(p + 1, &key_length, sizeof(key_length));
+    memcpy(p + 5, &value_length, sizeof(value_length));
+    memcpy(p + 9, &record->expires_at, sizeof(record->expires_at));
+    // FLUSH has no key and only SET has a value, their pointers may be NULL
+    if (key_length > 0)
+    {
+        memcpy(p + AOF_RECORD_HEADER, record->key, key_length);
+    }
+    if (value_length > 0)
+    {
+        memcpy(p + AOF_RECORD_HEADER + key_length, record->value, value_length);
+    }
+    aof->length += size;
+    aof->appended += size;
+
+    aof_last_log = aof;
+    aof_last_offset = aof->appended;
+    if (aof->length >= get_aof_wake_bytes())
+    {
+        pthread_cond_signal(&aof->pending);
+    }
+    pthread_mutex_unlock(&aof->lock);
+}
+
+/*
+Called once per batch of commands rather than per record. The caller
+flushes the log itself instead of handing off to the writer thread: the
+threads queued on io_lock meanwhile mostly find their records already
+synced by the same fsync. Under the other policies only the state of the
+log is reported.
+*/
+bool aof_wait(aof_t *aof)
+{
+    if (aof_last_log != aof)
+    {
+        return true;
+    }
+
+    aof_last_log = NULL;
+    bool synced = aof->fsync_policy != AOF_FSYNC_ALWAYS || aof_drain(aof, true, aof_last_offset);
+    return synced && aof_healthy(aof);
+}
+
+bool aof_healthy(aof_t *aof)
+{
+    pthread_mutex_lock(&aof->lock);
+    bool healthy = !aof->failed && !aof->lost;
+    pthread_mutex_unlock(&aof->lock);
+    return healthy;
+}
+
+// a failing log is retried once per timeout rather than in a busy loop
+bool aof_write_cycle(aof_t *aof, uint64_t timeout_ms)
+{
+    pthread_mutex_lock(&aof->lock);
+    if ((aof->length == 0 || aof->failed) && timeout_ms > 0)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)(timeout_ms / 1000);
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&aof->pending, &aof->lock, &deadline);
+    }
+    pthread_mutex_unlock(&aof->lock);
+
+    return aof_drain(aof, false, UINT64_MAX);
+}
+
+bool aof_sync(aof_t *aof)
+{
+    return aof_drain(aof, true, UINT64_MAX);
+}
+
+// ==================== Segments ====================
+
+/*
+The new segment is created, signed and made durable now, so that starting
+it in aof_position() is only a matter of swapping descriptors. Whatever
+was in a file of that number is stale: segments are only ever read up to
+the first missing one.
+*/
+bool aof_prepare_segment(aof_t *aof)
+{
+    pthread_mutex_lock(&aof->lock);
+    bool prepared = aof->next_fd >= 0;
+    uint64_t segment = aof->segment + 1;
+    pthread_mutex_unlock(&aof->lock);
+    if (prepared)
+    {
+        return true;
+    }
+
+    char path[PATH_MAX];
+    int fd = aof_segment_path(aof->path, segment, path, sizeof(path))
+                 ? open(path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644)
+                 : -1;
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (!aof_check_signature(fd, 0) || !aof_sync_directory(aof->path))
+    {
+        close(fd);
+        unlink(path);
+        return false;
+    }
+
+    pthread_mutex_lock(&aof->lock);
+    aof->next_fd = fd;
+    pthread_mutex_unlock(&aof->lock);
+    return true;
+}
+
+/*
+A log offset counts the bytes of every segment since aof_open(); the file
+offset of a record is its log offset minus the start of its segment. The
+new segment's signature is already written, so its first record goes
+right after it.
+*/
+void aof_position(aof_t *aof, bool rotate, uint64_t *segment, uint64_t *offset)
+{
+    pthread_mutex_lock(&aof->lock);
+    if (rotate && aof->next_fd >= 0 && aof->cut_fd < 0)
+    {
+        aof->cut_fd = aof->next_fd;
+        aof->cut = aof->length;
+        aof->next_fd = -1;
+        aof->segment++;
+        aof->segment_start = aof->appended - get_aof_signature_length();
+    }
+
+    *segment = aof->segment;
+    *offset = aof->appended - aof->segment_start;
+    pthread_mutex_unlock(&aof->lock);
+}
+
+/*
+Oldest first, so that an interrupted removal leaves the remaining segments
+numbered without gaps.
+*/
+void aof_remove_segments(const aof_t *aof, uint64_t segment)
+{
+    char path[PATH_MAX];
+    uint64_t oldest = segment;
+    while (oldest > 0 && aof_segment_path(aof->path, oldest - 1, path, sizeof(path)) && access(path, F_OK) == 0)
+    {
+        oldest--;
+    }
+
+    for (; oldest < segment && aof_segment_path(aof->path, oldest, path, sizeof(path)); oldest++)
+    {
+        unlink(path);
+    }
+}
+
+// ==================== Loader ====================
+
+// a deadline that passed while the server was down deletes the key
+static void aof_apply(storage_t *storage, const storage_journal_record_t *record, uint64_t now_ms)
+{
+    bool expired = record->expires_at != 0 && record->expires_at <= now_ms;
+    uint64_t ttl_ms = record->expires_at != 0 && !expired ? record->expires_at - now_ms : 0;
+
+    switch (record->op)
+    {
+    case STORAGE_JOURNAL_SET:
+        if (expired)
+        {
+            storage_delete(storage, record->key, record->key_length);
+        }
+        else
+        {
+            storage_value_t *value = storage_value_create(record->value, record->value_length);
+            if (value != NULL)
+            {
+                storage_set_expiring(storage, record->key, record->key_length, value, ttl_ms);
+            }
+        }
+        break;
+    case STORAGE_JOURNAL_DELETE:
+        storage_delete(storage, record->key, record->key_length);
+        break;
+    case STORAGE_JOURNAL_EXPIRE:
+        if (record->expires_at == 0)
+        {
+            storage_persist(storage, record->key, record->key_length);
+        }
+        else
+        {
+            storage_expire(storage, record->key, record->key_length, ttl_ms);
+        }
+        break;
+    case STORAGE_JOURNAL_FLUSH:
+        storage_flush(storage);
+        break;
+    }
+}
+
+static bool aof_load_segment(const char *path, storage_t *storage, uint64_t start, bool last, size_t *records)
+{
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return errno == ENOENT && start == 0;
+    }
+
+    // records before `start` are already in the snapshot; a shorter log is not the one it was taken from
+    struct stat status;
+    if (fstat(fd, &status) != 0 || !aof_check_signature(fd, status.st_size) || start > (uint64_t)status.st_size)
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)status.st_size > get_aof_signature_length() ? (size_t)status.st_size : 0;
+    const char *map = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if (map == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    if (map != NULL)
+    {
+        madvise((void *)map, size, MADV_SEQUENTIAL);
+    }
+
+    uint64_t now_ms = aof_now_ms();
+    size_t offset = start > get_aof_signature_length() ? (size_t)start : get_aof_signature_length();
+    bool corrupt = false;
+    while (!corrupt && offset + AOF_RECORD_HEADER <= size)
+    {
+        const char *p = map + offset;
+        uint32_t key_length;
+        uint32_t value_length;
+        storage_journal_record_t record = {.op = (storage_journal_op_t)(uint8_t)p[0]};
+        memcpy(&key_length, p + 1, sizeof(key_length));
+        memcpy(&value_length, p + 5, sizeof(value_length));
+        memcpy(&record.expires_at, p + 9, sizeof(record.expires_at));
+
+        size_t length = AOF_RECORD_HEADER + (size_t)key_length + value_length;
+        if (length > size - offset)
+        {
+            break;
+        }
+        corrupt = record.op > STORAGE_JOURNAL_FLUSH;
+        if (!corrupt)
+        {
+            record.key = p + AOF_RECORD_HEADER;
+            record.key_length = key_length;
+            record.value = record.key + key_length;
+            record.value_length = value_length;
+            aof_apply(storage, &record, now_ms);
+            offset += length;
+            (*records)++;
+        }
+    }
+
+    if (map != NULL)
+    {
+        munmap((void *)map, size);
+    }
+
+    // only a torn last record is cut off, anything else is left for inspection
+    bool loaded = !corrupt && (size == 0 || offset == size || (last && ftruncate(fd, (off_t)offset) == 0));
+    close(fd);
+    return loaded;
+}
+
+/*
+Earlier segments were synced whole before the next one got records, so
+only the last one may end in a torn record.
+*/
+bool aof_load(const char *path, storage_t *storage, uint64_t segment, uint64_t start, uint64_t *last_segment,
+              size_t *records)
+{
+    *records = 0;
+    *last_segment = segment;
+
+    char segment_path[PATH_MAX];
+    char next_path[PATH_MAX];
+    if (!aof_segment_path(path, segment, segment_path, sizeof(segment_path)))
+    {
+        return false;
+    }
+
+    for (;; segment++)
+    {
+        if (!aof_segment_path(path, segment + 1, next_path, sizeof(next_path)))
+        {
+            return false;
+        }
+
+        bool last = access(next_path, F_OK) != 0;
+        if (!aof_load_segment(segment_path, storage, start, last, records))
+        {
+            return false;
+        }
+
+        *last_segment = segment;
+        if (last)
+        {
+            return true;
+        }
+        memcpy(segment_path, next_path, sizeof(segment_path));
+        start = 0;
+    }
+}
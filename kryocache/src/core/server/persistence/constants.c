@@ -0,0 +1,52 @@
+/**
+ * @file constants.c
+ * @brief Persistence constants implementation
+ */
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/constants.h"
+
+// ==================== Append-Only Log Constants ====================
+
+static const char *AOF_FILE_NAME = "appendonly.aof";
+static const char *AOF_SIGNATURE = "KRYOAOF1"; // the trailing digit is the format version
+static const size_t AOF_SIGNATURE_LENGTH = 8;
+static const uint64_t AOF_FSYNC_INTERVAL_MS = 1000;
+static const uint64_t AOF_WRITE_WAIT_MS = 100; // also bounds how late an everysec fsync can be
+static const size_t AOF_WAKE_BYTES = 1048576;
+static const size_t AOF_INITIAL_BUFFER = 65536;
+
+// ==================== Snapshot Constants ====================
+
+static const char *SNAPSHOT_FILE_NAME = "dump.kss";
+static const char *SNAPSHOT_TEMP_FILE_NAME = "dump.kss.tmp";
+static const char *SNAPSHOT_SIGNATURE = "KRYOSNP"; // follows the protocol magic byte
+static const size_t SNAPSHOT_SIGNATURE_LENGTH = 7;
+static const uint32_t SNAPSHOT_VERSION = 4; // 3 had no log segment; 2 no generation, so no deltas; 1 no sections
+static const size_t SNAPSHOT_WRITE_BUFFER = 1048576;
+static const char *SNAPSHOT_MEMORY_STATS_PATH = "/proc/self/smaps_rollup";
+static const char *SNAPSHOT_COW_FIELD = "Private_Dirty:"; // pages that stopped being shared with the parent
+static const uint64_t SNAPSHOT_MAX_DELTAS = 16;    // each is one more file to read on startup
+static const uint64_t SNAPSHOT_MERGE_PERCENT = 50; // deltas this large next to the base are folded into a new one
+
+// ==================== Append-Only Log Constants Getters ====================
+
+const char *get_aof_file_name(void) { return AOF_FILE_NAME; }
+const char *get_aof_signature(void) { return AOF_SIGNATURE; }
+size_t get_aof_signature_length(void) { return AOF_SIGNATURE_LENGTH; }
+uint64_t get_aof_fsync_interval_ms(void) { return AOF_FSYNC_INTERVAL_MS; }
+uint64_t get_aof_write_wait_ms(void) { return AOF_WRITE_WAIT_MS; }
+size_t get_aof_wake_bytes(void) { return AOF_WAKE_BYTES; }
+size_t get_aof_initial_buffer(void) { return AOF_INITIAL_BUFFER; }
+
+// ==================== Snapshot Constants Getters ====================
+
+const char *get_snapshot_file_name(void) { return SNAPSHOT_FILE_NAME; }
+const char *get_snapshot_temp_file_name(void) { return SNAPSHOT_TEMP_FILE_NAME; }
+const char *get_snapshot_signature(void) { return SNAPSHOT_SIGNATURE; }
+size_t get_snapshot_signature_length(void) { return SNAPSHOT_SIGNATURE_LENGTH; }
+uint32_t get_snapshot_version(void) { return SNAPSHOT_VERSION; }
+size_t get_snapshot_write_buffer(void) { return SNAPSHOT_WRITE_BUFFER; }
+const char *get_snapshot_memory_stats_path(void) { return SNAPSHOT_MEMORY_STATS_PATH; }
+const char *get_snapshot_cow_field(void) { return SNAPSHOT_COW_FIELD; }
+uint64_t get_snapshot_max_deltas(void) { return SNAPSHOT_MAX_DELTAS; }
+uint64_t get_snapshot_merge_percent(void) { return SNAPSHOT_MERGE_PERCENT; }
@@ -0,0 +1,153 @@
+/**
+ * @file aof.h
+ * @brief Append-only log of keyspace changes
+ *
+ * Every change the storage journals is encoded as one binary record and
+ * appended to an in-memory buffer; a writer thread drains the buffer of all
+ * connections with one write() and fsyncs by policy, so a burst of writes
+ * costs one disk flush (group commit). Connections never wait for the disk
+ * except under AOF_FSYNC_ALWAYS, where aof_wait() holds back their replies
+ * until their records are durable; whoever gets to fsync first does it for
+ * everything buffered so far.
+ *
+ * Records a write or fsync failed on stay buffered and are retried on the
+ * next drain; until one succeeds the log reports itself unhealthy, so that
+ * writes can be refused instead of acknowledged and lost.
+ *
+ * After the signature, a record is: op (1 byte), key length (4 bytes),
+ * value length (4 bytes), deadline in Unix ms (8 bytes), key, value, in
+ * host byte order. A record cut short by a crash is dropped on load.
+ *
+ * The log is a chain of segments: the file at its path, then path.1,
+ * path.2, ... each starting with the signature. A base snapshot starts a
+ * new segment at the point it is taken and, once it is on disk, removes the
+ * segments before it, so the log only holds what the snapshot lacks.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/storage.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef enum
+    {
+        AOF_FSYNC_EVERYSEC, /**< fsync once a second; a crash loses at most about a second of writes */
+        AOF_FSYNC_ALWAYS,   /**< Replies wait until their records are on disk */
+        AOF_FSYNC_NO        /**< Leave flushing to the kernel */
+    } aof_fsync_policy_t;
+
+    typedef struct aof
+    {
+        int fd;                    /**< Segment being written, used under io_lock */
+        char *path;                /**< Segment 0, segment n is `path`.n */
+        aof_fsync_policy_t fsync_policy;
+        pthread_mutex_t lock;      /**< Guards the fields up to `lost` */
+        pthread_cond_t pending;    /**< Wakes the writer */
+        char *buffer;              /**< Records not taken by the writer yet */
+        size_t length;
+        size_t capacity;
+        uint64_t appended;         /**< Log offset after the last buffered record */
+        uint64_t segment;          /**< Segment new records go to */
+        uint64_t segment_start;    /**< Log offset of the first byte of that segment's file */
+        int next_fd;               /**< Next segment, created ahead of time, -1 = none */
+        int cut_fd;                /**< Segment the writer switches to after the first `cut` buffered bytes, -1 = none */
+        size_t cut;
+        bool failed;               /**< The last write or fsync failed, its records are buffered again */
+        bool lost;                 /**< A record could not be buffered, the log has a gap for good */
+        pthread_mutex_t io_lock;   /**< Serializes draining; guards the fields below */
+        char *spare;               /**< Buffer swapped in for `buffer` while it is written */
+        size_t spare_capacity;
+        uint64_t written;          /**< Log offset after the last written record */
+        uint64_t synced;           /**< Log offset up to which records are on disk */
+        uint64_t last_sync_ms;
+    } aof_t;
+
+    /**
+     * @brief Open segment `segment` of the log at `path` for appending, creating it with a signature if empty
+     * @return NULL when the file cannot be opened or is not a log
+     */
+    aof_t *aof_open(const char *path, uint64_t segment, aof_fsync_policy_t fsync_policy);
+    /**
+     * @brief Write and fsync what is still buffered, then close
+     */
+    void aof_close(aof_t *aof);
+
+    /**
+     * @brief storage_journal_fn appending the change to `arg`, an aof_t
+     */
+    void aof_journal(const storage_journal_record_t *record, void *arg);
+    /**
+     * @brief Under AOF_FSYNC_ALWAYS, make sure the calling thread's records are on disk
+     *
+     * Does not wait under the other policies.
+     * @return false when the calling thread's records may not reach the disk
+     */
+    bool aof_wait(aof_t *aof);
+    /**
+     * @return false while the last write or fsync failed, or after a record was lost
+     */
+    bool aof_healthy(aof_t *aof);
+
+    /**
+     * @brief Wait up to `timeout_ms` for records, then write them and fsync as due
+     *
+     * Meant to be called in a loop by one writer thread. Records a failed
+     * write left buffered are retried once per `timeout_ms`.
+     * @return false when a write or fsync failed
+     */
+    bool aof_write_cycle(aof_t *aof, uint64_t timeout_ms);
+    /**
+     * @brief Write everything appended so far and fsync it
+     * @return false when a write or fsync failed
+     */
+    bool aof_sync(aof_t *aof);
+
+    /**
+     * @brief Create the segment aof_position() starts next, unless it already exists
+     *
+     * Does the file I/O a rotation needs ahead of time; called by one thread at a time.
+     * @return false when the file cannot be created
+     */
+    bool aof_prepare_segment(aof_t *aof);
+    /**
+     * @brief Segment and file offset of the next record appended
+     *
+     * With `rotate` and a prepared segment, the records appended so far end
+     * the current segment and the position is the start of the next one.
+     * Cheap enough to call with the keyspace frozen.
+     */
+    void aof_position(aof_t *aof, bool rotate, uint64_t *segment, uint64_t *offset);
+    /**
+     * @brief Unlink the segments before `segment`
+     */
+    void aof_remove_segments(const aof_t *aof, uint64_t segment);
+
+    /**
+     * @brief Apply the records of the log at `path` to `storage`
+     *
+     * Replays segment `segment` from `start`, then every segment after it.
+     * A missing file is an empty log, unless `start` asks for records in it.
+     * A record cut short at the end of the last segment is truncated away so
+     * that appending can resume after the last whole one. The storage must
+     * not have a journal while the log is replayed.
+     * @param start file offset of the first record to apply, as recorded by a
+     *        snapshot; 0 applies the whole segment
+     * @param last_segment set to the segment appending resumes in
+     * @param records set to the number of records applied
+     * @return false when a file cannot be read or is not a log, or is not
+     *         the one the snapshot was taken from (missing or shorter than `start`)
+     */
+    bool aof_load(const char *path, storage_t *storage, uint64_t segment, uint64_t start, uint64_t *last_segment,
+                  size_t *records);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,42 @@
+/**
+ * @file constants.h
+ * @brief Persistence constants definition header
+ *
+ * File names, on-disk format identifiers, the timing of the append-only
+ * log writer and the buffering of snapshots.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // ==================== Append-Only Log Constants ====================
+    const char *get_aof_file_name(void);      ///< Log file inside the data directory
+    const char *get_aof_signature(void);      ///< First bytes of every log file, version included
+    size_t get_aof_signature_length(void);    ///< Length of get_aof_signature()
+    uint64_t get_aof_fsync_interval_ms(void); ///< Period of fsync under AOF_FSYNC_EVERYSEC
+    uint64_t get_aof_write_wait_ms(void);     ///< Longest the writer sleeps before checking for records
+    size_t get_aof_wake_bytes(void);          ///< Buffered bytes that wake the writer early
+    size_t get_aof_initial_buffer(void);      ///< Initial capacity of the record buffers
+
+    // ==================== Snapshot Constants ====================
+    const char *get_snapshot_file_name(void);          ///< Snapshot file inside the data directory
+    const char *get_snapshot_temp_file_name(void);     ///< File the child writes before renaming it into place
+    const char *get_snapshot_signature(void);          ///< Bytes after the magic byte of every snapshot
+    size_t get_snapshot_signature_length(void);        ///< Length of get_snapshot_signature()
+    uint32_t get_snapshot_version(void);               ///< Format version written, the only one read
+    size_t get_snapshot_write_buffer(void);            ///< Bytes the child buffers per write()
+    const char *get_snapshot_memory_stats_path(void);  ///< Where the child reads its copied memory from
+    const char *get_snapshot_cow_field(void);          ///< Field of that file counting copied memory in kB
+    uint64_t get_snapshot_max_deltas(void);            ///< Deltas written on top of one base before a new base
+    uint64_t get_snapshot_merge_percent(void);         ///< Size of the deltas, relative to the base, that calls for a new base
+
+#ifdef __cplusplus
+}
+#endif
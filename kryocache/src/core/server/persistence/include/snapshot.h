@@ -0,0 +1,161 @@
+/**
+ * @file snapshot.h
+ * @brief Point-in-time snapshots written by a forked child
+ *
+ * The keyspace is frozen just long enough to fork(); the child then owns a
+ * copy-on-write image of it and writes every live key to a temporary file
+ * that replaces the snapshot once it is synced, while the parent keeps
+ * serving. Pages the parent writes meanwhile are copied by the kernel, so
+ * fork time and copied memory are what a snapshot costs the server; both
+ * are kept in the stats.
+ *
+ * The snapshot records the log segment and offset it was taken at: on
+ * startup the snapshot is loaded and only the log records after that point
+ * replayed. A base starts a new log segment as it is taken and removes the
+ * older ones once it is on disk.
+ *
+ * Checkpoints are incremental: the storage tracks which keys each shard
+ * changed, and a checkpoint only writes those to a delta, numbered after
+ * the snapshot file (dump.kss.1, dump.kss.2, ...). A delta records a
+ * deleted key as such and replaces the value of the others. Once the deltas
+ * add up to a good part of the base, a good part of the keys changed or a
+ * dirty set overflowed, the next checkpoint writes a new base instead,
+ * which folds them in; so does the first one after a start. A checkpoint
+ * with no changed keys writes nothing. Loading applies the base, then its
+ * deltas in order, then the log after the last one.
+ *
+ * The file is a snapshot_header_t, one section per storage shard and an
+ * index of the sections at the end, all in host byte order. A record is a
+ * flags byte, the key and value lengths as LEB128 varints, the deadline in
+ * Unix ms (8 bytes) if the flags say there is one, the key and the value.
+ * Each section holds one hash range of the writing process and decodes on
+ * its own, so the child writes them from one thread per CPU, each into a
+ * range of the file reserved up front. The loader maps the file, sorts the
+ * records of every section by the shard they go to in this process, then
+ * fills each shard from its own thread with records that point into the
+ * mapping.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/storage.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/aof.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief First bytes of a snapshot file
+     */
+    typedef struct snapshot_header
+    {
+        uint8_t magic;          /**< get_protocol_magic_byte() */
+        char signature[7];      /**< get_snapshot_signature() */
+        uint32_t version;       /**< get_snapshot_version() */
+        uint32_t section_count; /**< Entries in the index */
+        uint64_t log_segment;   /**< Log segment the snapshot was taken in */
+        uint64_t log_offset;    /**< File offset in that segment the snapshot was taken at */
+        uint64_t index_offset;  /**< Where the index starts, 8-byte aligned; it runs to the end of the file */
+        uint64_t generation;    /**< Identifies a base; its deltas carry the same */
+        uint64_t delta;         /**< 0 for a base, n for its nth delta */
+    } snapshot_header_t;
+
+    /**
+     * @brief Index entry of one section: the records of one storage shard
+     *
+     * Sections are in the file in no particular order.
+     */
+    typedef struct snapshot_section
+    {
+        uint64_t offset;  /**< From the start of the file */
+        uint64_t length;  /**< Bytes of records */
+        uint64_t records; /**< Number of records, checked on load */
+    } snapshot_section_t;
+
+    typedef struct snapshot_stats
+    {
+        uint64_t saves;            /**< Full snapshots written */
+        uint64_t deltas;           /**< Deltas written */
+        uint64_t failures;         /**< Snapshots that could not be forked or written */
+        uint64_t last_fork_us;     /**< Writes were held back this long for the last fork() */
+        uint64_t max_fork_us;
+        uint64_t last_cow_bytes;   /**< Memory the last child had to copy because the parent wrote it */
+        uint64_t last_duration_ms; /**< From fork() to the child's exit, last snapshot */
+        uint64_t last_bytes;       /**< Size of the last file written */
+        uint64_t last_save_time;   /**< Unix time in seconds of the last snapshot written, 0 = none */
+        bool in_progress;
+    } snapshot_stats_t;
+
+    typedef struct snapshot
+    {
+        char *path;                /**< The snapshot */
+        char *temp_path;           /**< Written by the child, renamed to `path` when complete */
+        char *directory;           /**< Synced after the rename */
+        storage_t *storage;
+        aof_t *aof;                /**< Log the snapshot records its offset in, may be NULL */
+        pthread_mutex_t lock;      /**< Guards the fields below */
+        pthread_cond_t finished;   /**< Signalled when a child was reaped */
+        bool last_ok;              /**< Outcome of the last snapshot */
+        uint64_t generation;       /**< Of the base the next delta extends, 0 = the next checkpoint writes a base */
+        uint64_t delta_count;      /**< Deltas written on top of that base */
+        uint64_t base_bytes;
+        uint64_t delta_bytes;      /**< Of all those deltas */
+        snapshot_stats_t stats;
+    } snapshot_t;
+
+    /**
+     * @brief Prepare snapshots of `storage` into `directory`
+     * @return NULL when out of memory
+     */
+    snapshot_t *snapshot_create(const char *directory, storage_t *storage, aof_t *aof);
+    /**
+     * @brief Wait for a running child, then free
+     */
+    void snapshot_destroy(snapshot_t *snapshot);
+
+    /**
+     * @brief Fork a child writing a snapshot and return (BGSAVE)
+     * @return false when a snapshot is already running or fork() failed
+     */
+    bool snapshot_start(snapshot_t *snapshot);
+    /**
+     * @brief Write a snapshot of the keyspace as of now and wait for it (SAVE)
+     *
+     * Only the calling thread waits; the server keeps serving meanwhile.
+     * @return false when the snapshot could not be written
+     */
+    bool snapshot_save(snapshot_t *snapshot);
+    /**
+     * @brief Fork a child writing the keys changed since the last snapshot and return
+     *
+     * Writes a full snapshot instead when the storage does not track
+     * changed keys or the deltas are due to be folded into a new base.
+     * Does nothing, without forking, when the delta would be empty.
+     * @return false when a snapshot is already running or fork() failed
+     */
+    bool snapshot_checkpoint(snapshot_t *snapshot);
+    void snapshot_get_stats(snapshot_t *snapshot, snapshot_stats_t *stats);
+
+    /**
+     * @brief Apply the snapshot at `path` and its deltas to `storage`
+     *
+     * A missing file is an empty snapshot taken at the start of the log.
+     * Deltas of another base are left alone.
+     * @param log_segment set to the log segment the last file applied was taken in
+     * @param log_offset set to the file offset in that segment it was taken at
+     * @param records set to the number of records applied
+     * @return false when the file cannot be read or is not a whole snapshot
+     */
+    bool snapshot_load(const char *path, storage_t *storage, uint64_t *log_segment, uint64_t *log_offset,
+                       size_t *records);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,1081 @@
+/**
+ * @file snapshot.c
+ * @brief Forked snapshot writer and loader
+ */
+
+#define _GNU_SOURCE // pipe2()
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/snapshot.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/constants.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/include/constants.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define SNAPSHOT_RECORD_EXPIRES 0x01 // record flag: a deadline follows the lengths
+#define SNAPSHOT_RECORD_DELETED 0x02 // record flag: a delta deletes the key, there is no value
+#define SNAPSHOT_VARINT_MAX 10       // bytes of a 64-bit LEB128 number
+#define SNAPSHOT_LOAD_BATCH 256      // records parsed per storage_restore()
+#define SNAPSHOT_RECORD_HEADER_MAX (1 + 2 * SNAPSHOT_VARINT_MAX + sizeof(uint64_t))
+
+// records of one section, batched into one buffer per pwrite()
+typedef struct snapshot_writer
+{
+    int fd;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    uint64_t position; /**< Where the buffer goes in the file */
+    uint64_t records;
+    bool failed;
+} snapshot_writer_t;
+
+// shared by the threads of the child writing the sections
+typedef struct snapshot_write_job
+{
+    storage_t *storage;
+    int fd;
+    uint64_t now_ms;              /**< Keys expired by then are left out */
+    _Atomic uint64_t end;         /**< Where the next section is placed */
+    snapshot_section_t *sections; /**< The index, one entry per shard */
+    const storage_dirty_t *dirty; /**< For a delta, the keys each shard changed; NULL for a base */
+} snapshot_write_job_t;
+
+// shared by the threads loading a snapshot
+typedef struct snapshot_load_job
+{
+    storage_t *storage;
+    const uint8_t *map;
+    const snapshot_section_t *sections;
+    size_t section_count;
+    size_t shard_count;
+    uint64_t **offsets;     /**< Per section, file offsets of its records grouped by the shard they go to */
+    size_t **starts;        /**< Per section, shard_count + 1 bounds of those groups */
+    atomic_size_t records;  /**< Records handled so far */
+} snapshot_load_job_t;
+
+// a child being waited for by its reaper thread
+typedef struct snapshot_child
+{
+    snapshot_t *snapshot;
+    pid_t pid;
+    int report_fd;       /**< Read end of the pipe the child reports through */
+    uint64_t started_ms;
+    bool delta;
+    uint64_t generation; /**< Of the base written or extended */
+} snapshot_child_t;
+
+// state of the fork done while the keyspace is frozen
+typedef struct snapshot_fork
+{
+    snapshot_t *snapshot;
+    int report_fd;           /**< Write end of the report pipe */
+    bool delta;              /**< Asked for a delta, cleared when a base has to be written */
+    uint64_t generation;     /**< Of the base written or extended */
+    uint64_t sequence;       /**< Number of the delta */
+    uint64_t log_segment;    /**< Log position the snapshot is taken at */
+    uint64_t log_offset;
+    storage_dirty_t *dirty;  /**< One per shard, taken while frozen; NULL when the storage tracks none */
+    bool idle;               /**< Nothing changed since the base or delta this one would extend, no fork */
+    pid_t pid;
+} snapshot_fork_t;
+
+// what the child sends back before it exits
+typedef struct snapshot_report
+{
+    uint64_t cow_bytes;  /**< Memory it had to copy because the parent wrote it */
+    uint64_t file_bytes; /**< Size of the file written */
+} snapshot_report_t;
+
+static uint64_t snapshot_monotonic_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+// Unix time in µs, a fresh base's generation
+static uint64_t snapshot_realtime_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static char *snapshot_join_path(const char *directory, const char *name)
+{
+    size_t length = strlen(directory) + strlen(name) + 2;
+    char *path = malloc(length);
+    if (path != NULL)
+    {
+        snprintf(path, length, "%s/%s", directory, name);
+    }
+    return path;
+}
+
+snapshot_t *snapshot_create(const char *directory, storage_t *storage, aof_t *aof)
+{
+    snapshot_t *snapshot = calloc(1, sizeof(snapshot_t));
+    if (snapshot == NULL)
+    {
+        return NULL;
+    }
+
+    snapshot->path = snapshot_join_path(directory, get_snapshot_file_name());
+    snapshot->temp_path = snapshot_join_path(directory, get_snapshot_temp_file_name());
+    snapshot->directory = strdup(directory);
+    if (snapshot->path == NULL || snapshot->temp_path == NULL || snapshot->directory == NULL ||
+        pthread_mutex_init(&snapshot->lock, NULL) != 0)
+    {
+        free(snapshot->path);
+        free(snapshot->temp_path);
+        free(snapshot->directory);
+        free(snapshot);
+        return NULL;
+    }
+
+    if (pthread_cond_init(&snapshot->finished, NULL) != 0)
+    {
+        pthread_mutex_destroy(&snapshot->lock);
+        free(snapshot->path);
+        free(snapshot->temp_path);
+        free(snapshot->directory);
+        free(snapshot);
+        return NULL;
+    }
+
+    snapshot->storage = storage;
+    snapshot->aof = aof;
+    return snapshot;
+}
+
+// caller holds snapshot->lock
+static void snapshot_wait_locked(snapshot_t *snapshot)
+{
+    while (snapshot->stats.in_progress)
+    {
+        pthread_cond_wait(&snapshot->finished, &snapshot->lock);
+    }
+}
+
+void snapshot_destroy(snapshot_t *snapshot)
+{
+    if (snapshot == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&snapshot->lock);
+    snapshot_wait_locked(snapshot);
+    pthread_mutex_unlock(&snapshot->lock);
+
+    pthread_cond_destroy(&snapshot->finished);
+    pthread_mutex_destroy(&snapshot->lock);
+    free(snapshot->path);
+    free(snapshot->temp_path);
+    free(snapshot->directory);
+    free(snapshot);
+}
+
+// ==================== Tasks ====================
+
+/*
+Tasks are handed out through a shared counter to one thread per online CPU,
+the calling thread being one of them. Whatever threads cannot be started,
+the others pick up the work; the first failure stops the handing out.
+*/
+typedef struct snapshot_tasks
+{
+    size_t count;
+    atomic_size_t next;
+    atomic_bool failed;
+    bool (*fn)(size_t index, void *arg);
+    void *arg;
+} snapshot_tasks_t;
+
+static void *snapshot_tasks_worker(void *arg)
+{
+    snapshot_tasks_t *tasks = arg;
+    while (!atomic_load_explicit(&tasks->failed, memory_order_relaxed))
+    {
+        size_t index = atomic_fetch_add_explicit(&tasks->next, 1, memory_order_relaxed);
+        if (index >= tasks->count)
+        {
+            break;
+        }
+        if (!tasks->fn(index, tasks->arg))
+        {
+            atomic_store_explicit(&tasks->failed, true, memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+static bool snapshot_run_tasks(size_t count, bool (*fn)(size_t index, void *arg), void *arg)
+{
+    snapshot_tasks_t tasks = {.count = count, .fn = fn, .arg = arg};
+    atomic_init(&tasks.next, 0);
+    atomic_init(&tasks.failed, false);
+
+    long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t helpers = online_cpus > 1 ? (size_t)online_cpus - 1 : 0;
+    helpers = helpers < count ? helpers : (count > 0 ? count - 1 : 0);
+    pthread_t *threads = helpers > 0 ? malloc(helpers * sizeof(pthread_t)) : NULL;
+    size_t started = 0;
+    while (threads != NULL && started < helpers &&
+           pthread_create(&threads[started], NULL, snapshot_tasks_worker, &tasks) == 0)
+    {
+        started++;
+    }
+
+    snapshot_tasks_worker(&tasks);
+    for (size_t i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    return !atomic_load_explicit(&tasks.failed, memory_order_relaxed);
+}
+
+// ==================== Child ====================
+
+static bool snapshot_write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written < 0)
+        {
+            return false;
+        }
+
+        data += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+static bool snapshot_pwrite_all(int fd, const void *data, size_t length, uint64_t position)
+{
+    const char *bytes = data;
+    while (length > 0)
+    {
+        ssize_t written = pwrite(fd, bytes, length, (off_t)position);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+
+        bytes += written;
+        position += (uint64_t)written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+static bool snapshot_flush(snapshot_writer_t *writer)
+{
+    writer->failed = writer->failed || !snapshot_pwrite_all(writer->fd, writer->buffer, writer->length, writer->position);
+    writer->position += writer->length;
+    writer->length = 0;
+    return !writer->failed;
+}
+
+static void snapshot_append(snapshot_writer_t *writer, const void *data, size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+    if (writer->capacity - writer->length < length && !snapshot_flush(writer))
+    {
+        return;
+    }
+
+    // a value larger than the buffer goes out directly
+    if (length > writer->capacity)
+    {
+        writer->failed = !snapshot_pwrite_all(writer->fd, data, length, writer->position);
+        writer->position += length;
+        return;
+    }
+
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+static size_t snapshot_put_varint(uint8_t *out, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+// flags, key length and value length as varints, the deadline if any
+static size_t snapshot_record_header(const storage_journal_record_t *record, uint8_t *header)
+{
+    size_t length = 1;
+    header[0] = (record->expires_at != 0 ? SNAPSHOT_RECORD_EXPIRES : 0) |
+                (record->op == STORAGE_JOURNAL_DELETE ? SNAPSHOT_RECORD_DELETED : 0);
+    length += snapshot_put_varint(header + length, record->key_length);
+    length += snapshot_put_varint(header + length, record->value_length);
+    if (record->expires_at != 0)
+    {
+        memcpy(header + length, &record->expires_at, sizeof(record->expires_at));
+        length += sizeof(record->expires_at);
+    }
+    return length;
+}
+
+static void snapshot_size_record(const storage_journal_record_t *record, void *arg)
+{
+    snapshot_section_t *section = arg;
+    uint8_t header[SNAPSHOT_RECORD_HEADER_MAX];
+    section->length += snapshot_record_header(record, header) + record->key_length + record->value_length;
+    section->records++;
+}
+
+static void snapshot_write_record(const storage_journal_record_t *record, void *arg)
+{
+    snapshot_writer_t *writer = arg;
+    uint8_t header[SNAPSHOT_RECORD_HEADER_MAX];
+    snapshot_append(writer, header, snapshot_record_header(record, header));
+    snapshot_append(writer, record->key, record->key_length);
+    snapshot_append(writer, record->value, record->value_length);
+    writer->records++;
+}
+
+// a base holds every key of the shard, a delta the ones it changed
+static void snapshot_dump_section(snapshot_write_job_t *job, size_t index, storage_journal_fn fn, void *arg)
+{
+    if (job->dirty != NULL)
+    {
+        storage_dump_dirty(job->storage, &job->dirty[index], job->now_ms, fn, arg);
+    }
+    else
+    {
+        storage_dump(job->storage, index, job->now_ms, fn, arg);
+    }
+}
+
+/*
+A shard is walked twice: once to learn the size of its section, which
+reserves it a range of the file, and once to write into that range. The
+child changes nothing, so both walks see the same keys.
+*/
+static bool snapshot_write_section(size_t index, void *arg)
+{
+    snapshot_write_job_t *job = arg;
+    snapshot_section_t *section = &job->sections[index];
+    snapshot_dump_section(job, index, snapshot_size_record, section);
+    section->offset = atomic_fetch_add_explicit(&job->end, section->length, memory_order_relaxed);
+    if (section->records == 0)
+    {
+        return true;
+    }
+
+    snapshot_writer_t writer = {.fd = job->fd, .position = section->offset};
+    writer.capacity = section->length < get_snapshot_write_buffer() ? (size_t)section->length
+                                                                     : get_snapshot_write_buffer();
+    writer.buffer = malloc(writer.capacity);
+    if (writer.buffer == NULL)
+    {
+        return false;
+    }
+
+    snapshot_dump_section(job, index, snapshot_write_record, &writer);
+    bool written = snapshot_flush(&writer) && writer.records == section->records &&
+                   writer.position == section->offset + section->length;
+    free(writer.buffer);
+    return written;
+}
+
+static bool snapshot_sync_directory(const char *directory)
+{
+    int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+
+// the nth delta of the snapshot at `base` is `base`.n
+static bool snapshot_delta_path(const char *base, uint64_t delta, char *path, size_t size)
+{
+    int length = snprintf(path, size, "%s.%" PRIu64, base, delta);
+    return length > 0 && (size_t)length < size;
+}
+
+// a new base makes the deltas of the previous one stale; they are numbered from 1 without gaps
+static void snapshot_remove_deltas(const snapshot_t *snapshot)
+{
+    char path[PATH_MAX];
+    uint64_t delta = 1;
+    while (snapshot_delta_path(snapshot->path, delta, path, sizeof(path)) && unlink(path) == 0)
+    {
+        delta++;
+    }
+}
+
+/*
+Runs in the child, which has the storage to itself: the threads of the
+parent do not exist here. Each shard becomes one section, written by
+whichever thread of the child takes it. The index is only known at the
+end: it goes after the last section and the header, which points at it,
+is written before the file is synced. The old snapshot is only replaced
+by a complete, synced one; a delta is written the same way. The log
+segments a base covers are removed once the rename is on disk.
+*/
+static bool snapshot_write(snapshot_t *snapshot, const snapshot_fork_t *fork_state, uint64_t *file_bytes)
+{
+    storage_t *storage = snapshot->storage;
+    char delta_path[PATH_MAX];
+    if (fork_state->delta && !snapshot_delta_path(snapshot->path, fork_state->sequence, delta_path, sizeof(delta_path)))
+    {
+        return false;
+    }
+
+    snapshot_write_job_t job = {
+        .storage = storage,
+        .now_ms = snapshot_realtime_us() / 1000,
+        .sections = calloc(storage->shard_count, sizeof(snapshot_section_t)),
+        .dirty = fork_state->delta ? fork_state->dirty : NULL};
+    atomic_init(&job.end, sizeof(snapshot_header_t));
+    job.fd = open(snapshot->temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (job.sections == NULL || job.fd < 0)
+    {
+        free(job.sections);
+        if (job.fd >= 0)
+        {
+            close(job.fd);
+        }
+        return false;
+    }
+
+    snapshot_header_t header = {
+        .magic = get_protocol_magic_byte(),
+        .version = get_snapshot_version(),
+        .section_count = (uint32_t)storage->shard_count,
+        .log_segment = fork_state->log_segment,
+        .log_offset = fork_state->log_offset,
+        .generation = fork_state->generation,
+        .delta = fork_state->delta ? fork_state->sequence : 0};
+    memcpy(header.signature, get_snapshot_signature(), get_snapshot_signature_length());
+    bool written = snapshot_run_tasks(storage->shard_count, snapshot_write_section, &job);
+
+    // the index is 8-byte aligned, so the loader reads it in place from the mapping
+    uint64_t end = atomic_load_explicit(&job.end, memory_order_relaxed);
+    header.index_offset = (end + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+    *file_bytes = header.index_offset + storage->shard_count * sizeof(snapshot_section_t);
+    written = written &&
+              snapshot_pwrite_all(job.fd, job.sections, storage->shard_count * sizeof(snapshot_section_t),
+                                  header.index_offset) &&
+              snapshot_pwrite_all(job.fd, &header, sizeof(header), 0) && fsync(job.fd) == 0;
+    written = close(job.fd) == 0 && written;
+    free(job.sections);
+
+    bool replaced = written && rename(snapshot->temp_path, fork_state->delta ? delta_path : snapshot->path) == 0;
+    if (replaced && !fork_state->delta)
+    {
+        snapshot_remove_deltas(snapshot);
+    }
+    replaced = replaced && snapshot_sync_directory(snapshot->directory);
+    if (replaced && !fork_state->delta && snapshot->aof != NULL)
+    {
+        aof_remove_segments(snapshot->aof, fork_state->log_segment);
+    }
+    return replaced;
+}
+
+// memory of the child that is no longer shared with the parent, 0 when unknown
+static uint64_t snapshot_cow_bytes(void)
+{
+    int fd = open(get_snapshot_memory_stats_path(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    char text[4096];
+    ssize_t length = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (length <= 0)
+    {
+        return 0;
+    }
+    text[length] = '\0';
+
+    const char *field = strstr(text, get_snapshot_cow_field());
+    return field != NULL ? strtoull(field + strlen(get_snapshot_cow_field()), NULL, 10) * 1024 : 0;
+}
+
+/*
+Runs with every shard locked. The dirty sets are taken at the same point
+the child's image is, so the next delta starts exactly where this one
+ends. A delta needs every set intact, and is not worth it once a good
+part of the keys changed: a base then costs about the same. With every
+set intact and empty there is nothing to write, so an idle server pays
+neither the fork nor a file that counts toward the next base. A base also
+starts a new log segment here, so the log before it can go with the old
+base. Once the child is forked the parent returns at once; the child
+writes the snapshot, reports back and exits without running any of the
+parent's exit handlers.
+*/
+static void snapshot_fork(void *arg)
+{
+    snapshot_fork_t *fork_state = arg;
+    snapshot_t *snapshot = fork_state->snapshot;
+    storage_t *storage = snapshot->storage;
+
+    size_t changed = 0;
+    size_t keys = 0;
+    for (size_t i = 0; fork_state->dirty != NULL && i < storage->shard_count; i++)
+    {
+        storage_take_dirty(storage, i, &fork_state->dirty[i]);
+        fork_state->delta = fork_state->delta && !fork_state->dirty[i].overflowed;
+        changed += fork_state->dirty[i].count;
+        keys += storage->shards[i].size;
+    }
+    fork_state->delta = fork_state->delta && fork_state->dirty != NULL;
+    fork_state->idle = fork_state->delta && changed == 0;
+    fork_state->delta = fork_state->delta && changed * 100 < keys * get_snapshot_merge_percent();
+    if (fork_state->idle)
+    {
+        return;
+    }
+
+    if (snapshot->aof != NULL)
+    {
+        aof_position(snapshot->aof, !fork_state->delta, &fork_state->log_segment, &fork_state->log_offset);
+    }
+
+    fork_state->pid = fork();
+    if (fork_state->pid != 0)
+    {
+        return;
+    }
+
+    snapshot_report_t report = {0};
+    bool written = snapshot_write(snapshot, fork_state, &report.file_bytes);
+    report.cow_bytes = snapshot_cow_bytes();
+    written = snapshot_write_all(fork_state->report_fd, (const char *)&report, sizeof(report)) && written;
+    _exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// ==================== Parent ====================
+
+/*
+Whatever the outcome, the dirty sets the child started from are gone: a
+failed snapshot leaves changes no delta knows of, so the next one is a
+new base.
+*/
+static void snapshot_finish(const snapshot_child_t *child, bool ok, const snapshot_report_t *report,
+                            uint64_t duration_ms)
+{
+    snapshot_t *snapshot = child->snapshot;
+    pthread_mutex_lock(&snapshot->lock);
+    snapshot->last_ok = ok;
+    snapshot->stats.saves += ok && !child->delta ? 1 : 0;
+    snapshot->stats.deltas += ok && child->delta ? 1 : 0;
+    snapshot->stats.failures += ok ? 0 : 1;
+    snapshot->stats.last_cow_bytes = report->cow_bytes;
+    snapshot->stats.last_duration_ms = duration_ms;
+    snapshot->stats.last_bytes = ok ? report->file_bytes : snapshot->stats.last_bytes;
+    snapshot->stats.last_save_time = ok ? (uint64_t)time(NULL) : snapshot->stats.last_save_time;
+    snapshot->stats.in_progress = false;
+
+    if (!ok)
+    {
+        snapshot->generation = 0;
+    }
+    else if (child->delta)
+    {
+        snapshot->delta_count++;
+        snapshot->delta_bytes += report->file_bytes;
+    }
+    else
+    {
+        snapshot->generation = child->generation;
+        snapshot->delta_count = 0;
+        snapshot->delta_bytes = 0;
+        snapshot->base_bytes = report->file_bytes;
+    }
+
+    pthread_cond_broadcast(&snapshot->finished);
+    pthread_mutex_unlock(&snapshot->lock);
+}
+
+// a snapshot that failed before there was a child to reap
+static void snapshot_fail(snapshot_t *snapshot)
+{
+    snapshot_child_t child = {.snapshot = snapshot};
+    snapshot_report_t report = {0};
+    snapshot_finish(&child, false, &report, 0);
+}
+
+static void *snapshot_reap(void *arg)
+{
+    snapshot_child_t child = *(snapshot_child_t *)arg;
+    free(arg);
+
+    snapshot_report_t report = {0};
+    ssize_t length;
+    do
+    {
+        length = read(child.report_fd, &report, sizeof(report));
+    } while (length < 0 && errno == EINTR);
+    close(child.report_fd);
+
+    int status = 0;
+    pid_t reaped;
+    do
+    {
+        reaped = waitpid(child.pid, &status, 0);
+    } while (reaped < 0 && errno == EINTR);
+
+    bool ok = reaped == child.pid && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS &&
+              length == sizeof(report);
+    snapshot_finish(&child, ok, &report, snapshot_monotonic_us() / 1000 - child.started_ms);
+    return NULL;
+}
+
+/*
+The child is reaped by a detached thread, so neither SAVE nor BGSAVE ties
+up anything but the caller. `busy` tells a snapshot already running apart
+from a failed fork(). A delta extends the current base until the deltas
+are due to be folded into a new one; one with nothing to write is
+dropped without touching the chain or the stats.
+*/
+static bool snapshot_begin(snapshot_t *snapshot, bool delta, bool *busy)
+{
+    pthread_mutex_lock(&snapshot->lock);
+    *busy = snapshot->stats.in_progress;
+    snapshot->stats.in_progress = true;
+    delta = delta && snapshot->generation != 0 && snapshot->delta_count < get_snapshot_max_deltas() &&
+            snapshot->delta_bytes * 100 < snapshot->base_bytes * get_snapshot_merge_percent();
+    snapshot_fork_t fork_state = {
+        .snapshot = snapshot,
+        .delta = delta,
+        .generation = delta ? snapshot->generation : snapshot_realtime_us(),
+        .sequence = snapshot->delta_count + 1};
+    pthread_mutex_unlock(&snapshot->lock);
+    if (*busy)
+    {
+        return false;
+    }
+
+    int report[2];
+    storage_t *storage = snapshot->storage;
+    snapshot_child_t *child = malloc(sizeof(snapshot_child_t));
+    fork_state.dirty = storage->track_dirty ? calloc(storage->shard_count, sizeof(storage_dirty_t)) : NULL;
+    if (child == NULL || (storage->track_dirty && fork_state.dirty == NULL) || pipe2(report, O_CLOEXEC) != 0)
+    {
+        free(child);
+        free(fork_state.dirty);
+        snapshot_fail(snapshot);
+        return false;
+    }
+
+    // a failure only means this base does not start a new log segment
+    if (snapshot->aof != NULL)
+    {
+        aof_prepare_segment(snapshot->aof);
+    }
+
+    fork_state.report_fd = report[1];
+    uint64_t started_us = snapshot_monotonic_us();
+    storage_freeze(storage, snapshot_fork, &fork_state);
+    uint64_t fork_us = snapshot_monotonic_us() - started_us;
+    close(report[1]);
+
+    // the child works from its own copy of the dirty sets
+    for (size_t i = 0; fork_state.dirty != NULL && i < storage->shard_count; i++)
+    {
+        storage_dirty_release(&fork_state.dirty[i]);
+    }
+    free(fork_state.dirty);
+
+    if (fork_state.idle)
+    {
+        close(report[0]);
+        free(child);
+        pthread_mutex_lock(&snapshot->lock);
+        snapshot->stats.in_progress = false;
+        pthread_cond_broadcast(&snapshot->finished);
+        pthread_mutex_unlock(&snapshot->lock);
+        return true;
+    }
+    if (fork_state.pid < 0)
+    {
+        close(report[0]);
+        free(child);
+        snapshot_fail(snapshot);
+        return false;
+    }
+
+    pthread_mutex_lock(&snapshot->lock);
+    snapshot->stats.last_fork_us = fork_us;
+    snapshot->stats.max_fork_us = fork_us > snapshot->stats.max_fork_us ? fork_us : snapshot->stats.max_fork_us;
+    pthread_mutex_unlock(&snapshot->lock);
+
+    *child = (snapshot_child_t){
+        .snapshot = snapshot,
+        .pid = fork_state.pid,
+        .report_fd = report[0],
+        .started_ms = started_us / 1000,
+        .delta = fork_state.delta,
+        .generation = fork_state.generation};
+
+    pthread_t reaper;
+    pthread_attr_t attr;
+    bool detached = pthread_attr_init(&attr) == 0;
+    detached = detached && pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) == 0 &&
+               pthread_create(&reaper, &attr, snapshot_reap, child) == 0;
+    pthread_attr_destroy(&attr);
+    if (!detached)
+    {
+        snapshot_reap(child);
+    }
+    return true;
+}
+
+bool snapshot_start(snapshot_t *snapshot)
+{
+    bool busy;
+    return snapshot_begin(snapshot, false, &busy);
+}
+
+bool snapshot_checkpoint(snapshot_t *snapshot)
+{
+    bool busy;
+    return snapshot_begin(snapshot, true, &busy);
+}
+
+/*
+A snapshot already running may have been forked before the call, so it
+is waited for and a new one started. Should another caller start one
+first, that one is recent enough and its outcome is reported instead.
+*/
+bool snapshot_save(snapshot_t *snapshot)
+{
+    pthread_mutex_lock(&snapshot->lock);
+    snapshot_wait_locked(snapshot);
+    pthread_mutex_unlock(&snapshot->lock);
+
+    bool busy;
+    if (!snapshot_begin(snapshot, false, &busy) && !busy)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&snapshot->lock);
+    snapshot_wait_locked(snapshot);
+    bool ok = snapshot->last_ok;
+    pthread_mutex_unlock(&snapshot->lock);
+    return ok;
+}
+
+void snapshot_get_stats(snapshot_t *snapshot, snapshot_stats_t *stats)
+{
+    pthread_mutex_lock(&snapshot->lock);
+    *stats = snapshot->stats;
+    pthread_mutex_unlock(&snapshot->lock);
+}
+
+// ==================== Loader ====================
+
+static bool snapshot_get_varint(const uint8_t **cursor, const uint8_t *end, uint64_t *value)
+{
+    *value = 0;
+    for (unsigned shift = 0; *cursor < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *(*cursor)++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+Records point into the mapping, nothing is copied or allocated to parse
+them: the storage copies keys and values once, into their entries.
+*/
+static bool snapshot_parse_record(const uint8_t **cursor, const uint8_t *end, storage_journal_record_t *record)
+{
+    uint8_t flags = *(*cursor)++;
+    uint64_t key_length;
+    uint64_t value_length;
+    *record = (storage_journal_record_t){
+        .op = (flags & SNAPSHOT_RECORD_DELETED) != 0 ? STORAGE_JOURNAL_DELETE : STORAGE_JOURNAL_SET};
+    if (!snapshot_get_varint(cursor, end, &key_length) || !snapshot_get_varint(cursor, end, &value_length))
+    {
+        return false;
+    }
+    if ((flags & SNAPSHOT_RECORD_EXPIRES) != 0)
+    {
+        if ((size_t)(end - *cursor) < sizeof(record->expires_at))
+        {
+            return false;
+        }
+        memcpy(&record->expires_at, *cursor, sizeof(record->expires_at));
+        *cursor += sizeof(record->expires_at);
+    }
+    if (key_length > (uint64_t)(end - *cursor) || value_length > (uint64_t)(end - *cursor) - key_length)
+    {
+        return false;
+    }
+
+    record->key = (const char *)*cursor;
+    record->key_length = (size_t)key_length;
+    record->value = record->key + key_length;
+    record->value_length = (size_t)value_length;
+    *cursor += key_length + value_length;
+    return true;
+}
+
+/*
+Sections are split by the shards of the process that wrote them, whose
+hashes had another seed: the keys of one section go to every shard here.
+Each section is first parsed and its records sorted by the shard they go
+to, then every shard is filled by one thread, which has its lock to
+itself.
+*/
+static bool snapshot_route_section(size_t index, void *arg)
+{
+    snapshot_load_job_t *job = arg;
+    const snapshot_section_t *section = &job->sections[index];
+    const uint8_t *start = job->map + section->offset;
+    const uint8_t *end = start + section->length;
+    size_t count = (size_t)section->records;
+    uint32_t *shards = malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+    job->offsets[index] = malloc((count > 0 ? count : 1) * sizeof(uint64_t));
+    job->starts[index] = calloc(job->shard_count + 1, sizeof(size_t));
+    if (shards == NULL || job->offsets[index] == NULL || job->starts[index] == NULL)
+    {
+        free(shards);
+        return false;
+    }
+
+    size_t *starts = job->starts[index];
+    size_t parsed = 0;
+    storage_journal_record_t record;
+    for (const uint8_t *cursor = start; cursor < end; parsed++)
+    {
+        if (parsed == count || !snapshot_parse_record(&cursor, end, &record))
+        {
+            free(shards);
+            return false;
+        }
+        shards[parsed] = (uint32_t)storage_shard_of(job->storage, record.key, record.key_length);
+        starts[shards[parsed] + 1]++;
+    }
+    if (parsed != count)
+    {
+        free(shards);
+        return false;
+    }
+
+    // counting sort: starts[s] is where the records of shard s begin
+    for (size_t shard = 0; shard < job->shard_count; shard++)
+    {
+        starts[shard + 1] += starts[shard];
+    }
+    size_t *next = starts;
+    const uint8_t *cursor = start;
+    for (size_t i = 0; i < count; i++)
+    {
+        job->offsets[index][next[shards[i]]++] = (uint64_t)(cursor - job->map);
+        snapshot_parse_record(&cursor, end, &record);
+    }
+    // each start moved up to the next one; move them back
+    memmove(starts + 1, starts, job->shard_count * sizeof(size_t));
+    starts[0] = 0;
+
+    free(shards);
+    return true;
+}
+
+static bool snapshot_load_shard(size_t index, void *arg)
+{
+    snapshot_load_job_t *job = arg;
+    storage_journal_record_t batch[SNAPSHOT_LOAD_BATCH];
+    size_t count = 0;
+    size_t handled = 0;
+
+    for (size_t section = 0; section < job->section_count; section++)
+    {
+        const uint8_t *end = job->map + job->sections[section].offset + job->sections[section].length;
+        for (size_t i = job->starts[section][index]; i < job->starts[section][index + 1]; i++)
+        {
+            const uint8_t *cursor = job->map + job->offsets[section][i];
+            snapshot_parse_record(&cursor, end, &batch[count++]);
+            if (count == SNAPSHOT_LOAD_BATCH)
+            {
+                if (storage_restore(job->storage, batch, count) != count)
+                {
+                    return false;
+                }
+                handled += count;
+                count = 0;
+            }
+        }
+    }
+
+    bool restored = storage_restore(job->storage, batch, count) == count;
+    atomic_fetch_add_explicit(&job->records, handled + count, memory_order_relaxed);
+    return restored;
+}
+
+static bool snapshot_load_sections(snapshot_load_job_t *job)
+{
+    job->offsets = calloc(job->section_count, sizeof(uint64_t *));
+    job->starts = calloc(job->section_count, sizeof(size_t *));
+    bool loaded = job->offsets != NULL && job->starts != NULL &&
+                  snapshot_run_tasks(job->section_count, snapshot_route_section, job) &&
+                  snapshot_run_tasks(job->shard_count, snapshot_load_shard, job);
+
+    for (size_t i = 0; job->offsets != NULL && job->starts != NULL && i < job->section_count; i++)
+    {
+        free(job->offsets[i]);
+        free(job->starts[i]);
+    }
+    free(job->offsets);
+    free(job->starts);
+    return loaded;
+}
+
+/*
+The header and the index are checked before anything is applied, so a
+file that is not a whole snapshot of this version leaves the storage as
+it was; the sections then only have to be consistent with themselves.
+A delta is only applied on top of its own base, as its nth delta: a
+missing file or one of another base ends the chain and `applied` stays
+false.
+*/
+static bool snapshot_load_file(const char *path, storage_t *storage, uint64_t generation, uint64_t delta,
+                               snapshot_header_t *header, size_t *records, bool *applied)
+{
+    *applied = false;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return errno == ENOENT;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(snapshot_header_t))
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)status.st_size;
+    const uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise((void *)map, size, MADV_WILLNEED);
+
+    memcpy(header, map, sizeof(*header));
+    bool valid = header->magic == get_protocol_magic_byte() &&
+                 memcmp(header->signature, get_snapshot_signature(), get_snapshot_signature_length()) == 0 &&
+                 header->version == get_snapshot_version() && header->index_offset >= sizeof(*header) &&
+                 header->index_offset <= size && header->index_offset % sizeof(uint64_t) == 0 &&
+                 (size - header->index_offset) == (uint64_t)header->section_count * sizeof(snapshot_section_t);
+    if (valid && delta > 0 && (header->generation != generation || header->delta != delta))
+    {
+        munmap((void *)map, size);
+        return true;
+    }
+    valid = valid && header->delta == delta;
+
+    // a record takes at least three bytes, which also bounds what routing allocates
+    const snapshot_section_t *sections = valid ? (const snapshot_section_t *)(map + header->index_offset) : NULL;
+    uint64_t total = 0;
+    for (uint32_t i = 0; valid && i < header->section_count; i++)
+    {
+        valid = sections[i].offset >= sizeof(*header) && sections[i].offset <= header->index_offset &&
+                sections[i].length <= header->index_offset - sections[i].offset &&
+                sections[i].records <= sections[i].length / 3;
+        total += sections[i].records;
+    }
+
+    snapshot_load_job_t job = {
+        .storage = storage,
+        .map = map,
+        .sections = sections,
+        .section_count = header->section_count,
+        .shard_count = storage->shard_count};
+    atomic_init(&job.records, 0);
+    if (valid && delta == 0)
+    {
+        storage_reserve_keys(storage, (size_t)total);
+    }
+    valid = valid && snapshot_load_sections(&job);
+
+    *records += atomic_load_explicit(&job.records, memory_order_relaxed);
+    *applied = valid;
+    munmap((void *)map, size);
+    return valid;
+}
+
+bool snapshot_load(const char *path, storage_t *storage, uint64_t *log_segment, uint64_t *log_offset,
+                   size_t *records)
+{
+    *log_segment = 0;
+    *log_offset = 0;
+    *records = 0;
+
+    snapshot_header_t header;
+    bool applied;
+    if (!snapshot_load_file(path, storage, 0, 0, &header, records, &applied))
+    {
+        return false;
+    }
+
+    uint64_t generation = header.generation;
+    char delta_path[PATH_MAX];
+    for (uint64_t delta = 1; applied; delta++)
+    {
+        *log_segment = header.log_segment;
+        *log_offset = header.log_offset;
+        if (!snapshot_delta_path(path, delta, delta_path, sizeof(delta_path)) ||
+            !snapshot_load_file(delta_path, storage, generation, delta, &header, records, &applied))
+        {
+            return false;
+        }
+    }
+    return true;
+}
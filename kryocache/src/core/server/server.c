@@ -2,10 +2,16 @@
  * @file server.c
  * @brief High-performance in-memory cache server implementation
  */
+#define _GNU_SOURCE // accept4()
+
 #include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/include/server.h"
 #include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/include/constants.h"
 #include "/Users/dimaeremin/kryosette-db/third-party/smemset/include/smemset.h"
 #include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/commands/include/commands.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/commands/include/constants.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/constants.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/slab.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/persistence/include/constants.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,70 +22,1178 @@
 #include <signal.h>
 #include <time.h>
 #include <strings.h>
-#include <arpa/inet.h>    
-#include <errno.h>      
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <limits.h>
+
+static void *server_reactor_thread(void *arg);
+static bool server_reactor_run_uring(server_reactor_t *reactor);
+
+// ==================== Client Slot Management ====================
+
+/*
+The client table is a fixed array sized at init time and shared by all
+reactors. Free indexes are kept on a stack so that claiming and releasing a
+slot is O(1) instead of a scan over max_clients entries on every accept().
+*/
+static client_context_t *server_claim_client_slot(server_instance_t *server, int fd)
+{
+    client_context_t *client = NULL;
+
+    pthread_mutex_lock(&server->clients_lock);
+    if (server->free_slot_count > 0)
+    {
+        uint32_t slot = server->free_slots[--server->free_slot_count];
+        client = &server->clients[slot];
+        client->fd = fd;
+        client->thread_id = pthread_self();
+        client->connected = true;
+        server->client_count++;
+    }
+    pthread_mutex_unlock(&server->clients_lock);
+
+    return client;
+}
+
+static void server_release_client_slot(server_instance_t *server, client_context_t *client)
+{
+    pthread_mutex_lock(&server->clients_lock);
+    if (client->connected)
+    {
+        client->connected = false;
+        client->fd = get_initial_server_fd();
+        connection_state_release(&client->conn);
+        smemset(&client->addr, 0, sizeof(client->addr));
+        server->free_slots[server->free_slot_count++] = (uint32_t)(client - server->clients);
+        server->client_count--;
+    }
+    pthread_mutex_unlock(&server->clients_lock);
+}
+
+// ==================== Reactors ====================
+
+/*
+The listening socket is registered edge-triggered, so a single EPOLLIN may
+stand for any number of pending connections: accept4() must be repeated
+until the kernel reports EAGAIN, otherwise the remaining ones are never
+announced again.
+*/
+static void server_reactor_accept(server_reactor_t *reactor)
+{
+    server_instance_t *server = reactor->server;
+
+    while (server->status == SERVER_STATUS_RUNNING)
+    {
+        struct sockaddr_in6 client_addr;
+        socklen_t client_len = sizeof(client_addr);
+
+        int client_fd = accept4(reactor->listen_fd, (struct sockaddr *)&client_addr, &client_len,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED)
+            {
+                perror("accept4 failed");
+            }
+            return;
+        }
+
+        client_context_t *client = server_claim_client_slot(server, client_fd);
+        if (client == NULL)
+        {
+            // table full - refuse instead of queueing an fd nobody will serve
+            close(client_fd);
+            continue;
+        }
+        client->addr = client_addr;
+        client->conn.context = &reactor->commands;
+        if (reactor->commands.zerocopy_threshold > 0)
+        {
+            // older kernels reject SO_ZEROCOPY: large values are then sent by copy
+            int enable = 1;
+            client->conn.zerocopy = setsockopt(client_fd, get_socket_level(), SO_ZEROCOPY,
+                                               &enable, sizeof(enable)) == 0;
+        }
+
+        struct epoll_event event = {0};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = client;
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, client_fd, &event) < 0)
+        {
+            perror("epoll_ctl client failed");
+            close(client_fd);
+            server_release_client_slot(server, client);
+            continue;
+        }
+
+        uint64_t accepted = atomic_load_explicit(&reactor->connections_total, memory_order_relaxed);
+        atomic_store_explicit(&reactor->connections_total, accepted + 1, memory_order_relaxed);
+    }
+}
+
+/*
+A socket that still has MSG_ZEROCOPY sends in flight outlives its slot: it
+stays registered for EPOLLERR alone, which its completions raise, and is
+closed by connection_reap_orphans() once the last one arrived.
+*/
+static void server_close_client(server_reactor_t *reactor, client_context_t *client)
+{
+    if (connection_close(client->fd, &client->conn))
+    {
+        struct epoll_event event = {0};
+        event.events = EPOLLET;
+        event.data.ptr = &reactor->commands;
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+    }
+    server_release_client_slot(reactor->server, client);
+}
+
+static void server_serve_client(server_reactor_t *reactor, client_context_t *client, uint32_t events)
+{
+    /*
+    EPOLLERR alone is not fatal: MSG_ZEROCOPY completions are delivered on
+    the socket error queue and raise it too. A real socket error is reported
+    by the next recv()/sendmsg() inside handle_client_connection().
+    */
+    if (events & EPOLLHUP)
+    {
+        server_close_client(reactor, client);
+        return;
+    }
+
+    /*
+    Readable and writable edges are handled the same way: flush what is
+    queued, then read and execute everything the client has pipelined.
+    The connection stays open until the peer closes it or an error occurs.
+    */
+    if (!handle_client_connection(client->fd, &client->conn))
+    {
+        server_close_client(reactor, client);
+    }
+}
+
+/*
+One event loop per reactor for its listening socket and its clients.
+epoll_wait() blocks without a timeout; server_stop() interrupts it through
+wake_fd, so an idle server costs no CPU and a busy one never waits on a timer.
+*/
+static void *server_reactor_thread(void *arg)
+{
+    server_reactor_t *reactor = (server_reactor_t *)arg;
+    server_instance_t *server = reactor->server;
+
+    if (server->config.io_backend == SERVER_IO_BACKEND_IO_URING && server_reactor_run_uring(reactor))
+    {
+        return NULL;
+    }
+
+    int max_events = get_epoll_max_events();
+    struct epoll_event events[max_events];
+
+    while (server->status == SERVER_STATUS_RUNNING ||
+           (server->status == SERVER_STATUS_SHUTTING_DOWN && server->client_count > get_initial_client_count()))
+    {
+        int ready = epoll_wait(reactor->epoll_fd, events, max_events, get_epoll_wait_infinite());
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < ready; i++)
+        {
+            void *source = events[i].data.ptr;
+
+            if (source == &reactor->listen_fd)
+            {
+                server_reactor_accept(reactor);
+            }
+            else if (source == &reactor->wake_fd)
+            {
+                uint64_t wake_value;
+                while (read(reactor->wake_fd, &wake_value, sizeof(wake_value)) > 0)
+                {
+                }
+            }
+            else if (source == &reactor->commands)
+            {
+                connection_reap_orphans(&reactor->commands);
+            }
+            else
+            {
+                server_serve_client(reactor, (client_context_t *)source, events[i].events);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void server_wake_reactors(server_instance_t *server)
+{
+    for (uint32_t i = 0; i < server->reactor_count; i++)
+    {
+        if (server->reactors[i].wake_fd >= 0)
+        {
+            uint64_t wake_value = get_wake_signal_value();
+            ssize_t written = write(server->reactors[i].wake_fd, &wake_value, sizeof(wake_value));
+            (void)written;
+        }
+    }
+}
+
+static void server_shutdown_listeners(server_instance_t *server)
+{
+    for (uint32_t i = 0; i < server->reactor_count; i++)
+    {
+        if (server->reactors[i].listen_fd >= 0)
+        {
+            shutdown(server->reactors[i].listen_fd, get_socket_shutdown_mode());
+        }
+    }
+}
+
+/*
+Every reactor binds its own socket to the same port. SO_REUSEPORT makes the
+kernel hash incoming connections across all sockets of the group, which
+removes the single accept queue (and the thundering herd on it).
+On failure last_error is set and the caller releases whatever was created.
+*/
+static bool server_reactor_open(server_reactor_t *reactor)
+{
+    server_instance_t *server = reactor->server;
+
+    reactor->listen_fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, get_socket_protocol());
+    if (reactor->listen_fd < get_socket_success_code())
+    {
+        strcpy(server->last_error, get_socket_creation_error_message());
+        return false;
+    }
+
+    int socket_option = get_socket_reuseaddr_option();
+    if (setsockopt(reactor->listen_fd, get_socket_level(), SO_REUSEADDR,
+                   &socket_option, sizeof(socket_option)) < get_socket_success_code() ||
+        setsockopt(reactor->listen_fd, get_socket_level(), SO_REUSEPORT,
+                   &socket_option, sizeof(socket_option)) < get_socket_success_code())
+    {
+        strcpy(server->last_error, get_socket_option_error_message());
+        return false;
+    }
+
+    struct sockaddr_in6 server_address;
+    smemset(&server_address, 0, sizeof(server_address));
+    server_address.sin6_family = get_socket_domain();
+    server_address.sin6_port = htons(server->config.port);
+    server_address.sin6_addr = in6addr_any;
+
+    if (bind(reactor->listen_fd, (struct sockaddr *)&server_address,
+             sizeof(server_address)) < get_socket_success_code())
+    {
+        strcpy(server->last_error, get_socket_bind_error_message());
+        return false;
+    }
+
+    if (listen(reactor->listen_fd, get_socket_backlog()) < get_socket_success_code())
+    {
+        strcpy(server->last_error, get_socket_listen_error_message());
+        return false;
+    }
+
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->epoll_fd < 0 || reactor->wake_fd < 0)
+    {
+        strcpy(server->last_error, get_event_loop_error_message());
+        return false;
+    }
+
+    struct epoll_event event = {0};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = &reactor->listen_fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->listen_fd, &event) < 0)
+    {
+        strcpy(server->last_error, get_event_loop_error_message());
+        return false;
+    }
+
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = &reactor->wake_fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &event) < 0)
+    {
+        strcpy(server->last_error, get_event_loop_error_message());
+        return false;
+    }
+
+    return true;
+}
+
+// ==================== io_uring Backend ====================
+
+/*
+Optional completion-based backend. A reactor using it never calls accept(),
+recv() or send(): one multishot ACCEPT produces every new connection, one
+multishot RECV per client consumes buffers from a kernel-visible provided
+buffer ring, and replies go out as SEND requests. All of them are submitted
+and reaped with a single io_uring_enter() per loop iteration, so under load
+a GET/SET costs a fraction of a syscall.
+
+The ring is driven through raw syscalls (no liburing dependency). Support is
+probed at startup: IORING_SETUP_SINGLE_ISSUER (6.0) implies multishot RECV,
+and registering the provided buffer ring must succeed as well. Otherwise the
+reactor quietly keeps the epoll backend.
+*/
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SERVER_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef SERVER_HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// user_data = pointer (client or reactor, 8-byte aligned) | operation
+enum
+{
+    SERVER_URING_OP_ACCEPT = 1,
+    SERVER_URING_OP_RECV = 2,
+    SERVER_URING_OP_SEND = 3,
+    SERVER_URING_OP_WAKE = 4,
+    SERVER_URING_OP_CONTROL = 5, // ASYNC_CANCEL and SHUTDOWN completions
+    SERVER_URING_OP_MASK = 7
+};
+
+typedef struct server_uring
+{
+    int ring_fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail; /**< Tail including SQEs not yet published to the kernel */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *buffers;
+    unsigned buf_count;
+    unsigned buf_size;
+} server_uring_t;
+
+static int server_uring_enter(server_uring_t *ring, unsigned wait_nr)
+{
+    unsigned to_submit = ring->sq_local_tail - *ring->sq_tail;
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    return (int)syscall(__NR_io_uring_enter, ring->ring_fd, to_submit, wait_nr, flags, NULL, 0);
+}
+
+static struct io_uring_sqe *server_uring_get_sqe(server_uring_t *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head >= ring->sq_entries)
+    {
+        // queue full: hand the batch to the kernel to make room
+        server_uring_enter(ring, 0);
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sq_local_tail - head >= ring->sq_entries)
+        {
+            return NULL;
+        }
+    }
+
+    unsigned index = ring->sq_local_tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    smemset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+    return sqe;
+}
+
+static void server_uring_recycle_buffer(server_uring_t *ring, unsigned buffer_id)
+{
+    unsigned mask = ring->buf_count - 1;
+    uint16_t tail = ring->buf_ring->tail;
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[tail & mask];
+
+    buf->addr = (uint64_t)(uintptr_t)(ring->buffers + (size_t)buffer_id * ring->buf_size);
+    buf->len = ring->buf_size;
+    buf->bid = (uint16_t)buffer_id;
+    __atomic_store_n(&ring->buf_ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+static void server_uring_destroy(server_uring_t *ring)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+
+    if (ring->buf_ring != NULL)
+    {
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    }
+    free(ring->buffers);
+    if (ring->sqes != NULL)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->ring_fd >= 0)
+    {
+        close(ring->ring_fd);
+    }
+    free(ring);
+}
+
+/*
+Returns NULL when the kernel (or a seccomp policy, or the io_uring_disabled
+sysctl) does not provide everything the backend relies on.
+*/
+static server_uring_t *server_uring_create(void)
+{
+    server_uring_t *ring = (server_uring_t *)calloc(1, sizeof(server_uring_t));
+    if (ring == NULL)
+    {
+        return NULL;
+    }
+    ring->ring_fd = get_initial_server_fd();
+
+    struct io_uring_params params;
+    smemset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_CQSIZE;
+    params.cq_entries = get_uring_queue_depth() * 4; // multishot requests post many CQEs per SQE
+
+    ring->ring_fd = (int)syscall(__NR_io_uring_setup, get_uring_queue_depth(), &params);
+    if (ring->ring_fd < 0)
+    {
+        server_uring_destroy(ring);
+        return NULL;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+        {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        server_uring_destroy(ring);
+        return NULL;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            ring->cq_ring = NULL;
+            server_uring_destroy(ring);
+            return NULL;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        server_uring_destroy(ring);
+        return NULL;
+    }
+
+    char *sq = (char *)ring->sq_ring;
+    char *cq = (char *)ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = *(unsigned *)(sq + params.sq_off.ring_entries);
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // provided buffer ring: the kernel picks a free buffer for every RECV completion
+    ring->buf_count = get_uring_buffer_count();
+    ring->buf_size = get_uring_buffer_size();
+    ring->buf_ring_size = ring->buf_count * sizeof(struct io_uring_buf);
+    ring->buf_ring = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buf_ring == MAP_FAILED)
+    {
+        ring->buf_ring = NULL;
+        server_uring_destroy(ring);
+        return NULL;
+    }
+
+    ring->buffers = (char *)aligned_alloc((size_t)sysconf(_SC_PAGESIZE), (size_t)ring->buf_count * ring->buf_size);
+    if (ring->buffers == NULL)
+    {
+        server_uring_destroy(ring);
+        return NULL;
+    }
+
+    struct io_uring_buf_reg registration;
+    smemset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+    registration.ring_entries = ring->buf_count;
+    registration.bgid = get_uring_buffer_group();
+    if (syscall(__NR_io_uring_register, ring->ring_fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+    {
+        server_uring_destroy(ring);
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < ring->buf_count; i++)
+    {
+        server_uring_recycle_buffer(ring, i);
+    }
+
+    return ring;
+}
+
+static bool server_uring_submit_accept(server_reactor_t *reactor)
+{
+    struct io_uring_sqe *sqe = server_uring_get_sqe(reactor->uring);
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = reactor->listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = (uint64_t)(uintptr_t)reactor | SERVER_URING_OP_ACCEPT;
+    return true;
+}
+
+static bool server_uring_submit_wake(server_reactor_t *reactor)
+{
+    struct io_uring_sqe *sqe = server_uring_get_sqe(reactor->uring);
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = reactor->wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = (uint64_t)(uintptr_t)reactor | SERVER_URING_OP_WAKE;
+    return true;
+}
+
+static bool server_uring_submit_recv(server_reactor_t *reactor, client_context_t *client)
+{
+    struct io_uring_sqe *sqe = server_uring_get_sqe(reactor->uring);
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = get_uring_buffer_group();
+    sqe->user_data = (uint64_t)(uintptr_t)client | SERVER_URING_OP_RECV;
+
+    client->uring.recv_armed = true;
+    client->uring.recv_paused = false;
+    client->uring.ops_in_flight++;
+    return true;
+}
+
+static void server_uring_submit_cancel_recv(server_reactor_t *reactor, client_context_t *client)
+{
+    struct io_uring_sqe *sqe = server_uring_get_sqe(reactor->uring);
+    if (sqe == NULL)
+    {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = (uint64_t)(uintptr_t)client | SERVER_URING_OP_RECV;
+    sqe->user_data = (uint64_t)(uintptr_t)client | SERVER_URING_OP_CONTROL;
+
+    client->uring.recv_paused = true;
+    client->uring.ops_in_flight++;
+}
+
+/*
+Finish a connection once nothing references it any more. shutdown() makes
+every outstanding request complete (RECV with 0, SEND with an error), so the
+slot is recycled only after the last CQE for this client has been seen.
+*/
+static void server_uring_close_client(server_reactor_t *reactor, client_context_t *client)
+{
+    if (!client->uring.closing)
+    {
+        client->uring.closing = true;
+        shutdown(client->fd, SHUT_RDWR);
+    }
+
+    if (client->uring.ops_in_flight == 0)
+    {
+        output_queue_release(&client->uring.sending);
+        free(client->uring.iov);
+        smemset(&client->uring, 0, sizeof(client->uring));
+        close(client->fd);
+        server_release_client_slot(reactor->server, client);
+    }
+}
+
+static struct io_uring_sqe *server_uring_submit_send(server_reactor_t *reactor, client_context_t *client)
+{
+    client_uring_state_t *state = &client->uring;
+
+    if (state->iov == NULL)
+    {
+        state->iov = malloc(get_connection_max_iovecs() * sizeof(struct iovec));
+        if (state->iov == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe *sqe = server_uring_get_sqe(reactor->uring);
+    if (sqe == NULL)
+    {
+        return NULL;
+    }
+
+    smemset(&state->msg, 0, sizeof(state->msg));
+    state->msg.msg_iov = state->iov;
+    state->msg.msg_iovlen = output_queue_fill_iovec(&state->sending, state->iov, get_connection_max_iovecs());
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = client->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&state->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = (uint64_t)(uintptr_t)client | SERVER_URING_OP_SEND;
+    state->ops_in_flight++;
+    return sqe;
+}
+
+/*
+Only one SENDMSG per client is in flight: conn.output is moved into
+uring.sending, so new replies can be queued while the kernel still reads the
+previous batch. The gather list points into the queue, so referenced values
+are sent straight from storage. MSG_WAITALL makes the kernel retry short
+sends itself. The last batch of a closing connection is linked to a SHUTDOWN
+request, so the socket is shut down right after the final reply without
+another round trip.
+*/
+static void server_uring_flush(server_reactor_t *reactor, client_context_t *client)
+{
+    client_uring_state_t *state = &client->uring;
+    connection_state_t *conn = &client->conn;
+
+    if (state->closing || state->sending.pending > 0)
+    {
+        return;
+    }
+
+    bool finishing = conn->peer_closed || conn->closing;
+
+    if (!connection_has_pending_output(conn))
+    {
+        if (finishing)
+        {
+            server_uring_close_client(reactor, client);
+        }
+        return;
+    }
+
+    // swap queues; the drained one is reused for the next replies
+    output_queue_t drained = state->sending;
+    state->sending = conn->output;
+    conn->output = drained;
+
+    struct io_uring_sqe *sqe = server_uring_submit_send(reactor, client);
+    if (sqe == NULL)
+    {
+        server_uring_close_client(reactor, client);
+        return;
+    }
+
+    // a batch longer than one gather list is finished from server_uring_handle_send()
+    bool whole_batch = state->sending.count - state->sending.head <= get_connection_max_iovecs();
+    if (finishing && whole_batch && !connection_has_pending_output(conn))
+    {
+        struct io_uring_sqe *shutdown_sqe = server_uring_get_sqe(reactor->uring);
+        if (shutdown_sqe != NULL)
+        {
+            sqe->flags |= IOSQE_IO_LINK;
+            shutdown_sqe->opcode = IORING_OP_SHUTDOWN;
+            shutdown_sqe->fd = client->fd;
+            shutdown_sqe->len = SHUT_RDWR;
+            shutdown_sqe->user_data = (uint64_t)(uintptr_t)client | SERVER_URING_OP_CONTROL;
+            state->ops_in_flight++;
+        }
+    }
+}
+
+static void server_uring_handle_accept(server_reactor_t *reactor, struct io_uring_cqe *cqe)
+{
+    server_instance_t *server = reactor->server;
+
+    if (!(cqe->flags & IORING_CQE_F_MORE) && server->status == SERVER_STATUS_RUNNING)
+    {
+        server_uring_submit_accept(reactor);
+    }
+
+    if (cqe->res < 0)
+    {
+        return;
+    }
+
+    int client_fd = cqe->res;
+    if (server->status != SERVER_STATUS_RUNNING)
+    {
+        close(client_fd);
+        return;
+    }
+
+    client_context_t *client = server_claim_client_slot(server, client_fd);
+    if (client == NULL)
+    {
+        close(client_fd);
+        return;
+    }
+    client->conn.context = &reactor->commands;
+    smemset(&client->uring, 0, sizeof(client->uring));
+
+    if (!server_uring_submit_recv(reactor, client))
+    {
+        server_uring_close_client(reactor, client);
+        return;
+    }
+
+    uint64_t accepted = atomic_load_explicit(&reactor->connections_total, memory_order_relaxed);
+    atomic_store_explicit(&reactor->connections_total, accepted + 1, memory_order_relaxed);
+}
+
+static void server_uring_handle_recv(server_reactor_t *reactor, client_context_t *client, struct io_uring_cqe *cqe)
+{
+    server_uring_t *ring = reactor->uring;
+    client_uring_state_t *state = &client->uring;
+    bool failed = false;
+
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        state->recv_armed = false;
+        state->ops_in_flight--;
+    }
+
+    if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+    {
+        unsigned buffer_id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        const char *data = ring->buffers + (size_t)buffer_id * ring->buf_size;
+
+        if (!state->closing)
+        {
+            failed = !connection_feed_input(&client->conn, data, (size_t)cqe->res);
+        }
+        server_uring_recycle_buffer(ring, buffer_id);
+    }
+    else if (cqe->res == 0)
+    {
+        client->conn.peer_closed = true;
+    }
+    else if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED)
+    {
+        failed = true;
+    }
+
+    if (state->closing || failed)
+    {
+        server_uring_close_client(reactor, client);
+        return;
+    }
+
+    if (connection_output_over_watermark(&client->conn))
+    {
+        if (state->recv_armed && !state->recv_paused)
+        {
+            server_uring_submit_cancel_recv(reactor, client);
+        }
+    }
+    else if (!state->recv_armed && !state->recv_paused && !client->conn.peer_closed && !client->conn.closing)
+    {
+        // terminated by ENOBUFS or by the kernel - re-arm
+        server_uring_submit_recv(reactor, client);
+    }
+
+    server_uring_flush(reactor, client);
+}
+
+static void server_uring_handle_send(server_reactor_t *reactor, client_context_t *client, struct io_uring_cqe *cqe)
+{
+    client_uring_state_t *state = &client->uring;
+    state->ops_in_flight--;
+
+    if (cqe->res < 0 || state->closing)
+    {
+        server_uring_close_client(reactor, client);
+        return;
+    }
+
+    output_queue_consume(&state->sending, (size_t)cqe->res);
+    if (state->sending.pending > 0)
+    {
+        // more segments than one gather list holds, or a short send: continue the batch
+        if (server_uring_submit_send(reactor, client) == NULL)
+        {
+            server_uring_close_client(reactor, client);
+        }
+        return;
+    }
+
+    if (state->recv_paused && !state->recv_armed && !connection_output_over_watermark(&client->conn))
+    {
+        server_uring_submit_recv(reactor, client);
+    }
+
+    server_uring_flush(reactor, client);
+}
+
+static void server_uring_loop(server_reactor_t *reactor)
+{
+    server_instance_t *server = reactor->server;
+    server_uring_t *ring = reactor->uring;
+
+    if (!server_uring_submit_accept(reactor) || !server_uring_submit_wake(reactor))
+    {
+        return;
+    }
+
+    while (server->status == SERVER_STATUS_RUNNING ||
+           (server->status == SERVER_STATUS_SHUTTING_DOWN && server->client_count > get_initial_client_count()))
+    {
+        if (server_uring_enter(ring, 1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            perror("io_uring_enter failed");
+            break;
+        }
+
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+            void *owner = (void *)(uintptr_t)(cqe->user_data & ~(uint64_t)SERVER_URING_OP_MASK);
+            client_context_t *client = (client_context_t *)owner;
+
+            switch (cqe->user_data & SERVER_URING_OP_MASK)
+            {
+            case SERVER_URING_OP_ACCEPT:
+                server_uring_handle_accept(reactor, cqe);
+                break;
+            case SERVER_URING_OP_RECV:
+                server_uring_handle_recv(reactor, client, cqe);
+                break;
+            case SERVER_URING_OP_SEND:
+                server_uring_handle_send(reactor, client, cqe);
+                break;
+            case SERVER_URING_OP_CONTROL:
+                client->uring.ops_in_flight--;
+                if (client->uring.closing)
+                {
+                    server_uring_close_client(reactor, client);
+                }
+                break;
+            case SERVER_URING_OP_WAKE:
+            {
+                uint64_t wake_value;
+                while (read(reactor->wake_fd, &wake_value, sizeof(wake_value)) > 0)
+                {
+                }
+                server_uring_submit_wake(reactor);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+#endif
 
-static void *server_acceptor_thread(void *arg);
+/*
+Run the reactor on io_uring if the kernel supports it. The ring is created
+by the reactor thread itself: with IORING_SETUP_SINGLE_ISSUER only the
+creating task may submit. Returns false if the caller should use epoll.
+*/
+static bool server_reactor_run_uring(server_reactor_t *reactor)
+{
+#ifdef SERVER_HAVE_IO_URING
+    reactor->uring = server_uring_create();
+    if (reactor->uring != NULL)
+    {
+        reactor->io_backend = SERVER_IO_BACKEND_IO_URING;
+        server_uring_loop(reactor);
+        return true;
+    }
+#endif
 
-// ==================== Internal Thread Functions ====================
+    fprintf(stderr, "Reactor %u: io_uring is not supported, falling back to epoll\n", reactor->id);
+    reactor->io_backend = SERVER_IO_BACKEND_EPOLL;
+    return false;
+}
 
-static void *server_acceptor_thread(void *arg)
+/*
+Active expiry. Lazy expiry alone never frees keys that are not read again,
+so the storage timing wheel is advanced once per tick; each cycle does a
+bounded amount of work per shard, whatever the number of expiring keys.
+*/
+static void *server_expire_thread(void *arg)
 {
     server_instance_t *server = (server_instance_t *)arg;
+    uint64_t tick_ms = get_storage_wheel_tick_ms();
+    struct timespec tick = {
+        .tv_sec = (time_t)(tick_ms / 1000),
+        .tv_nsec = (long)(tick_ms % 1000) * 1000000,
+    };
+
+    while (server->status == SERVER_STATUS_RUNNING)
+    {
+        storage_expire_cycle(server->storage);
+        nanosleep(&tick, NULL);
+    }
+
+    return NULL;
+}
+
+static void server_expire_release(server_instance_t *server)
+{
+    if (server->expire_running)
+    {
+        pthread_join(server->expire_thread, NULL);
+        server->expire_running = false;
+    }
+}
 
-    printf("Acceptor thread started on port %d\n", server->config.port);
+/*
+FLUSH swaps in empty tables right away; the old ones, and values too big
+to free in a blink, are released here instead of by the next writer of
+their shard.
+*/
+static void *server_lazy_free_thread(void *arg)
+{
+    server_instance_t *server = (server_instance_t *)arg;
 
     while (server->status == SERVER_STATUS_RUNNING)
     {
-        /*
-            struct sockaddr_in6 {
-               sa_family_t     sin6_family;    AF_INET6 
-               in_port_t       sin6_port;      port number 
-               uint32_t        sin6_flowinfo;  IPv6 flow information 
-               struct in6_addr sin6_addr;     IPv6 address 
-               uint32_t        sin6_scope_id;  Scope ID (new in Linux 2.4) 
-            };
-
-            struct in6_addr {
-               unsigned char   s6_addr[16];   IPv6 address 
-            };
-        */
-        struct sockaddr_in6 client_addr;
-        socklen_t client_len = sizeof(client_addr);
+        storage_lazy_free_cycle(server->storage, get_storage_lazy_free_wait_ms());
+    }
+
+    return NULL;
+}
 
-        /*
-        #include <sys/socket.h>
+static void server_lazy_free_release(server_instance_t *server)
+{
+    if (server->lazy_free_running)
+    {
+        pthread_join(server->lazy_free_thread, NULL);
+        server->lazy_free_running = false;
+    }
+}
 
-        int accept(int sockfd, struct sockaddr *_Nullable restrict addr,
-                  socklen_t *_Nullable restrict addrlen);
+/*
+Writes what connections appended to the log and fsyncs it once a second
+under AOF_FSYNC_EVERYSEC. A failure is reported once, and so is the
+recovery; in between the log retries and writes are refused. Every
+persistence_interval seconds it also starts a checkpoint, which only
+writes the keys changed since the last one; one that cannot start
+because a snapshot is running waits for the next turn.
+*/
+static void *server_aof_thread(void *arg)
+{
+    server_instance_t *server = (server_instance_t *)arg;
+    bool healthy = true;
+    int interval = server->config.persistence_interval;
+    time_t checkpoint_at = time(NULL) + interval;
 
-        #define _GNU_SOURCE              See feature_test_macros(7) 
-        #include <sys/socket.h>
+    while (server->status == SERVER_STATUS_RUNNING)
+    {
+        bool written = aof_write_cycle(server->aof, get_aof_write_wait_ms());
+        if (!written && healthy)
+        {
+            fprintf(stderr, "%s: %s\n", get_persistence_write_error_message(), strerror(errno));
+        }
+        else if (written && !healthy)
+        {
+            fprintf(stderr, "%s\n", get_persistence_recovered_message());
+        }
+        healthy = written;
 
-        int accept4(int sockfd, struct sockaddr *_Nullable restrict addr,
-                  socklen_t *_Nullable restrict addrlen, int flags);
-        */
-        socklen_t client_len = sizeof(client_addr);
-        int client_fd = accept(server->server_fd, (struct sockaddr*)&client_addr, &client_len);
-
-        if (client_fd >= 0) {
-            char client_ip[INET6_ADDRSTRLEN];
-            inet_ntop(AF_INET6, &client_addr.sin6_addr, client_ip, sizeof(client_ip));
-            printf("New client connected from %s:%d\n", client_ip, ntohs(client_addr.sin6_port));
-            
-            handle_client_connection(client_fd);
-        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            perror("accept failed");
-            break;
+        if (interval > 0 && time(NULL) >= checkpoint_at)
+        {
+            snapshot_checkpoint(server->snapshot);
+            checkpoint_at = time(NULL) + interval;
         }
+    }
+
+    return NULL;
+}
+
+static void server_aof_release(server_instance_t *server)
+{
+    if (server->aof_running)
+    {
+        pthread_join(server->aof_thread, NULL);
+        server->aof_running = false;
+    }
+}
+
+/*
+Deleting or overwriting keys of one size leaves slab pages mostly empty
+but resident. Relocation copies entries, so it only runs while enough
+memory is wasted, in short bounded cycles at idle priority.
+*/
+static bool server_defrag_wanted(void)
+{
+    slab_class_stats_t stats[SLAB_MAX_CLASSES];
+    size_t count = slab_stats(stats, SLAB_MAX_CLASSES);
+    size_t resident = 0;
+    size_t used = 0;
+
+    for (size_t i = 0; i < count && i < SLAB_MAX_CLASSES; i++)
+    {
+        resident += stats[i].pages * get_slab_page_size();
+        used += stats[i].chunks_used * stats[i].chunk_size;
+    }
+
+    size_t wasted = resident - used;
+    return wasted > get_storage_defrag_ignore_bytes() &&
+           wasted * 100 > resident * get_storage_defrag_threshold_percent();
+}
+
+static void *server_defrag_thread(void *arg)
+{
+    server_instance_t *server = (server_instance_t *)arg;
+    uint64_t interval_ms = get_storage_defrag_interval_ms();
+    struct timespec interval = {
+        .tv_sec = (time_t)(interval_ms / 1000),
+        .tv_nsec = (long)(interval_ms % 1000) * 1000000,
+    };
+    struct sched_param param = {.sched_priority = 0};
+
+    // failing to lower the priority is harmless, every cycle is bounded anyway
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
 
-        usleep(100000);
+    while (server->status == SERVER_STATUS_RUNNING)
+    {
+        if (server_defrag_wanted())
+        {
+            storage_defrag_cycle(server->storage, get_storage_defrag_budget_us());
+        }
+        nanosleep(&interval, NULL);
     }
 
-    printf("Acceptor thread stopped\n");
     return NULL;
 }
 
+static void server_defrag_release(server_instance_t *server)
+{
+    if (server->defrag_running)
+    {
+        pthread_join(server->defrag_thread, NULL);
+        server->defrag_running = false;
+    }
+}
+
+/*
+Join reactor threads and close their descriptors. Safe to call on a
+partially started server and more than once.
+*/
+static void server_reactors_release(server_instance_t *server)
+{
+    server_wake_reactors(server);
+
+    for (uint32_t i = 0; i < server->reactor_count; i++)
+    {
+        server_reactor_t *reactor = &server->reactors[i];
+
+        if (reactor->running)
+        {
+            pthread_join(reactor->thread, NULL);
+            reactor->running = false;
+        }
+        command_context_release(&reactor->commands);
+
+#ifdef SERVER_HAVE_IO_URING
+        // closing the ring cancels whatever was still in flight
+        server_uring_destroy(reactor->uring);
+        reactor->uring = NULL;
+#endif
+
+        int *descriptors[] = {&reactor->listen_fd, &reactor->epoll_fd, &reactor->wake_fd};
+        for (size_t d = 0; d < sizeof(descriptors) / sizeof(descriptors[0]); d++)
+        {
+            if (*descriptors[d] >= 0)
+            {
+                close(*descriptors[d]);
+                *descriptors[d] = get_initial_server_fd();
+            }
+        }
+    }
+}
 
 // ==================== Server Initialization ====================
 
@@ -115,17 +1229,63 @@ server_instance_t *server_init_default(void)
         DEFAULT_CONFIG.port = get_server_default_port();
         DEFAULT_CONFIG.max_clients = get_server_max_clients();
         DEFAULT_CONFIG.max_memory = get_default_max_memory();
+        DEFAULT_CONFIG.eviction_policy = get_default_eviction_policy();
         DEFAULT_CONFIG.mode = get_default_server_mode();
         DEFAULT_CONFIG.bind_address = get_default_bind_address();
         DEFAULT_CONFIG.data_directory = get_default_data_directory();
         DEFAULT_CONFIG.persistence_enabled = get_default_persistence_enabled();
         DEFAULT_CONFIG.persistence_interval = get_default_persistence_interval();
+        DEFAULT_CONFIG.reactor_threads = get_default_reactor_threads();
+        DEFAULT_CONFIG.io_backend = get_default_io_backend();
+        DEFAULT_CONFIG.zerocopy_threshold = get_default_zerocopy_threshold();
+        DEFAULT_CONFIG.aof_fsync_policy = get_default_aof_fsync_policy();
         initialized = 1;
     }
 
     return server_init(&DEFAULT_CONFIG);
 }
 
+static bool server_data_path(const server_instance_t *server, const char *name, char *path, size_t size)
+{
+    if (server->config.data_directory == NULL)
+    {
+        return false;
+    }
+
+    int length = snprintf(path, size, "%s/%s", server->config.data_directory, name);
+    return length > 0 && (size_t)length < size;
+}
+
+/*
+The snapshot and the log are loaded before the journal is attached, so
+loading does not append the records it reads a second time, and before
+changed keys are tracked, so the loaded ones do not fill the dirty sets.
+*/
+static bool server_persistence_open(server_instance_t *server)
+{
+    char path[PATH_MAX] = "";
+    bool opened = server_data_path(server, get_aof_file_name(), path, sizeof(path)) &&
+                  (mkdir(server->config.data_directory, 0755) == 0 || errno == EEXIST) &&
+                  server_load_data(server) &&
+                  (server->aof = aof_open(path, server->aof_segment, server->config.aof_fsync_policy)) != NULL &&
+                  (server->snapshot = snapshot_create(server->config.data_directory, server->storage,
+                                                      server->aof)) != NULL;
+    if (!opened)
+    {
+        fprintf(stderr, "%s: %s\n", get_persistence_error_message(), path);
+        return false;
+    }
+
+    storage_set_journal(server->storage, aof_journal, server->aof);
+    storage_set_dirty_tracking(server->storage, server->config.persistence_interval > 0);
+    for (uint32_t i = 0; i < server->reactor_count; i++)
+    {
+        server->reactors[i].commands.aof = server->aof;
+        server->reactors[i].commands.snapshot = server->snapshot;
+    }
+    return true;
+}
+
 /*
 MEMORY INITIALIZATION SAFETY PRINCIPLE
 
@@ -163,52 +1323,67 @@ server_instance_t *server_init(const server_config_t *config)
     server->status = get_initial_server_status();
 
     /*
-    MEMORY SAFETY: CONSISTENT INITIALIZATION
-    Continue using calloc for all allocations to maintain zero-initialized state
+    THREAD SAFETY PRINCIPLE: PROTECTION BEFORE DATA
+
+    Always initialize synchronization primitives (mutexes, locks) BEFORE making data accessible.
+    storage_create() sets up the storage lock together with the table, so the
+    keyspace is never reachable unprotected.
     */
-    server->storage = (storage_t *)calloc(1, sizeof(storage_t));
+    server->storage = storage_create(get_initial_storage_capacity());
     if (server->storage == NULL)
     {
         free(server);
         return NULL;
     }
-
-    /*
-    THREAD SAFETY PRINCIPLE: PROTECTION BEFORE DATA
-
-    Always initialize synchronization primitives (mutexes, locks) BEFORE making data accessible.
-    When multiple threads can access shared data, the protection mechanism must be fully
-    established before any thread can potentially access that data.
-
-    Initializing data first and then creating the mutex creates a race condition window where
-    data is accessible but unprotected. This violates fundamental thread safety requirements.
-    */
-    if (pthread_mutex_init(&server->storage->lock, NULL) != 0)
+    storage_set_max_memory(server->storage, config->max_memory);
+    storage_set_lazy_free(server->storage, true);
+    if (!storage_set_eviction_policy(server->storage, config->eviction_policy))
     {
-        free(server->storage);
+        storage_destroy(server->storage);
         free(server);
         return NULL;
     }
 
     /*
-    DATA INITIALIZATION UNDER PROTECTION
-    Now that mutex is established, we can safely initialize the protected data
-    The mutex ensures thread-safe access from this point forward
+    One reactor per online CPU unless configured otherwise. The array is
+    allocated here so that stats can be aggregated before server_start().
     */
-    server->storage->capacity = get_initial_storage_capacity();
-    server->storage->size = get_initial_storage_size();
+    uint32_t reactor_count = config->reactor_threads;
+    if (reactor_count == 0)
+    {
+        long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        reactor_count = online_cpus > 0 ? (uint32_t)online_cpus : 1;
+    }
+    if (reactor_count > get_max_reactor_threads())
+    {
+        reactor_count = get_max_reactor_threads();
+    }
 
-    server->storage->buckets = (storage_node_t **)calloc(server->storage->capacity, sizeof(storage_node_t *));
-    if (server->storage->buckets == NULL)
+    server->reactors = (server_reactor_t *)aligned_alloc(_Alignof(server_reactor_t),
+                                                         reactor_count * sizeof(server_reactor_t));
+    if (server->reactors == NULL)
     {
-        pthread_mutex_destroy(&server->storage->lock);
-        free(server->storage);
+        storage_destroy(server->storage);
         free(server);
         return NULL;
     }
+    smemset(server->reactors, 0, reactor_count * sizeof(server_reactor_t));
+    server->reactor_count = reactor_count;
 
-    server->server_fd = get_initial_server_fd();
-    server->acceptor_thread = get_initial_thread_id();
+    for (uint32_t i = 0; i < reactor_count; i++)
+    {
+        server->reactors[i].server = server;
+        server->reactors[i].id = i;
+        server->reactors[i].listen_fd = get_initial_server_fd();
+        server->reactors[i].epoll_fd = get_initial_server_fd();
+        server->reactors[i].wake_fd = get_initial_server_fd();
+        server->reactors[i].thread = get_initial_thread_id();
+        server->reactors[i].running = false;
+        server->reactors[i].io_backend = SERVER_IO_BACKEND_EPOLL;
+        server->reactors[i].uring = NULL;
+        server->reactors[i].commands.storage = server->storage;
+        server->reactors[i].commands.zerocopy_threshold = config->zerocopy_threshold;
+    }
 
     /*
     MEMORY ALLOCATION SAFETY: SIZE VALIDATION
@@ -226,13 +1401,34 @@ server_instance_t *server_init(const server_config_t *config)
     server->clients = (client_context_t *)calloc(max_clients, sizeof(client_context_t));
     if (server->clients == NULL)
     {
-        pthread_mutex_destroy(&server->storage->lock);
-        free(server->storage->buckets);
-        free(server->storage);
+        free(server->reactors);
+        storage_destroy(server->storage);
+        free(server);
+        return NULL;
+    }
+
+    server->free_slots = (uint32_t *)calloc(max_clients, sizeof(uint32_t));
+    if (server->free_slots == NULL)
+    {
+        free(server->reactors);
+        free(server->clients);
+        storage_destroy(server->storage);
         free(server);
         return NULL;
     }
 
+    /*
+    Slots are handed out from the top of the stack, so push them in reverse
+    to give the first client index 0. fd 0 is a valid descriptor, therefore
+    unused slots are marked explicitly instead of relying on calloc().
+    */
+    for (size_t i = 0; i < max_clients; i++)
+    {
+        server->clients[i].fd = get_initial_server_fd();
+        server->free_slots[i] = (uint32_t)(max_clients - 1 - i);
+    }
+    server->free_slot_count = (uint32_t)max_clients;
+
     server->client_count = get_initial_client_count();
 
     /*
@@ -242,10 +1438,10 @@ server_instance_t *server_init(const server_config_t *config)
     */
     if (pthread_mutex_init(&server->clients_lock, NULL) != 0)
     {
+        free(server->reactors);
+        free(server->free_slots);
         free(server->clients);
-        pthread_mutex_destroy(&server->storage->lock);
-        free(server->storage->buckets);
-        free(server->storage);
+        storage_destroy(server->storage);
         free(server);
         return NULL;
     }
@@ -276,6 +1472,12 @@ server_instance_t *server_init(const server_config_t *config)
 
     server->start_time = get_initial_start_time();
 
+    if (server->config.persistence_enabled && !server_persistence_open(server))
+    {
+        server_destroy(server);
+        return NULL;
+    }
+
     /*
     RESOURCE TRACKING PRINCIPLE
 
@@ -336,55 +1538,76 @@ bool server_start(server_instance_t *server)
 
     server->status = SERVER_STATUS_STARTING;
 
-    // malloc 5 - создание сокета
-    server->server_fd = socket(AF_INET6, SOCK_STREAM, get_socket_protocol());
-    if (server->server_fd < get_socket_success_code())
+    // malloc 5 - создание сокетов: один SO_REUSEPORT listener на reactor
+    for (uint32_t i = 0; i < server->reactor_count; i++)
     {
-        server->status = SERVER_STATUS_ERROR;
-        strcpy(server->last_error, get_socket_creation_error_message());
-        return false;
+        if (!server_reactor_open(&server->reactors[i]))
+        {
+            server->status = SERVER_STATUS_ERROR;
+            server_reactors_release(server);
+            return false;
+        }
     }
 
-    int socket_option = get_socket_reuseaddr_option();
-    if (setsockopt(server->server_fd, get_socket_level(), SO_REUSEADDR,
-                   &socket_option, sizeof(socket_option)) < get_socket_success_code())
+    server->status = SERVER_STATUS_RUNNING;
+    server->start_time = time(NULL);
+
+    for (uint32_t i = 0; i < server->reactor_count; i++)
     {
-        server->status = SERVER_STATUS_ERROR;
-        strcpy(server->last_error, get_socket_option_error_message());
-        return false;
+        server_reactor_t *reactor = &server->reactors[i];
+        if (pthread_create(&reactor->thread, NULL,
+                           server_reactor_thread, reactor) != get_thread_success_code())
+        {
+            server->status = SERVER_STATUS_ERROR;
+            strcpy(server->last_error, get_thread_creation_error_message());
+            server_reactors_release(server);
+            return false;
+        }
+        reactor->running = true;
     }
 
-    struct sockaddr_in6 server_address;
-    server_address.sin6_family = get_socket_domain();
-    server_address.sin6_port = htons(server->config.port);
-    server_address.sin6_addr = in6addr_any;
-
-    if (bind(server->server_fd, (struct sockaddr *)&server_address,
-             sizeof(server_address)) < get_socket_success_code())
+    if (pthread_create(&server->expire_thread, NULL, server_expire_thread, server) != get_thread_success_code())
     {
         server->status = SERVER_STATUS_ERROR;
-        strcpy(server->last_error, get_socket_bind_error_message());
+        strcpy(server->last_error, get_thread_creation_error_message());
+        server_reactors_release(server);
         return false;
     }
+    server->expire_running = true;
 
-    if (listen(server->server_fd, get_socket_backlog()) < get_socket_success_code())
+    if (pthread_create(&server->defrag_thread, NULL, server_defrag_thread, server) != get_thread_success_code())
     {
         server->status = SERVER_STATUS_ERROR;
-        strcpy(server->last_error, get_socket_listen_error_message());
+        strcpy(server->last_error, get_thread_creation_error_message());
+        server_reactors_release(server);
         return false;
     }
+    server->defrag_running = true;
 
-    server->status = SERVER_STATUS_RUNNING;
-    server->start_time = time(NULL);
-
-    if (pthread_create(&server->acceptor_thread, NULL,
-                       server_acceptor_thread, server) != get_thread_success_code())
+    if (pthread_create(&server->lazy_free_thread, NULL, server_lazy_free_thread, server) !=
+        get_thread_success_code())
     {
         server->status = SERVER_STATUS_ERROR;
         strcpy(server->last_error, get_thread_creation_error_message());
+        server_reactors_release(server);
         return false;
     }
+    server->lazy_free_running = true;
+
+    if (server->aof != NULL)
+    {
+        if (pthread_create(&server->aof_thread, NULL, server_aof_thread, server) != get_thread_success_code())
+        {
+            server->status = SERVER_STATUS_ERROR;
+            strcpy(server->last_error, get_thread_creation_error_message());
+            server_reactors_release(server);
+            return false;
+        }
+        server->aof_running = true;
+    }
 
+    printf("Server listening on port %d with %u reactor threads\n",
+           server->config.port, server->reactor_count);
     return true;
 }
 
@@ -402,11 +1625,8 @@ bool server_stop(server_instance_t *server, uint32_t timeout_ms)
 
     server->status = SERVER_STATUS_SHUTTING_DOWN;
 
-    // Закрываем основной сокет сервера
-    if (server->server_fd >= get_initial_server_fd())
-    {
-        shutdown(server->server_fd, get_socket_shutdown_mode());
-    }
+    // Закрываем listening сокеты всех reactors
+    server_shutdown_listeners(server);
 
     time_t start_wait_time = time(NULL);
     while (server->client_count > get_initial_client_count() &&
@@ -422,6 +1642,7 @@ bool server_stop(server_instance_t *server, uint32_t timeout_ms)
     }
 
     server->status = SERVER_STATUS_STOPPED;
+    server_wake_reactors(server);
     return true;
 }
 
@@ -434,10 +1655,8 @@ void server_force_shutdown(server_instance_t *server)
 
     server->status = SERVER_STATUS_STOPPED;
 
-    if (server->server_fd >= get_initial_server_fd())
-    {
-        shutdown(server->server_fd, get_socket_shutdown_mode());
-    }
+    server_shutdown_listeners(server);
+    server_wake_reactors(server);
 }
 
 void server_destroy(server_instance_t *server)
@@ -459,24 +1678,39 @@ void server_destroy(server_instance_t *server)
         return;
     }
 
+    // reactors and the storage maintenance threads touch clients and storage - they must be gone first
+    server_expire_release(server);
+    server_defrag_release(server);
+    server_lazy_free_release(server);
+    server_aof_release(server);
+    if (server->reactors != NULL)
+    {
+        server_reactors_release(server);
+        free(server->reactors);
+        server->reactors = NULL;
+        server->reactor_count = 0;
+    }
+
     // free 4 - освобождаем массив клиентов
     if (server->clients != NULL)
     {
-        uint32_t clients_to_clean = server->client_count;
-        if (clients_to_clean > server->actual_max_clients)
-        {
-            clients_to_clean = server->actual_max_clients;
-        }
-
-        for (size_t i = 0; i < clients_to_clean; i++)
+        // slots are not packed, every entry has to be inspected
+        for (size_t i = 0; i < server->actual_max_clients; i++)
         {
-            if (server->clients[i].fd >= 0)
+            if (server->clients[i].connected && server->clients[i].fd >= 0)
             {
                 // pay attention to safety 💥
-                close(server->clients[i].fd);
+                // the reactors are gone: sends still in flight are reset, not orphaned
+                server->clients[i].conn.context = NULL;
+                connection_close(server->clients[i].fd, &server->clients[i].conn);
                 server->clients[i].fd = -1;
             }
 
+            connection_state_release(&server->clients[i].conn);
+            output_queue_release(&server->clients[i].uring.sending);
+            free(server->clients[i].uring.iov);
+            server->clients[i].uring.iov = NULL;
+
             server->clients[i].connected = false;
 
             /* void *smemset(void *s, int c, size_t n);
@@ -488,38 +1722,27 @@ void server_destroy(server_instance_t *server)
             sizeof: In C (unlike C++), when you declare a structure, you need to use the struct keyword before the name.
             but I'd rather do a typedef.
             */
-            smemset(&server->clients[i].addr, 0, sizeof(sockaddr_in_t));
+            smemset(&server->clients[i].addr, 0, sizeof(server->clients[i].addr));
         }
 
         free(server->clients);
         server->clients = NULL;
+        free(server->free_slots);
+        server->free_slots = NULL;
     }
 
     pthread_mutex_destroy(&server->clients_lock);
 
-    // free 3 - освобождаем бакеты хранилища
+    // a snapshot child still writing is waited for; nothing appends any more, what is still buffered goes to disk now
+    snapshot_destroy(server->snapshot);
+    server->snapshot = NULL;
+    aof_close(server->aof);
+    server->aof = NULL;
+
+    // free 3 - освобождаем хранилище вместе со всеми записями
     if (server->storage != NULL)
     {
-        // Освобождаем все узлы в бакетах
-        if (server->storage->buckets != NULL)
-        {
-            for (size_t i = 0; i < server->storage->capacity; i++) // Начинаем с 0!
-            {
-                storage_node_t *current = server->storage->buckets[i];
-                while (current != NULL)
-                {
-                    storage_node_t *next = current->next;
-                    free(current);
-                    current = next;
-                }
-                server->storage->buckets[i] = NULL;
-            }
-            free(server->storage->buckets);
-            server->storage->buckets = NULL;
-        }
-
-        pthread_mutex_destroy(&server->storage->lock);
-        free(server->storage);
+        storage_destroy(server->storage);
         server->storage = NULL; // Важно: обнуляем указатель
     }
 
@@ -547,11 +1770,32 @@ bool server_get_stats(const server_instance_t *server, server_stats_t *stats)
 
     stats->connections_total = get_initial_connection_count();
     stats->commands_processed = get_initial_command_count();
-    stats->keys_stored = server->storage->size;
-    stats->memory_used = get_initial_memory_usage();
+
+    // counters are per reactor to keep the hot path free of shared writes
+    for (uint32_t i = 0; i < server->reactor_count; i++)
+    {
+        const server_reactor_t *reactor = &server->reactors[i];
+        stats->connections_total += atomic_load_explicit(&reactor->connections_total, memory_order_relaxed);
+        stats->commands_processed += atomic_load_explicit(&reactor->commands.commands_processed, memory_order_relaxed);
+    }
+
+    stats->keys_stored = storage_size(server->storage);
+    stats->memory_used = storage_memory_used(server->storage);
     stats->connected_clients = server->client_count;
     stats->uptime_seconds = get_server_uptime_seconds(server);
 
+    snapshot_stats_t snapshot = {0};
+    if (server->snapshot != NULL)
+    {
+        snapshot_get_stats(server->snapshot, &snapshot);
+    }
+    stats->snapshots_saved = snapshot.saves;
+    stats->snapshot_deltas = snapshot.deltas;
+    stats->snapshot_in_progress = snapshot.in_progress;
+    stats->snapshot_fork_us = snapshot.last_fork_us;
+    stats->snapshot_max_fork_us = snapshot.max_fork_us;
+    stats->snapshot_cow_bytes = snapshot.last_cow_bytes;
+
     return true;
 }
 
@@ -581,11 +1825,16 @@ server_config_t server_config_default(void)
     config.port = get_server_default_port();
     config.max_clients = get_server_max_clients();
     config.max_memory = get_default_max_memory();
+    config.eviction_policy = get_default_eviction_policy();
     config.mode = get_default_server_mode();
     config.bind_address = get_default_bind_address();
     config.data_directory = get_default_data_directory();
     config.persistence_enabled = get_default_persistence_enabled();
     config.persistence_interval = get_default_persistence_interval();
+    config.reactor_threads = get_default_reactor_threads();
+    config.io_backend = get_default_io_backend();
+    config.zerocopy_threshold = get_default_zerocopy_threshold();
+    config.aof_fsync_policy = get_default_aof_fsync_policy();
     return config;
 }
 
@@ -610,6 +1859,31 @@ bool server_config_validate(const server_config_t *config, char *error_buffer, s
         return false;
     }
 
+    if (config->reactor_threads > get_max_reactor_threads())
+    {
+        snprintf(error_buffer, error_size, get_invalid_reactor_count_error_message(), get_max_reactor_threads());
+        return false;
+    }
+
+    if (config->io_backend != SERVER_IO_BACKEND_EPOLL && config->io_backend != SERVER_IO_BACKEND_IO_URING)
+    {
+        snprintf(error_buffer, error_size, get_invalid_io_backend_error_message());
+        return false;
+    }
+
+    if (config->eviction_policy != STORAGE_EVICTION_LRU && config->eviction_policy != STORAGE_EVICTION_LFU)
+    {
+        snprintf(error_buffer, error_size, get_invalid_eviction_policy_error_message());
+        return false;
+    }
+
+    if (config->aof_fsync_policy != AOF_FSYNC_EVERYSEC && config->aof_fsync_policy != AOF_FSYNC_ALWAYS &&
+        config->aof_fsync_policy != AOF_FSYNC_NO)
+    {
+        snprintf(error_buffer, error_size, get_invalid_aof_fsync_error_message());
+        return false;
+    }
+
     return true;
 }
 
@@ -636,47 +1910,77 @@ bool server_config_save(const char *filename, const server_config_t *config)
 
 // ==================== Advanced Features ====================
 
+/*
+Every change is in the log already: saving makes sure it is on disk and
+writes a snapshot from a forked child, so the next start only replays the
+log from there. Only the caller waits for the child.
+*/
 bool server_save_data(server_instance_t *server)
 {
     if (server == NULL)
     {
         return false;
     }
-    return true;
+    return server->aof == NULL || (aof_sync(server->aof) && snapshot_save(server->snapshot));
 }
 
+/*
+Loads the snapshot, then replays the log records written after it. Like
+the storage settings, it must run before server_start(); the journal is
+detached meanwhile, and records still buffered are written out first so
+none is missed.
+*/
 bool server_load_data(server_instance_t *server)
 {
-    if (server == NULL)
+    if (server == NULL || server->status == SERVER_STATUS_RUNNING)
     {
         return false;
     }
-    return true;
-}
+    if (!server->config.persistence_enabled)
+    {
+        return true;
+    }
 
-bool server_flush_data(server_instance_t *server)
-{
-    if (server == NULL || server->storage == NULL)
+    char path[PATH_MAX];
+    char snapshot_path[PATH_MAX];
+    if (!server_data_path(server, get_aof_file_name(), path, sizeof(path)) ||
+        !server_data_path(server, get_snapshot_file_name(), snapshot_path, sizeof(snapshot_path)) ||
+        (server->aof != NULL && !aof_sync(server->aof)))
     {
         return false;
     }
 
-    pthread_mutex_lock(&server->storage->lock);
+    size_t keys = 0;
+    size_t records = 0;
+    uint64_t log_segment = 0;
+    uint64_t log_offset = 0;
+    storage_set_journal(server->storage, NULL, NULL);
+    bool loaded = snapshot_load(snapshot_path, server->storage, &log_segment, &log_offset, &keys) &&
+                  aof_load(path, server->storage, log_segment, log_offset, &server->aof_segment, &records);
+    if (server->aof != NULL)
+    {
+        storage_set_journal(server->storage, aof_journal, server->aof);
+    }
 
-    for (size_t i = get_initial_storage_size(); i < server->storage->capacity; i++)
+    if (loaded && keys > 0)
     {
-        storage_node_t *current = server->storage->buckets[i];
-        while (current != NULL)
-        {
-            storage_node_t *next = current->next;
-            free(current); // free для каждого узла при flush
-            current = next;
-        }
-        server->storage->buckets[i] = NULL;
+        printf("Loaded %zu keys from %s\n", keys, snapshot_path);
+    }
+    if (loaded && records > 0)
+    {
+        printf("Loaded %zu records from %s\n", records, path);
+    }
+    return loaded;
+}
+
+bool server_flush_data(server_instance_t *server)
+{
+    if (server == NULL || server->storage == NULL)
+    {
+        return false;
     }
 
-    server->storage->size = get_initial_storage_size();
-    pthread_mutex_unlock(&server->storage->lock);
+    storage_flush(server->storage);
 
     return true;
 }
@@ -0,0 +1,110 @@
+/**
+ * @file constants.c
+ * @brief Storage constants implementation
+ */
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/constants.h"
+
+// ==================== Hash Table Constants ====================
+
+static const size_t STORAGE_SHARD_COUNT = 64; // well above the core count, keeps collisions on one lock rare
+static const size_t STORAGE_MIN_CAPACITY = 16;
+static const size_t STORAGE_MAX_LOAD_PERCENT = 75;
+static const size_t STORAGE_GROW_LOAD_PERCENT = 50; // below it a resize only sweeps tombstones
+static const size_t STORAGE_REHASH_STEP = 16;       // drains the old table long before the new one fills
+
+// ==================== Expiry Constants ====================
+
+static const uint64_t STORAGE_WHEEL_TICK_MS = 100; // 10 cycles per second, like the usual server hz
+static const size_t STORAGE_EXPIRE_BUDGET = 256;   // bounds how long a cycle holds one shard lock
+
+// ==================== Eviction Constants ====================
+
+static const uint64_t STORAGE_LRU_RESOLUTION_MS = 100; // 2^24 steps wrap after about 19 days
+static const size_t STORAGE_EVICTION_SAMPLES = 5;      // with the candidate pool close to true LRU
+static const size_t STORAGE_EVICTION_SCAN = 64;
+static const size_t STORAGE_EVICTION_ROUNDS = 8; // the last one scans without limit
+static const size_t STORAGE_SKETCH_COUNTERS = 262144;        // 256KB, four counters per key for 64K keys
+static const size_t STORAGE_SKETCH_AGING_INTERVAL = 655360; // ten accesses per key the sketch is sized for
+
+// ==================== Scan Constants ====================
+
+static const size_t STORAGE_SCAN_VISIT_FACTOR = 10; // keeps SCAN over a sparse table bounded
+
+// ==================== Lazy Free Constants ====================
+
+static const size_t STORAGE_LAZY_FREE_BYTES = 262144; // from here values are malloc'd, freeing one may munmap()
+static const uint64_t STORAGE_LAZY_FREE_WAIT_MS = 100;
+
+// ==================== Dirty Tracking Constants ====================
+
+static const size_t STORAGE_DIRTY_MAX_KEYS = 65536; // 4M keys over 64 shards, past that a full snapshot is due anyway
+
+// ==================== Defragmentation Constants ====================
+
+static const uint64_t STORAGE_DEFRAG_INTERVAL_MS = 100;
+static const uint64_t STORAGE_DEFRAG_BUDGET_US = 1000;         // 1% of a core at the default interval
+static const size_t STORAGE_DEFRAG_SCAN = 256;                 // slots per shard lock hold
+static const size_t STORAGE_DEFRAG_IGNORE_BYTES = 104857600;   // 100MB of waste is never worth the copies
+static const size_t STORAGE_DEFRAG_THRESHOLD_PERCENT = 10;
+
+// ==================== Slab Allocator Constants ====================
+
+static const size_t SLAB_PAGE_SIZE = 1048576;     // 1MB
+static const size_t SLAB_MIN_CHUNK_SIZE = 16;     // free list link, keeps chunks 16-byte aligned
+static const size_t SLAB_MAX_CHUNK_SIZE = 262144; // at least three chunks per page besides its header
+static const size_t SLAB_GROWTH_PERCENT = 125;    // at most a fifth of a chunk is wasted
+static const size_t SLAB_MAGAZINE_BYTES = 65536;  // caps what one thread hoards of a big class
+static const size_t SLAB_SPARSE_PAGE_PERCENT = 50; // pages less used than this are evacuated
+
+// ==================== Hash Table Constants Getters ====================
+
+size_t get_storage_shard_count(void) { return STORAGE_SHARD_COUNT; }
+size_t get_storage_min_capacity(void) { return STORAGE_MIN_CAPACITY; }
+size_t get_storage_max_load_percent(void) { return STORAGE_MAX_LOAD_PERCENT; }
+size_t get_storage_grow_load_percent(void) { return STORAGE_GROW_LOAD_PERCENT; }
+size_t get_storage_rehash_step(void) { return STORAGE_REHASH_STEP; }
+
+// ==================== Expiry Constants Getters ====================
+
+uint64_t get_storage_wheel_tick_ms(void) { return STORAGE_WHEEL_TICK_MS; }
+size_t get_storage_expire_budget(void) { return STORAGE_EXPIRE_BUDGET; }
+
+// ==================== Eviction Constants Getters ====================
+
+uint64_t get_storage_lru_resolution_ms(void) { return STORAGE_LRU_RESOLUTION_MS; }
+size_t get_storage_eviction_samples(void) { return STORAGE_EVICTION_SAMPLES; }
+size_t get_storage_eviction_scan(void) { return STORAGE_EVICTION_SCAN; }
+size_t get_storage_eviction_rounds(void) { return STORAGE_EVICTION_ROUNDS; }
+size_t get_storage_sketch_counters(void) { return STORAGE_SKETCH_COUNTERS; }
+size_t get_storage_sketch_aging_interval(void) { return STORAGE_SKETCH_AGING_INTERVAL; }
+
+// ==================== Scan Constants Getters ====================
+
+size_t get_storage_scan_visit_factor(void) { return STORAGE_SCAN_VISIT_FACTOR; }
+
+// ==================== Lazy Free Constants Getters ====================
+
+size_t get_storage_lazy_free_bytes(void) { return STORAGE_LAZY_FREE_BYTES; }
+uint64_t get_storage_lazy_free_wait_ms(void) { return STORAGE_LAZY_FREE_WAIT_MS; }
+
+// ==================== Dirty Tracking Constants Getters ====================
+
+size_t get_storage_dirty_max_keys(void) { return STORAGE_DIRTY_MAX_KEYS; }
+
+// ==================== Defragmentation Constants Getters ====================
+
+uint64_t get_storage_defrag_interval_ms(void) { return STORAGE_DEFRAG_INTERVAL_MS; }
+uint64_t get_storage_defrag_budget_us(void) { return STORAGE_DEFRAG_BUDGET_US; }
+size_t get_storage_defrag_scan(void) { return STORAGE_DEFRAG_SCAN; }
+size_t get_storage_defrag_ignore_bytes(void) { return STORAGE_DEFRAG_IGNORE_BYTES; }
+size_t get_storage_defrag_threshold_percent(void) { return STORAGE_DEFRAG_THRESHOLD_PERCENT; }
+
+// ==================== Slab Allocator Constants Getters ====================
+
+size_t get_slab_page_size(void) { return SLAB_PAGE_SIZE; }
+size_t get_slab_min_chunk_size(void) { return SLAB_MIN_CHUNK_SIZE; }
+size_t get_slab_max_chunk_size(void) { return SLAB_MAX_CHUNK_SIZE; }
+size_t get_slab_growth_percent(void) { return SLAB_GROWTH_PERCENT; }
+size_t get_slab_magazine_bytes(void) { return SLAB_MAGAZINE_BYTES; }
+size_t get_slab_sparse_page_percent(void) { return SLAB_SPARSE_PAGE_PERCENT; }
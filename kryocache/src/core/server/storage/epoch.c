@@ -0,0 +1,134 @@
+/**
+ * @file epoch.c
+ * @brief Epoch-based memory reclamation
+ *
+ * Every thread that reads storage owns a record announcing the global epoch
+ * it observed when entering a critical section (0 while outside). The global
+ * epoch only advances once all active records have caught up with it, so
+ * memory unlinked in epoch E is unreachable once the global epoch is E + 2:
+ * every reader still inside a section entered after the unlink.
+ */
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/epoch.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define EPOCH_QUIESCENT 0
+
+typedef struct epoch_record
+{
+    _Atomic(uint64_t) state; /**< Epoch observed on entry, EPOCH_QUIESCENT outside a section */
+    _Atomic(bool) in_use;    /**< Owned by a live thread */
+    struct epoch_record *next;
+} epoch_record_t;
+
+static _Atomic(uint64_t) g_epoch = 1;
+static _Atomic(epoch_record_t *) g_epoch_records;
+static _Thread_local epoch_record_t *t_epoch_record;
+static pthread_key_t g_epoch_key;
+static pthread_once_t g_epoch_once = PTHREAD_ONCE_INIT;
+
+// records are never freed: an exiting thread hands its record to the next one
+static void epoch_record_release(void *arg)
+{
+    epoch_record_t *record = arg;
+    atomic_store_explicit(&record->state, EPOCH_QUIESCENT, memory_order_release);
+    atomic_store_explicit(&record->in_use, false, memory_order_release);
+}
+
+static void epoch_init_key(void)
+{
+    pthread_key_create(&g_epoch_key, epoch_record_release);
+}
+
+static epoch_record_t *epoch_record_get(void)
+{
+    if (t_epoch_record != NULL)
+    {
+        return t_epoch_record;
+    }
+
+    pthread_once(&g_epoch_once, epoch_init_key);
+
+    epoch_record_t *record = atomic_load_explicit(&g_epoch_records, memory_order_acquire);
+    for (; record != NULL; record = record->next)
+    {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&record->in_use, &expected, true))
+        {
+            break;
+        }
+    }
+
+    if (record == NULL)
+    {
+        record = calloc(1, sizeof(epoch_record_t));
+        if (record == NULL)
+        {
+            abort(); // a reader without a record could have memory freed under it
+        }
+        atomic_init(&record->in_use, true);
+
+        epoch_record_t *head = atomic_load_explicit(&g_epoch_records, memory_order_relaxed);
+        do
+        {
+            record->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&g_epoch_records, &head, record,
+                                                        memory_order_release, memory_order_relaxed));
+    }
+
+    t_epoch_record = record;
+    pthread_setspecific(g_epoch_key, record);
+    return record;
+}
+
+void epoch_enter(void)
+{
+    epoch_record_t *record = epoch_record_get();
+    uint64_t epoch;
+
+    /*
+    The announcement must be visible before the first pointer load of the
+    section. If the epoch moved while announcing, a concurrent advance may
+    have missed it, so announce again.
+    */
+    do
+    {
+        epoch = atomic_load(&g_epoch);
+        atomic_store(&record->state, epoch);
+        atomic_thread_fence(memory_order_seq_cst);
+    } while (atomic_load(&g_epoch) != epoch);
+}
+
+void epoch_exit(void)
+{
+    atomic_store_explicit(&t_epoch_record->state, EPOCH_QUIESCENT, memory_order_release);
+}
+
+uint64_t epoch_current(void)
+{
+    return atomic_load(&g_epoch);
+}
+
+bool epoch_try_advance(void)
+{
+    uint64_t epoch = atomic_load(&g_epoch);
+
+    for (epoch_record_t *record = atomic_load_explicit(&g_epoch_records, memory_order_acquire);
+         record != NULL; record = record->next)
+    {
+        uint64_t state = atomic_load(&record->state);
+        if (state != EPOCH_QUIESCENT && state != epoch)
+        {
+            return false;
+        }
+    }
+
+    return atomic_compare_exchange_strong(&g_epoch, &epoch, epoch + 1);
+}
+
+bool epoch_is_safe(uint64_t retired_epoch)
+{
+    return atomic_load(&g_epoch) >= retired_epoch + 2;
+}
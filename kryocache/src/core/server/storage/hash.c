@@ -0,0 +1,151 @@
+/**
+ * @file hash.c
+ * @brief wyhash (final version 4) with a per-process seed
+ */
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/hash.h"
+#include "/Users/dimaeremin/kryosette-db/third-party/drs-generator/src/core/drs_generator.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+// wyhash default secret: odd 64-bit constants with balanced bit counts
+static const uint64_t HASH_SECRET[4] = {
+    0x2d358dccaa6c78a5ULL,
+    0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL,
+    0x4d5a2da51de1aa47ULL,
+};
+
+static uint64_t g_hash_seed;
+static pthread_once_t g_hash_once = PTHREAD_ONCE_INIT;
+
+// ==================== Primitives ====================
+
+static inline void hash_mum(uint64_t *a, uint64_t *b)
+{
+    __uint128_t product = (__uint128_t)*a * *b;
+    *a = (uint64_t)product;
+    *b = (uint64_t)(product >> 64);
+}
+
+static inline uint64_t hash_mix(uint64_t a, uint64_t b)
+{
+    hash_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t hash_read64(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t hash_read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// 1..3 bytes: first, middle and last byte cover every length without branching on it
+static inline uint64_t hash_read_small(const uint8_t *p, size_t length)
+{
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+}
+
+// ==================== Seed ====================
+
+/*
+drs_generator turns the raw entropy into the seed, so it is never the
+kernel value itself. Its outputs are decimal-digit mixes narrower than
+64 bits: two of them are folded together.
+*/
+static void hash_seed_init(void)
+{
+    uint64_t entropy[2];
+    if (getrandom(entropy, sizeof(entropy), GRND_NONBLOCK) != sizeof(entropy))
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        entropy[0] = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+        entropy[1] = ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)&entropy;
+    }
+
+    drs_generator generator;
+    drs_init(&generator, entropy[0], entropy[1]);
+    uint64_t high = drs_next(&generator);
+    uint64_t low = drs_next(&generator);
+    g_hash_seed = hash_mix(high ^ HASH_SECRET[0], low ^ entropy[0] ^ HASH_SECRET[1]);
+}
+
+void hash_init(void)
+{
+    pthread_once(&g_hash_once, hash_seed_init);
+}
+
+// ==================== Hash ====================
+
+uint64_t hash_bytes(const void *data, size_t length)
+{
+    const uint8_t *p = data;
+    uint64_t seed = g_hash_seed ^ hash_mix(g_hash_seed ^ HASH_SECRET[0], HASH_SECRET[1]);
+    uint64_t a;
+    uint64_t b;
+
+    if (length <= 16)
+    {
+        if (length >= 4)
+        {
+            size_t offset = (length >> 3) << 2;
+            a = (hash_read32(p) << 32) | hash_read32(p + offset);
+            b = (hash_read32(p + length - 4) << 32) | hash_read32(p + length - 4 - offset);
+        }
+        else if (length > 0)
+        {
+            a = hash_read_small(p, length);
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t remaining = length;
+        if (remaining >= 48)
+        {
+            uint64_t seed1 = seed;
+            uint64_t seed2 = seed;
+            do
+            {
+                seed = hash_mix(hash_read64(p) ^ HASH_SECRET[1], hash_read64(p + 8) ^ seed);
+                seed1 = hash_mix(hash_read64(p + 16) ^ HASH_SECRET[2], hash_read64(p + 24) ^ seed1);
+                seed2 = hash_mix(hash_read64(p + 32) ^ HASH_SECRET[3], hash_read64(p + 40) ^ seed2);
+                p += 48;
+                remaining -= 48;
+            } while (remaining >= 48);
+            seed ^= seed1 ^ seed2;
+        }
+
+        while (remaining > 16)
+        {
+            seed = hash_mix(hash_read64(p) ^ HASH_SECRET[1], hash_read64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+
+        // the last 16 bytes, overlapping already mixed ones for short tails
+        a = hash_read64(p + remaining - 16);
+        b = hash_read64(p + remaining - 8);
+    }
+
+    a ^= HASH_SECRET[1];
+    b ^= seed;
+    hash_mum(&a, &b);
+    return hash_mix(a ^ HASH_SECRET[0] ^ length, b ^ HASH_SECRET[1]);
+}
@@ -0,0 +1,65 @@
+/**
+ * @file constants.h
+ * @brief Storage constants definition header
+ *
+ * Sizing and resize policy of the storage hash table, expiry timing and
+ * eviction sampling.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // ==================== Hash Table Constants ====================
+    size_t get_storage_shard_count(void);       ///< Independently locked shards, power of two
+    size_t get_storage_min_capacity(void);      ///< Smallest slot count of a table
+    size_t get_storage_max_load_percent(void);  ///< Live entries plus tombstones that trigger a resize
+    size_t get_storage_grow_load_percent(void); ///< Live entries above this double the capacity on resize
+    size_t get_storage_rehash_step(void);       ///< Old slots migrated per write while rehashing
+
+    // ==================== Expiry Constants ====================
+    uint64_t get_storage_wheel_tick_ms(void); ///< Resolution of the timing wheel and period of the expiry cycle
+    size_t get_storage_expire_budget(void);   ///< Wheel entries handled per shard per expiry cycle
+
+    // ==================== Eviction Constants ====================
+    uint64_t get_storage_lru_resolution_ms(void);   ///< Period of one step of the 24-bit LRU clock
+    size_t get_storage_eviction_samples(void);      ///< Random entries looked at per pool refill
+    size_t get_storage_eviction_scan(void);         ///< Slots scanned from a random position to find one entry
+    size_t get_storage_eviction_rounds(void);       ///< Pool refills before an eviction gives up
+    size_t get_storage_sketch_counters(void);       ///< Counters of the LFU frequency sketch
+    size_t get_storage_sketch_aging_interval(void); ///< Accesses between two halvings of the sketch
+
+    // ==================== Scan Constants ====================
+    size_t get_storage_scan_visit_factor(void); ///< Home groups a SCAN call may visit per key requested
+
+    // ==================== Lazy Free Constants ====================
+    size_t get_storage_lazy_free_bytes(void);     ///< Values at least this long are freed in the background
+    uint64_t get_storage_lazy_free_wait_ms(void); ///< Longest a lazy-free cycle waits for work
+
+    // ==================== Dirty Tracking Constants ====================
+    size_t get_storage_dirty_max_keys(void); ///< Changed keys a shard tracks before its dirty set overflows
+
+    // ==================== Defragmentation Constants ====================
+    uint64_t get_storage_defrag_interval_ms(void);   ///< Period at which fragmentation is checked
+    uint64_t get_storage_defrag_budget_us(void);     ///< Time one defragmentation cycle may take
+    size_t get_storage_defrag_scan(void);            ///< Slots visited per shard lock hold
+    size_t get_storage_defrag_ignore_bytes(void);    ///< Slab waste below this never triggers defragmentation
+    size_t get_storage_defrag_threshold_percent(void); ///< Share of resident slab memory that must be waste
+
+    // ==================== Slab Allocator Constants ====================
+    size_t get_slab_page_size(void);      ///< Bytes mapped per slab page, a power of two
+    size_t get_slab_min_chunk_size(void); ///< Smallest size class, also the chunk alignment
+    size_t get_slab_max_chunk_size(void); ///< Largest size class, bigger requests bypass the slabs
+    size_t get_slab_growth_percent(void); ///< Size of each class relative to the previous one
+    size_t get_slab_magazine_bytes(void); ///< Most bytes of one class a thread keeps cached
+    size_t get_slab_sparse_page_percent(void); ///< Pages used below this share are evacuated by defragmentation
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,46 @@
+/**
+ * @file epoch.h
+ * @brief Epoch-based memory reclamation for lock-free storage readers
+ *
+ * Readers bracket every access to shared storage memory with
+ * epoch_enter()/epoch_exit(). Writers unlink memory first, then tag it with
+ * epoch_current() and free it only once epoch_is_safe() reports that every
+ * reader that could still see it has left its critical section.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief Start a read-side critical section on the calling thread
+     *
+     * Pointers loaded from storage stay valid until the matching epoch_exit().
+     * Sections do not nest.
+     */
+    void epoch_enter(void);
+    void epoch_exit(void);
+
+    /**
+     * @brief Epoch to tag memory with after it has been unlinked
+     */
+    uint64_t epoch_current(void);
+    /**
+     * @brief Advance the global epoch if every active reader has observed it
+     * @return true when the epoch moved forward
+     */
+    bool epoch_try_advance(void);
+    /**
+     * @brief Whether memory retired in `retired_epoch` can no longer be reached by any reader
+     */
+    bool epoch_is_safe(uint64_t retired_epoch);
+
+#ifdef __cplusplus
+}
+#endif
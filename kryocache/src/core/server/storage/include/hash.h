@@ -0,0 +1,29 @@
+/**
+ * @file hash.h
+ * @brief Seeded key hash of the storage
+ *
+ * wyhash-style word-at-a-time hash. The seed is drawn once per process, so
+ * an attacker cannot precompute keys that all land in the same probe chain.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief Draw the process seed; idempotent and thread-safe
+     *
+     * Must run before the first hash_bytes(): storage_create() takes care of it.
+     */
+    void hash_init(void);
+    uint64_t hash_bytes(const void *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,55 @@
+/**
+ * @file sketch.h
+ * @brief Count-min frequency sketch for LFU eviction and TinyLFU admission
+ *
+ * Estimates how often a key hash was seen recently with a few bits per key
+ * and no per-key state. All counters of one hash live in a single cache
+ * line, so recording an access costs one miss at most. Counters saturate at
+ * 15 and are all halved once enough accesses were recorded, so popularity
+ * that is not renewed fades away.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SKETCH_COUNTER_MAX 15
+
+    typedef struct sketch
+    {
+        size_t block_mask;           /**< Cache-line blocks minus one, their count is a power of two */
+        size_t aging_interval;       /**< Accesses between two halvings */
+        _Atomic(size_t) additions;   /**< Accesses recorded since the last halving */
+        _Atomic(uint64_t) words[];   /**< 8 counters per word, 8 words per block */
+    } sketch_t;
+
+    /**
+     * @param counters total counter count, rounded up to a power of two
+     * @param aging_interval accesses between two halvings of every counter
+     */
+    sketch_t *sketch_create(size_t counters, size_t aging_interval);
+    void sketch_destroy(sketch_t *sketch);
+    size_t sketch_bytes(const sketch_t *sketch);
+
+    /**
+     * @brief Record one access; safe to call from any thread without locking
+     *
+     * Concurrent updates of the same counter may be lost, which only makes
+     * the estimate a little more approximate.
+     */
+    void sketch_increment(sketch_t *sketch, uint64_t hash);
+    /**
+     * @return estimated recent accesses, 0 to SKETCH_COUNTER_MAX
+     */
+    uint32_t sketch_estimate(const sketch_t *sketch, uint64_t hash);
+
+#ifdef __cplusplus
+}
+#endif
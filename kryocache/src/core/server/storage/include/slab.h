@@ -0,0 +1,80 @@
+/**
+ * @file slab.h
+ * @brief Size-classed slab allocator for storage entries and values
+ *
+ * Memory is carved from large mmap'd pages into fixed-size chunks, one free
+ * list per size class. Classes grow by 1.25x, so a chunk wastes at most
+ * about a fifth of its size. Each thread keeps a small magazine of free
+ * chunks per class and only takes the class lock to refill or drain it in
+ * batches. Callers pass the requested length back on free, so chunks carry
+ * no header of their own. Requests above the largest class go to malloc.
+ *
+ * Sparse pages can be evacuated: slab_defrag_alloc() hands out a chunk in a
+ * denser page for a chunk worth moving, and slab_release_pages() returns
+ * pages left empty to the OS.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SLAB_MAX_CLASSES 64
+
+    /**
+     * @brief Utilization of one size class
+     *
+     * Chunks held in thread magazines count as free, and so do the parts of
+     * owned pages that were never carved.
+     */
+    typedef struct slab_class_stats
+    {
+        size_t chunk_size;
+        size_t pages;       /**< Resident pages owned by this class */
+        size_t chunks_used; /**< Chunks handed out and not freed */
+        size_t chunks_free; /**< Chunks carved and free, in free lists or magazines */
+    } slab_class_stats_t;
+
+    /**
+     * @brief Allocate `size` bytes from the matching size class
+     * @return NULL when out of memory
+     */
+    void *slab_alloc(size_t size);
+    /**
+     * @brief Return a chunk; `size` must be the value passed to slab_alloc()
+     */
+    void slab_free(void *ptr, size_t size);
+    /**
+     * @brief Bytes actually reserved for a request of `size` bytes
+     */
+    size_t slab_chunk_size(size_t size);
+    /**
+     * @brief Snapshot the utilization of every size class, smallest first
+     * @return number of classes, of which at most `capacity` are written
+     */
+    size_t slab_stats(slab_class_stats_t *stats, size_t capacity);
+
+    /**
+     * @brief Chunk to move the contents of `ptr` to, if moving it helps
+     *
+     * Returns NULL unless `ptr` lives in a sparse page whose live chunks
+     * fit into the other pages of its class. The caller copies the data,
+     * repoints every reference and frees `ptr` as usual.
+     * @param size the value passed to slab_alloc() for `ptr`
+     */
+    void *slab_defrag_alloc(const void *ptr, size_t size);
+    /**
+     * @brief Give pages without live chunks back to the OS with MADV_DONTNEED
+     * @return number of pages released
+     */
+    size_t slab_release_pages(void);
+
+#ifdef __cplusplus
+}
+#endif
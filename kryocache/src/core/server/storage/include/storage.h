@@ -0,0 +1,495 @@
+/**
+ * @file storage.h
+ * @brief Key/value storage of the cache server
+ *
+ * Open-addressing hash table with linear probing. When the load factor is
+ * exceeded a table of the new size is allocated and entries are moved over
+ * a few slots per write, so a resize never stalls a request. Keys and values
+ * are exact-length byte strings allocated from the slab allocator (slab.h).
+ * The keyspace is split into shards by the high hash bits, each with its
+ * own lock and table, so operations on different keys run in parallel.
+ * GET and EXISTS take no lock at all: writers publish slots with CAS and
+ * unlinked entries and tables are freed through epoch reclamation (epoch.h).
+ * Keys with a TTL are dropped lazily when accessed after their deadline and
+ * actively by a per-shard hierarchical timing wheel (storage_expire_cycle).
+ * Every byte held for keys, values and tables is accounted; above the
+ * memory limit writes first evict keys by sampled approximate LRU, or by
+ * LFU with TinyLFU admission (sketch.h).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+    Reference-counted value bytes. GET queues a reference instead of copying, so
+    a value stays alive after SET/FLUSH drop it from storage until every send
+    that points at it has completed.
+    */
+    typedef struct storage_value
+    {
+        _Atomic(uint32_t) refcount;
+        uint32_t length;
+        char data[];
+    } storage_value_t;
+
+    /*
+    Key and value of an entry are immutable once published: SET of an existing
+    key installs a new entry, so lock-free readers never see a key with a torn
+    value. Only the deadline changes in place (EXPIRE/PERSIST), and so does the
+    number of an integer entry (INCR), which is a single atomic word.
+
+    A value that is the canonical decimal form of a 64-bit integer is kept in
+    the entry itself instead of a separate value buffer.
+    */
+    typedef struct storage_entry
+    {
+        union
+        {
+            storage_value_t *value;          /**< Unless `integer_encoded` */
+            _Atomic(int64_t) integer;        /**< If `integer_encoded`, stored under the shard lock */
+        };
+        uint64_t hash;                       /**< hash_bytes() of the key, reused by resize and lookups */
+        _Atomic(uint64_t) expires_at;        /**< Unix time in ms, 0 = no TTL */
+        struct storage_entry *timer_next;    /**< Timing wheel list, shard lock only */
+        struct storage_entry **timer_pprev;  /**< Link pointing at this entry, NULL while not scheduled */
+        _Atomic(uint32_t) access;            /**< 24-bit LRU clock of the last access */
+        uint32_t key_length : 31;
+        uint32_t integer_encoded : 1;        /**< Fixed for the entry's lifetime */
+        char key[];
+    } storage_entry_t;
+
+    /**
+     * @brief One open-addressing table
+     *
+     * Slots hold words in the EHashPtr layout of third-party/ephemeral_hash_cas:
+     * the entry pointer in the low 48 bits and a 16-bit hash tag in the high bits, so
+     * readers skip mismatching entries without dereferencing them. Each slot
+     * also has a SwissTable-style control byte; lookups scan those a group
+     * of slots at a time before looking at any slot.
+     */
+    typedef struct storage_table
+    {
+        size_t capacity;             /**< Power of two, at least 16, fixed for the table's lifetime */
+        size_t used;                 /**< Live entries plus tombstones, written under the shard lock */
+        _Atomic(uint64_t) *control;  /**< capacity control bytes packed 8 per word, after the slots */
+        _Atomic(uint64_t) slots[];   /**< 0 = never used, STORAGE_TOMBSTONE = deleted */
+    } storage_table_t;
+
+    struct storage_retired;
+
+#define STORAGE_WHEEL_LEVELS 4
+#define STORAGE_WHEEL_SLOT_BITS 6
+#define STORAGE_WHEEL_SLOTS (1 << STORAGE_WHEEL_SLOT_BITS)
+
+    /**
+     * @brief Hierarchical timing wheel of the entries with a TTL
+     *
+     * Level 0 has one slot per tick, each higher level one slot per full turn
+     * of the level below. When a lower level wraps around, the matching slot
+     * of the level above is moved to `cascade` and redistributed from there
+     * within the cycle budget, so neither expiring nor cascading ever walks
+     * more than a bounded number of entries under the shard lock.
+     */
+    typedef struct storage_wheel
+    {
+        uint64_t tick;                                                      /**< Tick whose slot is handled next */
+        storage_entry_t *slots[STORAGE_WHEEL_LEVELS][STORAGE_WHEEL_SLOTS];
+        storage_entry_t *cascade[STORAGE_WHEEL_LEVELS];                     /**< Per level, a slot waiting to move down (0 unused) */
+    } storage_wheel_t;
+
+    struct storage_dirty_key;
+
+    /**
+     * @brief Keys of one shard changed since the set was last taken
+     *
+     * Each key is kept once however often it changes. Past
+     * get_storage_dirty_max_keys() keys the set is emptied and only
+     * remembers that it overflowed.
+     */
+    typedef struct storage_dirty
+    {
+        struct storage_dirty_key **keys; /**< Open addressing by hash, NULL = free slot */
+        size_t capacity;                 /**< Power of two, 0 until the first key */
+        size_t count;
+        bool overflowed;                 /**< Keys were dropped: any key of the shard may have changed */
+    } storage_dirty_t;
+
+    /**
+     * @brief Independently locked part of the keyspace
+     *
+     * Writers serialize on the lock; readers only load the table pointers and
+     * slots. Aligned to a cache line so that threads working on neighbouring
+     * shards do not bounce each other's lock and counters.
+     */
+    typedef struct storage_shard
+    {
+        _Alignas(64) pthread_mutex_t lock;
+        _Atomic(storage_table_t *) table;  /**< Receives every insert */
+        _Atomic(storage_table_t *) rehash; /**< Previous table while it is being drained, NULL otherwise */
+        _Atomic(uint64_t) tables_seq;      /**< Odd while table/rehash are being swapped */
+        size_t rehash_index;               /**< Next slot of `rehash` to migrate */
+        size_t size;                       /**< Live entries in both tables */
+        struct storage_retired *retired_head; /**< Unlinked memory waiting for its grace period, oldest first */
+        struct storage_retired *retired_tail;
+        storage_wheel_t wheel;
+        struct storage *storage;           /**< Owner, for the storage-wide memory counter */
+        size_t memory;                     /**< Bytes of the tables and entries of this shard */
+        storage_dirty_t dirty;             /**< Keys changed since storage_take_dirty(), while tracking */
+    } storage_shard_t;
+
+#define STORAGE_EVICTION_POOL_SIZE 16
+
+    /**
+     * @brief Eviction candidate, a copy of a sampled key
+     */
+    typedef struct storage_candidate
+    {
+        uint32_t score;   /**< Idle LRU clock steps, under LFU below the inverted frequency; highest goes first */
+        uint32_t access;  /**< Access stamp when sampled: evicted only if still unchanged */
+        uint64_t hash;
+        size_t key_length;
+        char *key;
+    } storage_candidate_t;
+
+    /**
+     * @brief Best eviction candidates seen so far, sorted by ascending score
+     *
+     * Keeps approximate LRU close to exact LRU with a handful of samples per
+     * eviction, with no per-access bookkeeping beyond the entry's stamp.
+     */
+    typedef struct storage_eviction_pool
+    {
+        pthread_mutex_t lock;
+        size_t count;
+        storage_candidate_t candidates[STORAGE_EVICTION_POOL_SIZE];
+    } storage_eviction_pool_t;
+
+    /**
+     * @brief Retired memory too costly to free under a shard lock
+     *
+     * Writers hand it over once its grace period passed, and
+     * storage_lazy_free_cycle() frees it on a background thread.
+     */
+    typedef struct storage_lazy_free
+    {
+        pthread_mutex_t lock;
+        pthread_cond_t queued;
+        bool enabled;                 /**< Otherwise everything is freed inline */
+        struct storage_retired *head; /**< Ready to be freed, no reader can reach it */
+        struct storage_retired *tail;
+    } storage_lazy_free_t;
+
+    typedef enum
+    {
+        STORAGE_EVICTION_LRU, /**< Evict the key idle for the longest time */
+        STORAGE_EVICTION_LFU  /**< Evict the least frequently used key; new keys must beat it to get in */
+    } storage_eviction_policy_t;
+
+    struct sketch;
+
+    typedef enum
+    {
+        STORAGE_JOURNAL_SET,    /**< Key now has `value`, expiring at `expires_at` */
+        STORAGE_JOURNAL_DELETE, /**< Key was deleted or evicted */
+        STORAGE_JOURNAL_EXPIRE, /**< Deadline of the key is now `expires_at` */
+        STORAGE_JOURNAL_FLUSH   /**< Every key was deleted */
+    } storage_journal_op_t;
+
+    /**
+     * @brief One change to the keyspace; the pointers are only valid during the call
+     *
+     * Deadlines are absolute, so replaying a record later gives the key the
+     * same deadline. Keys that expire are not recorded.
+     */
+    typedef struct storage_journal_record
+    {
+        storage_journal_op_t op;
+        const char *key;
+        size_t key_length;
+        const char *value;
+        size_t value_length;
+        uint64_t expires_at; /**< Unix time in ms, 0 = no TTL */
+    } storage_journal_record_t;
+
+    /**
+     * @brief Receives every change while the key's shard lock is held
+     *
+     * Changes of one key arrive in the order they were made. Must not call
+     * back into the storage.
+     */
+    typedef void (*storage_journal_fn)(const storage_journal_record_t *record, void *arg);
+
+    typedef struct storage
+    {
+        storage_shard_t *shards;
+        size_t shard_count;       /**< Power of two */
+        unsigned shard_shift;     /**< hash >> shard_shift is the shard index */
+        size_t initial_capacity;  /**< Per-shard table size after FLUSH */
+        size_t max_memory;        /**< Eviction threshold in bytes, 0 = unlimited */
+        _Atomic(uint32_t) lru_clock; /**< Current 24-bit LRU clock, refreshed by the expiry cycle */
+        struct sketch *sketch;    /**< Access frequencies, only under STORAGE_EVICTION_LFU */
+        storage_eviction_pool_t eviction;
+        storage_lazy_free_t lazy_free;
+        size_t defrag_shard;      /**< Where the next storage_defrag_cycle() resumes */
+        size_t defrag_slot;
+        storage_journal_fn journal; /**< NULL = changes are not recorded */
+        void *journal_arg;
+        bool track_dirty;         /**< Changed keys are added to their shard's dirty set */
+        _Alignas(64) _Atomic(size_t) memory_used; /**< Sum of the shards' memory plus fixed overhead */
+    } storage_t;
+
+    // ==================== Values ====================
+    storage_value_t *storage_value_create(const char *data, size_t length);
+    void storage_value_acquire(storage_value_t *value);
+    void storage_value_release(storage_value_t *value);
+
+    typedef enum
+    {
+        STORAGE_INCR_OK,
+        STORAGE_INCR_NOT_INTEGER, /**< The value is not a 64-bit integer */
+        STORAGE_INCR_OVERFLOW,    /**< The result would not fit in 64 bits */
+        STORAGE_INCR_NO_MEMORY
+    } storage_incr_status_t;
+
+    typedef enum
+    {
+        STORAGE_SET_OK,
+        STORAGE_SET_NOT_ADMITTED, /**< TinyLFU kept the keys it would have evicted for a less popular new one */
+        STORAGE_SET_NO_MEMORY     /**< The memory limit could not be met even after evicting */
+    } storage_set_status_t;
+
+#define STORAGE_TTL_PERSISTENT (-1) /**< storage_ttl(): the key has no TTL */
+#define STORAGE_TTL_MISSING (-2)    /**< storage_ttl(): the key does not exist */
+
+    // ==================== Storage ====================
+    /**
+     * @brief Create an empty storage
+     * @param initial_capacity total slot count hint, spread over the shards
+     */
+    storage_t *storage_create(size_t initial_capacity);
+    void storage_destroy(storage_t *storage);
+
+    /**
+     * @brief Insert or replace a key
+     *
+     * Takes over the caller's reference to `value`, also on failure. Fails
+     * when the memory limit cannot be met even after evicting, or when
+     * TinyLFU does not admit a new key; storage_set_expiring() tells which.
+     */
+    bool storage_set(storage_t *storage, const char *key, size_t key_length, storage_value_t *value);
+    /**
+     * @brief storage_set() with a TTL
+     * @param ttl_ms milliseconds until the key expires, 0 = no TTL
+     */
+    storage_set_status_t storage_set_expiring(storage_t *storage, const char *key, size_t key_length,
+                                              storage_value_t *value, uint64_t ttl_ms);
+    /**
+     * @brief Look a key up
+     * @return a reference the caller drops with storage_value_release(), or NULL
+     */
+    storage_value_t *storage_get(storage_t *storage, const char *key, size_t key_length);
+    /**
+     * @brief storage_get() for several keys, with their memory accesses overlapped
+     *
+     * Stores a reference or NULL for each key in `values`, in key order.
+     */
+    void storage_get_many(storage_t *storage, const char *const *keys, const size_t *key_lengths, size_t count,
+                          storage_value_t **values);
+    bool storage_exists(storage_t *storage, const char *key, size_t key_length);
+    /**
+     * @brief Add `delta` to the integer value of a key, atomically
+     *
+     * A missing key counts as 0 and is created without a TTL; an existing
+     * key keeps its TTL. The new value is stored in `result`.
+     */
+    storage_incr_status_t storage_incr(storage_t *storage, const char *key, size_t key_length, int64_t delta,
+                                       int64_t *result);
+    /**
+     * @return true when the key was present
+     */
+    bool storage_delete(storage_t *storage, const char *key, size_t key_length);
+    void storage_flush(storage_t *storage);
+    size_t storage_size(storage_t *storage);
+
+    // ==================== Memory ====================
+    /**
+     * @brief Set the memory limit; 0 disables eviction
+     *
+     * Must be called before the storage is shared between threads.
+     */
+    void storage_set_max_memory(storage_t *storage, size_t max_memory);
+    /**
+     * @brief Bytes allocated for keys, values and tables
+     */
+    size_t storage_memory_used(storage_t *storage);
+    /**
+     * @brief Choose how keys are evicted at the memory limit
+     *
+     * Under STORAGE_EVICTION_LFU every GET and SET is recorded in a frequency
+     * sketch, and a write that needs room for a new key fails if the key is
+     * estimated less popular than the one it would evict, so a one-off scan
+     * cannot push out the working set. Must be called before the storage is
+     * shared between threads.
+     * @return false when the sketch cannot be allocated
+     */
+    bool storage_set_eviction_policy(storage_t *storage, storage_eviction_policy_t policy);
+
+    // ==================== Lazy Free ====================
+    /**
+     * @brief Free flushed tables and very large values on another thread
+     *
+     * Once enabled, whoever calls storage_lazy_free_cycle() frees them;
+     * what is still queued when the storage is destroyed is freed then.
+     * Must be called before the storage is shared between threads.
+     */
+    void storage_set_lazy_free(storage_t *storage, bool enabled);
+    /**
+     * @brief Free everything queued, waiting up to `timeout_ms` for work
+     * @return number of tables and entries freed
+     */
+    size_t storage_lazy_free_cycle(storage_t *storage, uint64_t timeout_ms);
+
+    // ==================== Journal ====================
+    /**
+     * @brief Report every change of the keyspace to `fn`, or stop with NULL
+     *
+     * Must be called while no other thread uses the storage.
+     */
+    void storage_set_journal(storage_t *storage, storage_journal_fn fn, void *arg);
+    /**
+     * @brief Run `fn` while every shard is locked, so the keyspace cannot change
+     *
+     * Every change made before has been journaled and none after. Meant for
+     * fork(): the child starts from a keyspace no writer is in the middle of.
+     */
+    void storage_freeze(storage_t *storage, void (*fn)(void *arg), void *arg);
+    /**
+     * @brief Report every key of shard `shard_index` to `fn` as a STORAGE_JOURNAL_SET record
+     *
+     * Takes no lock, so the calling process must have the storage to itself,
+     * like a child forked under storage_freeze(). Keys whose deadline is at
+     * or before `now_ms` (Unix time) are left out, so two walks with the
+     * same `now_ms` report the same keys.
+     */
+    void storage_dump(storage_t *storage, size_t shard_index, uint64_t now_ms, storage_journal_fn fn, void *arg);
+
+    // ==================== Dirty Tracking ====================
+    /**
+     * @brief Start or stop recording which keys each shard changes
+     *
+     * Lets a snapshot write only what changed since the previous one. Must
+     * be called while no other thread uses the storage.
+     */
+    void storage_set_dirty_tracking(storage_t *storage, bool enabled);
+    /**
+     * @brief Move the dirty set of shard `shard_index` to `dirty`, leaving an empty one
+     *
+     * The caller holds the shard lock, e.g. under storage_freeze(), and
+     * frees `dirty` with storage_dirty_release().
+     */
+    void storage_take_dirty(storage_t *storage, size_t shard_index, storage_dirty_t *dirty);
+    /**
+     * @brief Report each key of `dirty` to `fn`: as STORAGE_JOURNAL_SET if present, else STORAGE_JOURNAL_DELETE
+     *
+     * Same conditions as storage_dump(): no lock is taken, and keys past
+     * `now_ms` count as deleted.
+     */
+    void storage_dump_dirty(storage_t *storage, const storage_dirty_t *dirty, uint64_t now_ms, storage_journal_fn fn,
+                            void *arg);
+    void storage_dirty_release(storage_dirty_t *dirty);
+
+    // ==================== Bulk Load ====================
+    /**
+     * @brief Index of the shard `key` belongs to
+     *
+     * Work split by shard runs in parallel without contending for shard
+     * locks. The mapping holds for the process only: hashes are seeded.
+     */
+    size_t storage_shard_of(storage_t *storage, const char *key, size_t key_length);
+    /**
+     * @brief Grow the tables of empty shards to hold `keys` keys between them
+     *
+     * Meant to run before a bulk load of known size, so the tables do not
+     * rehash over and over while they fill up.
+     */
+    void storage_reserve_keys(storage_t *storage, size_t keys);
+    /**
+     * @brief Apply a batch of STORAGE_JOURNAL_SET and STORAGE_JOURNAL_DELETE records, e.g. read back from disk
+     *
+     * Deadlines are absolute; a record already past its own deletes the
+     * key. A batch whose keys share a shard takes its lock only once. The
+     * memory limit is only enforced after the whole batch, by evicting.
+     * @return number of records handled; fewer than `count` when out of memory
+     */
+    size_t storage_restore(storage_t *storage, const storage_journal_record_t *records, size_t count);
+
+    // ==================== Expiry ====================
+    /**
+     * @brief Give an existing key a TTL; 0 expires it right away
+     * @return true when the key was present
+     */
+    bool storage_expire(storage_t *storage, const char *key, size_t key_length, uint64_t ttl_ms);
+    /**
+     * @return true when the key was present and had a TTL
+     */
+    bool storage_persist(storage_t *storage, const char *key, size_t key_length);
+    /**
+     * @return milliseconds left, STORAGE_TTL_PERSISTENT or STORAGE_TTL_MISSING
+     */
+    int64_t storage_ttl(storage_t *storage, const char *key, size_t key_length);
+    /**
+     * @brief Advance every shard's timing wheel and drop the keys that expired
+     *
+     * Meant to run every get_storage_wheel_tick_ms(). Handles at most
+     * get_storage_expire_budget() wheel entries per shard; a backlog is
+     * carried over to the next cycle. Also advances the LRU clock.
+     * @return number of keys removed
+     */
+    size_t storage_expire_cycle(storage_t *storage);
+
+    // ==================== Scan ====================
+    /**
+     * @brief Receives one key of storage_scan(); the key is only valid during the call
+     *
+     * Runs under a shard lock, so it must not call back into the storage.
+     */
+    typedef void (*storage_scan_fn)(const char *key, size_t key_length, void *arg);
+
+    /**
+     * @brief Report the next keys of an incremental walk over the keyspace
+     *
+     * Start with cursor 0 and pass back the returned cursor until it is 0
+     * again. Every key present for the whole walk is reported at least once,
+     * even when tables are resized in between; keys added or removed meanwhile
+     * may or may not be, and a key may be reported more than once. Each call
+     * reports about `count` keys and visits at most `count` times
+     * get_storage_scan_visit_factor() groups of slots, so it may report none.
+     * @return the cursor to continue from, 0 when the walk is complete
+     */
+    uint64_t storage_scan(storage_t *storage, uint64_t cursor, size_t count, storage_scan_fn fn, void *arg);
+
+    // ==================== Defragmentation ====================
+    /**
+     * @brief Move entries out of sparse slab pages and release emptied pages
+     *
+     * Visits at most get_storage_defrag_scan() slots per shard lock hold and
+     * stops once `budget_us` microseconds have passed or every shard was
+     * visited; the next call picks up where this one stopped. Only one
+     * thread may run it at a time.
+     * @return number of entries moved
+     */
+    size_t storage_defrag_cycle(storage_t *storage, uint64_t budget_us);
+
+#ifdef __cplusplus
+}
+#endif
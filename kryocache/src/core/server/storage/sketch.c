@@ -0,0 +1,135 @@
+/**
+ * @file sketch.c
+ * @brief Blocked count-min sketch with conservative update and halving
+ *
+ * A hash selects one 64-byte block and, within it, one byte counter in each
+ * of four rows of 16. The estimate is the smallest of the four; an access
+ * only increments the counters equal to that minimum, which keeps keys that
+ * share counters with a popular one from inheriting its count.
+ */
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/sketch.h"
+#include <stdlib.h>
+
+#define SKETCH_ROWS 4
+#define SKETCH_ROW_COUNTERS 16
+#define SKETCH_BLOCK_WORDS 8
+#define SKETCH_HALF_MASK 0x7F7F7F7F7F7F7F7FULL
+
+typedef struct sketch_slot
+{
+    size_t word;
+    unsigned shift;
+} sketch_slot_t;
+
+// the block comes from a remixed hash so it is independent of the row bits
+static void sketch_locate(const sketch_t *sketch, uint64_t hash, sketch_slot_t slots[SKETCH_ROWS])
+{
+    size_t block = (size_t)((hash * 0x9E3779B97F4A7C15ULL) >> 32) & sketch->block_mask;
+
+    for (unsigned row = 0; row < SKETCH_ROWS; row++)
+    {
+        unsigned counter = (unsigned)(hash >> (row * 4)) & (SKETCH_ROW_COUNTERS - 1);
+        slots[row].word = block * SKETCH_BLOCK_WORDS + row * 2 + counter / 8;
+        slots[row].shift = (counter % 8) * 8;
+    }
+}
+
+static uint32_t sketch_counter(const sketch_t *sketch, const sketch_slot_t *slot)
+{
+    uint64_t word = atomic_load_explicit((_Atomic(uint64_t) *)&sketch->words[slot->word], memory_order_relaxed);
+    return (uint32_t)(word >> slot->shift) & 0xFF;
+}
+
+sketch_t *sketch_create(size_t counters, size_t aging_interval)
+{
+    size_t blocks = 1;
+    while (blocks * SKETCH_BLOCK_WORDS * 8 < counters)
+    {
+        blocks *= 2;
+    }
+
+    sketch_t *sketch = calloc(1, sizeof(sketch_t) + blocks * SKETCH_BLOCK_WORDS * sizeof(uint64_t));
+    if (sketch == NULL)
+    {
+        return NULL;
+    }
+
+    sketch->block_mask = blocks - 1;
+    sketch->aging_interval = aging_interval > 0 ? aging_interval : 1;
+    atomic_init(&sketch->additions, 0);
+    return sketch;
+}
+
+void sketch_destroy(sketch_t *sketch)
+{
+    free(sketch);
+}
+
+size_t sketch_bytes(const sketch_t *sketch)
+{
+    return sizeof(sketch_t) + (sketch->block_mask + 1) * SKETCH_BLOCK_WORDS * sizeof(uint64_t);
+}
+
+/*
+Halve every counter. Increments racing with it may be lost or survive
+unhalved, either way the counters stay within a byte.
+*/
+static void sketch_age(sketch_t *sketch)
+{
+    size_t words = (sketch->block_mask + 1) * SKETCH_BLOCK_WORDS;
+    for (size_t i = 0; i < words; i++)
+    {
+        uint64_t word = atomic_load_explicit(&sketch->words[i], memory_order_relaxed);
+        atomic_store_explicit(&sketch->words[i], (word >> 1) & SKETCH_HALF_MASK, memory_order_relaxed);
+    }
+}
+
+void sketch_increment(sketch_t *sketch, uint64_t hash)
+{
+    sketch_slot_t slots[SKETCH_ROWS];
+    uint32_t counts[SKETCH_ROWS];
+    uint32_t minimum = SKETCH_COUNTER_MAX;
+
+    sketch_locate(sketch, hash, slots);
+    for (unsigned row = 0; row < SKETCH_ROWS; row++)
+    {
+        counts[row] = sketch_counter(sketch, &slots[row]);
+        minimum = counts[row] < minimum ? counts[row] : minimum;
+    }
+
+    if (minimum >= SKETCH_COUNTER_MAX)
+    {
+        return;
+    }
+
+    for (unsigned row = 0; row < SKETCH_ROWS; row++)
+    {
+        if (counts[row] == minimum)
+        {
+            atomic_fetch_add_explicit(&sketch->words[slots[row].word], (uint64_t)1 << slots[row].shift,
+                                      memory_order_relaxed);
+        }
+    }
+
+    // exactly one thread sees the count reach the interval
+    if (atomic_fetch_add_explicit(&sketch->additions, 1, memory_order_relaxed) + 1 == sketch->aging_interval)
+    {
+        sketch_age(sketch);
+        atomic_fetch_sub_explicit(&sketch->additions, sketch->aging_interval / 2, memory_order_relaxed);
+    }
+}
+
+uint32_t sketch_estimate(const sketch_t *sketch, uint64_t hash)
+{
+    sketch_slot_t slots[SKETCH_ROWS];
+    uint32_t minimum = SKETCH_COUNTER_MAX;
+
+    sketch_locate(sketch, hash, slots);
+    for (unsigned row = 0; row < SKETCH_ROWS; row++)
+    {
+        uint32_t count = sketch_counter(sketch, &slots[row]);
+        minimum = count < minimum ? count : minimum;
+    }
+    return minimum;
+}
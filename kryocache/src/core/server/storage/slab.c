@@ -0,0 +1,670 @@
+/**
+ * @file slab.c
+ * @brief Size-classed slab allocator with per-thread magazines and page defragmentation
+ */
+
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, madvise()
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/slab.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/constants.h"
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define SLAB_MAGAZINE_CAPACITY 32
+#define SLAB_LOOKUP_STEP 16
+#define SLAB_LOOKUP_LIMIT 1024
+
+/*
+Free chunks are linked through their own first bytes,
+which is why the smallest class must hold a pointer.
+*/
+typedef struct slab_free_chunk
+{
+    struct slab_free_chunk *next;
+} slab_free_chunk_t;
+
+typedef enum
+{
+    SLAB_PAGE_PARTIAL,  /**< Has free or uncarved chunks, on the owner's partial list */
+    SLAB_PAGE_FULL,     /**< Every chunk in use, on no list */
+    SLAB_PAGE_DRAINING, /**< Sparse, being emptied by the defragmenter, never allocated from */
+    SLAB_PAGE_RELEASED, /**< Given back to the OS, waiting on the released list for any class */
+} slab_page_state_t;
+
+struct slab_class;
+
+/*
+Header at the start of every page. Pages are mmap'd aligned to their own
+size, the same way as the arena allocator's chunks (data/tokens/core/core.c)
+but with the address trimmed, so the page of a chunk is found by masking.
+*/
+typedef struct slab_page
+{
+    struct slab_class *owner;
+    struct slab_page *prev; /**< Neighbours on the owner's partial or draining list */
+    struct slab_page *next;
+    slab_free_chunk_t *free_list;
+    size_t carved; /**< Chunks cut so far, in address order */
+    size_t live;   /**< Carved chunks not on free_list, those in magazines included */
+    slab_page_state_t state;
+    _Atomic(bool) draining; /**< Read by slab_free() without the class lock */
+} slab_page_t;
+
+typedef struct slab_page_list
+{
+    slab_page_t *head;
+    slab_page_t *tail;
+} slab_page_list_t;
+
+typedef struct slab_class
+{
+    size_t chunk_size;
+    size_t page_capacity;     /**< Chunks per page after the header */
+    size_t magazine_capacity; /**< Chunks a thread may cache, fewer for big classes */
+    slab_page_list_t partial; /**< Allocation takes the head, pages that regain room join the tail */
+    slab_page_list_t draining;
+    size_t page_count;        /**< Pages owned in any state but released */
+    size_t chunks_live;       /**< Sum of the pages' live counts */
+    size_t partial_room;      /**< Free and uncarved chunks of the partial pages */
+    pthread_mutex_t lock;
+} slab_class_t;
+
+typedef struct slab_magazine
+{
+    _Atomic(size_t) count; /**< Written by the owning thread only, read by slab_stats() */
+    void *chunks[SLAB_MAGAZINE_CAPACITY];
+} slab_magazine_t;
+
+/*
+Magazines of one thread. Like epoch records they are never freed: an
+exiting thread empties them and leaves them to the next thread.
+*/
+typedef struct slab_thread
+{
+    slab_magazine_t magazines[SLAB_MAX_CLASSES];
+    _Atomic(bool) in_use;
+    struct slab_thread *next;
+} slab_thread_t;
+
+/*
+Values are released from whichever reactor sends the last reply that
+references them, so the allocator is process-wide rather than per storage.
+*/
+static slab_class_t g_slab_classes[SLAB_MAX_CLASSES];
+static size_t g_slab_class_count;
+static uint8_t g_slab_lookup[SLAB_LOOKUP_LIMIT / SLAB_LOOKUP_STEP]; /**< Class of each small size, by 16-byte step */
+static pthread_once_t g_slab_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_slab_key;
+static _Atomic(slab_thread_t *) g_slab_threads;
+static slab_page_t *g_slab_released;
+static size_t g_slab_released_count;
+static pthread_mutex_t g_slab_released_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local slab_thread_t *t_slab_thread;
+
+// ==================== Size Classes ====================
+
+static void slab_thread_release(void *arg);
+static size_t slab_page_header_bytes(void);
+
+static size_t slab_round_chunk(size_t size)
+{
+    size_t alignment = get_slab_min_chunk_size();
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+static void slab_init_classes(void)
+{
+    size_t chunk_size = get_slab_min_chunk_size();
+
+    while (g_slab_class_count < SLAB_MAX_CLASSES && chunk_size <= get_slab_max_chunk_size())
+    {
+        slab_class_t *slab_class = &g_slab_classes[g_slab_class_count++];
+        size_t magazine = get_slab_magazine_bytes() / chunk_size;
+
+        slab_class->chunk_size = chunk_size;
+        slab_class->page_capacity = (get_slab_page_size() - slab_page_header_bytes()) / chunk_size;
+        slab_class->magazine_capacity = magazine < SLAB_MAGAZINE_CAPACITY ? magazine : SLAB_MAGAZINE_CAPACITY;
+        pthread_mutex_init(&slab_class->lock, NULL);
+
+        // grow by the factor, but at least by one alignment step
+        size_t next = slab_round_chunk(chunk_size * get_slab_growth_percent() / 100);
+        chunk_size = next > chunk_size ? next : chunk_size + get_slab_min_chunk_size();
+    }
+
+    size_t index = 0;
+    for (size_t step = 0; step < SLAB_LOOKUP_LIMIT / SLAB_LOOKUP_STEP; step++)
+    {
+        while (g_slab_classes[index].chunk_size < (step + 1) * SLAB_LOOKUP_STEP)
+        {
+            index++;
+        }
+        g_slab_lookup[step] = (uint8_t)index;
+    }
+
+    pthread_key_create(&g_slab_key, slab_thread_release);
+}
+
+static slab_class_t *slab_class_for(size_t size)
+{
+    pthread_once(&g_slab_once, slab_init_classes);
+
+    if (size == 0)
+    {
+        size = 1;
+    }
+    if (size <= SLAB_LOOKUP_LIMIT)
+    {
+        return &g_slab_classes[g_slab_lookup[(size - 1) / SLAB_LOOKUP_STEP]];
+    }
+
+    size_t low = 0;
+    size_t high = g_slab_class_count;
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if (g_slab_classes[middle].chunk_size < size)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low < g_slab_class_count ? &g_slab_classes[low] : NULL;
+}
+
+static size_t slab_class_index(const slab_class_t *slab_class)
+{
+    return (size_t)(slab_class - g_slab_classes);
+}
+
+// ==================== Pages ====================
+
+static size_t slab_page_header_bytes(void)
+{
+    return slab_round_chunk(sizeof(slab_page_t));
+}
+
+static slab_page_t *slab_page_of(const void *ptr)
+{
+    return (slab_page_t *)((uintptr_t)ptr & ~(uintptr_t)(get_slab_page_size() - 1));
+}
+
+static void slab_list_push(slab_page_list_t *list, slab_page_t *page)
+{
+    page->prev = list->tail;
+    page->next = NULL;
+    if (list->tail != NULL)
+    {
+        list->tail->next = page;
+    }
+    else
+    {
+        list->head = page;
+    }
+    list->tail = page;
+}
+
+static void slab_list_remove(slab_page_list_t *list, slab_page_t *page)
+{
+    if (page->prev != NULL)
+    {
+        page->prev->next = page->next;
+    }
+    else
+    {
+        list->head = page->next;
+    }
+
+    if (page->next != NULL)
+    {
+        page->next->prev = page->prev;
+    }
+    else
+    {
+        list->tail = page->prev;
+    }
+    page->prev = page->next = NULL;
+}
+
+// map twice the size and trim both ends to get an aligned page
+static slab_page_t *slab_page_map(void)
+{
+    size_t size = get_slab_page_size();
+    char *mapping = mmap(NULL, size * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    char *page = (char *)(((uintptr_t)mapping + size - 1) & ~(uintptr_t)(size - 1));
+    size_t head = (size_t)(page - mapping);
+    if (head > 0)
+    {
+        munmap(mapping, head);
+    }
+    munmap(page + size, size - head);
+    return (slab_page_t *)page;
+}
+
+// released pages are reused before new ones are mapped, by whichever class needs one
+static slab_page_t *slab_page_acquire(slab_class_t *slab_class)
+{
+    pthread_mutex_lock(&g_slab_released_lock);
+    slab_page_t *page = g_slab_released;
+    if (page != NULL)
+    {
+        g_slab_released = page->next;
+        g_slab_released_count--;
+    }
+    pthread_mutex_unlock(&g_slab_released_lock);
+
+    if (page == NULL && (page = slab_page_map()) == NULL)
+    {
+        return NULL;
+    }
+
+    *page = (slab_page_t){.owner = slab_class, .state = SLAB_PAGE_PARTIAL};
+    atomic_init(&page->draining, false);
+    slab_list_push(&slab_class->partial, page);
+    slab_class->page_count++;
+    slab_class->partial_room += slab_class->page_capacity;
+    return page;
+}
+
+/*
+Caller holds the class lock and has unlinked the page; nothing in it is
+live. The header stays resident, the rest goes back to the OS and reads
+as zeroes when the page is carved again.
+*/
+static void slab_page_release(slab_class_t *slab_class, slab_page_t *page)
+{
+    size_t system_page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t header = (slab_page_header_bytes() + system_page - 1) / system_page * system_page;
+    madvise((char *)page + header, get_slab_page_size() - header, MADV_DONTNEED);
+
+    slab_class->page_count--;
+    page->state = SLAB_PAGE_RELEASED;
+    atomic_store_explicit(&page->draining, false, memory_order_relaxed);
+
+    pthread_mutex_lock(&g_slab_released_lock);
+    page->next = g_slab_released;
+    g_slab_released = page;
+    g_slab_released_count++;
+    pthread_mutex_unlock(&g_slab_released_lock);
+}
+
+// called with the class lock held
+static void *slab_class_take(slab_class_t *slab_class)
+{
+    slab_page_t *page = slab_class->partial.head;
+    if (page == NULL && (page = slab_page_acquire(slab_class)) == NULL)
+    {
+        return NULL;
+    }
+
+    void *chunk = page->free_list;
+    if (chunk != NULL)
+    {
+        page->free_list = page->free_list->next;
+    }
+    else
+    {
+        chunk = (char *)page + slab_page_header_bytes() + page->carved * slab_class->chunk_size;
+        page->carved++;
+    }
+
+    page->live++;
+    slab_class->chunks_live++;
+    slab_class->partial_room--;
+    if (page->live == slab_class->page_capacity)
+    {
+        slab_list_remove(&slab_class->partial, page);
+        page->state = SLAB_PAGE_FULL;
+    }
+    return chunk;
+}
+
+// called with the class lock held
+static void slab_class_put(slab_class_t *slab_class, void *ptr)
+{
+    slab_page_t *page = slab_page_of(ptr);
+    slab_free_chunk_t *chunk = ptr;
+
+    chunk->next = page->free_list;
+    page->free_list = chunk;
+    page->live--;
+    slab_class->chunks_live--;
+
+    if (page->state == SLAB_PAGE_FULL)
+    {
+        page->state = SLAB_PAGE_PARTIAL;
+        slab_list_push(&slab_class->partial, page);
+    }
+    if (page->state == SLAB_PAGE_PARTIAL)
+    {
+        slab_class->partial_room++;
+    }
+}
+
+// ==================== Magazines ====================
+
+static size_t slab_magazine_count(const slab_magazine_t *magazine)
+{
+    return atomic_load_explicit(&magazine->count, memory_order_relaxed);
+}
+
+static void slab_magazine_set_count(slab_magazine_t *magazine, size_t count)
+{
+    atomic_store_explicit(&magazine->count, count, memory_order_relaxed);
+}
+
+/*
+A thread that exits hands its cached chunks back, otherwise they would be
+lost to every other thread.
+*/
+static void slab_thread_release(void *arg)
+{
+    slab_thread_t *thread = arg;
+
+    for (size_t i = 0; i < g_slab_class_count; i++)
+    {
+        slab_magazine_t *magazine = &thread->magazines[i];
+        size_t count = slab_magazine_count(magazine);
+        if (count == 0)
+        {
+            continue;
+        }
+
+        slab_class_t *slab_class = &g_slab_classes[i];
+        pthread_mutex_lock(&slab_class->lock);
+        for (size_t c = 0; c < count; c++)
+        {
+            slab_class_put(slab_class, magazine->chunks[c]);
+        }
+        slab_magazine_set_count(magazine, 0);
+        pthread_mutex_unlock(&slab_class->lock);
+    }
+
+    t_slab_thread = NULL;
+    atomic_store_explicit(&thread->in_use, false, memory_order_release);
+}
+
+static slab_thread_t *slab_thread_get(void)
+{
+    if (t_slab_thread != NULL)
+    {
+        return t_slab_thread;
+    }
+
+    slab_thread_t *thread = atomic_load_explicit(&g_slab_threads, memory_order_acquire);
+    for (; thread != NULL; thread = thread->next)
+    {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&thread->in_use, &expected, true))
+        {
+            break;
+        }
+    }
+
+    if (thread == NULL)
+    {
+        thread = calloc(1, sizeof(slab_thread_t));
+        if (thread == NULL)
+        {
+            return NULL;
+        }
+        atomic_init(&thread->in_use, true);
+
+        slab_thread_t *head = atomic_load_explicit(&g_slab_threads, memory_order_relaxed);
+        do
+        {
+            thread->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&g_slab_threads, &head, thread, memory_order_release,
+                                                        memory_order_relaxed));
+    }
+
+    t_slab_thread = thread;
+    pthread_setspecific(g_slab_key, thread);
+    return thread;
+}
+
+// NULL when the thread's magazines could not be allocated: the class is used directly
+static slab_magazine_t *slab_magazine_for(const slab_class_t *slab_class)
+{
+    if (slab_class->magazine_capacity == 0)
+    {
+        return NULL;
+    }
+
+    slab_thread_t *thread = slab_thread_get();
+    return thread != NULL ? &thread->magazines[slab_class_index(slab_class)] : NULL;
+}
+
+// refill half a magazine under one lock acquisition and return one more chunk
+static void *slab_magazine_refill(slab_class_t *slab_class, slab_magazine_t *magazine)
+{
+    size_t count = slab_magazine_count(magazine);
+
+    pthread_mutex_lock(&slab_class->lock);
+    void *chunk = slab_class_take(slab_class);
+    while (chunk != NULL && count < slab_class->magazine_capacity / 2)
+    {
+        void *cached = slab_class_take(slab_class);
+        if (cached == NULL)
+        {
+            break;
+        }
+        magazine->chunks[count++] = cached;
+    }
+    slab_magazine_set_count(magazine, count);
+    pthread_mutex_unlock(&slab_class->lock);
+
+    return chunk;
+}
+
+// drain the older half of a full magazine under one lock acquisition
+static void slab_magazine_drain(slab_class_t *slab_class, slab_magazine_t *magazine)
+{
+    size_t count = slab_magazine_count(magazine);
+    size_t keep = count / 2;
+
+    pthread_mutex_lock(&slab_class->lock);
+    for (size_t i = keep; i < count; i++)
+    {
+        slab_class_put(slab_class, magazine->chunks[i]);
+    }
+    slab_magazine_set_count(magazine, keep);
+    pthread_mutex_unlock(&slab_class->lock);
+}
+
+// ==================== Allocation ====================
+
+void *slab_alloc(size_t size)
+{
+    slab_class_t *slab_class = slab_class_for(size);
+    if (slab_class == NULL)
+    {
+        return malloc(size);
+    }
+
+    slab_magazine_t *magazine = slab_magazine_for(slab_class);
+    if (magazine == NULL)
+    {
+        pthread_mutex_lock(&slab_class->lock);
+        void *chunk = slab_class_take(slab_class);
+        pthread_mutex_unlock(&slab_class->lock);
+        return chunk;
+    }
+
+    size_t count = slab_magazine_count(magazine);
+    if (count > 0)
+    {
+        slab_magazine_set_count(magazine, count - 1);
+        return magazine->chunks[count - 1];
+    }
+
+    return slab_magazine_refill(slab_class, magazine);
+}
+
+void slab_free(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    slab_class_t *slab_class = slab_class_for(size);
+    if (slab_class == NULL)
+    {
+        free(ptr);
+        return;
+    }
+
+    // chunks of a draining page skip the magazine, so the page can empty out
+    slab_magazine_t *magazine = slab_magazine_for(slab_class);
+    if (magazine == NULL || atomic_load_explicit(&slab_page_of(ptr)->draining, memory_order_relaxed))
+    {
+        pthread_mutex_lock(&slab_class->lock);
+        slab_class_put(slab_class, ptr);
+        pthread_mutex_unlock(&slab_class->lock);
+        return;
+    }
+
+    if (slab_magazine_count(magazine) == slab_class->magazine_capacity)
+    {
+        slab_magazine_drain(slab_class, magazine);
+    }
+    size_t count = slab_magazine_count(magazine);
+    magazine->chunks[count] = ptr;
+    slab_magazine_set_count(magazine, count + 1);
+}
+
+size_t slab_chunk_size(size_t size)
+{
+    slab_class_t *slab_class = slab_class_for(size);
+    return slab_class != NULL ? slab_class->chunk_size : size;
+}
+
+/*
+Magazine counts are read without stopping their threads, so a class may be
+off by the few chunks moving between a magazine and its owner meanwhile.
+*/
+size_t slab_stats(slab_class_stats_t *stats, size_t capacity)
+{
+    pthread_once(&g_slab_once, slab_init_classes);
+
+    for (size_t i = 0; i < g_slab_class_count && i < capacity; i++)
+    {
+        slab_class_t *slab_class = &g_slab_classes[i];
+        size_t cached = 0;
+
+        pthread_mutex_lock(&slab_class->lock);
+        for (slab_thread_t *thread = atomic_load_explicit(&g_slab_threads, memory_order_acquire); thread != NULL;
+             thread = thread->next)
+        {
+            cached += slab_magazine_count(&thread->magazines[i]);
+        }
+
+        size_t used = slab_class->chunks_live > cached ? slab_class->chunks_live - cached : 0;
+        stats[i] = (slab_class_stats_t){
+            .chunk_size = slab_class->chunk_size,
+            .pages = slab_class->page_count,
+            .chunks_used = used,
+            .chunks_free = slab_class->page_count * slab_class->page_capacity - used,
+        };
+        pthread_mutex_unlock(&slab_class->lock);
+    }
+
+    return g_slab_class_count;
+}
+
+// ==================== Defragmentation ====================
+
+/*
+A partial page below the sparse threshold starts draining once the other
+partial pages of its class have room for everything still live in it, so
+moving its chunks never maps a new page. From then on it is off the
+partial list and every move out of it takes a chunk from a denser page.
+*/
+void *slab_defrag_alloc(const void *ptr, size_t size)
+{
+    slab_class_t *slab_class = slab_class_for(size);
+    if (slab_class == NULL)
+    {
+        return NULL;
+    }
+
+    slab_page_t *page = slab_page_of(ptr);
+    void *chunk = NULL;
+
+    pthread_mutex_lock(&slab_class->lock);
+    size_t room = slab_class->page_capacity - page->live;
+    if (page->state == SLAB_PAGE_PARTIAL &&
+        page->live * 100 < slab_class->page_capacity * get_slab_sparse_page_percent() &&
+        slab_class->partial_room - room >= page->live)
+    {
+        slab_list_remove(&slab_class->partial, page);
+        slab_class->partial_room -= room;
+        page->state = SLAB_PAGE_DRAINING;
+        atomic_store_explicit(&page->draining, true, memory_order_relaxed);
+        slab_list_push(&slab_class->draining, page);
+    }
+
+    if (page->state == SLAB_PAGE_DRAINING)
+    {
+        chunk = slab_class_take(slab_class);
+    }
+    pthread_mutex_unlock(&slab_class->lock);
+
+    return chunk;
+}
+
+/*
+Drained pages and partial pages left without a live chunk are released,
+except the last partial page of a class, which new allocations would only
+fault back in.
+*/
+size_t slab_release_pages(void)
+{
+    pthread_once(&g_slab_once, slab_init_classes);
+    size_t released = 0;
+
+    for (size_t i = 0; i < g_slab_class_count; i++)
+    {
+        slab_class_t *slab_class = &g_slab_classes[i];
+
+        pthread_mutex_lock(&slab_class->lock);
+        slab_page_t *next;
+        for (slab_page_t *page = slab_class->draining.head; page != NULL; page = next)
+        {
+            next = page->next;
+            if (page->live == 0)
+            {
+                slab_list_remove(&slab_class->draining, page);
+                slab_page_release(slab_class, page);
+                released++;
+            }
+        }
+
+        for (slab_page_t *page = slab_class->partial.head; page != NULL; page = next)
+        {
+            next = page->next;
+            if (page->live == 0 && slab_class->partial.head != slab_class->partial.tail)
+            {
+                slab_list_remove(&slab_class->partial, page);
+                slab_class->partial_room -= slab_class->page_capacity;
+                slab_page_release(slab_class, page);
+                released++;
+            }
+        }
+        pthread_mutex_unlock(&slab_class->lock);
+    }
+
+    return released;
+}
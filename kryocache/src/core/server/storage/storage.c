@@ -0,0 +1,2704 @@
+/**
+ * @file storage.c
+ * @brief Open-addressing hash table with incremental rehash and lock-free reads
+ */
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/storage.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/constants.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/slab.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/epoch.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/hash.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/sketch.h"
+#include <assert.h>
+#include <sched.h>
+#include <time.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Slot words. A tombstone marks a deleted slot: probing continues past it and
+inserts may reuse it. It is never dereferenced, so any non-zero word that
+cannot be an entry pointer will do.
+*/
+#define STORAGE_EMPTY ((uint64_t)0)
+#define STORAGE_TOMBSTONE ((uint64_t)1)
+#define STORAGE_NOT_FOUND SIZE_MAX
+#define STORAGE_LRU_CLOCK_MAX ((1U << 24) - 1)
+#define STORAGE_GET_BATCH 16 /**< Lookups whose cache misses storage_get_many() overlaps */
+
+typedef enum
+{
+    STORAGE_RETIRED_ENTRY,         /**< Replaced or deleted entry */
+    STORAGE_RETIRED_TABLE,         /**< Drained table, its entries live on in the new one */
+    STORAGE_RETIRED_TABLE_ENTRIES, /**< Flushed table together with every entry still in it */
+} storage_retired_kind_t;
+
+/*
+Memory unlinked by a writer that lock-free readers may still be using.
+Freed once the epoch it was retired in is safe.
+*/
+typedef struct storage_retired
+{
+    struct storage_retired *next;
+    uint64_t epoch;
+    storage_retired_kind_t kind;
+    void *ptr;
+} storage_retired_t;
+
+// where a lookup found its entry, for the writer that replaces or erases it
+typedef struct storage_location
+{
+    storage_table_t *table;
+    size_t index;
+} storage_location_t;
+
+// ==================== Values ====================
+
+/*
+Values are binary-safe: exactly `length` bytes are stored, without a
+terminating NUL, and they may contain NUL bytes themselves.
+*/
+storage_value_t *storage_value_create(const char *data, size_t length)
+{
+    storage_value_t *value = slab_alloc(sizeof(storage_value_t) + length);
+    if (value == NULL)
+    {
+        return NULL;
+    }
+
+    atomic_init(&value->refcount, 1);
+    value->length = (uint32_t)length;
+    memcpy(value->data, data, length);
+    return value;
+}
+
+void storage_value_acquire(storage_value_t *value)
+{
+    atomic_fetch_add_explicit(&value->refcount, 1, memory_order_relaxed);
+}
+
+/*
+The last reference may be dropped by a reactor after SET/FLUSH has already
+unlinked the value, so the decrement must order all prior reads of data.
+*/
+void storage_value_release(storage_value_t *value)
+{
+    if (value != NULL && atomic_fetch_sub_explicit(&value->refcount, 1, memory_order_acq_rel) == 1)
+    {
+        slab_free(value, sizeof(storage_value_t) + value->length);
+    }
+}
+
+// ==================== Entries ====================
+
+/*
+Only the canonical form is accepted: no sign on positive numbers, no leading
+zeros and no "-0", so formatting the number gives back the exact bytes.
+*/
+static bool storage_parse_integer(const char *data, size_t length, int64_t *integer)
+{
+    bool negative = length > 0 && data[0] == '-';
+    const char *digits = data + negative;
+    size_t count = length - negative;
+
+    if (count == 0 || count > 19 || (digits[0] == '0' && (count > 1 || negative)))
+    {
+        return false;
+    }
+
+    // accumulated as a negative number, whose range includes INT64_MIN
+    int64_t number = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (digits[i] < '0' || digits[i] > '9')
+        {
+            return false;
+        }
+
+        int digit = digits[i] - '0';
+        if (number < (INT64_MIN + digit) / 10)
+        {
+            return false;
+        }
+        number = number * 10 - digit;
+    }
+
+    if (!negative && number == INT64_MIN)
+    {
+        return false;
+    }
+    *integer = negative ? number : -number;
+    return true;
+}
+
+static storage_entry_t *storage_entry_alloc(const char *key, size_t key_length, uint64_t hash)
+{
+    storage_entry_t *entry = slab_alloc(sizeof(storage_entry_t) + key_length);
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    entry->hash = hash;
+    atomic_init(&entry->expires_at, 0);
+    entry->timer_next = NULL;
+    entry->timer_pprev = NULL;
+    atomic_init(&entry->access, 0);
+    entry->key_length = (uint32_t)key_length;
+    entry->integer_encoded = 0;
+    memcpy(entry->key, key, key_length);
+    return entry;
+}
+
+static storage_entry_t *storage_entry_create_integer(const char *key, size_t key_length, uint64_t hash,
+                                                     int64_t integer)
+{
+    storage_entry_t *entry = storage_entry_alloc(key, key_length, hash);
+    if (entry != NULL)
+    {
+        atomic_init(&entry->integer, integer);
+        entry->integer_encoded = 1;
+    }
+    return entry;
+}
+
+// takes over the reference to `value`, which is dropped right away if the entry holds it as an integer
+static storage_entry_t *storage_entry_create(const char *key, size_t key_length, uint64_t hash,
+                                             storage_value_t *value)
+{
+    int64_t integer;
+    if (storage_parse_integer(value->data, value->length, &integer))
+    {
+        storage_entry_t *entry = storage_entry_create_integer(key, key_length, hash, integer);
+        if (entry != NULL)
+        {
+            storage_value_release(value);
+        }
+        return entry;
+    }
+
+    storage_entry_t *entry = storage_entry_alloc(key, key_length, hash);
+    if (entry != NULL)
+    {
+        entry->value = value;
+    }
+    return entry;
+}
+
+static void storage_entry_destroy(storage_entry_t *entry)
+{
+    if (!entry->integer_encoded)
+    {
+        storage_value_release(entry->value);
+    }
+    slab_free(entry, sizeof(storage_entry_t) + entry->key_length);
+}
+
+/*
+Readers get the number as a value of its own, formatted when it is read:
+there is no shared buffer an INCR could change under them.
+*/
+static storage_value_t *storage_entry_format_integer(const storage_entry_t *entry)
+{
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%" PRId64,
+                          atomic_load_explicit(&entry->integer, memory_order_relaxed));
+    return storage_value_create(digits, (size_t)length);
+}
+
+// the cached hash rejects almost every mismatch before the key bytes are touched
+static bool storage_entry_matches(const storage_entry_t *entry, uint64_t hash, const char *key, size_t key_length)
+{
+    return entry->hash == hash && entry->key_length == key_length && memcmp(entry->key, key, key_length) == 0;
+}
+
+static uint64_t storage_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// the clock is only read for keys that have a TTL
+static bool storage_entry_live(const storage_entry_t *entry)
+{
+    uint64_t expires_at = atomic_load_explicit(&entry->expires_at, memory_order_relaxed);
+    return expires_at == 0 || expires_at > storage_now_ms();
+}
+
+// bits 32..47 are used neither by the table index nor by the shard selection
+static uint16_t storage_hash_tag(uint64_t hash)
+{
+    return (uint16_t)(hash >> 32);
+}
+
+/*
+Slot words keep the EHashPtr layout of third-party/ephemeral_hash_cas, but
+are encoded here: its header does not build warning-clean on its own.
+*/
+#define STORAGE_SLOT_POINTER_MASK ((UINT64_C(1) << 48) - 1)
+
+static uint64_t storage_slot_word(const storage_entry_t *entry, uint16_t tag)
+{
+    uintptr_t pointer = (uintptr_t)entry;
+    assert((pointer & ~STORAGE_SLOT_POINTER_MASK) == 0);
+    return ((uint64_t)tag << 48) | pointer;
+}
+
+static storage_entry_t *storage_slot_entry(uint64_t word)
+{
+    return (storage_entry_t *)(uintptr_t)(word & STORAGE_SLOT_POINTER_MASK);
+}
+
+static uint16_t storage_slot_tag(uint64_t word)
+{
+    return (uint16_t)(word >> 48);
+}
+
+// ==================== Control Groups ====================
+
+/*
+Every slot has a control byte: the 7-bit hash fragment H2 while it holds an
+entry, or one of the two markers below (the same encoding as SwissTable).
+Control bytes are kept in 64-bit words so that readers load them
+atomically, and they are matched a group at a time: 16 slots with SSE2 or
+NEON, 8 with the portable SWAR fallback. Defining STORAGE_PROBE_SCALAR at
+compile time forces the fallback on every target.
+*/
+#define STORAGE_CONTROL_EMPTY ((uint8_t)0x80)
+#define STORAGE_CONTROL_DELETED ((uint8_t)0xFE)
+#define STORAGE_CONTROL_LSBS 0x0101010101010101ULL
+#define STORAGE_CONTROL_MSBS 0x8080808080808080ULL
+
+#if !defined(STORAGE_PROBE_SCALAR) && defined(__SSE2__)
+#include <emmintrin.h>
+#define STORAGE_GROUP_WIDTH 16
+#define STORAGE_GROUP_SLOT_SHIFT 0 /**< log2 of mask bits per slot */
+#elif !defined(STORAGE_PROBE_SCALAR) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define STORAGE_GROUP_WIDTH 16
+#define STORAGE_GROUP_SLOT_SHIFT 2
+#else
+#define STORAGE_GROUP_WIDTH 8
+#define STORAGE_GROUP_SLOT_SHIFT 3
+#endif
+
+#define STORAGE_GROUP_WORDS (STORAGE_GROUP_WIDTH / 8)
+
+// bits 48..54 are used neither by the table index nor by the shard selection
+static uint8_t storage_hash_h2(uint64_t hash)
+{
+    return (uint8_t)((hash >> 48) & 0x7F);
+}
+
+/*
+The match helpers return one set bit per matching slot, at bit
+(slot << STORAGE_GROUP_SLOT_SHIFT).
+*/
+#if STORAGE_GROUP_WIDTH == 16 && defined(__SSE2__)
+
+static __m128i storage_group_load(_Atomic(uint64_t) *group)
+{
+    uint64_t low = atomic_load_explicit(&group[0], memory_order_acquire);
+    uint64_t high = atomic_load_explicit(&group[1], memory_order_acquire);
+    return _mm_set_epi64x((long long)high, (long long)low);
+}
+
+static uint64_t storage_group_match(_Atomic(uint64_t) *group, uint8_t h2)
+{
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(storage_group_load(group), _mm_set1_epi8((char)h2)));
+}
+
+static uint64_t storage_group_match_empty(_Atomic(uint64_t) *group)
+{
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(storage_group_load(group), _mm_set1_epi8((char)STORAGE_CONTROL_EMPTY)));
+}
+
+// both markers have the top bit set, H2 never does
+static uint64_t storage_group_match_free(_Atomic(uint64_t) *group)
+{
+    return (uint32_t)_mm_movemask_epi8(storage_group_load(group));
+}
+
+#elif STORAGE_GROUP_WIDTH == 16
+
+static uint8x16_t storage_group_load(_Atomic(uint64_t) *group)
+{
+    uint64_t low = atomic_load_explicit(&group[0], memory_order_acquire);
+    uint64_t high = atomic_load_explicit(&group[1], memory_order_acquire);
+    return vcombine_u8(vcreate_u8(low), vcreate_u8(high));
+}
+
+// NEON has no movemask: narrow each byte lane to a nibble, keep one bit of it
+static uint64_t storage_group_mask(uint8x16_t lanes)
+{
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(lanes), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ULL;
+}
+
+static uint64_t storage_group_match(_Atomic(uint64_t) *group, uint8_t h2)
+{
+    return storage_group_mask(vceqq_u8(storage_group_load(group), vdupq_n_u8(h2)));
+}
+
+static uint64_t storage_group_match_empty(_Atomic(uint64_t) *group)
+{
+    return storage_group_mask(vceqq_u8(storage_group_load(group), vdupq_n_u8(STORAGE_CONTROL_EMPTY)));
+}
+
+static uint64_t storage_group_match_free(_Atomic(uint64_t) *group)
+{
+    return storage_group_mask(vcltzq_s8(vreinterpretq_s8_u8(storage_group_load(group))));
+}
+
+#else
+
+/*
+SWAR zero-byte test. It can report a false match in the byte above a real
+one; callers verify every candidate against the slot anyway.
+*/
+static uint64_t storage_group_match(_Atomic(uint64_t) *group, uint8_t h2)
+{
+    uint64_t x = atomic_load_explicit(group, memory_order_acquire) ^ (STORAGE_CONTROL_LSBS * h2);
+    return (x - STORAGE_CONTROL_LSBS) & ~x & STORAGE_CONTROL_MSBS;
+}
+
+// exact: EMPTY is the only control byte with bit 7 set and bit 1 clear
+static uint64_t storage_group_match_empty(_Atomic(uint64_t) *group)
+{
+    uint64_t control = atomic_load_explicit(group, memory_order_acquire);
+    return control & ~(control << 6) & STORAGE_CONTROL_MSBS;
+}
+
+static uint64_t storage_group_match_free(_Atomic(uint64_t) *group)
+{
+    return atomic_load_explicit(group, memory_order_acquire) & STORAGE_CONTROL_MSBS;
+}
+
+#endif
+
+static size_t storage_group_next_slot(uint64_t *mask)
+{
+    size_t slot = (size_t)__builtin_ctzll(*mask) >> STORAGE_GROUP_SLOT_SHIFT;
+    *mask &= *mask - 1;
+    return slot;
+}
+
+// ==================== Tables ====================
+
+static storage_table_t *storage_table_create(size_t capacity)
+{
+    size_t control_words = capacity / 8;
+    storage_table_t *table =
+        calloc(1, sizeof(storage_table_t) + (capacity + control_words) * sizeof(_Atomic(uint64_t)));
+    if (table == NULL)
+    {
+        return NULL;
+    }
+
+    table->capacity = capacity;
+    table->control = &table->slots[capacity];
+    for (size_t i = 0; i < control_words; i++)
+    {
+        atomic_init(&table->control[i], STORAGE_CONTROL_LSBS * STORAGE_CONTROL_EMPTY);
+    }
+    return table;
+}
+
+static uint8_t storage_table_control(storage_table_t *table, size_t index)
+{
+    return (uint8_t)(atomic_load_explicit(&table->control[index / 8], memory_order_relaxed) >> (index % 8 * 8));
+}
+
+/*
+Only the shard lock holder stores control words, so a plain
+read-modify-store is atomic as far as readers can tell.
+*/
+static void storage_table_set_control(storage_table_t *table, size_t index, uint8_t control)
+{
+    _Atomic(uint64_t) *word = &table->control[index / 8];
+    unsigned shift = index % 8 * 8;
+    uint64_t value = atomic_load_explicit(word, memory_order_relaxed);
+    value = (value & ~(0xFFULL << shift)) | ((uint64_t)control << shift);
+    atomic_store_explicit(word, value, memory_order_release);
+}
+
+static void storage_table_destroy_entries(storage_table_t *table)
+{
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        uint64_t word = atomic_load_explicit(&table->slots[i], memory_order_relaxed);
+        if (word != STORAGE_EMPTY && word != STORAGE_TOMBSTONE)
+        {
+            // replies still queued on connections keep their own value reference
+            storage_entry_destroy(storage_slot_entry(word));
+        }
+    }
+}
+
+/*
+Safe without the shard lock. Probing goes group by group from the group of
+the home slot; a group with an EMPTY control byte ends it, so a miss
+usually costs one control load and no entry access at all. A control
+match is only a candidate: the slot word is checked against its tag and
+the entry against the full hash before the key bytes are compared, since
+a reader may see a control byte and a slot from different writes.
+*/
+static size_t storage_table_find(storage_table_t *table, uint64_t hash, const char *key, size_t key_length,
+                                 storage_entry_t **found)
+{
+    if (table == NULL)
+    {
+        return STORAGE_NOT_FOUND;
+    }
+
+    uint8_t h2 = storage_hash_h2(hash);
+    uint16_t tag = storage_hash_tag(hash);
+    size_t groups = table->capacity / STORAGE_GROUP_WIDTH;
+    size_t group = (hash & (table->capacity - 1)) / STORAGE_GROUP_WIDTH;
+
+    for (size_t probes = 0; probes < groups; probes++, group = (group + 1) & (groups - 1))
+    {
+        _Atomic(uint64_t) *control = &table->control[group * STORAGE_GROUP_WORDS];
+        for (uint64_t match = storage_group_match(control, h2); match != 0;)
+        {
+            size_t index = group * STORAGE_GROUP_WIDTH + storage_group_next_slot(&match);
+            uint64_t word = atomic_load_explicit(&table->slots[index], memory_order_acquire);
+            if (word != STORAGE_EMPTY && word != STORAGE_TOMBSTONE && storage_slot_tag(word) == tag &&
+                storage_entry_matches(storage_slot_entry(word), hash, key, key_length))
+            {
+                *found = storage_slot_entry(word);
+                return index;
+            }
+        }
+
+        if (storage_group_match_empty(control) != 0)
+        {
+            return STORAGE_NOT_FOUND;
+        }
+    }
+
+    return STORAGE_NOT_FOUND;
+}
+
+/*
+Writers hold the shard lock, so the CAS can only fail on a bug; it is the
+publication point that orders the entry's contents before its visibility.
+*/
+static void storage_slot_publish(_Atomic(uint64_t) *slot, uint64_t expected, uint64_t desired)
+{
+    bool published = atomic_compare_exchange_strong(slot, &expected, desired);
+    assert(published);
+    (void)published;
+}
+
+/*
+Place an entry whose key is known to be absent, in the first EMPTY or
+DELETED slot of its probe sequence. The load factor keeps at least one
+empty slot in the table, so the probe always terminates. The slot is
+published before its control byte: a reader that matches the control
+byte finds the entry in place.
+*/
+static void storage_table_insert(storage_table_t *table, uint64_t hash, storage_entry_t *entry)
+{
+    size_t groups = table->capacity / STORAGE_GROUP_WIDTH;
+    size_t group = (hash & (table->capacity - 1)) / STORAGE_GROUP_WIDTH;
+    uint64_t free_slots;
+
+    while ((free_slots = storage_group_match_free(&table->control[group * STORAGE_GROUP_WORDS])) == 0)
+    {
+        group = (group + 1) & (groups - 1);
+    }
+
+    size_t index = group * STORAGE_GROUP_WIDTH + storage_group_next_slot(&free_slots);
+    if (storage_table_control(table, index) == STORAGE_CONTROL_EMPTY)
+    {
+        table->used++;
+    }
+
+    uint64_t word = atomic_load_explicit(&table->slots[index], memory_order_relaxed);
+    storage_slot_publish(&table->slots[index], word, storage_slot_word(entry, storage_hash_tag(hash)));
+    storage_table_set_control(table, index, storage_hash_h2(hash));
+}
+
+// same key, so the control byte already holds its H2
+static void storage_table_replace(storage_table_t *table, size_t index, uint64_t hash, storage_entry_t *entry)
+{
+    uint64_t word = atomic_load_explicit(&table->slots[index], memory_order_relaxed);
+    storage_slot_publish(&table->slots[index], word, storage_slot_word(entry, storage_hash_tag(hash)));
+}
+
+/*
+DELETED rather than EMPTY keeps probe sequences intact for the entries
+stored past this slot.
+*/
+static void storage_table_erase(storage_table_t *table, size_t index)
+{
+    uint64_t word = atomic_load_explicit(&table->slots[index], memory_order_relaxed);
+    storage_slot_publish(&table->slots[index], word, STORAGE_TOMBSTONE);
+    storage_table_set_control(table, index, STORAGE_CONTROL_DELETED);
+}
+
+// ==================== Memory Accounting ====================
+
+// what the slab allocator really hands out, not just the requested size
+static size_t storage_entry_bytes(const storage_entry_t *entry)
+{
+    size_t bytes = slab_chunk_size(sizeof(storage_entry_t) + entry->key_length);
+    return entry->integer_encoded ? bytes : bytes + slab_chunk_size(sizeof(storage_value_t) + entry->value->length);
+}
+
+static size_t storage_table_bytes(size_t capacity)
+{
+    return sizeof(storage_table_t) + capacity * (sizeof(_Atomic(uint64_t)) + 1);
+}
+
+/*
+Caller holds the shard lock. The storage-wide counter is what the memory
+limit is checked against, so it is updated right away rather than summed
+over the shards on every write.
+*/
+static void storage_shard_account(storage_shard_t *shard, size_t added, size_t removed)
+{
+    shard->memory = shard->memory + added - removed;
+    atomic_fetch_add_explicit(&shard->storage->memory_used, added - removed, memory_order_relaxed);
+}
+
+// ==================== Reclamation ====================
+
+static void storage_retired_destroy(storage_retired_kind_t kind, void *ptr)
+{
+    switch (kind)
+    {
+    case STORAGE_RETIRED_ENTRY:
+        storage_entry_destroy(ptr);
+        break;
+    case STORAGE_RETIRED_TABLE_ENTRIES:
+        storage_table_destroy_entries(ptr);
+        free(ptr);
+        break;
+    case STORAGE_RETIRED_TABLE:
+        free(ptr);
+        break;
+    }
+}
+
+static void storage_retired_free(storage_retired_t *retired)
+{
+    storage_retired_destroy(retired->kind, retired->ptr);
+    slab_free(retired, sizeof(storage_retired_t));
+}
+
+/*
+Caller holds the shard lock and has already unlinked `ptr`. Retired memory
+is queued in epoch order, so reclamation only ever looks at the head.
+*/
+static void storage_retire(storage_shard_t *shard, storage_retired_kind_t kind, void *ptr)
+{
+    uint64_t epoch = epoch_current();
+    storage_retired_t *retired = slab_alloc(sizeof(storage_retired_t));
+    if (retired == NULL)
+    {
+        // nowhere to queue it: wait out the grace period right here
+        while (!epoch_is_safe(epoch))
+        {
+            if (!epoch_try_advance())
+            {
+                sched_yield();
+            }
+        }
+        storage_retired_destroy(kind, ptr);
+        return;
+    }
+
+    *retired = (storage_retired_t){.epoch = epoch, .kind = kind, .ptr = ptr};
+    if (shard->retired_tail != NULL)
+    {
+        shard->retired_tail->next = retired;
+    }
+    else
+    {
+        shard->retired_head = retired;
+    }
+    shard->retired_tail = retired;
+}
+
+/*
+A flushed table is freed entry by entry, and a huge value may have to be
+unmapped; either would stall every writer of the shard.
+*/
+static bool storage_retired_lazy(const storage_lazy_free_t *lazy, const storage_retired_t *retired)
+{
+    if (!lazy->enabled)
+    {
+        return false;
+    }
+
+    switch (retired->kind)
+    {
+    case STORAGE_RETIRED_TABLE_ENTRIES:
+        return true;
+    case STORAGE_RETIRED_ENTRY:
+    {
+        const storage_entry_t *entry = retired->ptr;
+        return !entry->integer_encoded && entry->value->length >= get_storage_lazy_free_bytes();
+    }
+    default:
+        return false;
+    }
+}
+
+static void storage_reclaim(storage_shard_t *shard)
+{
+    if (shard->retired_head == NULL)
+    {
+        return;
+    }
+
+    storage_lazy_free_t *lazy = &shard->storage->lazy_free;
+    storage_retired_t *lazy_head = NULL;
+    storage_retired_t *lazy_last = NULL;
+
+    epoch_try_advance();
+    while (shard->retired_head != NULL && epoch_is_safe(shard->retired_head->epoch))
+    {
+        storage_retired_t *retired = shard->retired_head;
+        shard->retired_head = retired->next;
+        if (shard->retired_head == NULL)
+        {
+            shard->retired_tail = NULL;
+        }
+
+        if (storage_retired_lazy(lazy, retired))
+        {
+            retired->next = NULL;
+            if (lazy_last != NULL)
+            {
+                lazy_last->next = retired;
+            }
+            else
+            {
+                lazy_head = retired;
+            }
+            lazy_last = retired;
+        }
+        else
+        {
+            storage_retired_free(retired);
+        }
+    }
+
+    if (lazy_head != NULL)
+    {
+        pthread_mutex_lock(&lazy->lock);
+        if (lazy->tail != NULL)
+        {
+            lazy->tail->next = lazy_head;
+        }
+        else
+        {
+            lazy->head = lazy_head;
+        }
+        lazy->tail = lazy_last;
+        pthread_cond_signal(&lazy->queued);
+        pthread_mutex_unlock(&lazy->lock);
+    }
+}
+
+// ==================== Incremental Rehash ====================
+
+/*
+Swap the table pair as seen by readers. The sequence is odd while the two
+pointers are inconsistent, and readers that miss retry when it changed.
+*/
+static void storage_publish_tables(storage_shard_t *shard, storage_table_t *table, storage_table_t *rehash)
+{
+    atomic_fetch_add(&shard->tables_seq, 1);
+    atomic_store(&shard->rehash, rehash);
+    atomic_store(&shard->table, table);
+    atomic_fetch_add(&shard->tables_seq, 1);
+}
+
+/*
+Move up to `slots` slots of the old table into the current one. An entry is
+published in the new table before its old slot becomes a tombstone, and
+readers search the old table first, so a lookup racing with the move always
+finds the key in one of them. Tombstones rather than empty slots keep probe
+chains intact for the entries not migrated yet.
+*/
+static void storage_rehash_step(storage_shard_t *shard, size_t slots)
+{
+    storage_table_t *old = atomic_load_explicit(&shard->rehash, memory_order_relaxed);
+    storage_table_t *table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+
+    while (old != NULL && slots-- > 0)
+    {
+        uint64_t word = atomic_load_explicit(&old->slots[shard->rehash_index], memory_order_relaxed);
+        if (word != STORAGE_EMPTY && word != STORAGE_TOMBSTONE)
+        {
+            storage_entry_t *entry = storage_slot_entry(word);
+            storage_table_insert(table, entry->hash, entry);
+            storage_table_erase(old, shard->rehash_index);
+        }
+
+        if (++shard->rehash_index == old->capacity)
+        {
+            storage_publish_tables(shard, table, NULL);
+            storage_retire(shard, STORAGE_RETIRED_TABLE, old);
+            storage_shard_account(shard, 0, storage_table_bytes(old->capacity));
+            shard->rehash_index = 0;
+            old = NULL;
+        }
+    }
+}
+
+/*
+Start a resize once live entries plus tombstones pass the load factor.
+A table that is mostly tombstones is rebuilt at the same capacity. The
+previous table is drained by later writes; if it is still not empty when
+the next resize is due, it is finished here first.
+*/
+static bool storage_reserve(storage_shard_t *shard)
+{
+    storage_table_t *table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+    storage_table_t *old = atomic_load_explicit(&shard->rehash, memory_order_relaxed);
+
+    if ((table->used + 1) * 100 <= table->capacity * get_storage_max_load_percent())
+    {
+        return true;
+    }
+
+    if (old != NULL)
+    {
+        storage_rehash_step(shard, old->capacity - shard->rehash_index);
+    }
+
+    size_t capacity = table->capacity;
+    if (shard->size * 100 > capacity * get_storage_grow_load_percent())
+    {
+        capacity *= 2;
+    }
+
+    storage_table_t *grown = storage_table_create(capacity);
+    if (grown == NULL)
+    {
+        // keep serving from the full table as long as it has empty slots
+        return table->used + 1 < table->capacity;
+    }
+
+    shard->rehash_index = 0;
+    storage_publish_tables(shard, grown, table);
+    storage_shard_account(shard, storage_table_bytes(capacity), 0);
+    return true;
+}
+
+// ==================== Timing Wheel ====================
+
+static void storage_timer_link(storage_entry_t **head, storage_entry_t *entry)
+{
+    entry->timer_next = *head;
+    if (*head != NULL)
+    {
+        (*head)->timer_pprev = &entry->timer_next;
+    }
+    entry->timer_pprev = head;
+    *head = entry;
+}
+
+static void storage_timer_unlink(storage_entry_t *entry)
+{
+    if (entry->timer_pprev == NULL)
+    {
+        return;
+    }
+
+    *entry->timer_pprev = entry->timer_next;
+    if (entry->timer_next != NULL)
+    {
+        entry->timer_next->timer_pprev = entry->timer_pprev;
+    }
+    entry->timer_next = NULL;
+    entry->timer_pprev = NULL;
+}
+
+/*
+(Re)place an entry by its deadline, relative to the wheel's current tick.
+A deadline already due goes into the current slot. One beyond the top
+level's range parks in its farthest slot and is placed again when that
+slot cascades.
+*/
+static void storage_wheel_schedule(storage_wheel_t *wheel, storage_entry_t *entry)
+{
+    storage_timer_unlink(entry);
+
+    uint64_t expires_at = atomic_load_explicit(&entry->expires_at, memory_order_relaxed);
+    if (expires_at == 0)
+    {
+        return;
+    }
+
+    uint64_t tick = expires_at / get_storage_wheel_tick_ms();
+    if (tick < wheel->tick)
+    {
+        tick = wheel->tick;
+    }
+
+    uint64_t delta = tick - wheel->tick;
+    unsigned level = 0;
+    while (level + 1 < STORAGE_WHEEL_LEVELS && delta >= (1ULL << (STORAGE_WHEEL_SLOT_BITS * (level + 1))))
+    {
+        level++;
+    }
+
+    uint64_t horizon = 1ULL << (STORAGE_WHEEL_SLOT_BITS * STORAGE_WHEEL_LEVELS);
+    if (delta >= horizon)
+    {
+        tick = wheel->tick + horizon - 1;
+    }
+
+    unsigned shift = STORAGE_WHEEL_SLOT_BITS * level;
+    storage_timer_link(&wheel->slots[level][(tick >> shift) & (STORAGE_WHEEL_SLOTS - 1)], entry);
+}
+
+// ==================== Shards ====================
+
+/*
+The table index uses the low hash bits, so the shard is picked from the
+high ones: keys of one shard still spread over its whole table.
+*/
+static storage_shard_t *storage_shard_for(storage_t *storage, uint64_t hash)
+{
+    return &storage->shards[storage->shard_count > 1 ? hash >> storage->shard_shift : 0];
+}
+
+/*
+Search both tables, the draining one first. Without the lock a miss is only
+trusted if the table pair did not change meanwhile.
+*/
+static storage_entry_t *storage_lookup(storage_shard_t *shard, uint64_t hash, const char *key, size_t key_length,
+                                       storage_location_t *location)
+{
+    for (;;)
+    {
+        uint64_t seq = atomic_load(&shard->tables_seq);
+        storage_table_t *old = atomic_load(&shard->rehash);
+        storage_table_t *table = atomic_load(&shard->table);
+        storage_entry_t *entry = NULL;
+
+        if ((seq & 1) == 0)
+        {
+            size_t index = storage_table_find(old, hash, key, key_length, &entry);
+            if (index != STORAGE_NOT_FOUND)
+            {
+                *location = (storage_location_t){.table = old, .index = index};
+                return entry;
+            }
+
+            index = storage_table_find(table, hash, key, key_length, &entry);
+            if (index != STORAGE_NOT_FOUND)
+            {
+                *location = (storage_location_t){.table = table, .index = index};
+                return entry;
+            }
+
+            if (atomic_load(&shard->tables_seq) == seq)
+            {
+                return NULL;
+            }
+        }
+
+        sched_yield();
+    }
+}
+
+/*
+Caller holds the shard lock and found `entry` at `location`. Also used for
+entries past their deadline, which count as already gone for the caller.
+*/
+static void storage_shard_erase(storage_shard_t *shard, storage_entry_t *entry, const storage_location_t *location)
+{
+    storage_timer_unlink(entry);
+    storage_table_erase(location->table, location->index);
+    storage_shard_account(shard, 0, storage_entry_bytes(entry));
+    storage_retire(shard, STORAGE_RETIRED_ENTRY, entry);
+    shard->size--;
+}
+
+/*
+Writer-side lookup under the shard lock: an entry found past its deadline
+is removed on the spot and reported as missing.
+*/
+static storage_entry_t *storage_lookup_live(storage_shard_t *shard, uint64_t hash, const char *key,
+                                            size_t key_length, storage_location_t *location)
+{
+    storage_entry_t *entry = storage_lookup(shard, hash, key, key_length, location);
+    if (entry != NULL && !storage_entry_live(entry))
+    {
+        storage_shard_erase(shard, entry, location);
+        return NULL;
+    }
+    return entry;
+}
+
+/*
+Lazy expiry of a lock-free read that found the key past its deadline. The
+lookup is repeated under the lock: a writer may have replaced it meanwhile.
+*/
+static void storage_drop_expired(storage_shard_t *shard, uint64_t hash, const char *key, size_t key_length)
+{
+    storage_location_t location;
+
+    pthread_mutex_lock(&shard->lock);
+    storage_lookup_live(shard, hash, key, key_length, &location);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/*
+Handle due wheel entries of one shard. Moving or expiring an entry and
+advancing by one tick each cost one unit of budget. The wheel only moves
+past a tick once the cascades and the tick's slot are empty, so a slot
+cut short by the budget is simply resumed by the next cycle.
+*/
+static size_t storage_shard_expire(storage_shard_t *shard, uint64_t now_ms, size_t budget)
+{
+    storage_wheel_t *wheel = &shard->wheel;
+    uint64_t now_tick = now_ms / get_storage_wheel_tick_ms();
+    size_t expired = 0;
+
+    while (budget-- > 0)
+    {
+        storage_entry_t **head = NULL;
+        for (unsigned level = 1; level < STORAGE_WHEEL_LEVELS && head == NULL; level++)
+        {
+            head = wheel->cascade[level] != NULL ? &wheel->cascade[level] : NULL;
+        }
+        if (head == NULL && wheel->tick < now_tick &&
+            wheel->slots[0][wheel->tick & (STORAGE_WHEEL_SLOTS - 1)] != NULL)
+        {
+            head = &wheel->slots[0][wheel->tick & (STORAGE_WHEEL_SLOTS - 1)];
+        }
+
+        if (head != NULL)
+        {
+            storage_entry_t *entry = *head;
+            uint64_t expires_at = atomic_load_explicit(&entry->expires_at, memory_order_relaxed);
+            if (expires_at <= now_ms)
+            {
+                storage_location_t location;
+                storage_entry_t *found = storage_lookup(shard, entry->hash, entry->key, entry->key_length, &location);
+                assert(found == entry);
+                (void)found;
+                storage_shard_erase(shard, entry, &location);
+                expired++;
+            }
+            else
+            {
+                storage_wheel_schedule(wheel, entry);
+            }
+            continue;
+        }
+
+        if (wheel->tick >= now_tick)
+        {
+            break;
+        }
+
+        // every lower level wrapped around: their parent slots move down
+        wheel->tick++;
+        for (unsigned level = 1; level < STORAGE_WHEEL_LEVELS; level++)
+        {
+            unsigned shift = STORAGE_WHEEL_SLOT_BITS * level;
+            if ((wheel->tick & ((1ULL << shift) - 1)) != 0)
+            {
+                break;
+            }
+
+            storage_entry_t **slot = &wheel->slots[level][(wheel->tick >> shift) & (STORAGE_WHEEL_SLOTS - 1)];
+            wheel->cascade[level] = *slot;
+            if (*slot != NULL)
+            {
+                (*slot)->timer_pprev = &wheel->cascade[level];
+            }
+            *slot = NULL;
+        }
+    }
+
+    return expired;
+}
+
+static void storage_shard_clear(storage_shard_t *shard, storage_table_t *fresh)
+{
+    storage_table_t *table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+    storage_table_t *old = atomic_load_explicit(&shard->rehash, memory_order_relaxed);
+
+    storage_publish_tables(shard, fresh, NULL);
+    storage_retire(shard, STORAGE_RETIRED_TABLE_ENTRIES, table);
+    if (old != NULL)
+    {
+        // entries already migrated are tombstones here, the rest is only here
+        storage_retire(shard, STORAGE_RETIRED_TABLE_ENTRIES, old);
+    }
+    shard->rehash_index = 0;
+    shard->size = 0;
+    storage_shard_account(shard, storage_table_bytes(fresh->capacity), shard->memory);
+
+    // the flushed entries are never unlinked one by one: drop the lists whole
+    uint64_t tick = shard->wheel.tick;
+    memset(&shard->wheel, 0, sizeof(shard->wheel));
+    shard->wheel.tick = tick;
+}
+
+/*
+Operations that span the keyspace take every shard lock in index order,
+and release them in reverse, so two of them can never deadlock.
+*/
+static void storage_lock_all(storage_t *storage)
+{
+    for (size_t i = 0; i < storage->shard_count; i++)
+    {
+        pthread_mutex_lock(&storage->shards[i].lock);
+    }
+}
+
+static void storage_unlock_all(storage_t *storage)
+{
+    for (size_t i = storage->shard_count; i-- > 0;)
+    {
+        pthread_mutex_unlock(&storage->shards[i].lock);
+    }
+}
+
+// ==================== Dirty Tracking ====================
+
+typedef struct storage_dirty_key
+{
+    uint64_t hash;
+    size_t key_length;
+    char key[];
+} storage_dirty_key_t;
+
+void storage_dirty_release(storage_dirty_t *dirty)
+{
+    for (size_t i = 0; i < dirty->capacity; i++)
+    {
+        free(dirty->keys[i]);
+    }
+    free(dirty->keys);
+    *dirty = (storage_dirty_t){0};
+}
+
+static void storage_dirty_overflow(storage_dirty_t *dirty)
+{
+    storage_dirty_release(dirty);
+    dirty->overflowed = true;
+}
+
+// the set stays at most half full
+static bool storage_dirty_grow(storage_dirty_t *dirty)
+{
+    size_t capacity = dirty->capacity > 0 ? dirty->capacity * 2 : get_storage_min_capacity();
+    storage_dirty_key_t **keys = calloc(capacity, sizeof(storage_dirty_key_t *));
+    if (keys == NULL)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < dirty->capacity; i++)
+    {
+        if (dirty->keys[i] != NULL)
+        {
+            size_t index = dirty->keys[i]->hash & (capacity - 1);
+            while (keys[index] != NULL)
+            {
+                index = (index + 1) & (capacity - 1);
+            }
+            keys[index] = dirty->keys[i];
+        }
+    }
+
+    free(dirty->keys);
+    dirty->keys = keys;
+    dirty->capacity = capacity;
+    return true;
+}
+
+/*
+Runs under the shard lock on every change. A key already in the set costs
+one probe; a set that cannot take another key overflows rather than fail
+the write.
+*/
+static void storage_dirty_add(storage_shard_t *shard, uint64_t hash, const char *key, size_t key_length)
+{
+    storage_dirty_t *dirty = &shard->dirty;
+    if (dirty->overflowed)
+    {
+        return;
+    }
+
+    size_t mask = dirty->capacity - 1;
+    for (size_t index = hash & mask; dirty->capacity > 0 && dirty->keys[index] != NULL; index = (index + 1) & mask)
+    {
+        const storage_dirty_key_t *known = dirty->keys[index];
+        if (known->hash == hash && known->key_length == key_length && memcmp(known->key, key, key_length) == 0)
+        {
+            return;
+        }
+    }
+
+    storage_dirty_key_t *added = NULL;
+    if (dirty->count >= get_storage_dirty_max_keys() ||
+        ((dirty->count + 1) * 2 > dirty->capacity && !storage_dirty_grow(dirty)) ||
+        (added = malloc(sizeof(storage_dirty_key_t) + key_length)) == NULL)
+    {
+        storage_dirty_overflow(dirty);
+        return;
+    }
+    added->hash = hash;
+    added->key_length = key_length;
+    memcpy(added->key, key, key_length);
+
+    mask = dirty->capacity - 1;
+    size_t index = hash & mask;
+    while (dirty->keys[index] != NULL)
+    {
+        index = (index + 1) & mask;
+    }
+    dirty->keys[index] = added;
+    dirty->count++;
+}
+
+void storage_set_dirty_tracking(storage_t *storage, bool enabled)
+{
+    storage->track_dirty = enabled;
+    for (size_t i = 0; !enabled && i < storage->shard_count; i++)
+    {
+        storage_dirty_release(&storage->shards[i].dirty);
+    }
+}
+
+void storage_take_dirty(storage_t *storage, size_t shard_index, storage_dirty_t *dirty)
+{
+    storage_shard_t *shard = &storage->shards[shard_index];
+    *dirty = shard->dirty;
+    shard->dirty = (storage_dirty_t){0};
+}
+
+// ==================== Journal ====================
+
+void storage_set_journal(storage_t *storage, storage_journal_fn fn, void *arg)
+{
+    storage->journal = fn;
+    storage->journal_arg = arg;
+}
+
+// caller holds the shard lock of the key; FLUSH has no key and marks no shard
+static void storage_journal_key(storage_t *storage, storage_journal_op_t op, uint64_t hash, const char *key,
+                                size_t key_length, uint64_t expires_at)
+{
+    if (storage->track_dirty && key != NULL)
+    {
+        storage_dirty_add(storage_shard_for(storage, hash), hash, key, key_length);
+    }
+    if (storage->journal != NULL)
+    {
+        storage_journal_record_t record = {
+            .op = op, .key = key, .key_length = key_length, .expires_at = expires_at};
+        storage->journal(&record, storage->journal_arg);
+    }
+}
+
+// an integer is recorded in its decimal form, written to `digits`
+static void storage_entry_record(const storage_entry_t *entry, storage_journal_record_t *record, char digits[24])
+{
+    *record = (storage_journal_record_t){
+        .op = STORAGE_JOURNAL_SET,
+        .key = entry->key,
+        .key_length = entry->key_length,
+        .expires_at = atomic_load_explicit(&entry->expires_at, memory_order_relaxed)};
+
+    if (entry->integer_encoded)
+    {
+        int length = snprintf(digits, 24, "%" PRId64, atomic_load_explicit(&entry->integer, memory_order_relaxed));
+        record->value = digits;
+        record->value_length = (size_t)length;
+    }
+    else
+    {
+        record->value = entry->value->data;
+        record->value_length = entry->value->length;
+    }
+}
+
+// caller holds the shard lock of the entry
+static void storage_journal_entry(storage_t *storage, const storage_entry_t *entry)
+{
+    if (storage->track_dirty)
+    {
+        storage_dirty_add(storage_shard_for(storage, entry->hash), entry->hash, entry->key, entry->key_length);
+    }
+    if (storage->journal == NULL)
+    {
+        return;
+    }
+
+    char digits[24];
+    storage_journal_record_t record;
+    storage_entry_record(entry, &record, digits);
+    storage->journal(&record, storage->journal_arg);
+}
+
+/*
+With every shard lock held no change is half done and none is journaled
+until `fn` returns, so what `fn` captures matches a position in the log.
+*/
+void storage_freeze(storage_t *storage, void (*fn)(void *arg), void *arg)
+{
+    storage_lock_all(storage);
+    fn(arg);
+    storage_unlock_all(storage);
+}
+
+static void storage_dump_table(const storage_table_t *table, uint64_t now_ms, storage_journal_fn fn, void *arg)
+{
+    if (table == NULL)
+    {
+        return;
+    }
+
+    char digits[24];
+    storage_journal_record_t record;
+    for (size_t index = 0; index < table->capacity; index++)
+    {
+        uint64_t word = atomic_load_explicit(&table->slots[index], memory_order_relaxed);
+        if (word == STORAGE_EMPTY || word == STORAGE_TOMBSTONE)
+        {
+            continue;
+        }
+
+        storage_entry_t *entry = storage_slot_entry(word);
+        uint64_t expires_at = atomic_load_explicit(&entry->expires_at, memory_order_relaxed);
+        if (expires_at == 0 || expires_at > now_ms)
+        {
+            storage_entry_record(entry, &record, digits);
+            fn(&record, arg);
+        }
+    }
+}
+
+// while a shard is rehashing each of its keys is in exactly one of the two tables
+void storage_dump(storage_t *storage, size_t shard_index, uint64_t now_ms, storage_journal_fn fn, void *arg)
+{
+    storage_shard_t *shard = &storage->shards[shard_index];
+    storage_dump_table(atomic_load_explicit(&shard->table, memory_order_relaxed), now_ms, fn, arg);
+    storage_dump_table(atomic_load_explicit(&shard->rehash, memory_order_relaxed), now_ms, fn, arg);
+}
+
+void storage_dump_dirty(storage_t *storage, const storage_dirty_t *dirty, uint64_t now_ms, storage_journal_fn fn,
+                        void *arg)
+{
+    char digits[24];
+    storage_journal_record_t record;
+    for (size_t i = 0; i < dirty->capacity; i++)
+    {
+        const storage_dirty_key_t *key = dirty->keys[i];
+        if (key == NULL)
+        {
+            continue;
+        }
+
+        storage_location_t location;
+        storage_entry_t *entry = storage_lookup(storage_shard_for(storage, key->hash), key->hash, key->key,
+                                                key->key_length, &location);
+        uint64_t expires_at = entry != NULL ? atomic_load_explicit(&entry->expires_at, memory_order_relaxed) : 0;
+        if (entry != NULL && (expires_at == 0 || expires_at > now_ms))
+        {
+            storage_entry_record(entry, &record, digits);
+        }
+        else
+        {
+            record = (storage_journal_record_t){
+                .op = STORAGE_JOURNAL_DELETE, .key = key->key, .key_length = key->key_length};
+        }
+        fn(&record, arg);
+    }
+}
+
+// ==================== Eviction ====================
+
+static void storage_lru_refresh(storage_t *storage)
+{
+    uint32_t clock = (uint32_t)((storage_now_ms() / get_storage_lru_resolution_ms()) & STORAGE_LRU_CLOCK_MAX);
+    atomic_store_explicit(&storage->lru_clock, clock, memory_order_relaxed);
+}
+
+/*
+Lock-free readers stamp the entry they return. The store is skipped while
+the stamp is current, so a hot key does not dirty its cache line on every
+read.
+*/
+static void storage_entry_touch(storage_t *storage, storage_entry_t *entry)
+{
+    uint32_t clock = atomic_load_explicit(&storage->lru_clock, memory_order_relaxed);
+    if (atomic_load_explicit(&entry->access, memory_order_relaxed) != clock)
+    {
+        atomic_store_explicit(&entry->access, clock, memory_order_relaxed);
+    }
+}
+
+// the clock wraps around, so idle time is taken modulo its range
+static uint32_t storage_entry_idle(storage_t *storage, uint32_t access)
+{
+    return (atomic_load_explicit(&storage->lru_clock, memory_order_relaxed) - access) & STORAGE_LRU_CLOCK_MAX;
+}
+
+/*
+Idle time in the low 24 bits. Under LFU the inverted frequency goes above
+it, so the least used key is evicted first and idle time breaks ties.
+*/
+static uint32_t storage_candidate_score(storage_t *storage, const storage_entry_t *entry, uint32_t access)
+{
+    uint32_t score = storage_entry_idle(storage, access);
+    if (storage->sketch != NULL)
+    {
+        score |= (SKETCH_COUNTER_MAX - sketch_estimate(storage->sketch, entry->hash)) << 24;
+    }
+    return score;
+}
+
+static size_t storage_candidate_key_bytes(size_t key_length)
+{
+    return key_length > 0 ? key_length : 1;
+}
+
+// thread-local xorshift64*, seeded from the hash of the thread's own state
+static uint64_t storage_random(void)
+{
+    static _Thread_local uint64_t state;
+    if (state == 0)
+    {
+        uint64_t seed[2] = {(uint64_t)(uintptr_t)&state, storage_now_ms()};
+        state = hash_bytes(seed, sizeof(seed)) | 1;
+    }
+
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+Keep the pool sorted by ascending score and free of duplicates. When it is
+full, a candidate only gets in by pushing out the one with the lowest score.
+*/
+static void storage_pool_insert(storage_t *storage, storage_entry_t *entry)
+{
+    storage_eviction_pool_t *pool = &storage->eviction;
+    uint32_t access = atomic_load_explicit(&entry->access, memory_order_relaxed);
+    uint32_t score = storage_candidate_score(storage, entry, access);
+
+    for (size_t i = 0; i < pool->count; i++)
+    {
+        const storage_candidate_t *candidate = &pool->candidates[i];
+        if (candidate->hash == entry->hash && candidate->key_length == entry->key_length &&
+            memcmp(candidate->key, entry->key, entry->key_length) == 0)
+        {
+            return;
+        }
+    }
+
+    if (pool->count == STORAGE_EVICTION_POOL_SIZE && score <= pool->candidates[0].score)
+    {
+        return;
+    }
+
+    char *key = slab_alloc(storage_candidate_key_bytes(entry->key_length));
+    if (key == NULL)
+    {
+        return;
+    }
+    memcpy(key, entry->key, entry->key_length);
+
+    if (pool->count == STORAGE_EVICTION_POOL_SIZE)
+    {
+        slab_free(pool->candidates[0].key, storage_candidate_key_bytes(pool->candidates[0].key_length));
+        memmove(&pool->candidates[0], &pool->candidates[1], (pool->count - 1) * sizeof(storage_candidate_t));
+        pool->count--;
+    }
+
+    size_t position = pool->count++;
+    while (position > 0 && pool->candidates[position - 1].score > score)
+    {
+        pool->candidates[position] = pool->candidates[position - 1];
+        position--;
+    }
+    pool->candidates[position] = (storage_candidate_t){
+        .score = score,
+        .access = access,
+        .hash = entry->hash,
+        .key_length = entry->key_length,
+        .key = key,
+    };
+}
+
+/*
+Sample random entries without any shard lock, the same way GET reads, and
+offer them to the pool. Each sample scans forward from a random slot of a
+random shard; `scan` bounds how far, so a sparse table cannot stall it.
+*/
+static void storage_pool_refill(storage_t *storage, size_t scan)
+{
+    epoch_enter();
+    for (size_t sample = 0; sample < get_storage_eviction_samples(); sample++)
+    {
+        uint64_t random = storage_random();
+        storage_shard_t *shard = &storage->shards[random & (storage->shard_count - 1)];
+        storage_table_t *table = atomic_load(&shard->table);
+        size_t start = (size_t)(random >> 32);
+
+        for (size_t i = 0; i < table->capacity && i < scan; i++)
+        {
+            uint64_t word = atomic_load_explicit(&table->slots[(start + i) & (table->capacity - 1)],
+                                                 memory_order_acquire);
+            if (word != STORAGE_EMPTY && word != STORAGE_TOMBSTONE)
+            {
+                storage_pool_insert(storage, storage_slot_entry(word));
+                break;
+            }
+        }
+    }
+    epoch_exit();
+}
+
+// the key is only evicted if nobody accessed it since it was sampled
+static bool storage_evict_candidate(storage_t *storage, const storage_candidate_t *candidate)
+{
+    storage_shard_t *shard = storage_shard_for(storage, candidate->hash);
+    storage_location_t location;
+
+    pthread_mutex_lock(&shard->lock);
+    storage_reclaim(shard);
+    storage_entry_t *entry = storage_lookup(shard, candidate->hash, candidate->key, candidate->key_length, &location);
+    bool evicted = entry != NULL && atomic_load_explicit(&entry->access, memory_order_relaxed) == candidate->access;
+    if (evicted)
+    {
+        storage_shard_erase(shard, entry, &location);
+        storage_journal_key(storage, STORAGE_JOURNAL_DELETE, candidate->hash, candidate->key, candidate->key_length, 0);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return evicted;
+}
+
+/*
+Evict the candidate with the highest score that still exists, refilling
+the pool as it runs dry. Gives up only after several refills found nothing,
+the last of them scanning whole tables: the storage is then empty or close
+to it. With `incoming` set (TinyLFU admission), also gives up when that
+hash is not estimated more popular than the victim and sets `rejected`;
+the victim stays in the pool.
+*/
+static bool storage_evict(storage_t *storage, const uint64_t *incoming, bool *rejected)
+{
+    storage_eviction_pool_t *pool = &storage->eviction;
+    size_t rounds = get_storage_eviction_rounds();
+    uint32_t frequency = incoming != NULL ? sketch_estimate(storage->sketch, *incoming) : 0;
+    bool evicted = false;
+    *rejected = false;
+
+    pthread_mutex_lock(&pool->lock);
+    for (size_t round = 0; round < rounds && !evicted && !*rejected; round++)
+    {
+        storage_pool_refill(storage, round + 1 < rounds ? get_storage_eviction_scan() : SIZE_MAX);
+        while (pool->count > 0 && !evicted)
+        {
+            storage_candidate_t candidate = pool->candidates[pool->count - 1];
+            if (incoming != NULL && frequency <= sketch_estimate(storage->sketch, candidate.hash))
+            {
+                *rejected = true;
+                break;
+            }
+
+            pool->count--;
+            evicted = storage_evict_candidate(storage, &candidate);
+            slab_free(candidate.key, storage_candidate_key_bytes(candidate.key_length));
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return evicted;
+}
+
+static bool storage_memory_exceeded(storage_t *storage, size_t bytes)
+{
+    return storage->max_memory != 0 &&
+           atomic_load_explicit(&storage->memory_used, memory_order_relaxed) + bytes > storage->max_memory;
+}
+
+static storage_set_status_t storage_make_room(storage_t *storage, size_t bytes, const uint64_t *incoming)
+{
+    while (storage_memory_exceeded(storage, bytes))
+    {
+        bool rejected;
+        if (!storage_evict(storage, incoming, &rejected))
+        {
+            return rejected ? STORAGE_SET_NOT_ADMITTED : STORAGE_SET_NO_MEMORY;
+        }
+    }
+    return STORAGE_SET_OK;
+}
+
+// ==================== Defragmentation ====================
+
+static uint64_t storage_monotonic_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+/*
+Caller holds the shard lock. Entries are immutable, so moving one means
+publishing a copy in its slot and retiring the original like any replaced
+entry; readers keep whichever of the two they loaded. A value is copied
+rather than patched for the same reason, and only when its own chunk is the
+one worth moving. An integer entry has no value to move.
+*/
+static bool storage_entry_relocate(storage_shard_t *shard, storage_table_t *table, size_t index,
+                                   storage_entry_t *entry)
+{
+    size_t entry_size = sizeof(storage_entry_t) + entry->key_length;
+    size_t value_size = entry->integer_encoded ? 0 : sizeof(storage_value_t) + entry->value->length;
+    storage_entry_t *moved = slab_defrag_alloc(entry, entry_size);
+    storage_value_t *value = entry->integer_encoded ? NULL : slab_defrag_alloc(entry->value, value_size);
+
+    if (moved == NULL && value == NULL)
+    {
+        return false;
+    }
+    if (moved == NULL && (moved = slab_alloc(entry_size)) == NULL)
+    {
+        slab_free(value, value_size);
+        return false;
+    }
+
+    if (entry->integer_encoded)
+    {
+        atomic_init(&moved->integer, atomic_load_explicit(&entry->integer, memory_order_relaxed));
+    }
+    else if (value != NULL)
+    {
+        atomic_init(&value->refcount, 1);
+        value->length = entry->value->length;
+        memcpy(value->data, entry->value->data, value->length);
+        moved->value = value;
+    }
+    else
+    {
+        moved->value = entry->value;
+        storage_value_acquire(moved->value);
+    }
+
+    moved->hash = entry->hash;
+    atomic_init(&moved->expires_at, atomic_load_explicit(&entry->expires_at, memory_order_relaxed));
+    moved->timer_next = NULL;
+    moved->timer_pprev = NULL;
+    atomic_init(&moved->access, atomic_load_explicit(&entry->access, memory_order_relaxed));
+    moved->key_length = entry->key_length;
+    moved->integer_encoded = entry->integer_encoded;
+    memcpy(moved->key, entry->key, entry->key_length);
+
+    storage_timer_unlink(entry);
+    storage_table_replace(table, index, moved->hash, moved);
+    storage_wheel_schedule(&shard->wheel, moved);
+    storage_retire(shard, STORAGE_RETIRED_ENTRY, entry);
+    return true;
+}
+
+// shards in the middle of a rehash are skipped, their entries are about to move anyway
+static bool storage_shard_defrag(storage_shard_t *shard, size_t *cursor, size_t *moved)
+{
+    pthread_mutex_lock(&shard->lock);
+    storage_reclaim(shard);
+
+    storage_table_t *table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+    bool done = atomic_load_explicit(&shard->rehash, memory_order_relaxed) != NULL || *cursor >= table->capacity;
+
+    if (!done)
+    {
+        size_t end = *cursor + get_storage_defrag_scan();
+        end = end < table->capacity ? end : table->capacity;
+
+        for (; *cursor < end; (*cursor)++)
+        {
+            uint64_t word = atomic_load_explicit(&table->slots[*cursor], memory_order_relaxed);
+            if (word != STORAGE_EMPTY && word != STORAGE_TOMBSTONE &&
+                storage_entry_relocate(shard, table, *cursor, storage_slot_entry(word)))
+            {
+                (*moved)++;
+            }
+        }
+        done = *cursor == table->capacity;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+    return done;
+}
+
+/*
+Walks the tables a few slots per lock hold, resuming where the previous
+cycle stopped, and ends early once every shard was visited. Pages emptied
+by earlier cycles are released at the end; the chunks moved away in this
+one only come back after their grace period.
+*/
+size_t storage_defrag_cycle(storage_t *storage, uint64_t budget_us)
+{
+    uint64_t deadline = storage_monotonic_us() + budget_us;
+    size_t moved = 0;
+
+    for (size_t visited = 0; visited < storage->shard_count && storage_monotonic_us() < deadline;)
+    {
+        storage_shard_t *shard = &storage->shards[storage->defrag_shard];
+        if (storage_shard_defrag(shard, &storage->defrag_slot, &moved))
+        {
+            storage->defrag_shard = (storage->defrag_shard + 1) & (storage->shard_count - 1);
+            storage->defrag_slot = 0;
+            visited++;
+        }
+    }
+
+    slab_release_pages();
+    return moved;
+}
+
+// ==================== Storage ====================
+
+storage_t *storage_create(size_t initial_capacity)
+{
+    size_t shard_count = get_storage_shard_count();
+    unsigned shard_bits = 0;
+    while (((size_t)1 << shard_bits) < shard_count)
+    {
+        shard_bits++;
+    }
+
+    size_t capacity = get_storage_min_capacity();
+    while (capacity * shard_count < initial_capacity)
+    {
+        capacity *= 2;
+    }
+
+    hash_init();
+
+    // the memory counter sits on its own cache line
+    storage_t *storage = aligned_alloc(_Alignof(storage_t), sizeof(storage_t));
+    if (storage == NULL)
+    {
+        return NULL;
+    }
+    memset(storage, 0, sizeof(storage_t));
+
+    if (pthread_mutex_init(&storage->eviction.lock, NULL) != 0)
+    {
+        free(storage);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&storage->lazy_free.lock, NULL) != 0)
+    {
+        pthread_mutex_destroy(&storage->eviction.lock);
+        free(storage);
+        return NULL;
+    }
+
+    if (pthread_cond_init(&storage->lazy_free.queued, NULL) != 0)
+    {
+        pthread_mutex_destroy(&storage->lazy_free.lock);
+        pthread_mutex_destroy(&storage->eviction.lock);
+        free(storage);
+        return NULL;
+    }
+
+    storage->shards = aligned_alloc(_Alignof(storage_shard_t), shard_count * sizeof(storage_shard_t));
+    if (storage->shards == NULL)
+    {
+        pthread_cond_destroy(&storage->lazy_free.queued);
+        pthread_mutex_destroy(&storage->lazy_free.lock);
+        pthread_mutex_destroy(&storage->eviction.lock);
+        free(storage);
+        return NULL;
+    }
+    memset(storage->shards, 0, shard_count * sizeof(storage_shard_t));
+    storage->shard_shift = 64 - shard_bits;
+    storage->initial_capacity = capacity;
+    atomic_init(&storage->memory_used, sizeof(storage_t) + shard_count * sizeof(storage_shard_t));
+    storage_lru_refresh(storage);
+    uint64_t tick = storage_now_ms() / get_storage_wheel_tick_ms();
+
+    for (; storage->shard_count < shard_count; storage->shard_count++)
+    {
+        storage_shard_t *shard = &storage->shards[storage->shard_count];
+
+        if (pthread_mutex_init(&shard->lock, NULL) != 0)
+        {
+            storage_destroy(storage);
+            return NULL;
+        }
+
+        storage_table_t *table = storage_table_create(capacity);
+        if (table == NULL)
+        {
+            pthread_mutex_destroy(&shard->lock);
+            storage_destroy(storage);
+            return NULL;
+        }
+        atomic_init(&shard->table, table);
+        shard->wheel.tick = tick;
+        shard->storage = storage;
+        storage_shard_account(shard, storage_table_bytes(capacity), 0);
+    }
+
+    return storage;
+}
+
+/*
+No reader may be running any more, so retired memory is freed without
+waiting for its grace period.
+*/
+void storage_destroy(storage_t *storage)
+{
+    if (storage == NULL)
+    {
+        return;
+    }
+
+    // only shards below shard_count were fully initialized
+    for (size_t i = 0; i < storage->shard_count; i++)
+    {
+        storage_shard_t *shard = &storage->shards[i];
+        storage_table_t *tables[] = {atomic_load(&shard->table), atomic_load(&shard->rehash)};
+
+        for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++)
+        {
+            if (tables[t] != NULL)
+            {
+                storage_table_destroy_entries(tables[t]);
+                free(tables[t]);
+            }
+        }
+
+        while (shard->retired_head != NULL)
+        {
+            storage_retired_t *retired = shard->retired_head;
+            shard->retired_head = retired->next;
+            storage_retired_free(retired);
+        }
+
+        storage_dirty_release(&shard->dirty);
+        pthread_mutex_destroy(&shard->lock);
+    }
+
+    for (size_t i = 0; i < storage->eviction.count; i++)
+    {
+        storage_candidate_t *candidate = &storage->eviction.candidates[i];
+        slab_free(candidate->key, storage_candidate_key_bytes(candidate->key_length));
+    }
+    pthread_mutex_destroy(&storage->eviction.lock);
+
+    while (storage->lazy_free.head != NULL)
+    {
+        storage_retired_t *retired = storage->lazy_free.head;
+        storage->lazy_free.head = retired->next;
+        storage_retired_free(retired);
+    }
+    pthread_cond_destroy(&storage->lazy_free.queued);
+    pthread_mutex_destroy(&storage->lazy_free.lock);
+
+    sketch_destroy(storage->sketch);
+    free(storage->shards);
+    free(storage);
+}
+
+bool storage_set(storage_t *storage, const char *key, size_t key_length, storage_value_t *value)
+{
+    return storage_set_expiring(storage, key, key_length, value, 0) == STORAGE_SET_OK;
+}
+
+storage_set_status_t storage_set_expiring(storage_t *storage, const char *key, size_t key_length,
+                                          storage_value_t *value, uint64_t ttl_ms)
+{
+    uint64_t hash = hash_bytes(key, key_length);
+    storage_shard_t *shard = storage_shard_for(storage, hash);
+    storage_entry_t *entry = storage_entry_create(key, key_length, hash, value);
+    if (entry == NULL)
+    {
+        storage_value_release(value);
+        return STORAGE_SET_NO_MEMORY;
+    }
+
+    if (ttl_ms > 0)
+    {
+        atomic_init(&entry->expires_at, storage_now_ms() + ttl_ms);
+    }
+    atomic_init(&entry->access, atomic_load_explicit(&storage->lru_clock, memory_order_relaxed));
+
+    /*
+    An overwrite is charged in full: the old entry may well be the one
+    evicted. Admission only applies to new keys, an update is never refused
+    for being unpopular.
+    */
+    const uint64_t *incoming = NULL;
+    if (storage->sketch != NULL)
+    {
+        sketch_increment(storage->sketch, hash);
+        if (storage_memory_exceeded(storage, storage_entry_bytes(entry)) && !storage_exists(storage, key, key_length))
+        {
+            incoming = &hash;
+        }
+    }
+
+    storage_set_status_t room = storage_make_room(storage, storage_entry_bytes(entry), incoming);
+    if (room != STORAGE_SET_OK)
+    {
+        storage_entry_destroy(entry);
+        return room;
+    }
+
+    bool stored = true;
+
+    pthread_mutex_lock(&shard->lock);
+    storage_reclaim(shard);
+    storage_rehash_step(shard, get_storage_rehash_step());
+
+    storage_location_t location;
+    storage_entry_t *previous = storage_lookup(shard, hash, key, key_length, &location);
+    if (previous != NULL)
+    {
+        // replaced wherever it is, a pending rehash moves the new entry later; a plain SET drops the TTL
+        storage_timer_unlink(previous);
+        storage_table_replace(location.table, location.index, hash, entry);
+        storage_shard_account(shard, storage_entry_bytes(entry), storage_entry_bytes(previous));
+        storage_retire(shard, STORAGE_RETIRED_ENTRY, previous);
+    }
+    else if (storage_reserve(shard))
+    {
+        storage_table_insert(atomic_load_explicit(&shard->table, memory_order_relaxed), hash, entry);
+        storage_shard_account(shard, storage_entry_bytes(entry), 0);
+        shard->size++;
+    }
+    else
+    {
+        stored = false;
+    }
+
+    if (stored)
+    {
+        storage_wheel_schedule(&shard->wheel, entry);
+        storage_journal_entry(storage, entry);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (!stored)
+    {
+        storage_entry_destroy(entry);
+        return STORAGE_SET_NO_MEMORY;
+    }
+
+    // a table that grew for this insert is paid for by evicting afterwards
+    storage_make_room(storage, 0, NULL);
+    return STORAGE_SET_OK;
+}
+
+/*
+Caller is in an epoch section. The entry may be unlinked right after it was
+found, but it is retired, not freed, and it keeps its reference to the
+value until the grace period ends: the value cannot drop to zero before it
+is acquired here. A key past its deadline is left to the caller to drop
+once it has left the section.
+*/
+static storage_value_t *storage_read(storage_t *storage, uint64_t hash, const char *key, size_t key_length,
+                                     bool *expired)
+{
+    storage_location_t location;
+
+    // misses count too: under TinyLFU a key must be asked for to get in
+    if (storage->sketch != NULL)
+    {
+        sketch_increment(storage->sketch, hash);
+    }
+
+    storage_entry_t *entry = storage_lookup(storage_shard_for(storage, hash), hash, key, key_length, &location);
+    *expired = entry != NULL && !storage_entry_live(entry);
+    if (entry == NULL || *expired)
+    {
+        return NULL;
+    }
+
+    storage_entry_touch(storage, entry);
+    if (entry->integer_encoded)
+    {
+        return storage_entry_format_integer(entry);
+    }
+    storage_value_acquire(entry->value);
+    return entry->value;
+}
+
+storage_value_t *storage_get(storage_t *storage, const char *key, size_t key_length)
+{
+    uint64_t hash = hash_bytes(key, key_length);
+    bool expired;
+
+    epoch_enter();
+    storage_value_t *value = storage_read(storage, hash, key, key_length, &expired);
+    epoch_exit();
+
+    if (expired)
+    {
+        storage_drop_expired(storage_shard_for(storage, hash), hash, key, key_length);
+    }
+    return value;
+}
+
+/*
+Caller is in an epoch section. Touches the cache lines of the home
+position a lookup starts from; prefetching memory that was freed meanwhile
+is harmless, it cannot fault.
+*/
+static void storage_prefetch_home(storage_t *storage, uint64_t hash)
+{
+    storage_table_t *table = atomic_load_explicit(&storage_shard_for(storage, hash)->table, memory_order_acquire);
+    size_t index = hash & (table->capacity - 1);
+    __builtin_prefetch(&table->control[index / STORAGE_GROUP_WIDTH * STORAGE_GROUP_WORDS]);
+    __builtin_prefetch(&table->slots[index]);
+}
+
+// the home slot holds the key more often than not, its entry is the next miss
+static void storage_prefetch_entry(storage_t *storage, uint64_t hash)
+{
+    storage_table_t *table = atomic_load_explicit(&storage_shard_for(storage, hash)->table, memory_order_acquire);
+    uint64_t word = atomic_load_explicit(&table->slots[hash & (table->capacity - 1)], memory_order_relaxed);
+    if (word != STORAGE_EMPTY && word != STORAGE_TOMBSTONE)
+    {
+        __builtin_prefetch(storage_slot_entry(word));
+    }
+}
+
+/*
+Keys are looked up a batch at a time: all of them are hashed and their
+home slots prefetched, then the entries in those slots, before the first
+one is resolved. The misses of a batch overlap instead of adding up.
+*/
+void storage_get_many(storage_t *storage, const char *const *keys, const size_t *key_lengths, size_t count,
+                      storage_value_t **values)
+{
+    uint64_t hashes[STORAGE_GET_BATCH];
+    bool expired[STORAGE_GET_BATCH];
+
+    for (size_t start = 0; start < count; start += STORAGE_GET_BATCH)
+    {
+        size_t batch = count - start < STORAGE_GET_BATCH ? count - start : STORAGE_GET_BATCH;
+
+        for (size_t i = 0; i < batch; i++)
+        {
+            hashes[i] = hash_bytes(keys[start + i], key_lengths[start + i]);
+        }
+
+        epoch_enter();
+        for (size_t i = 0; i < batch; i++)
+        {
+            storage_prefetch_home(storage, hashes[i]);
+        }
+        for (size_t i = 0; i < batch; i++)
+        {
+            storage_prefetch_entry(storage, hashes[i]);
+        }
+        for (size_t i = 0; i < batch; i++)
+        {
+            values[start + i] = storage_read(storage, hashes[i], keys[start + i], key_lengths[start + i], &expired[i]);
+        }
+        epoch_exit();
+
+        for (size_t i = 0; i < batch; i++)
+        {
+            if (expired[i])
+            {
+                storage_drop_expired(storage_shard_for(storage, hashes[i]), hashes[i], keys[start + i],
+                                     key_lengths[start + i]);
+            }
+        }
+    }
+}
+
+bool storage_exists(storage_t *storage, const char *key, size_t key_length)
+{
+    uint64_t hash = hash_bytes(key, key_length);
+    storage_shard_t *shard = storage_shard_for(storage, hash);
+    storage_location_t location;
+
+    epoch_enter();
+    storage_entry_t *entry = storage_lookup(shard, hash, key, key_length, &location);
+    bool expired = entry != NULL && !storage_entry_live(entry);
+    epoch_exit();
+
+    if (expired)
+    {
+        storage_drop_expired(shard, hash, key, key_length);
+    }
+    return entry != NULL && !expired;
+}
+
+/*
+Caller holds the shard lock. SET already stores every number as an integer
+entry, so a value with a buffer is never a number.
+*/
+static storage_incr_status_t storage_shard_incr(storage_t *storage, storage_shard_t *shard, uint64_t hash,
+                                                const char *key, size_t key_length, int64_t delta, int64_t *result)
+{
+    storage_location_t location;
+    storage_entry_t *entry = storage_lookup_live(shard, hash, key, key_length, &location);
+
+    if (entry != NULL)
+    {
+        if (!entry->integer_encoded)
+        {
+            return STORAGE_INCR_NOT_INTEGER;
+        }
+
+        int64_t current = atomic_load_explicit(&entry->integer, memory_order_relaxed);
+        if (delta > 0 ? current > INT64_MAX - delta : current < INT64_MIN - delta)
+        {
+            return STORAGE_INCR_OVERFLOW;
+        }
+
+        *result = current + delta;
+        atomic_store_explicit(&entry->integer, *result, memory_order_relaxed);
+        storage_entry_touch(storage, entry);
+        storage_journal_entry(storage, entry);
+        return STORAGE_INCR_OK;
+    }
+
+    storage_entry_t *counter = storage_entry_create_integer(key, key_length, hash, delta);
+    if (counter == NULL || !storage_reserve(shard))
+    {
+        if (counter != NULL)
+        {
+            storage_entry_destroy(counter);
+        }
+        return STORAGE_INCR_NO_MEMORY;
+    }
+
+    atomic_init(&counter->access, atomic_load_explicit(&storage->lru_clock, memory_order_relaxed));
+    storage_table_insert(atomic_load_explicit(&shard->table, memory_order_relaxed), hash, counter);
+    storage_shard_account(shard, storage_entry_bytes(counter), 0);
+    shard->size++;
+    storage_journal_entry(storage, counter);
+    *result = delta;
+    return STORAGE_INCR_OK;
+}
+
+/*
+The read and the write happen under the shard lock, so concurrent INCRs of
+one key never lose an update. A new counter is paid for by evicting
+afterwards, like a table grown by SET.
+*/
+storage_incr_status_t storage_incr(storage_t *storage, const char *key, size_t key_length, int64_t delta,
+                                   int64_t *result)
+{
+    uint64_t hash = hash_bytes(key, key_length);
+    storage_shard_t *shard = storage_shard_for(storage, hash);
+
+    if (storage->sketch != NULL)
+    {
+        sketch_increment(storage->sketch, hash);
+    }
+
+    pthread_mutex_lock(&shard->lock);
+    storage_reclaim(shard);
+    storage_rehash_step(shard, get_storage_rehash_step());
+    size_t memory = shard->memory;
+    storage_incr_status_t status = storage_shard_incr(storage, shard, hash, key, key_length, delta, result);
+    bool grown = shard->memory > memory;
+    pthread_mutex_unlock(&shard->lock);
+
+    if (grown)
+    {
+        storage_make_room(storage, 0, NULL);
+    }
+    return status;
+}
+
+bool storage_delete(storage_t *storage, const char *key, size_t key_length)
+{
+    uint64_t hash = hash_bytes(key, key_length);
+    storage_shard_t *shard = storage_shard_for(storage, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    storage_reclaim(shard);
+    storage_rehash_step(shard, get_storage_rehash_step());
+
+    storage_location_t location;
+    storage_entry_t *entry = storage_lookup_live(shard, hash, key, key_length, &location);
+    if (entry != NULL)
+    {
+        storage_shard_erase(shard, entry, &location);
+        storage_journal_key(storage, STORAGE_JOURNAL_DELETE, hash, key, key_length, 0);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return entry != NULL;
+}
+
+/*
+Every shard gets a fresh table up front, so a failed allocation leaves the
+storage untouched instead of half flushed.
+*/
+void storage_flush(storage_t *storage)
+{
+    storage_table_t **fresh = calloc(storage->shard_count, sizeof(storage_table_t *));
+    bool allocated = fresh != NULL;
+    for (size_t i = 0; allocated && i < storage->shard_count; i++)
+    {
+        fresh[i] = storage_table_create(storage->initial_capacity);
+        allocated = fresh[i] != NULL;
+    }
+
+    if (allocated)
+    {
+        storage_lock_all(storage);
+        for (size_t i = 0; i < storage->shard_count; i++)
+        {
+            storage_shard_clear(&storage->shards[i], fresh[i]);
+            if (storage->track_dirty)
+            {
+                storage_dirty_overflow(&storage->shards[i].dirty);
+            }
+        }
+        storage_journal_key(storage, STORAGE_JOURNAL_FLUSH, 0, NULL, 0, 0);
+        storage_unlock_all(storage);
+    }
+    else if (fresh != NULL)
+    {
+        for (size_t i = 0; i < storage->shard_count; i++)
+        {
+            free(fresh[i]);
+        }
+    }
+
+    free(fresh);
+}
+
+/*
+All shards are held together so the count is a consistent snapshot
+rather than a sum of sizes observed at different times.
+*/
+size_t storage_size(storage_t *storage)
+{
+    size_t size = 0;
+
+    storage_lock_all(storage);
+    for (size_t i = 0; i < storage->shard_count; i++)
+    {
+        size += storage->shards[i].size;
+    }
+    storage_unlock_all(storage);
+
+    return size;
+}
+
+// ==================== Bulk Load ====================
+
+size_t storage_shard_of(storage_t *storage, const char *key, size_t key_length)
+{
+    return (size_t)(storage_shard_for(storage, hash_bytes(key, key_length)) - storage->shards);
+}
+
+/*
+Only a shard without keys and without a rehash under way gets a bigger
+table: there is nothing to move, the old table is retired as it is. Keys
+do not spread exactly evenly, so each shard gets an eighth above its share.
+*/
+void storage_reserve_keys(storage_t *storage, size_t keys)
+{
+    size_t share = keys / storage->shard_count;
+    size_t per_shard = share + share / 8 + 1;
+    size_t capacity = storage->initial_capacity;
+    while (capacity * get_storage_max_load_percent() < per_shard * 100)
+    {
+        capacity *= 2;
+    }
+
+    for (size_t i = 0; i < storage->shard_count; i++)
+    {
+        storage_shard_t *shard = &storage->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        storage_table_t *table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+        storage_table_t *fresh = NULL;
+        if (shard->size == 0 && atomic_load_explicit(&shard->rehash, memory_order_relaxed) == NULL &&
+            table->capacity < capacity && (fresh = storage_table_create(capacity)) != NULL)
+        {
+            storage_publish_tables(shard, fresh, NULL);
+            storage_retire(shard, STORAGE_RETIRED_TABLE, table);
+            storage_shard_account(shard, storage_table_bytes(capacity), storage_table_bytes(table->capacity));
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+// the value is copied out of `record`, a canonical integer is stored as one right away
+static storage_entry_t *storage_entry_restore(const storage_journal_record_t *record, uint64_t hash)
+{
+    int64_t integer;
+    if (storage_parse_integer(record->value, record->value_length, &integer))
+    {
+        return storage_entry_create_integer(record->key, record->key_length, hash, integer);
+    }
+
+    storage_value_t *value = storage_value_create(record->value, record->value_length);
+    storage_entry_t *entry = value != NULL ? storage_entry_alloc(record->key, record->key_length, hash) : NULL;
+    if (entry == NULL)
+    {
+        storage_value_release(value);
+        return NULL;
+    }
+    entry->value = value;
+    return entry;
+}
+
+/*
+Caller holds `*locked` unless it is NULL; it is swapped for the key's
+shard lock when they differ, so a run of keys in one shard takes it once.
+A record that removes the key allocates nothing.
+*/
+static bool storage_restore_one(storage_t *storage, const storage_journal_record_t *record, uint64_t hash,
+                                uint32_t clock, bool removes, storage_shard_t **locked)
+{
+    storage_entry_t *entry = removes ? NULL : storage_entry_restore(record, hash);
+    if (!removes && entry == NULL)
+    {
+        return false;
+    }
+    if (entry != NULL)
+    {
+        atomic_init(&entry->expires_at, record->expires_at);
+        atomic_init(&entry->access, clock);
+    }
+
+    storage_shard_t *shard = storage_shard_for(storage, hash);
+    if (shard != *locked)
+    {
+        if (*locked != NULL)
+        {
+            pthread_mutex_unlock(&(*locked)->lock);
+        }
+        pthread_mutex_lock(&shard->lock);
+        storage_reclaim(shard);
+        *locked = shard;
+    }
+    storage_rehash_step(shard, get_storage_rehash_step());
+
+    storage_location_t location;
+    storage_entry_t *previous = storage_lookup(shard, hash, record->key, record->key_length, &location);
+    if (removes)
+    {
+        if (previous != NULL)
+        {
+            storage_shard_erase(shard, previous, &location);
+            storage_journal_key(storage, STORAGE_JOURNAL_DELETE, hash, record->key, record->key_length, 0);
+        }
+        return true;
+    }
+    if (previous != NULL)
+    {
+        storage_timer_unlink(previous);
+        storage_table_replace(location.table, location.index, hash, entry);
+        storage_shard_account(shard, storage_entry_bytes(entry), storage_entry_bytes(previous));
+        storage_retire(shard, STORAGE_RETIRED_ENTRY, previous);
+    }
+    else if (storage_reserve(shard))
+    {
+        storage_table_insert(atomic_load_explicit(&shard->table, memory_order_relaxed), hash, entry);
+        storage_shard_account(shard, storage_entry_bytes(entry), 0);
+        shard->size++;
+    }
+    else
+    {
+        storage_entry_destroy(entry);
+        return false;
+    }
+
+    storage_wheel_schedule(&shard->wheel, entry);
+    storage_journal_entry(storage, entry);
+    return true;
+}
+
+/*
+Like a run of storage_set_expiring() and storage_delete() calls, minus
+what a load does not need: the shard lock is kept across consecutive keys of the same shard,
+there is no admission check and the memory limit is enforced once at the
+end rather than per key. As in storage_get_many(), the home slots of a
+batch are prefetched together.
+*/
+size_t storage_restore(storage_t *storage, const storage_journal_record_t *records, size_t count)
+{
+    uint64_t now_ms = storage_now_ms();
+    uint32_t clock = atomic_load_explicit(&storage->lru_clock, memory_order_relaxed);
+    uint64_t hashes[STORAGE_GET_BATCH];
+    storage_shard_t *locked = NULL;
+    size_t done = 0;
+    bool failed = false;
+
+    while (!failed && done < count)
+    {
+        size_t batch = count - done < STORAGE_GET_BATCH ? count - done : STORAGE_GET_BATCH;
+        const storage_journal_record_t *next = &records[done];
+        for (size_t i = 0; i < batch; i++)
+        {
+            hashes[i] = hash_bytes(next[i].key, next[i].key_length);
+        }
+        epoch_enter();
+        for (size_t i = 0; i < batch; i++)
+        {
+            storage_prefetch_home(storage, hashes[i]);
+        }
+        epoch_exit();
+
+        for (size_t i = 0; i < batch && !failed; i++)
+        {
+            bool removes = next[i].op == STORAGE_JOURNAL_DELETE ||
+                           (next[i].expires_at != 0 && next[i].expires_at <= now_ms);
+            failed = !storage_restore_one(storage, &next[i], hashes[i], clock, removes, &locked);
+            done += failed ? 0 : 1;
+        }
+    }
+
+    if (locked != NULL)
+    {
+        pthread_mutex_unlock(&locked->lock);
+    }
+
+    storage_make_room(storage, 0, NULL);
+    return done;
+}
+
+// ==================== Expiry ====================
+
+bool storage_expire(storage_t *storage, const char *key, size_t key_length, uint64_t ttl_ms)
+{
+    uint64_t hash = hash_bytes(key, key_length);
+    storage_shard_t *shard = storage_shard_for(storage, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    storage_reclaim(shard);
+
+    storage_location_t location;
+    storage_entry_t *entry = storage_lookup_live(shard, hash, key, key_length, &location);
+    if (entry != NULL && ttl_ms == 0)
+    {
+        storage_shard_erase(shard, entry, &location);
+        storage_journal_key(storage, STORAGE_JOURNAL_DELETE, hash, key, key_length, 0);
+    }
+    else if (entry != NULL)
+    {
+        uint64_t expires_at = storage_now_ms() + ttl_ms;
+        atomic_store_explicit(&entry->expires_at, expires_at, memory_order_relaxed);
+        storage_wheel_schedule(&shard->wheel, entry);
+        storage_journal_key(storage, STORAGE_JOURNAL_EXPIRE, hash, key, key_length, expires_at);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return entry != NULL;
+}
+
+bool storage_persist(storage_t *storage, const char *key, size_t key_length)
+{
+    uint64_t hash = hash_bytes(key, key_length);
+    storage_shard_t *shard = storage_shard_for(storage, hash);
+    bool persisted = false;
+
+    pthread_mutex_lock(&shard->lock);
+    storage_reclaim(shard);
+
+    storage_location_t location;
+    storage_entry_t *entry = storage_lookup_live(shard, hash, key, key_length, &location);
+    if (entry != NULL && atomic_load_explicit(&entry->expires_at, memory_order_relaxed) != 0)
+    {
+        atomic_store_explicit(&entry->expires_at, 0, memory_order_relaxed);
+        storage_timer_unlink(entry);
+        storage_journal_key(storage, STORAGE_JOURNAL_EXPIRE, hash, key, key_length, 0);
+        persisted = true;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return persisted;
+}
+
+int64_t storage_ttl(storage_t *storage, const char *key, size_t key_length)
+{
+    uint64_t hash = hash_bytes(key, key_length);
+    storage_shard_t *shard = storage_shard_for(storage, hash);
+    storage_location_t location;
+    int64_t ttl = STORAGE_TTL_MISSING;
+
+    epoch_enter();
+    storage_entry_t *entry = storage_lookup(shard, hash, key, key_length, &location);
+    uint64_t expires_at = entry != NULL ? atomic_load_explicit(&entry->expires_at, memory_order_relaxed) : 0;
+    epoch_exit();
+
+    if (entry == NULL)
+    {
+        return STORAGE_TTL_MISSING;
+    }
+    if (expires_at == 0)
+    {
+        return STORAGE_TTL_PERSISTENT;
+    }
+
+    uint64_t now = storage_now_ms();
+    if (expires_at > now)
+    {
+        ttl = (int64_t)(expires_at - now);
+    }
+    else
+    {
+        storage_drop_expired(shard, hash, key, key_length);
+    }
+    return ttl;
+}
+
+/*
+Shards are visited one at a time, each for a bounded number of wheel
+entries, so expiring millions of keys never holds a lock for long and
+never scans a table.
+*/
+size_t storage_expire_cycle(storage_t *storage)
+{
+    uint64_t now_ms = storage_now_ms();
+    size_t expired = 0;
+
+    storage_lru_refresh(storage);
+
+    for (size_t i = 0; i < storage->shard_count; i++)
+    {
+        storage_shard_t *shard = &storage->shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        storage_reclaim(shard);
+        expired += storage_shard_expire(shard, now_ms, get_storage_expire_budget());
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    return expired;
+}
+
+// ==================== Memory ====================
+
+void storage_set_max_memory(storage_t *storage, size_t max_memory)
+{
+    storage->max_memory = max_memory;
+}
+
+size_t storage_memory_used(storage_t *storage)
+{
+    return atomic_load_explicit(&storage->memory_used, memory_order_relaxed);
+}
+
+bool storage_set_eviction_policy(storage_t *storage, storage_eviction_policy_t policy)
+{
+    if (policy == STORAGE_EVICTION_LFU && storage->sketch == NULL)
+    {
+        storage->sketch = sketch_create(get_storage_sketch_counters(), get_storage_sketch_aging_interval());
+        if (storage->sketch == NULL)
+        {
+            return false;
+        }
+        atomic_fetch_add_explicit(&storage->memory_used, sketch_bytes(storage->sketch), memory_order_relaxed);
+    }
+    else if (policy == STORAGE_EVICTION_LRU && storage->sketch != NULL)
+    {
+        atomic_fetch_sub_explicit(&storage->memory_used, sketch_bytes(storage->sketch), memory_order_relaxed);
+        sketch_destroy(storage->sketch);
+        storage->sketch = NULL;
+    }
+    return true;
+}
+
+// ==================== Lazy Free ====================
+
+void storage_set_lazy_free(storage_t *storage, bool enabled)
+{
+    storage->lazy_free.enabled = enabled;
+}
+
+/*
+The whole queue is detached at once, so writers handing over more work
+never wait for the frees.
+*/
+size_t storage_lazy_free_cycle(storage_t *storage, uint64_t timeout_ms)
+{
+    storage_lazy_free_t *lazy = &storage->lazy_free;
+
+    pthread_mutex_lock(&lazy->lock);
+    if (lazy->head == NULL && timeout_ms > 0)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)(timeout_ms / 1000);
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&lazy->queued, &lazy->lock, &deadline);
+    }
+    storage_retired_t *retired = lazy->head;
+    lazy->head = NULL;
+    lazy->tail = NULL;
+    pthread_mutex_unlock(&lazy->lock);
+
+    size_t freed = 0;
+    while (retired != NULL)
+    {
+        storage_retired_t *next = retired->next;
+        storage_retired_free(retired);
+        retired = next;
+        freed++;
+    }
+
+    return freed;
+}
+
+// ==================== Scan ====================
+
+static uint64_t storage_bit_reverse(uint64_t v)
+{
+    v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+    v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(v);
+}
+
+/*
+Increment the bits of `cursor` under `mask` starting from the highest one.
+Home groups of a table twice as large split group g into g and g + groups,
+which this order visits back to back, so a resize between two calls never
+makes the cursor skip a group it had not covered yet.
+*/
+static uint64_t storage_cursor_next(uint64_t cursor, uint64_t mask)
+{
+    cursor |= ~mask;
+    return storage_bit_reverse(storage_bit_reverse(cursor) + 1);
+}
+
+static uint64_t storage_table_group_mask(const storage_table_t *table)
+{
+    return table->capacity / STORAGE_GROUP_WIDTH - 1;
+}
+
+/*
+Caller holds the shard lock. A key is reported for the group its probing
+starts from, wherever it ended up: like a lookup, the probe sequence from
+there reaches it before a group with an EMPTY control byte.
+*/
+static size_t storage_scan_group(storage_table_t *table, uint64_t home, storage_scan_fn fn, void *arg)
+{
+    uint64_t mask = storage_table_group_mask(table);
+    size_t reported = 0;
+
+    for (uint64_t probes = 0, group = home; probes <= mask; probes++, group = (group + 1) & mask)
+    {
+        for (size_t index = group * STORAGE_GROUP_WIDTH; index < (group + 1) * STORAGE_GROUP_WIDTH; index++)
+        {
+            uint64_t word = atomic_load_explicit(&table->slots[index], memory_order_relaxed);
+            if (word == STORAGE_EMPTY || word == STORAGE_TOMBSTONE)
+            {
+                continue;
+            }
+
+            storage_entry_t *entry = storage_slot_entry(word);
+            if (((entry->hash & (table->capacity - 1)) / STORAGE_GROUP_WIDTH) == home && storage_entry_live(entry))
+            {
+                fn(entry->key, entry->key_length, arg);
+                reported++;
+            }
+        }
+
+        if (storage_group_match_empty(&table->control[group * STORAGE_GROUP_WORDS]) != 0)
+        {
+            break;
+        }
+    }
+
+    return reported;
+}
+
+/*
+While a shard is rehashing, each of its keys is in exactly one of the two
+tables. The smaller table's home group is visited along with every group
+of the larger one it expands to, which is what the cursor of either table
+size would have covered.
+*/
+static uint64_t storage_shard_scan(storage_shard_t *shard, uint64_t cursor, size_t *reported, storage_scan_fn fn,
+                                   void *arg)
+{
+    storage_table_t *small = atomic_load_explicit(&shard->table, memory_order_relaxed);
+    storage_table_t *large = atomic_load_explicit(&shard->rehash, memory_order_relaxed);
+
+    if (large == NULL)
+    {
+        uint64_t mask = storage_table_group_mask(small);
+        *reported += storage_scan_group(small, cursor & mask, fn, arg);
+        return storage_cursor_next(cursor, mask);
+    }
+
+    if (small->capacity > large->capacity)
+    {
+        storage_table_t *swap = small;
+        small = large;
+        large = swap;
+    }
+
+    uint64_t small_mask = storage_table_group_mask(small);
+    uint64_t large_mask = storage_table_group_mask(large);
+    *reported += storage_scan_group(small, cursor & small_mask, fn, arg);
+    do
+    {
+        *reported += storage_scan_group(large, cursor & large_mask, fn, arg);
+        cursor = storage_cursor_next(cursor, large_mask);
+    } while ((cursor & (small_mask ^ large_mask)) != 0);
+
+    return cursor;
+}
+
+/*
+The cursor holds the shard index in its low bits and the position within
+that shard above them. Shards are walked one after another, each under its
+lock for a single home group at a time.
+*/
+uint64_t storage_scan(storage_t *storage, uint64_t cursor, size_t count, storage_scan_fn fn, void *arg)
+{
+    unsigned shard_bits = 64 - storage->shard_shift;
+    size_t index = (size_t)cursor & (storage->shard_count - 1);
+    uint64_t position = shard_bits < 64 ? cursor >> shard_bits : 0;
+    size_t reported = 0;
+    count = count > 0 ? count : 1;
+    size_t visits = count * get_storage_scan_visit_factor();
+
+    while (reported < count && visits-- > 0)
+    {
+        storage_shard_t *shard = &storage->shards[index];
+
+        pthread_mutex_lock(&shard->lock);
+        position = storage_shard_scan(shard, position, &reported, fn, arg);
+        pthread_mutex_unlock(&shard->lock);
+
+        if (position == 0 && ++index == storage->shard_count)
+        {
+            return 0;
+        }
+    }
+
+    return (position << shard_bits) | index;
+}
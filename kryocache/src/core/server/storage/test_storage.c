@@ -0,0 +1,1356 @@
+/**
+ * @file test_storage.c
+ * @brief Test suite for the storage hash table
+ */
+
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/storage.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/constants.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/slab.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/hash.h"
+#include "/Users/dimaeremin/kryosette-db/kryocache/src/core/server/storage/include/sketch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// ==================== Test Constants ====================
+
+static const int TEST_SUCCESS = 0;
+static const int TEST_FAILURE = 1;
+static const char *TEST_PASS_MESSAGE = "✅ PASS";
+static const char *TEST_FAIL_MESSAGE = "❌ FAIL";
+static const size_t TEST_KEY_COUNT = 100000;
+static const size_t TEST_THREAD_COUNT = 4;
+static const size_t TEST_THREAD_KEY_COUNT = 20000;
+static const size_t TEST_READER_COUNT = 3;
+static const size_t TEST_HOT_VALUE_LENGTH = 256;
+static const size_t TEST_EXPIRING_KEY_COUNT = 20000;
+static const size_t TEST_MEMORY_LIMIT_EXTRA = 4194304; // 4MB above an empty storage
+static const size_t TEST_HOT_KEY_COUNT = 200;
+static const size_t TEST_COLD_VALUE_LENGTH = 1000;
+static const size_t TEST_HOT_READS = 8;
+static const size_t TEST_SLAB_CHUNK_COUNT = 1000;
+static const size_t TEST_SLAB_CHUNK_SIZE = 100;
+static const size_t TEST_SKETCH_COUNTERS = 4096;
+static const size_t TEST_SKETCH_AGING_INTERVAL = 1000;
+static const size_t TEST_DEFRAG_KEY_COUNT = 10000;
+static const size_t TEST_DEFRAG_VALUE_LENGTH = 700;
+static const size_t TEST_DEFRAG_KEEP_EVERY = 10;
+static const size_t TEST_DEFRAG_CYCLES = 8;
+static const uint64_t TEST_DEFRAG_BUDGET_US = 1000000;
+static const size_t TEST_LAZY_FREE_KEY_COUNT = 10000;
+static const size_t TEST_LAZY_FREE_VALUE_LENGTH = 333;
+static const size_t TEST_LAZY_FREE_BIG_LENGTH = 1048576;
+static const size_t TEST_GRACE_CYCLES = 4;
+static const size_t TEST_SCAN_KEY_COUNT = 20000;
+static const size_t TEST_SCAN_COUNT = 50;
+static const size_t TEST_SCAN_GROWTH = 20; // keys added between two SCAN calls
+static const size_t TEST_GET_MANY_COUNT = 100; // several lookup batches, the last one partial
+static const size_t TEST_INCR_COUNT = 20000;
+static const size_t TEST_DUMP_KEY_COUNT = 20000;
+static const size_t TEST_RESTORE_KEY_COUNT = 50000;
+
+// ==================== Test Utilities ====================
+
+void test_header(const char *test_name)
+{
+    printf("\n🎯 Testing: %s\n", test_name);
+    printf("=========================================\n");
+}
+
+void test_result(const char *test_case, bool passed)
+{
+    printf("  %s - %s\n", test_case, passed ? TEST_PASS_MESSAGE : TEST_FAIL_MESSAGE);
+}
+
+static bool test_set_string(storage_t *storage, const char *key, const char *value)
+{
+    storage_value_t *stored = storage_value_create(value, strlen(value));
+    return stored != NULL && storage_set(storage, key, strlen(key), stored);
+}
+
+static bool test_value_equals(storage_t *storage, const char *key, const char *expected)
+{
+    storage_value_t *value = storage_get(storage, key, strlen(key));
+    if (value == NULL)
+    {
+        return false;
+    }
+
+    bool equal = value->length == strlen(expected) && memcmp(value->data, expected, value->length) == 0;
+    storage_value_release(value);
+    return equal;
+}
+
+static void test_sleep_ms(uint64_t ms)
+{
+    struct timespec delay = {.tv_sec = (time_t)(ms / 1000), .tv_nsec = (long)(ms % 1000) * 1000000};
+    nanosleep(&delay, NULL);
+}
+
+// ==================== Storage Tests ====================
+
+int test_storage_basic_operations(void)
+{
+    test_header("Basic Operations");
+
+    storage_t *storage = storage_create(0);
+    bool created = (storage != NULL);
+    test_result("Storage created", created);
+    if (!created)
+    {
+        return TEST_FAILURE;
+    }
+
+    bool set_works = test_set_string(storage, "alpha", "1") && test_value_equals(storage, "alpha", "1");
+    test_result("SET then GET returns the value", set_works);
+
+    bool overwrite_works = test_set_string(storage, "alpha", "2") && test_value_equals(storage, "alpha", "2") &&
+                           storage_size(storage) == 1;
+    test_result("Overwrite keeps a single entry", overwrite_works);
+
+    bool missing_works = storage_get(storage, "beta", 4) == NULL && !storage_exists(storage, "beta", 4);
+    test_result("Missing key is not found", missing_works);
+
+    bool delete_works = storage_delete(storage, "alpha", 5) && !storage_exists(storage, "alpha", 5) &&
+                        !storage_delete(storage, "alpha", 5) && storage_size(storage) == 0;
+    test_result("DELETE removes the key once", delete_works);
+
+    storage_destroy(storage);
+
+    return set_works && overwrite_works && missing_works && delete_works ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_storage_value_outlives_overwrite(void)
+{
+    test_header("Value References");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    test_set_string(storage, "key", "old");
+    storage_value_t *held = storage_get(storage, "key", 3);
+    test_set_string(storage, "key", "new");
+    storage_flush(storage);
+
+    bool held_intact = held != NULL && memcmp(held->data, "old", 3) == 0;
+    test_result("Held value survives overwrite and flush", held_intact);
+    storage_value_release(held);
+
+    storage_destroy(storage);
+    return held_intact ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_storage_binary_safe(void)
+{
+    test_header("Binary-Safe Keys and Values");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    const char key[] = {'k', '\0', 'x'};
+    const char data[] = {'a', '\0', 'b', '\0'};
+    storage_value_t *stored = storage_value_create(data, sizeof(data));
+    bool set_works = stored != NULL && storage_set(storage, key, sizeof(key), stored);
+
+    storage_value_t *value = storage_get(storage, key, sizeof(key));
+    bool round_trip = value != NULL && value->length == sizeof(data) && memcmp(value->data, data, sizeof(data)) == 0;
+    storage_value_release(value);
+    test_result("Embedded NUL bytes round-trip", set_works && round_trip);
+
+    bool prefix_distinct = !storage_exists(storage, key, 1);
+    test_result("Key prefix before NUL is a different key", prefix_distinct);
+
+    // classes grow by the growth factor, rounded up to the alignment
+    slab_class_stats_t classes[SLAB_MAX_CLASSES];
+    size_t class_count = slab_stats(classes, SLAB_MAX_CLASSES);
+    bool small_classes = slab_chunk_size(1) == get_slab_min_chunk_size() && class_count > 1;
+    for (size_t i = 1; i < class_count; i++)
+    {
+        size_t limit = classes[i - 1].chunk_size * get_slab_growth_percent() / 100 + get_slab_min_chunk_size();
+        small_classes = small_classes && classes[i].chunk_size > classes[i - 1].chunk_size &&
+                        classes[i].chunk_size <= limit && classes[i].chunk_size % get_slab_min_chunk_size() == 0 &&
+                        slab_chunk_size(classes[i - 1].chunk_size + 1) == classes[i].chunk_size;
+    }
+    bool large_bypass = slab_chunk_size(get_slab_max_chunk_size() + 1) == get_slab_max_chunk_size() + 1;
+    test_result("Slab size classes", small_classes && large_bypass);
+
+    // every length path of the hash must depend on every byte
+    char bytes[100] = {0};
+    bool hash_covers = true;
+    for (size_t length = 1; length <= sizeof(bytes); length++)
+    {
+        uint64_t base = hash_bytes(bytes, length);
+        hash_covers = hash_covers && hash_bytes(bytes, length) == base && hash_bytes(bytes, length - 1) != base;
+        for (size_t i = 0; i < length; i++)
+        {
+            bytes[i] = 1;
+            hash_covers = hash_covers && hash_bytes(bytes, length) != base;
+            bytes[i] = 0;
+        }
+    }
+    test_result("Hash depends on every byte and the length", hash_covers);
+
+    storage_destroy(storage);
+    return set_works && round_trip && prefix_distinct && small_classes && large_bypass && hash_covers ? TEST_SUCCESS
+                                                                                                     : TEST_FAILURE;
+}
+
+int test_storage_incremental_rehash(void)
+{
+    test_header("Incremental Rehash");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    char key[32];
+    char value[32];
+    bool inserted = true;
+    for (size_t i = 0; i < TEST_KEY_COUNT && inserted; i++)
+    {
+        snprintf(key, sizeof(key), "key:%zu", i);
+        snprintf(value, sizeof(value), "value:%zu", i);
+        inserted = test_set_string(storage, key, value);
+
+        // every key written so far must stay visible while tables are being migrated
+        if (i % 997 == 0)
+        {
+            snprintf(key, sizeof(key), "key:%zu", i / 2);
+            snprintf(value, sizeof(value), "value:%zu", i / 2);
+            inserted = inserted && test_value_equals(storage, key, value);
+        }
+    }
+    test_result("Keys readable while growing", inserted);
+
+    size_t capacity = 0;
+    bool grown = true;
+    for (size_t i = 0; i < storage->shard_count; i++)
+    {
+        const storage_table_t *table = atomic_load(&storage->shards[i].table);
+        capacity += table->capacity;
+        grown = grown && table->used * 100 <= table->capacity * get_storage_max_load_percent();
+    }
+    grown = grown && capacity >= TEST_KEY_COUNT;
+    test_result("Shard tables grew within the load factor", grown);
+
+    bool spread = true;
+    for (size_t i = 0; i < storage->shard_count; i++)
+    {
+        spread = spread && storage->shards[i].size > 0;
+    }
+    test_result("Keys spread over every shard", spread);
+
+    bool deleted = true;
+    for (size_t i = 0; i < TEST_KEY_COUNT; i += 2)
+    {
+        snprintf(key, sizeof(key), "key:%zu", i);
+        deleted = deleted && storage_delete(storage, key, strlen(key));
+    }
+
+    bool all_found = true;
+    for (size_t i = 0; i < TEST_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "key:%zu", i);
+        all_found = all_found && storage_exists(storage, key, strlen(key)) == (i % 2 == 1);
+    }
+    bool size_correct = storage_size(storage) == TEST_KEY_COUNT / 2;
+    test_result("Deletes across old and new tables", deleted && all_found && size_correct);
+
+    storage_destroy(storage);
+    return inserted && grown && spread && deleted && all_found && size_correct ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+typedef struct test_worker
+{
+    storage_t *storage;
+    size_t id;
+    bool passed;
+} test_worker_t;
+
+static void *test_storage_worker(void *arg)
+{
+    test_worker_t *worker = arg;
+    char key[32];
+    char value[32];
+
+    worker->passed = true;
+    for (size_t i = 0; i < TEST_THREAD_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "t%zu:%zu", worker->id, i);
+        snprintf(value, sizeof(value), "v%zu", i);
+        worker->passed = worker->passed && test_set_string(worker->storage, key, value) &&
+                         test_value_equals(worker->storage, key, value);
+
+        if (i % 3 == 0)
+        {
+            worker->passed = worker->passed && storage_delete(worker->storage, key, strlen(key));
+        }
+    }
+
+    return NULL;
+}
+
+int test_storage_concurrent_access(void)
+{
+    test_header("Concurrent Access");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    pthread_t threads[TEST_THREAD_COUNT];
+    test_worker_t workers[TEST_THREAD_COUNT];
+    for (size_t i = 0; i < TEST_THREAD_COUNT; i++)
+    {
+        workers[i] = (test_worker_t){.storage = storage, .id = i};
+        pthread_create(&threads[i], NULL, test_storage_worker, &workers[i]);
+    }
+
+    // STATS-style cross-shard reads run alongside the writers
+    for (size_t i = 0; i < 100; i++)
+    {
+        storage_size(storage);
+    }
+
+    bool workers_passed = true;
+    for (size_t i = 0; i < TEST_THREAD_COUNT; i++)
+    {
+        pthread_join(threads[i], NULL);
+        workers_passed = workers_passed && workers[i].passed;
+    }
+    test_result("Writers on disjoint keys see their own writes", workers_passed);
+
+    size_t expected = TEST_THREAD_COUNT * (TEST_THREAD_KEY_COUNT - (TEST_THREAD_KEY_COUNT + 2) / 3);
+    bool size_correct = storage_size(storage) == expected;
+    test_result("Size is consistent after concurrent writes", size_correct);
+
+    storage_destroy(storage);
+    return workers_passed && size_correct ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+typedef struct test_reader
+{
+    storage_t *storage;
+    _Atomic(bool) *stop;
+    bool passed;
+} test_reader_t;
+
+/*
+Readers run without locks while the writer overwrites the hot key and grows
+every table: the stable key must never go missing and a value must never be
+seen half written or after it was freed.
+*/
+static void *test_storage_reader(void *arg)
+{
+    test_reader_t *reader = arg;
+
+    reader->passed = true;
+    while (!atomic_load(reader->stop))
+    {
+        storage_value_t *value = storage_get(reader->storage, "hot", 3);
+        if (value != NULL)
+        {
+            for (size_t i = 1; i < value->length; i++)
+            {
+                reader->passed = reader->passed && value->data[i] == value->data[0];
+            }
+            reader->passed = reader->passed && value->length == TEST_HOT_VALUE_LENGTH;
+            storage_value_release(value);
+        }
+
+        reader->passed = reader->passed && storage_exists(reader->storage, "stable", 6);
+    }
+
+    return NULL;
+}
+
+int test_storage_lock_free_reads(void)
+{
+    test_header("Lock-Free Reads");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    test_set_string(storage, "stable", "1");
+
+    _Atomic(bool) stop = false;
+    pthread_t threads[TEST_READER_COUNT];
+    test_reader_t readers[TEST_READER_COUNT];
+    for (size_t i = 0; i < TEST_READER_COUNT; i++)
+    {
+        readers[i] = (test_reader_t){.storage = storage, .stop = &stop};
+        pthread_create(&threads[i], NULL, test_storage_reader, &readers[i]);
+    }
+
+    char hot[TEST_HOT_VALUE_LENGTH];
+    char key[32];
+    bool written = true;
+    for (size_t i = 0; i < TEST_KEY_COUNT && written; i++)
+    {
+        memset(hot, 'a' + (int)(i % 26), sizeof(hot));
+        storage_value_t *value = storage_value_create(hot, sizeof(hot));
+        written = value != NULL && storage_set(storage, "hot", 3, value);
+
+        snprintf(key, sizeof(key), "grow:%zu", i);
+        written = written && test_set_string(storage, key, "x");
+        if (i % 5 == 0)
+        {
+            written = written && storage_delete(storage, key, strlen(key));
+        }
+    }
+    atomic_store(&stop, true);
+
+    bool readers_passed = true;
+    for (size_t i = 0; i < TEST_READER_COUNT; i++)
+    {
+        pthread_join(threads[i], NULL);
+        readers_passed = readers_passed && readers[i].passed;
+    }
+    test_result("Writer overwrites and grows tables", written);
+    test_result("Readers never see a missing or torn value", readers_passed);
+
+    storage_destroy(storage);
+    return written && readers_passed ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_storage_expiry(void)
+{
+    test_header("Expiry");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    storage_value_t *value = storage_value_create("v", 1);
+    bool ttl_set = value != NULL && storage_set_expiring(storage, "session", 7, value, 50) == STORAGE_SET_OK &&
+                   storage_exists(storage, "session", 7) && storage_ttl(storage, "session", 7) > 0;
+    test_sleep_ms(80);
+    bool lazy = storage_get(storage, "session", 7) == NULL && storage_ttl(storage, "session", 7) == STORAGE_TTL_MISSING &&
+                storage_size(storage) == 0;
+    test_result("Key expires lazily on access", ttl_set && lazy);
+
+    test_set_string(storage, "key", "v");
+    bool commands = storage_ttl(storage, "key", 3) == STORAGE_TTL_PERSISTENT && !storage_persist(storage, "key", 3) &&
+                    storage_expire(storage, "key", 3, 60000) && storage_ttl(storage, "key", 3) > 59000 &&
+                    storage_persist(storage, "key", 3) && storage_ttl(storage, "key", 3) == STORAGE_TTL_PERSISTENT &&
+                    !storage_expire(storage, "missing", 7, 1000) && storage_expire(storage, "key", 3, 0) &&
+                    !storage_exists(storage, "key", 3);
+    test_result("EXPIRE, PERSIST and TTL", commands);
+
+    value = storage_value_create("v", 1);
+    storage_set_expiring(storage, "overwritten", 11, value, 1);
+    test_set_string(storage, "overwritten", "v");
+    test_sleep_ms(5);
+    bool set_clears = storage_exists(storage, "overwritten", 11);
+    test_result("Plain SET clears the TTL", set_clears);
+
+    // nothing reads these keys again: only the timing wheel can drop them
+    char key[32];
+    for (size_t i = 0; i < TEST_EXPIRING_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "expiring:%zu", i);
+        value = storage_value_create("v", 1);
+        storage_set_expiring(storage, key, strlen(key), value, 1 + i % 200);
+    }
+    test_sleep_ms(300);
+
+    size_t expired = 0;
+    for (size_t cycle = 0; cycle < 100 && storage_size(storage) > 1; cycle++)
+    {
+        expired += storage_expire_cycle(storage);
+    }
+    bool active = expired == TEST_EXPIRING_KEY_COUNT && storage_size(storage) == 1;
+    test_result("Timing wheel expires keys nobody reads", active);
+
+    storage_destroy(storage);
+    return ttl_set && lazy && commands && set_clears && active ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+static size_t test_slab_used(size_t size)
+{
+    slab_class_stats_t classes[SLAB_MAX_CLASSES];
+    size_t class_count = slab_stats(classes, SLAB_MAX_CLASSES);
+    for (size_t i = 0; i < class_count; i++)
+    {
+        if (classes[i].chunk_size == slab_chunk_size(size))
+        {
+            return classes[i].chunks_used;
+        }
+    }
+    return 0;
+}
+
+static size_t test_slab_pages(size_t size)
+{
+    slab_class_stats_t classes[SLAB_MAX_CLASSES];
+    size_t class_count = slab_stats(classes, SLAB_MAX_CLASSES);
+    for (size_t i = 0; i < class_count; i++)
+    {
+        if (classes[i].chunk_size == slab_chunk_size(size))
+        {
+            return classes[i].pages;
+        }
+    }
+    return 0;
+}
+
+static void *test_slab_worker(void *arg)
+{
+    void **chunks = arg;
+    for (size_t i = 0; i < TEST_SLAB_CHUNK_COUNT; i++)
+    {
+        chunks[i] = slab_alloc(TEST_SLAB_CHUNK_SIZE);
+    }
+    // half of them are freed here and end up in this thread's magazine
+    for (size_t i = 0; i < TEST_SLAB_CHUNK_COUNT / 2; i++)
+    {
+        slab_free(chunks[i], TEST_SLAB_CHUNK_SIZE);
+    }
+    return NULL;
+}
+
+int test_slab_allocator(void)
+{
+    test_header("Slab Allocator");
+
+    size_t before = test_slab_used(TEST_SLAB_CHUNK_SIZE);
+    void *chunks[TEST_SLAB_CHUNK_COUNT];
+    bool distinct = true;
+    for (size_t i = 0; i < TEST_SLAB_CHUNK_COUNT; i++)
+    {
+        chunks[i] = slab_alloc(TEST_SLAB_CHUNK_SIZE);
+        distinct = distinct && chunks[i] != NULL && (i == 0 || chunks[i] != chunks[i - 1]);
+        if (chunks[i] != NULL)
+        {
+            memset(chunks[i], (int)i, TEST_SLAB_CHUNK_SIZE);
+        }
+    }
+    bool counted = test_slab_used(TEST_SLAB_CHUNK_SIZE) == before + TEST_SLAB_CHUNK_COUNT;
+    for (size_t i = 0; i < TEST_SLAB_CHUNK_COUNT; i++)
+    {
+        slab_free(chunks[i], TEST_SLAB_CHUNK_SIZE);
+    }
+    counted = counted && test_slab_used(TEST_SLAB_CHUNK_SIZE) == before;
+    test_result("Chunks are distinct and counted as used until freed", distinct && counted);
+
+    // chunks cached by a thread that exits go back to the shared class
+    pthread_t thread;
+    bool joined = pthread_create(&thread, NULL, test_slab_worker, chunks) == 0 && pthread_join(thread, NULL) == 0;
+    bool handed_back = joined && test_slab_used(TEST_SLAB_CHUNK_SIZE) == before + TEST_SLAB_CHUNK_COUNT / 2;
+    for (size_t i = TEST_SLAB_CHUNK_COUNT / 2; joined && i < TEST_SLAB_CHUNK_COUNT; i++)
+    {
+        slab_free(chunks[i], TEST_SLAB_CHUNK_SIZE);
+    }
+    handed_back = handed_back && test_slab_used(TEST_SLAB_CHUNK_SIZE) == before;
+    test_result("Chunks freed on another thread are reused after it exits", handed_back);
+
+    return distinct && counted && handed_back ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_storage_memory_accounting(void)
+{
+    test_header("Memory Accounting");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    size_t empty = storage_memory_used(storage);
+    test_set_string(storage, "key", "value");
+    size_t one = storage_memory_used(storage);
+    bool counted = one - empty == slab_chunk_size(sizeof(storage_entry_t) + 3) +
+                                      slab_chunk_size(sizeof(storage_value_t) + 5);
+    test_set_string(storage, "key", "value");
+    counted = counted && storage_memory_used(storage) == one;
+    storage_delete(storage, "key", 3);
+    counted = counted && storage_memory_used(storage) == empty;
+    test_result("Entries are charged their slab chunks", counted);
+
+    char key[32];
+    for (size_t i = 0; i < TEST_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "key:%zu", i);
+        test_set_string(storage, key, "v");
+    }
+    bool grew = storage_memory_used(storage) > empty + TEST_KEY_COUNT * sizeof(storage_entry_t);
+    storage_flush(storage);
+    bool flushed = storage_memory_used(storage) == empty;
+    test_result("Table growth and FLUSH are accounted", grew && flushed);
+
+    storage_destroy(storage);
+    return counted && grew && flushed ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+static storage_set_status_t test_store_cold(storage_t *storage, size_t index)
+{
+    char key[32];
+    char cold[TEST_COLD_VALUE_LENGTH];
+    snprintf(key, sizeof(key), "cold:%zu", index);
+    memset(cold, 'c', sizeof(cold));
+
+    storage_value_t *value = storage_value_create(cold, sizeof(cold));
+    return value != NULL ? storage_set_expiring(storage, key, strlen(key), value, 0) : STORAGE_SET_NO_MEMORY;
+}
+
+static bool test_set_cold(storage_t *storage, size_t index)
+{
+    return test_store_cold(storage, index) == STORAGE_SET_OK;
+}
+
+int test_storage_lru_eviction(void)
+{
+    test_header("LRU Eviction");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    size_t limit = storage_memory_used(storage) + TEST_MEMORY_LIMIT_EXTRA;
+    storage_set_max_memory(storage, limit);
+
+    char key[32];
+    for (size_t i = 0; i < TEST_HOT_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "hot:%zu", i);
+        test_set_string(storage, key, "v");
+    }
+
+    // fill up to the limit without evicting
+    size_t filled = 0;
+    while (storage_memory_used(storage) + 2 * TEST_COLD_VALUE_LENGTH < limit && test_set_cold(storage, filled))
+    {
+        filled++;
+    }
+
+    // the expiry cycle advances the LRU clock: read the hot keys between two ticks
+    test_sleep_ms(2 * get_storage_lru_resolution_ms());
+    storage_expire_cycle(storage);
+    for (size_t i = 0; i < TEST_HOT_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "hot:%zu", i);
+        storage_value_release(storage_get(storage, key, strlen(key)));
+    }
+    test_sleep_ms(2 * get_storage_lru_resolution_ms());
+    storage_expire_cycle(storage);
+
+    bool within_limit = true;
+    for (size_t i = filled; i < filled + filled / 2; i++)
+    {
+        within_limit = within_limit && test_set_cold(storage, i) && storage_memory_used(storage) <= limit;
+    }
+    bool evicted = storage_size(storage) < TEST_HOT_KEY_COUNT + filled + filled / 2;
+    test_result("Writes succeed and stay within max_memory", within_limit && evicted);
+
+    size_t hot_kept = 0;
+    for (size_t i = 0; i < TEST_HOT_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "hot:%zu", i);
+        hot_kept += storage_exists(storage, key, strlen(key));
+    }
+    bool lru = hot_kept * 10 >= TEST_HOT_KEY_COUNT * 9;
+    test_result("Recently read keys survive eviction", lru);
+
+    storage_destroy(storage);
+    return within_limit && evicted && lru ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_storage_lfu_admission(void)
+{
+    test_header("LFU Eviction and TinyLFU Admission");
+
+    sketch_t *sketch = sketch_create(TEST_SKETCH_COUNTERS, TEST_SKETCH_AGING_INTERVAL);
+    bool counted = sketch != NULL;
+    for (size_t i = 0; counted && i < TEST_HOT_READS; i++)
+    {
+        sketch_increment(sketch, hash_bytes("hot", 3));
+    }
+    counted = counted && sketch_estimate(sketch, hash_bytes("hot", 3)) == TEST_HOT_READS &&
+              sketch_estimate(sketch, hash_bytes("cold", 4)) < TEST_HOT_READS / 2;
+
+    // other keys' accesses trigger a halving
+    for (uint64_t i = 0; counted && i < TEST_SKETCH_AGING_INTERVAL; i++)
+    {
+        sketch_increment(sketch, hash_bytes(&i, sizeof(i)));
+    }
+    bool aged = counted && sketch_estimate(sketch, hash_bytes("hot", 3)) <= TEST_HOT_READS / 2 + 1;
+    sketch_destroy(sketch);
+    test_result("Sketch counts accesses and ages them", counted && aged);
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL || !storage_set_eviction_policy(storage, STORAGE_EVICTION_LFU))
+    {
+        storage_destroy(storage);
+        return TEST_FAILURE;
+    }
+
+    size_t limit = storage_memory_used(storage) + TEST_MEMORY_LIMIT_EXTRA;
+    storage_set_max_memory(storage, limit);
+
+    char key[32];
+    for (size_t i = 0; i < TEST_HOT_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "hot:%zu", i);
+        test_set_string(storage, key, "v");
+        for (size_t read = 0; read < TEST_HOT_READS; read++)
+        {
+            storage_value_release(storage_get(storage, key, strlen(key)));
+        }
+    }
+
+    size_t filled = 0;
+    while (storage_memory_used(storage) + 2 * TEST_COLD_VALUE_LENGTH < limit && test_set_cold(storage, filled))
+    {
+        filled++;
+    }
+
+    // a cache-aside scan: every key is read once, missed and written once
+    bool within_limit = true;
+    size_t refused = 0;
+    size_t out_of_memory = 0;
+    for (size_t i = filled; i < 3 * filled; i++)
+    {
+        snprintf(key, sizeof(key), "cold:%zu", i);
+        storage_value_release(storage_get(storage, key, strlen(key)));
+        storage_set_status_t status = test_store_cold(storage, i);
+        refused += status == STORAGE_SET_NOT_ADMITTED;
+        out_of_memory += status == STORAGE_SET_NO_MEMORY;
+        within_limit = within_limit && storage_memory_used(storage) <= limit;
+    }
+    test_result("Scan stays within max_memory, once-seen keys are refused", within_limit && refused > 0);
+    test_result("Refusals are reported as not admitted, not as out of memory", out_of_memory == 0);
+
+    size_t hot_kept = 0;
+    for (size_t i = 0; i < TEST_HOT_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "hot:%zu", i);
+        hot_kept += storage_exists(storage, key, strlen(key));
+    }
+    bool lfu = hot_kept * 10 >= TEST_HOT_KEY_COUNT * 9;
+    test_result("Frequently read keys survive a scan", lfu);
+
+    storage_destroy(storage);
+    return counted && aged && within_limit && refused > 0 && out_of_memory == 0 && lfu ? TEST_SUCCESS
+                                                                                          : TEST_FAILURE;
+}
+
+// ==================== Main Test Runner ====================
+
+static void test_defrag_value(size_t index, char *data)
+{
+    for (size_t i = 0; i < TEST_DEFRAG_VALUE_LENGTH; i++)
+    {
+        data[i] = (char)(index + i);
+    }
+}
+
+int test_storage_defrag(void)
+{
+    test_header("Defragmentation");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    size_t value_size = sizeof(storage_value_t) + TEST_DEFRAG_VALUE_LENGTH;
+    char key[32];
+    char data[TEST_DEFRAG_VALUE_LENGTH];
+    for (size_t i = 0; i < TEST_DEFRAG_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "defrag:%zu", i);
+        test_defrag_value(i, data);
+        storage_set(storage, key, strlen(key), storage_value_create(data, sizeof(data)));
+    }
+    size_t filled = test_slab_pages(value_size);
+
+    // scattered deletes leave every page mostly empty but none free
+    for (size_t i = 0; i < TEST_DEFRAG_KEY_COUNT; i++)
+    {
+        if (i % TEST_DEFRAG_KEEP_EVERY != 0)
+        {
+            snprintf(key, sizeof(key), "defrag:%zu", i);
+            storage_delete(storage, key, strlen(key));
+        }
+    }
+    size_t sparse = test_slab_pages(value_size);
+
+    size_t moved = 0;
+    for (size_t i = 0; i < TEST_DEFRAG_CYCLES; i++)
+    {
+        moved += storage_defrag_cycle(storage, TEST_DEFRAG_BUDGET_US);
+    }
+    size_t compacted = test_slab_pages(value_size);
+    bool released = moved > 0 && sparse == filled && compacted * 2 < sparse;
+    test_result("Entries leave sparse pages and the pages are released", released);
+
+    bool intact = storage_size(storage) == TEST_DEFRAG_KEY_COUNT / TEST_DEFRAG_KEEP_EVERY;
+    for (size_t i = 0; intact && i < TEST_DEFRAG_KEY_COUNT; i += TEST_DEFRAG_KEEP_EVERY)
+    {
+        snprintf(key, sizeof(key), "defrag:%zu", i);
+        test_defrag_value(i, data);
+        storage_value_t *value = storage_get(storage, key, strlen(key));
+        intact = value != NULL && value->length == sizeof(data) && memcmp(value->data, data, sizeof(data)) == 0;
+        storage_value_release(value);
+    }
+    test_result("Moved entries keep their keys and values", intact);
+
+    storage_destroy(storage);
+    return released && intact ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_storage_lazy_free(void)
+{
+    test_header("Lazy Free");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+    storage_set_lazy_free(storage, true);
+
+    size_t value_size = sizeof(storage_value_t) + TEST_LAZY_FREE_VALUE_LENGTH;
+    size_t before = test_slab_used(value_size);
+    char key[32];
+    char data[TEST_LAZY_FREE_VALUE_LENGTH];
+    memset(data, 'l', sizeof(data));
+    for (size_t i = 0; i < TEST_LAZY_FREE_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "lazy:%zu", i);
+        storage_set(storage, key, strlen(key), storage_value_create(data, sizeof(data)));
+    }
+
+    // the grace period passes, but writers only hand the tables over
+    storage_flush(storage);
+    for (size_t i = 0; i < TEST_GRACE_CYCLES; i++)
+    {
+        storage_expire_cycle(storage);
+    }
+    bool deferred = storage_size(storage) == 0 &&
+                    test_slab_used(value_size) == before + TEST_LAZY_FREE_KEY_COUNT;
+    size_t tables = storage_lazy_free_cycle(storage, 0);
+    bool flushed = deferred && tables >= get_storage_shard_count() && test_slab_used(value_size) == before;
+    test_result("FLUSH leaves freeing the old tables to the lazy-free cycle", flushed);
+
+    char *big = calloc(1, TEST_LAZY_FREE_BIG_LENGTH);
+    storage_value_t *value = big != NULL ? storage_value_create(big, TEST_LAZY_FREE_BIG_LENGTH) : NULL;
+    free(big);
+    storage_set(storage, "big", 3, value);
+    test_set_string(storage, "small", "v");
+    storage_delete(storage, "big", 3);
+    storage_delete(storage, "small", 5);
+    for (size_t i = 0; i < TEST_GRACE_CYCLES; i++)
+    {
+        storage_expire_cycle(storage);
+    }
+    bool deleted = value != NULL && storage_lazy_free_cycle(storage, 0) == 1;
+    test_result("Only the large deleted value is freed lazily", deleted);
+
+    storage_destroy(storage);
+    return flushed && deleted ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+typedef struct test_scan
+{
+    bool *seen;
+    size_t reported;
+} test_scan_t;
+
+static void test_scan_key(const char *key, size_t key_length, void *arg)
+{
+    test_scan_t *scan = arg;
+    char copy[32];
+    size_t index;
+    scan->reported++;
+
+    if (key_length < sizeof(copy))
+    {
+        memcpy(copy, key, key_length);
+        copy[key_length] = '\0';
+        if (sscanf(copy, "scan:%zu", &index) == 1 && index < TEST_SCAN_KEY_COUNT)
+        {
+            scan->seen[index] = true;
+        }
+    }
+}
+
+int test_storage_scan(void)
+{
+    test_header("Scan");
+
+    storage_t *storage = storage_create(0);
+    bool *seen = calloc(TEST_SCAN_KEY_COUNT, sizeof(bool));
+    if (storage == NULL || seen == NULL)
+    {
+        storage_destroy(storage);
+        free(seen);
+        return TEST_FAILURE;
+    }
+
+    char key[32];
+    for (size_t i = 0; i < TEST_SCAN_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "scan:%zu", i);
+        test_set_string(storage, key, "v");
+    }
+
+    // the tables keep growing and rehashing while the walk is under way
+    test_scan_t scan = {.seen = seen};
+    uint64_t cursor = 0;
+    size_t calls = 0;
+    size_t added = 0;
+    do
+    {
+        cursor = storage_scan(storage, cursor, TEST_SCAN_COUNT, test_scan_key, &scan);
+        for (size_t i = 0; i < TEST_SCAN_GROWTH; i++, added++)
+        {
+            snprintf(key, sizeof(key), "grow:%zu", added);
+            test_set_string(storage, key, "v");
+        }
+        calls++;
+    } while (cursor != 0 && calls < TEST_KEY_COUNT);
+
+    bool complete = cursor == 0;
+    for (size_t i = 0; complete && i < TEST_SCAN_KEY_COUNT; i++)
+    {
+        complete = seen[i];
+    }
+    test_result("Every key present throughout is reported across resizes", complete);
+
+    // reporting a key twice is allowed, but not wholesale
+    bool bounded = scan.reported < (TEST_SCAN_KEY_COUNT + added) * 2;
+    test_result("Keys are not reported over and over", bounded);
+
+    free(seen);
+    storage_destroy(storage);
+    return complete && bounded ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_storage_get_many(void)
+{
+    test_header("Batched Lookups");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    // even keys exist, odd ones do not
+    char names[TEST_GET_MANY_COUNT][32];
+    const char *keys[TEST_GET_MANY_COUNT];
+    size_t key_lengths[TEST_GET_MANY_COUNT];
+    storage_value_t *values[TEST_GET_MANY_COUNT];
+    for (size_t i = 0; i < TEST_GET_MANY_COUNT; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "many:%zu", i);
+        keys[i] = names[i];
+        key_lengths[i] = strlen(names[i]);
+        if (i % 2 == 0)
+        {
+            test_set_string(storage, names[i], names[i]);
+        }
+    }
+
+    storage_get_many(storage, keys, key_lengths, TEST_GET_MANY_COUNT, values);
+    bool matches = true;
+    for (size_t i = 0; i < TEST_GET_MANY_COUNT; i++)
+    {
+        bool expected = i % 2 == 0 ? values[i] != NULL && values[i]->length == key_lengths[i] &&
+                                         memcmp(values[i]->data, keys[i], key_lengths[i]) == 0
+                                   : values[i] == NULL;
+        matches = matches && expected;
+        storage_value_release(values[i]);
+    }
+    test_result("Each key gets its own value or NULL, in order", matches);
+
+    storage_destroy(storage);
+    return matches ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+static void *test_incr_worker(void *arg)
+{
+    test_worker_t *worker = arg;
+    int64_t result;
+
+    worker->passed = true;
+    for (size_t i = 0; i < TEST_INCR_COUNT; i++)
+    {
+        worker->passed = worker->passed &&
+                         storage_incr(worker->storage, "counter", 7, i % 2 == 0 ? 3 : -1, &result) == STORAGE_INCR_OK;
+    }
+
+    return NULL;
+}
+
+int test_storage_incr(void)
+{
+    test_header("Integer Counters");
+
+    storage_t *storage = storage_create(0);
+    if (storage == NULL)
+    {
+        return TEST_FAILURE;
+    }
+
+    // the number lives in the entry, no value chunk is charged for it
+    size_t empty = storage_memory_used(storage);
+    int64_t result = 0;
+    bool created = test_set_string(storage, "n", "41") &&
+                   storage_memory_used(storage) - empty == slab_chunk_size(sizeof(storage_entry_t) + 1) &&
+                   storage_incr(storage, "n", 1, 1, &result) == STORAGE_INCR_OK && result == 42 &&
+                   test_value_equals(storage, "n", "42") &&
+                   storage_incr(storage, "fresh", 5, -5, &result) == STORAGE_INCR_OK && result == -5;
+    test_result("SET of a number and a missing key both give counters", created);
+
+    bool kept_ttl = storage_expire(storage, "n", 1, 60000) &&
+                    storage_incr(storage, "n", 1, 1, &result) == STORAGE_INCR_OK && result == 43 &&
+                    storage_ttl(storage, "n", 1) > 0;
+    test_result("An increment keeps the TTL", kept_ttl);
+
+    // only the canonical form is a number: "007" stays a string
+    bool rejected = test_set_string(storage, "text", "007") &&
+                    storage_incr(storage, "text", 4, 1, &result) == STORAGE_INCR_NOT_INTEGER &&
+                    test_value_equals(storage, "text", "007") &&
+                    test_set_string(storage, "max", "9223372036854775807") &&
+                    storage_incr(storage, "max", 3, 1, &result) == STORAGE_INCR_OVERFLOW &&
+                    test_value_equals(storage, "max", "9223372036854775807") &&
+                    test_set_string(storage, "min", "-9223372036854775808") &&
+                    storage_incr(storage, "min", 3, -1, &result) == STORAGE_INCR_OVERFLOW &&
+                    test_set_string(storage, "big", "9223372036854775808") &&
+                    storage_incr(storage, "big", 3, 1, &result) == STORAGE_INCR_NOT_INTEGER;
+    test_result("Non-numbers and overflow are refused and leave the value", rejected);
+
+    pthread_t threads[TEST_THREAD_COUNT];
+    test_worker_t workers[TEST_THREAD_COUNT];
+    for (size_t i = 0; i < TEST_THREAD_COUNT; i++)
+    {
+        workers[i] = (test_worker_t){.storage = storage, .id = i};
+        pthread_create(&threads[i], NULL, test_incr_worker, &workers[i]);
+    }
+
+    bool workers_passed = true;
+    for (size_t i = 0; i < TEST_THREAD_COUNT; i++)
+    {
+        pthread_join(threads[i], NULL);
+        workers_passed = workers_passed && workers[i].passed;
+    }
+
+    char expected[32];
+    snprintf(expected, sizeof(expected), "%zu", TEST_THREAD_COUNT * TEST_INCR_COUNT);
+    bool atomic = workers_passed && test_value_equals(storage, "counter", expected);
+    test_result("Concurrent increments are never lost", atomic);
+
+    storage_destroy(storage);
+    return created && kept_ttl && rejected && atomic ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+typedef struct test_dump
+{
+    storage_t *storage;
+    uint64_t now_ms;
+    unsigned char *seen; /**< Times each dump:N key was reported */
+    size_t reported;
+    bool integer_formatted;
+    bool expired_reported;
+} test_dump_t;
+
+static void test_dump_record(const storage_journal_record_t *record, void *arg)
+{
+    test_dump_t *dump = arg;
+    char copy[32];
+    size_t index;
+    dump->reported++;
+
+    if (record->key_length >= sizeof(copy))
+    {
+        return;
+    }
+    memcpy(copy, record->key, record->key_length);
+    copy[record->key_length] = '\0';
+
+    if (sscanf(copy, "dump:%zu", &index) == 1 && index < TEST_DUMP_KEY_COUNT)
+    {
+        dump->seen[index]++;
+    }
+    else if (strcmp(copy, "n") == 0)
+    {
+        dump->integer_formatted = record->value_length == 2 && memcmp(record->value, "42", 2) == 0;
+    }
+    else if (strcmp(copy, "gone") == 0)
+    {
+        dump->expired_reported = true;
+    }
+}
+
+// storage_dump() takes no lock, so it may run while the keyspace is frozen
+static void test_dump_frozen(void *arg)
+{
+    test_dump_t *dump = arg;
+    for (size_t i = 0; i < dump->storage->shard_count; i++)
+    {
+        storage_dump(dump->storage, i, dump->now_ms, test_dump_record, dump);
+    }
+}
+
+int test_storage_dump(void)
+{
+    test_header("Dump");
+
+    storage_t *storage = storage_create(0);
+    unsigned char *seen = calloc(TEST_DUMP_KEY_COUNT, 1);
+    if (storage == NULL || seen == NULL)
+    {
+        storage_destroy(storage);
+        free(seen);
+        return TEST_FAILURE;
+    }
+
+    char key[32];
+    for (size_t i = 0; i < TEST_DUMP_KEY_COUNT; i++)
+    {
+        snprintf(key, sizeof(key), "dump:%zu", i);
+        test_set_string(storage, key, "v");
+    }
+    test_set_string(storage, "n", "42");
+    storage_set_expiring(storage, "gone", 4, storage_value_create("v", 1), 1);
+    test_sleep_ms(5);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    test_dump_t dump = {
+        .storage = storage, .seen = seen, .now_ms = (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000};
+    storage_freeze(storage, test_dump_frozen, &dump);
+
+    bool once = dump.reported == TEST_DUMP_KEY_COUNT + 1;
+    for (size_t i = 0; once && i < TEST_DUMP_KEY_COUNT; i++)
+    {
+        once = seen[i] == 1;
+    }
+    test_result("Every live key is reported once", once);
+    test_result("Counters are reported in decimal", dump.integer_formatted);
+    test_result("Keys past their deadline are left out", !dump.expired_reported);
+
+    free(seen);
+    storage_destroy(storage);
+    return once && dump.integer_formatted && !dump.expired_reported ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+static size_t test_table_slots(storage_t *storage)
+{
+    size_t slots = 0;
+    for (size_t i = 0; i < storage->shard_count; i++)
+    {
+        slots += atomic_load_explicit(&storage->shards[i].table, memory_order_relaxed)->capacity;
+    }
+    return slots;
+}
+
+int test_storage_restore(void)
+{
+    test_header("Bulk Restore");
+
+    storage_t *storage = storage_create(0);
+    storage_journal_record_t *records = calloc(TEST_RESTORE_KEY_COUNT + 3, sizeof(storage_journal_record_t));
+    char (*keys)[32] = calloc(TEST_RESTORE_KEY_COUNT, sizeof(*keys));
+    if (storage == NULL || records == NULL || keys == NULL)
+    {
+        storage_destroy(storage);
+        free(records);
+        free(keys);
+        return TEST_FAILURE;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < TEST_RESTORE_KEY_COUNT; i++)
+    {
+        int length = snprintf(keys[i], sizeof(keys[i]), "restore:%zu", i);
+        records[count++] = (storage_journal_record_t){
+            .op = STORAGE_JOURNAL_SET, .key = keys[i], .key_length = (size_t)length, .value = "v", .value_length = 1};
+    }
+    records[count++] = (storage_journal_record_t){
+        .op = STORAGE_JOURNAL_SET, .key = "old", .key_length = 3, .value = "after", .value_length = 5};
+    records[count++] = (storage_journal_record_t){
+        .op = STORAGE_JOURNAL_SET, .key = "n", .key_length = 1, .value = "42", .value_length = 2,
+        .expires_at = (uint64_t)time(NULL) * 1000 + 60000};
+    records[count++] = (storage_journal_record_t){
+        .op = STORAGE_JOURNAL_SET, .key = "gone", .key_length = 4, .value = "v", .value_length = 1, .expires_at = 1};
+
+    // the tables are sized up front and do not grow while the batch goes in
+    size_t initial = test_table_slots(storage);
+    storage_reserve_keys(storage, TEST_RESTORE_KEY_COUNT);
+    size_t reserved = test_table_slots(storage);
+    test_set_string(storage, "old", "before");
+    bool handled = storage_restore(storage, records, count) == count;
+    int64_t result = 0;
+    bool restored = handled && storage_size(storage) == TEST_RESTORE_KEY_COUNT + 2 &&
+                    test_value_equals(storage, "restore:0", "v") && test_value_equals(storage, "old", "after") &&
+                    storage_incr(storage, "n", 1, 1, &result) == STORAGE_INCR_OK && result == 43 &&
+                    storage_ttl(storage, "n", 1) > 0 && !storage_exists(storage, "gone", 4);
+    test_result("Keys, overwrites, counters and deadlines are restored", restored);
+
+    bool presized = reserved > initial && test_table_slots(storage) == reserved;
+    test_result("Reserved tables take the batch without a rehash", presized);
+
+    free(records);
+    free(keys);
+    storage_destroy(storage);
+    return restored && presized ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+typedef struct test_dirty
+{
+    storage_t *storage;
+    storage_dirty_t *sets; /**< One per shard, taken while frozen */
+    size_t reported;
+    bool overwrite_reported; /**< "a" with its last value */
+    bool delete_reported;    /**< "b" as deleted */
+} test_dirty_t;
+
+static void test_dirty_take(void *arg)
+{
+    test_dirty_t *dirty = arg;
+    for (size_t i = 0; i < dirty->storage->shard_count; i++)
+    {
+        storage_take_dirty(dirty->storage, i, &dirty->sets[i]);
+    }
+}
+
+static void test_dirty_record(const storage_journal_record_t *record, void *arg)
+{
+    test_dirty_t *dirty = arg;
+    dirty->reported++;
+    if (record->key_length == 1 && record->key[0] == 'a')
+    {
+        dirty->overwrite_reported = record->op == STORAGE_JOURNAL_SET && record->value_length == 1 &&
+                                    record->value[0] == '3';
+    }
+    else if (record->key_length == 1 && record->key[0] == 'b')
+    {
+        dirty->delete_reported = record->op == STORAGE_JOURNAL_DELETE;
+    }
+}
+
+// takes the dirty sets and reports them; true when no set overflowed
+static bool test_dirty_collect(test_dirty_t *dirty)
+{
+    bool complete = true;
+    dirty->reported = 0;
+    storage_freeze(dirty->storage, test_dirty_take, dirty);
+    for (size_t i = 0; i < dirty->storage->shard_count; i++)
+    {
+        complete = complete && !dirty->sets[i].overflowed;
+        storage_dump_dirty(dirty->storage, &dirty->sets[i], (uint64_t)time(NULL) * 1000, test_dirty_record, dirty);
+        storage_dirty_release(&dirty->sets[i]);
+    }
+    return complete;
+}
+
+int test_storage_dirty_tracking(void)
+{
+    test_header("Dirty Tracking");
+
+    storage_t *storage = storage_create(0);
+    storage_dirty_t *sets = storage != NULL ? calloc(storage->shard_count, sizeof(storage_dirty_t)) : NULL;
+    if (sets == NULL)
+    {
+        storage_destroy(storage);
+        return TEST_FAILURE;
+    }
+    test_set_string(storage, "before", "v");
+    storage_set_dirty_tracking(storage, true);
+
+    int64_t result;
+    test_set_string(storage, "a", "1");
+    test_set_string(storage, "a", "2");
+    storage_incr(storage, "a", 1, 1, &result);
+    test_set_string(storage, "b", "v");
+    storage_delete(storage, "b", 1);
+    test_set_string(storage, "c", "v");
+
+    test_dirty_t dirty = {.storage = storage, .sets = sets};
+    bool complete = test_dirty_collect(&dirty);
+    bool changes = complete && dirty.reported == 3 && dirty.overwrite_reported && dirty.delete_reported;
+    test_result("Changed keys are reported once, deleted ones as deletes", changes);
+
+    test_set_string(storage, "d", "v");
+    bool taken = test_dirty_collect(&dirty) && dirty.reported == 1;
+    test_result("Taking the sets starts new ones", taken);
+
+    storage_flush(storage);
+    bool overflowed = !test_dirty_collect(&dirty) && dirty.reported == 0;
+    test_result("FLUSH overflows every set", overflowed);
+
+    test_set_string(storage, "c", "v");
+    storage_journal_record_t removal = {.op = STORAGE_JOURNAL_DELETE, .key = "c", .key_length = 1};
+    bool removed = storage_restore(storage, &removal, 1) == 1 && !storage_exists(storage, "c", 1);
+    test_result("Restored deletes remove the key", removed);
+
+    storage_set_dirty_tracking(storage, false);
+    free(sets);
+    storage_destroy(storage);
+    return changes && taken && overflowed && removed ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int main(void)
+{
+    printf("🚀 Starting Storage Test Suite\n");
+    printf("=========================================\n");
+
+    int (*tests[])(void) = {
+        test_storage_basic_operations,
+        test_storage_value_outlives_overwrite,
+        test_storage_binary_safe,
+        test_storage_incremental_rehash,
+        test_storage_concurrent_access,
+        test_storage_lock_free_reads,
+        test_storage_expiry,
+        test_slab_allocator,
+        test_storage_memory_accounting,
+        test_storage_lru_eviction,
+        test_storage_lfu_admission,
+        test_storage_defrag,
+        test_storage_lazy_free,
+        test_storage_scan,
+        test_storage_get_many,
+        test_storage_incr,
+        test_storage_dump,
+        test_storage_restore,
+        test_storage_dirty_tracking,
+    };
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    {
+        failures += tests[i]();
+    }
+
+    printf("\n🎉 Test Suite Complete!\n");
+    printf("=========================================\n");
+    printf("Total failures: %d\n", failures);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
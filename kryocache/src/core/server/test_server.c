@@ -5,10 +5,15 @@
 
 #include "/mnt/c/Users/dmako/kryosette/kryosette-db/kryocache/src/core/server/include/server.h"
 #include "/mnt/c/Users/dmako/kryosette/kryosette-db/kryocache/src/core/server/include/constants.h"
+#include "/mnt/c/Users/dmako/kryosette/kryosette-db/kryocache/src/core/server/persistence/include/constants.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 // ==================== Test Constants ====================
 
@@ -157,7 +162,12 @@ int test_server_config_default(void)
     bool persistence_disabled = (config.persistence_enabled == get_default_persistence_enabled());
     test_result("Persistence disabled by default", persistence_disabled);
 
-    return port_correct && max_clients_correct && persistence_disabled ? TEST_SUCCESS : TEST_FAILURE;
+    bool zerocopy_threshold_correct = (config.zerocopy_threshold == get_default_zerocopy_threshold());
+    test_result("Default zerocopy threshold correct", zerocopy_threshold_correct);
+
+    return port_correct && max_clients_correct && persistence_disabled && zerocopy_threshold_correct
+               ? TEST_SUCCESS
+               : TEST_FAILURE;
 }
 
 int test_server_config_validation(void)
@@ -167,9 +177,13 @@ int test_server_config_validation(void)
     server_config_t valid_config = server_config_default();
     server_config_t invalid_port_config = server_config_default();
     server_config_t invalid_clients_config = server_config_default();
+    server_config_t invalid_reactors_config = server_config_default();
+    server_config_t invalid_backend_config = server_config_default();
 
     invalid_port_config.port = get_invalid_port_number();
     invalid_clients_config.max_clients = get_invalid_client_count();
+    invalid_reactors_config.reactor_threads = get_max_reactor_threads() + 1;
+    invalid_backend_config.io_backend = (server_io_backend_t)(SERVER_IO_BACKEND_IO_URING + 1);
 
     printf("DEBUG: invalid_port=%d, max_port=%d\n",
            get_invalid_port_number(), get_maximum_port_number());
@@ -187,7 +201,16 @@ int test_server_config_validation(void)
     bool invalid_clients_fails = !server_config_validate(&invalid_clients_config, error_buffer, sizeof(error_buffer));
     test_result("Invalid client count fails validation", invalid_clients_fails);
 
-    return valid_config_passes && invalid_port_fails && invalid_clients_fails ? TEST_SUCCESS : TEST_FAILURE;
+    bool invalid_reactors_fails = !server_config_validate(&invalid_reactors_config, error_buffer, sizeof(error_buffer));
+    test_result("Invalid reactor count fails validation", invalid_reactors_fails);
+
+    bool invalid_backend_fails = !server_config_validate(&invalid_backend_config, error_buffer, sizeof(error_buffer));
+    test_result("Unknown I/O backend fails validation", invalid_backend_fails);
+
+    return valid_config_passes && invalid_port_fails && invalid_clients_fails && invalid_reactors_fails &&
+                   invalid_backend_fails
+               ? TEST_SUCCESS
+               : TEST_FAILURE;
 }
 
 // ==================== Server Information Tests ====================
@@ -249,6 +272,13 @@ int test_server_stats_collection(void)
 
             bool initial_clients_zero = (stats.connected_clients == get_initial_client_count());
             test_result("Initial client count is zero", initial_clients_zero);
+
+            bool reactor_counters_zero = (stats.connections_total == (uint64_t)get_initial_connection_count() &&
+                                          stats.commands_processed == (uint64_t)get_initial_command_count());
+            test_result("Reactor counters aggregate to zero", reactor_counters_zero);
+
+            bool reactors_allocated = (server->reactor_count > 0 && server->reactors != NULL);
+            test_result("Reactors allocated", reactors_allocated);
         }
 
         // free 5 - освобождаем тестовый сервер
@@ -291,6 +321,366 @@ int test_server_data_operations(void)
     return TEST_FAILURE;
 }
 
+int test_server_persistence_round_trip(void)
+{
+    test_header("Server Persistence Round Trip");
+
+    server_config_t config = server_config_default();
+    config.data_directory = get_test_data_directory();
+    config.persistence_enabled = true;
+    config.aof_fsync_policy = AOF_FSYNC_ALWAYS;
+
+    server_instance_t *server = server_init(&config);
+    bool server_created = (server != NULL);
+    test_result("Server with persistence created", server_created);
+
+    if (!server_created)
+    {
+        return TEST_FAILURE;
+    }
+
+    int64_t counter = 0;
+    bool written = server_flush_data(server) &&
+                   storage_set(server->storage, "persisted", 9, storage_value_create("value", 5)) &&
+                   storage_set(server->storage, "dropped", 7, storage_value_create("value", 5)) &&
+                   storage_delete(server->storage, "dropped", 7) &&
+                   storage_incr(server->storage, "counter", 7, 5, &counter) == STORAGE_INCR_OK &&
+                   server_save_data(server);
+    test_result("Changes written to the log", written);
+
+    server_stats_t stats;
+    bool snapshot_taken = server_get_stats(server, &stats) && stats.snapshots_saved == 1 &&
+                          !stats.snapshot_in_progress;
+    test_result("Snapshot written by a forked child", snapshot_taken);
+    server_destroy(server);
+
+    server = server_init(&config);
+    bool reloaded = (server != NULL);
+    test_result("Server reopened on the same directory", reloaded);
+
+    if (reloaded)
+    {
+        storage_value_t *value = storage_get(server->storage, "persisted", 9);
+        reloaded = (value != NULL && value->length == 5 && memcmp(value->data, "value", 5) == 0);
+        storage_value_release(value);
+
+        storage_value_t *missing = storage_get(server->storage, "dropped", 7);
+        reloaded = reloaded && missing == NULL;
+        storage_value_release(missing);
+
+        reloaded = reloaded && storage_incr(server->storage, "counter", 7, 0, &counter) == STORAGE_INCR_OK &&
+                   counter == 5;
+
+        server_flush_data(server);
+        server_destroy(server);
+    }
+    test_result("Keys restored from the log", reloaded);
+
+    return written && snapshot_taken && reloaded ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_server_persistence_checkpoint(void)
+{
+    test_header("Server Persistence Checkpoint");
+
+    server_config_t config = server_config_default();
+    config.data_directory = get_test_data_directory();
+    config.persistence_enabled = true;
+    config.aof_fsync_policy = AOF_FSYNC_ALWAYS;
+
+    server_instance_t *server = server_init(&config);
+    bool server_created = (server != NULL);
+    test_result("Server with persistence created", server_created);
+
+    if (!server_created)
+    {
+        return TEST_FAILURE;
+    }
+
+    // untouched by the checkpoint below, so two changed keys stay a delta
+    bool written = server_flush_data(server);
+    for (int i = 0; written && i < 8; i++)
+    {
+        char key[16];
+        int length = snprintf(key, sizeof(key), "unchanged%d", i);
+        written = storage_set(server->storage, key, (size_t)length, storage_value_create("value", 5));
+    }
+    written = written && storage_set(server->storage, "persisted", 9, storage_value_create("value", 5)) &&
+              server_save_data(server);
+    test_result("Base snapshot written", written);
+
+    server_stats_t stats;
+    bool idle = written && snapshot_checkpoint(server->snapshot) && server_get_stats(server, &stats) &&
+                !stats.snapshot_in_progress && stats.snapshot_deltas == 0 && stats.snapshots_saved == 1;
+    test_result("Checkpoint without changes writes nothing", idle);
+
+    // only in the delta: the log is replayed from where the delta was taken
+    bool checkpointed = storage_set(server->storage, "checkpointed", 12, storage_value_create("value", 5)) &&
+                        storage_delete(server->storage, "persisted", 9) &&
+                        snapshot_checkpoint(server->snapshot);
+    while (checkpointed && server_get_stats(server, &stats) && stats.snapshot_in_progress)
+    {
+        usleep(get_test_poll_interval_us());
+    }
+    checkpointed = checkpointed && stats.snapshot_deltas == 1 && stats.snapshots_saved == 1;
+    test_result("Checkpoint wrote only the changed keys as a delta", checkpointed);
+    server_destroy(server);
+
+    server = server_init(&config);
+    bool reloaded = (server != NULL);
+    test_result("Server reopened on the same directory", reloaded);
+
+    if (reloaded)
+    {
+        storage_value_t *value = storage_get(server->storage, "checkpointed", 12);
+        reloaded = (value != NULL && value->length == 5 && memcmp(value->data, "value", 5) == 0);
+        storage_value_release(value);
+
+        reloaded = reloaded && !storage_exists(server->storage, "persisted", 9) &&
+                   storage_exists(server->storage, "unchanged0", 10);
+
+        server_flush_data(server);
+        server_destroy(server);
+    }
+    test_result("Base and delta applied on reload", reloaded);
+
+    return written && idle && checkpointed && reloaded ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+// the log segment the server appends to
+static bool test_log_path(const server_instance_t *server, char *path, size_t size)
+{
+    int length = server->aof->segment == 0
+                     ? snprintf(path, size, "%s", server->aof->path)
+                     : snprintf(path, size, "%s.%llu", server->aof->path, (unsigned long long)server->aof->segment);
+    return length > 0 && (size_t)length < size;
+}
+
+static long long test_file_size(const char *path)
+{
+    struct stat status;
+    return stat(path, &status) == 0 ? (long long)status.st_size : -1;
+}
+
+static bool test_file_append(const char *path, const void *data, size_t length)
+{
+    FILE *file = fopen(path, "ab");
+    bool appended = file != NULL && fwrite(data, 1, length, file) == length;
+    return file != NULL && fclose(file) == 0 && appended;
+}
+
+static bool test_file_write(const char *path, const void *data, size_t length)
+{
+    FILE *file = fopen(path, "wb");
+    bool written = file != NULL && fwrite(data, 1, length, file) == length;
+    return file != NULL && fclose(file) == 0 && written;
+}
+
+static unsigned char *test_file_read(const char *path, size_t *length)
+{
+    long long size = test_file_size(path);
+    FILE *file = size > 0 ? fopen(path, "rb") : NULL;
+    unsigned char *data = file != NULL ? malloc((size_t)size) : NULL;
+    bool read = data != NULL && fread(data, 1, (size_t)size, file) == (size_t)size;
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    if (!read)
+    {
+        free(data);
+        return NULL;
+    }
+
+    *length = (size_t)size;
+    return data;
+}
+
+// each breaks one of the checks made before anything is applied
+typedef enum
+{
+    TEST_DAMAGE_VERSION,
+    TEST_DAMAGE_SIGNATURE,
+    TEST_DAMAGE_INDEX_BOUNDS,
+    TEST_DAMAGE_SECTION_PAST_INDEX,
+    TEST_DAMAGE_RECORD_COUNT,
+    TEST_DAMAGE_TRUNCATED,
+    TEST_DAMAGE_COUNT
+} test_snapshot_damage_t;
+
+static const char *TEST_DAMAGE_NAMES[TEST_DAMAGE_COUNT] = {
+    "Other format version refused",
+    "Wrong signature refused",
+    "Index out of bounds refused",
+    "Section past the index refused",
+    "More records than a section can hold refused",
+    "Truncated file refused",
+};
+
+static bool test_snapshot_write_damaged(const char *path, const unsigned char *pristine, size_t size,
+                                        test_snapshot_damage_t damage)
+{
+    unsigned char *copy = malloc(size);
+    if (copy == NULL)
+    {
+        return false;
+    }
+    memcpy(copy, pristine, size);
+
+    snapshot_header_t header;
+    snapshot_section_t section;
+    memcpy(&header, copy, sizeof(header));
+    size_t index_offset = (size_t)header.index_offset;
+    memcpy(&section, copy + index_offset, sizeof(section));
+
+    switch (damage)
+    {
+    case TEST_DAMAGE_VERSION:
+        header.version++;
+        break;
+    case TEST_DAMAGE_SIGNATURE:
+        header.signature[0] ^= 0x20;
+        break;
+    case TEST_DAMAGE_INDEX_BOUNDS:
+        header.index_offset = size + sizeof(uint64_t);
+        break;
+    case TEST_DAMAGE_SECTION_PAST_INDEX:
+        section.offset = index_offset + 1;
+        break;
+    case TEST_DAMAGE_RECORD_COUNT:
+        section.records = section.length / 3 + 1;
+        break;
+    default:
+        size = index_offset;
+        break;
+    }
+
+    memcpy(copy, &header, sizeof(header));
+    if (index_offset + sizeof(section) <= size)
+    {
+        memcpy(copy + index_offset, &section, sizeof(section));
+    }
+    bool written = test_file_write(path, copy, size);
+    free(copy);
+    return written;
+}
+
+int test_server_snapshot_validation(void)
+{
+    test_header("Server Snapshot Validation");
+
+    server_config_t config = server_config_default();
+    config.data_directory = get_test_data_directory();
+    config.persistence_enabled = true;
+    config.aof_fsync_policy = AOF_FSYNC_ALWAYS;
+
+    // only in the snapshot, deleted since; "live" only in the storage
+    char path[256];
+    int length = snprintf(path, sizeof(path), "%s/%s", get_test_data_directory(), get_snapshot_file_name());
+    server_instance_t *server = server_init(&config);
+    bool saved = server != NULL && length > 0 && (size_t)length < sizeof(path) && server_flush_data(server) &&
+                 storage_set(server->storage, "snapshotted", 11, storage_value_create("value", 5)) &&
+                 server_save_data(server) && storage_delete(server->storage, "snapshotted", 11) &&
+                 storage_set(server->storage, "live", 4, storage_value_create("value", 5));
+    size_t size = 0;
+    unsigned char *pristine = saved ? test_file_read(path, &size) : NULL;
+    saved = pristine != NULL && size > sizeof(snapshot_header_t);
+    test_result("Snapshot saved", saved);
+
+    bool rejected = saved;
+    for (int damage = 0; saved && damage < TEST_DAMAGE_COUNT; damage++)
+    {
+        bool refused = test_snapshot_write_damaged(path, pristine, size, (test_snapshot_damage_t)damage) &&
+                       !server_load_data(server) && !storage_exists(server->storage, "snapshotted", 11) &&
+                       storage_exists(server->storage, "live", 4) && storage_size(server->storage) == 1;
+        test_result(TEST_DAMAGE_NAMES[damage], refused);
+        rejected = rejected && refused;
+    }
+
+    bool restored = saved && test_file_write(path, pristine, size) && server_load_data(server);
+    test_result("Intact snapshot loads again", restored);
+    free(pristine);
+
+    server_flush_data(server);
+    server_destroy(server);
+
+    return saved && rejected && restored ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_server_log_torn_tail(void)
+{
+    test_header("Server Log Torn Tail");
+
+    server_config_t config = server_config_default();
+    config.data_directory = get_test_data_directory();
+    config.persistence_enabled = true;
+    config.aof_fsync_policy = AOF_FSYNC_ALWAYS;
+
+    char path[256];
+    server_instance_t *server = server_init(&config);
+    bool written = server != NULL && test_log_path(server, path, sizeof(path)) &&
+                   server_flush_data(server) &&
+                   storage_set(server->storage, "whole", 5, storage_value_create("value", 5));
+    server_destroy(server);
+    long long size = written ? test_file_size(path) : -1;
+    test_result("Log written", written && size > 0);
+
+    // a SET header announcing an 8-byte key, followed by only 3 of them
+    unsigned char torn[20] = {STORAGE_JOURNAL_SET};
+    uint32_t key_length = 8;
+    memcpy(torn + 1, &key_length, sizeof(key_length));
+    server = written && test_file_append(path, torn, sizeof(torn)) ? server_init(&config) : NULL;
+    bool truncated = server != NULL && storage_exists(server->storage, "whole", 5) &&
+                     test_file_size(path) == size;
+    server_destroy(server);
+    test_result("Torn last record cut off on reload", truncated);
+
+    // a whole record with an unknown op is not cut off but refuses the load
+    unsigned char unknown[17] = {0xff};
+    server = truncated && test_file_append(path, unknown, sizeof(unknown)) ? server_init(&config) : NULL;
+    bool refused = truncated && server == NULL && test_file_size(path) == size + (long long)sizeof(unknown);
+    server_destroy(server);
+    test_result("Unknown record refused and left in place", refused);
+
+    server = written && truncate(path, (off_t)size) == 0 ? server_init(&config) : NULL;
+    bool cleaned = server != NULL && server_flush_data(server);
+    server_destroy(server);
+
+    return written && truncated && refused && cleaned ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_server_log_segments(void)
+{
+    test_header("Server Log Segments");
+
+    server_config_t config = server_config_default();
+    config.data_directory = get_test_data_directory();
+    config.persistence_enabled = true;
+    config.aof_fsync_policy = AOF_FSYNC_ALWAYS;
+
+    char covered[256];
+    char path[256];
+    server_instance_t *server = server_init(&config);
+    bool rotated = server != NULL && test_log_path(server, covered, sizeof(covered)) &&
+                   server_flush_data(server) &&
+                   storage_set(server->storage, "before", 6, storage_value_create("value", 5)) &&
+                   server_save_data(server) &&
+                   storage_set(server->storage, "after", 5, storage_value_create("value", 5));
+    rotated = rotated && test_log_path(server, path, sizeof(path)) && strcmp(path, covered) != 0 &&
+              test_file_size(covered) < 0 && test_file_size(path) > 0;
+    server_destroy(server);
+    test_result("Base snapshot started a new segment and removed the old one", rotated);
+
+    server = rotated ? server_init(&config) : NULL;
+    bool reloaded = server != NULL && storage_exists(server->storage, "before", 6) &&
+                    storage_exists(server->storage, "after", 5);
+    reloaded = reloaded && server_flush_data(server);
+    server_destroy(server);
+    test_result("Keys restored from the snapshot and the new segment", reloaded);
+
+    return rotated && reloaded ? TEST_SUCCESS : TEST_FAILURE;
+}
+
 int test_server_version_info(void)
 {
     test_header("Server Version Information");
@@ -306,6 +696,246 @@ int test_server_version_info(void)
     return version_valid && build_info_valid ? TEST_SUCCESS : TEST_FAILURE;
 }
 
+// ==================== Command Tests ====================
+
+// one command line and the exact reply it must queue
+typedef struct test_command_case
+{
+    const char *command;
+    const char *reply;
+} test_command_case_t;
+
+// compare the queued replies, inline bytes and referenced values alike, then drop them
+static bool test_output_equals(connection_state_t *conn, const char *expected)
+{
+    output_queue_t *output = &conn->output;
+    size_t position = 0;
+    bool equal = output->pending == strlen(expected);
+    for (size_t i = output->head; equal && i < output->count; i++)
+    {
+        const output_segment_t *segment = &output->segments[i];
+        const char *bytes = segment->value != NULL ? segment->value->data : output->bytes.data;
+        equal = memcmp(bytes + segment->offset, expected + position, segment->length) == 0;
+        position += segment->length;
+    }
+
+    output_queue_consume(output, output->pending);
+    return equal;
+}
+
+/*
+Each line goes through the parser of a connection without a socket, the
+way an asynchronous backend feeds it.
+*/
+static bool test_command_replies(connection_state_t *conn, const test_command_case_t *cases, size_t count)
+{
+    bool passed = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        char line[512];
+        int length = snprintf(line, sizeof(line), "%s\r\n", cases[i].command);
+        bool replied = length > 0 && (size_t)length < sizeof(line) &&
+                       connection_feed_input(conn, line, (size_t)length) &&
+                       test_output_equals(conn, cases[i].reply);
+        test_result(cases[i].command, replied);
+        passed = passed && replied;
+    }
+    return passed;
+}
+
+// on a server without persistence
+static int test_commands(const char *name, const test_command_case_t *cases, size_t count)
+{
+    test_header(name);
+
+    server_config_t config = server_config_default();
+    config.persistence_enabled = false;
+    server_instance_t *server = server_init(&config);
+    bool passed = (server != NULL);
+    test_result("Server created for command tests", passed);
+
+    if (!passed)
+    {
+        return TEST_FAILURE;
+    }
+
+    command_context_t context = {.storage = server->storage};
+    connection_state_t conn = {.context = &context};
+    passed = test_command_replies(&conn, cases, count) && passed;
+
+    connection_state_release(&conn);
+    command_context_release(&context);
+    server_destroy(server);
+
+    return passed ? TEST_SUCCESS : TEST_FAILURE;
+}
+
+int test_command_expiry(void)
+{
+    // EX is only an option as the last two words; TTL rounds to whole seconds
+    static const test_command_case_t cases[] = {
+        {"SET session value EX 100", "OK\r\n"},
+        {"TTL session", "100\r\n"},
+        {"GET session", "VALUE value\r\n"},
+        {"SET zero value EX 0", "ERROR Invalid expire time\r\n"},
+        {"SET huge value EX 99999999999999999999", "ERROR Invalid expire time\r\n"},
+        {"SET huge value EX 18446744073709552", "ERROR Invalid expire time\r\n"},
+        {"EXISTS zero", "0\r\n"},
+        {"EXISTS huge", "0\r\n"},
+        {"SET middle a EX 5 b", "OK\r\n"},
+        {"GET middle", "VALUE a EX 5 b\r\n"},
+        {"TTL middle", "-1\r\n"},
+        {"SET bare value EX", "OK\r\n"},
+        {"GET bare", "VALUE value EX\r\n"},
+        {"SET signed value EX -5", "OK\r\n"},
+        {"GET signed", "VALUE value EX -5\r\n"},
+        {"EXPIRE middle 50", "1\r\n"},
+        {"TTL middle", "50\r\n"},
+        {"PERSIST middle", "1\r\n"},
+        {"TTL middle", "-1\r\n"},
+        {"PERSIST middle", "0\r\n"},
+        {"EXPIRE middle -5", "ERROR Invalid EXPIRE format\r\n"},
+        {"EXPIRE middle 99999999999999999999", "ERROR Invalid EXPIRE format\r\n"},
+        {"EXPIRE middle", "ERROR Invalid EXPIRE format\r\n"},
+        {"EXPIRE 50", "ERROR Invalid EXPIRE format\r\n"},
+        {"EXPIRE missing 10", "0\r\n"},
+        {"TTL missing", "-2\r\n"},
+        {"PERSIST missing", "0\r\n"},
+        {"EXPIRE session 0", "1\r\n"},
+        {"GET session", "NOT_FOUND\r\n"},
+    };
+    return test_commands("Command Expiry Parsing", cases, sizeof(cases) / sizeof(cases[0]));
+}
+
+int test_command_scan(void)
+{
+    // each pattern picks out one key; COUNT covers the whole keyspace in one call
+    static const test_command_case_t cases[] = {
+        {"MSET user:1 a user:2 b user:10 c admin d a*b e [x] f [x g hello h hallo i hxllo j h]llo k", "OK\r\n"},
+        {"SCAN 0 MATCH user:1 COUNT 100000", "KEY user:1\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH user:1? COUNT 100000", "KEY user:10\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH *:2 COUNT 100000", "KEY user:2\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH adm* COUNT 100000", "KEY admin\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH a\\*b COUNT 100000", "KEY a*b\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH \\[x] COUNT 100000", "KEY [x]\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH [x COUNT 100000", "KEY [x\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH h[e]llo COUNT 100000", "KEY hello\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH h[a-b]llo COUNT 100000", "KEY hallo\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH h[b-a]llo COUNT 100000", "KEY hallo\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH h[^ae\\]]llo COUNT 100000", "KEY hxllo\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH h[\\]]llo COUNT 100000", "KEY h]llo\r\nCURSOR 0\r\n"},
+        {"SCAN 0 MATCH missing* COUNT 100000", "CURSOR 0\r\n"},
+        {"SCAN 0 COUNT 99999999 MATCH adm*", "KEY admin\r\nCURSOR 0\r\n"},
+        {"SCAN abc", "ERROR Invalid cursor\r\n"},
+        {"SCAN -1", "ERROR Invalid cursor\r\n"},
+        {"SCAN 99999999999999999999", "ERROR Invalid cursor\r\n"},
+        {"SCAN 0 COUNT 0", "ERROR Invalid SCAN format\r\n"},
+        {"SCAN 0 COUNT ten", "ERROR Invalid SCAN format\r\n"},
+        {"SCAN 0 MATCH", "ERROR Invalid SCAN format\r\n"},
+        {"SCAN 0 MATCH ", "ERROR Invalid SCAN format\r\n"},
+        {"SCAN 0 LIMIT 5", "ERROR Invalid SCAN format\r\n"},
+    };
+    return test_commands("Command SCAN and MATCH Patterns", cases, sizeof(cases) / sizeof(cases[0]));
+}
+
+int test_command_incr(void)
+{
+    // the delta is the last word, the key everything before it
+    static const test_command_case_t cases[] = {
+        {"INCR counter", "1\r\n"},
+        {"INCRBY counter 41", "42\r\n"},
+        {"DECRBY counter 2", "40\r\n"},
+        {"DECR counter", "39\r\n"},
+        {"INCRBY counter -39", "0\r\n"},
+        {"DECRBY counter -5", "5\r\n"},
+        {"INCRBY counter 0", "5\r\n"},
+        {"INCRBY two words 3", "3\r\n"},
+        {"GET two words", "VALUE 3\r\n"},
+        {"DECRBY counter -9223372036854775808", "ERROR Invalid DECRBY format\r\n"},
+        {"INCRBY counter 9223372036854775808", "ERROR Invalid INCRBY format\r\n"},
+        {"INCRBY counter -", "ERROR Invalid INCRBY format\r\n"},
+        {"INCRBY counter +5", "ERROR Invalid INCRBY format\r\n"},
+        {"INCRBY counter --5", "ERROR Invalid INCRBY format\r\n"},
+        {"INCRBY counter 5x", "ERROR Invalid INCRBY format\r\n"},
+        {"DECRBY counter", "ERROR Invalid DECRBY format\r\n"},
+        {"INCRBY 5", "ERROR Invalid INCRBY format\r\n"},
+        {"GET counter", "VALUE 5\r\n"},
+        {"INCRBY low -9223372036854775808", "-9223372036854775808\r\n"},
+        {"DECR low", "ERROR Increment would overflow\r\n"},
+        {"DECRBY high -9223372036854775807", "9223372036854775807\r\n"},
+        {"INCR high", "ERROR Increment would overflow\r\n"},
+        {"SET text hello", "OK\r\n"},
+        {"INCR text", "ERROR Value is not an integer\r\n"},
+        {"DECRBY text 1", "ERROR Value is not an integer\r\n"},
+    };
+    return test_commands("Command INCRBY and DECRBY Arguments", cases, sizeof(cases) / sizeof(cases[0]));
+}
+
+/*
+The log descriptor is swapped for a read-only one, so every write to it
+fails until the real one is put back.
+*/
+int test_command_log_failure(void)
+{
+    test_header("Command Replies While the Log Fails");
+
+    server_config_t config = server_config_default();
+    config.data_directory = get_test_data_directory();
+    config.persistence_enabled = true;
+    config.aof_fsync_policy = AOF_FSYNC_ALWAYS;
+
+    char path[256];
+    server_instance_t *server = server_init(&config);
+    int fd = server != NULL && test_log_path(server, path, sizeof(path)) && server_flush_data(server)
+                 ? open(path, O_RDONLY)
+                 : -1;
+    test_result("Server with persistence created", fd >= 0);
+
+    if (fd < 0)
+    {
+        server_destroy(server);
+        return TEST_FAILURE;
+    }
+
+    static const test_command_case_t failing[] = {
+        {"SET kept value", "ERROR Persistence failed\r\n"},
+        {"SET refused value", "ERROR Persistence failed\r\n"},
+        {"GET kept", "VALUE value\r\n"},
+    };
+    static const test_command_case_t recovered[] = {
+        {"SET after value", "OK\r\n"},
+    };
+
+    command_context_t context = {.storage = server->storage, .aof = server->aof};
+    connection_state_t conn = {.context = &context};
+    pthread_mutex_lock(&server->aof->io_lock);
+    int log_fd = server->aof->fd;
+    server->aof->fd = fd;
+    pthread_mutex_unlock(&server->aof->io_lock);
+    bool refused = test_command_replies(&conn, failing, sizeof(failing) / sizeof(failing[0]));
+
+    pthread_mutex_lock(&server->aof->io_lock);
+    server->aof->fd = log_fd;
+    pthread_mutex_unlock(&server->aof->io_lock);
+    close(fd);
+    bool retried = aof_sync(server->aof);
+    test_result("Kept records written once the log recovers", retried);
+    retried = test_command_replies(&conn, recovered, sizeof(recovered) / sizeof(recovered[0])) && retried;
+
+    connection_state_release(&conn);
+    command_context_release(&context);
+    server_destroy(server);
+
+    server = server_init(&config);
+    bool reloaded = server != NULL && storage_exists(server->storage, "kept", 4) &&
+                    storage_exists(server->storage, "after", 5) && !storage_exists(server->storage, "refused", 7);
+    reloaded = reloaded && server_flush_data(server);
+    server_destroy(server);
+    test_result("Unacknowledged write kept, refused one absent after reload", reloaded);
+
+    return refused && retried && reloaded ? TEST_SUCCESS : TEST_FAILURE;
+}
+
 // ==================== Memory Safety Tests ====================
 
 int test_server_destroy_safety(void)
@@ -370,10 +1000,23 @@ int main(void)
     // Test Group 4: Advanced Features
     int (*advanced_tests[])(void) = {
         test_server_data_operations,
+        test_server_persistence_round_trip,
+        test_server_persistence_checkpoint,
+        test_server_log_torn_tail,
+        test_server_log_segments,
+        test_server_snapshot_validation,
         test_server_version_info};
     total_failures += run_test_group("Advanced Features Tests", advanced_tests, get_advanced_test_count());
 
-    // Test Group 5: Memory Safety
+    // Test Group 5: Commands
+    int (*command_tests[])(void) = {
+        test_command_expiry,
+        test_command_scan,
+        test_command_incr,
+        test_command_log_failure};
+    total_failures += run_test_group("Command Tests", command_tests, get_command_test_count());
+
+    // Test Group 6: Memory Safety
     int (*safety_tests[])(void) = {
         test_server_destroy_safety};
     total_failures += run_test_group("Memory Safety Tests", safety_tests, 1);